@@ -114,7 +114,11 @@ typedef enum
 	ESTATUS_KB_KEYBOARD_NOT_FOUND,
 	ESTATUS_KB_MOUSE_NOT_FOUND,
 	ESTATUS_KB_CONTROLLER_RESET_FAULT,
-	ESTATUS_KB_IDENT_FAULT
+	ESTATUS_KB_IDENT_FAULT,
+
+	// Network related
+	ESTATUS_NIC_NOT_PRESENT,
+	ESTATUS_NIC_SOCKET_OUT_OF_RANGE
 } EStatus;
 
 // Serial port related
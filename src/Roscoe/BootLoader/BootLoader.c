@@ -12,6 +12,56 @@
 #include "Shared/Interrupt.h"
 #include "Shared/IDE.h"
 #include "Shared/Stream.h"
+#include "Shared/ZImage.h"
+
+// If there's a compressed operational image at the start of BIOS flash,
+// inflate it into SRAM and run it. Returns if there isn't one or it's bad.
+static void BootLoaderOpImageBoot(void)
+{
+	EVersionCode eVersionCode;
+	SImageVersion *psVersion = NULL;
+	uint32_t u32ImageSize = 0;
+
+	POST_SET(POSTCODE_BOOTLOADER_OP_IMAGE_SEARCH);
+	if (false == ZImageIsPresent((const uint8_t *) ROSCOE_FLASH_BIOS_BASE))
+	{
+		return;
+	}
+
+	// Inflate straight out of flash. The CRCs are checked on the way.
+	POST_SET(POSTCODE_BOOTLOADER_COPY_OP_IMAGE);
+	eVersionCode = ZImageInflate((const uint8_t *) ROSCOE_FLASH_BIOS_BASE,
+								 ROSCOE_FLASH_BIOS_SIZE,
+								 (uint8_t *) ROSCOE_BIOS_BASE,
+								 ROSCOE_SYSTEM_SRAM_SIZE,
+								 &u32ImageSize);
+	if (eVersionCode != EVERSION_OK)
+	{
+		printf("\nOperational image failed to inflate - %s\n", VersionCodeGetText(eVersionCode));
+		return;
+	}
+
+	// Make sure what came out is an operational image meant to run here
+	POST_SET(POSTCODE_BOOTLOADER_VERIFY_OP_IMAGE_COPY);
+	eVersionCode = VersionFindStructure((uint8_t *) ROSCOE_BIOS_BASE,
+										u32ImageSize,
+										EIMGTYPE_OPERATIONAL,
+										&psVersion);
+	if ((EVERSION_OK == eVersionCode) &&
+		(psVersion->u32LoadAddress != ROSCOE_BIOS_BASE))
+	{
+		eVersionCode = EVERSION_BAD_LOAD_ADDRESS;
+	}
+
+	if (eVersionCode != EVERSION_OK)
+	{
+		printf("\nOperational image failed verification - %s\n", VersionCodeGetText(eVersionCode));
+		return;
+	}
+
+	POST_SET(POSTCODE_BOOTLOADER_OP_IMAGE_EXEC);
+	((void (*)(void))psVersion->u32EntryPoint)();
+}
 
 // Main entry point for boot loader
 void main(void)
@@ -19,9 +69,9 @@ void main(void)
 	// Indicate that we're at main() on the POST code LEDs
 	POST_SET(POSTCODE_BOOTLOADER_MAIN);
 
-	(void) MonitorStart();
+	BootLoaderOpImageBoot();
 
-//	((void (*)(void))psVersion->u32EntryPoint)();
+	(void) MonitorStart();
 
 	// SHOULD NOT GET HERE
 	printf("\nReturned from dispatch to operational image - this should not happen!\n");
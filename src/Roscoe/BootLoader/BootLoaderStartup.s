@@ -10,8 +10,18 @@
 	.extern SYM (InterruptServiceRoutine)
 	.extern	SYM (_end)
 	.extern	SYM (_stack)
+	.extern	SYM (__bss_start)
+	.extern	SYM (g_sImageVersion)
 	.global	BootLoaderEntry
 
+/* SImageVersion layout (see Shared/Version.h) - keep these in sync */
+	.equ	VERSION_IMAGE_CRC32_OFFSET, 20
+	.equ	VERSION_IMAGE_SIZE_OFFSET, 24
+	.equ	VERSION_STRUCT_SIZE, 56
+
+/* Boot image CRC32 seed (VERSION_CRC32_IMAGE_INITIAL in Shared/Version.h) */
+	.equ	VERSION_CRC32_IMAGE_INITIAL, 0xe4a1f9f5
+
 /* Set a POST code macro */
 	.macro	POSTSet, POSTCode
 	moveb	#\POSTCode >> 8, %d0
@@ -36,6 +46,75 @@
 	stop	#0x2700			/* Shut off all interrupts and halt */	
 	.endm
 
+/* Byte swap a 32 bit data register */
+	.macro	BSWAP32, Reg
+	rolw	#8, \Reg
+	swap	\Reg
+	rolw	#8, \Reg
+	.endm
+
+/* Fold the 32 bit value in d7 into the CRC32 in d4 using the slicing-by-4
+   table at a3. The CRC is kept byte swapped so big endian longs can be
+   folded in directly (same as zlib's crc32_big()). Trashes d5/d6/d7. */
+	.macro	CRC32Long
+	eorl	%d7, %d4
+	moveq	#0, %d5
+	moveb	%d4, %d5
+	movel	(%a3,%d5.w*4), %d6
+	lsrl	#8, %d4
+	moveb	%d4, %d5
+	movel	(0x400,%a3,%d5.w*4), %d7
+	eorl	%d7, %d6
+	lsrl	#8, %d4
+	moveb	%d4, %d5
+	movel	(0x800,%a3,%d5.w*4), %d7
+	eorl	%d7, %d6
+	lsrl	#8, %d4
+	movel	(0xc00,%a3,%d4.w*4), %d7
+	eorl	%d7, %d6
+	movel	%d6, %d4
+	.endm
+
+/* Read back the long just written to (a1) and make sure it matches Reg,
+   then optionally fold it into the CRC */
+	.macro	CopyCheck, Reg, CRC
+	movel	\Reg, %d6
+	movel	(%a1)+, %d7
+	cmpl	%d6, %d7
+	bne	BootLoaderDRAMFault
+	.if	\CRC
+	CRC32Long
+	.endif
+	.endm
+
+/* Copy a0 (flash) to a1 (SRAM) until a1 reaches a2, 16 bytes at a time
+   with MOVEM bursts, verifying each long on the way. Both ends must be long
+   aligned. If CRC is nonzero, everything copied is also folded in to the
+   CRC32 in d4. Trashes d0-d3/d5-d7/a5. */
+	.macro	CopyVerify, CRC
+CopyBurst\@:
+	lea	16(%a1), %a5
+	cmpal	%a2, %a5
+	bhi	CopyLong\@
+	moveml	(%a0)+, %d0-%d3
+	moveml	%d0-%d3, (%a1)
+	CopyCheck	%d0, \CRC
+	CopyCheck	%d1, \CRC
+	CopyCheck	%d2, \CRC
+	CopyCheck	%d3, \CRC
+	bra	CopyBurst\@
+
+CopyLong\@:
+	cmpal	%a2, %a1
+	bcc	CopyDone\@
+	movel	(%a0)+, %d0
+	movel	%d0, (%a1)
+	CopyCheck	%d0, \CRC
+	bra	CopyLong\@
+
+CopyDone\@:
+	.endm
+
 /* Roscoe address ranges and peripherals */
 
 	.text
@@ -1529,32 +1608,142 @@ UARTInit:
 /* Now we start the copy of our code to the base RAM and check it */
 	POSTSet	POSTCODE_BOOTLOADER_COPY
 
-	lea	__end, %a0
-	movel	%a0, %a2
+/* Build the slicing-by-4 CRC32 table in the (not yet used) heap area of
+   0WS SRAM. First pass is the plain byte-at-a-time table. */
+
+	lea	__end, %a3
+	movel	%a3, %a0
+	movel	#0xedb88320, %d2
+	moveq	#0, %d0
+
+CRCTableByte:
+	movel	%d0, %d1
+	moveq	#7, %d3
+
+CRCTableBit:
+	lsrl	#1, %d1
+	bcc	CRCTableNoXor
+	eorl	%d2, %d1
+
+CRCTableNoXor:
+	dbra	%d3, CRCTableBit
+	movel	%d1, (%a0)+
+	addql	#1, %d0
+	cmpl	#256, %d0
+	bne	CRCTableByte
+
+/* Now the 3 slices past it, stored byte swapped */
+
+	moveq	#0, %d0
+
+CRCTableSlices:
+	lea	(%a3,%d0.w*4), %a0
+	movel	(%a0), %d1
+	moveq	#2, %d3
+
+CRCTableSlice:
+	moveq	#0, %d5
+	moveb	%d1, %d5
+	lsrl	#8, %d1
+	movel	(%a3,%d5.w*4), %d6
+	eorl	%d6, %d1
+	lea	0x400(%a0), %a0
+	movel	%d1, %d6
+	BSWAP32	%d6
+	movel	%d6, (%a0)
+	dbra	%d3, CRCTableSlice
+	addql	#1, %d0
+	cmpl	#256, %d0
+	bne	CRCTableSlices
+
+/* And finally byte swap the first slice */
+
+	movel	%a3, %a0
+	movew	#255, %d3
+
+CRCTableSwap:
+	movel	(%a0), %d1
+	BSWAP32	%d1
+	movel	%d1, (%a0)+
+	dbra	%d3, CRCTableSwap
+
+/* Copy, read back and CRC in one pass. The version structure isn't part of
+   the image CRC32, so copy the image in pieces around it. */
+
+	movel	#VERSION_CRC32_IMAGE_INITIAL, %d4
+	BSWAP32	%d4
+	notl	%d4
 
 	lea	ROSCOE_FLASH_BOOT_BASE, %a0
 	lea	ROSCOE_BOOT_BASE_SRAM, %a1
-
-BootLoaderCopy:
+	lea	g_sImageVersion, %a2
+	CopyVerify	1
+
+	lea	(g_sImageVersion + VERSION_STRUCT_SIZE), %a2
+	CopyVerify	0
+
+/* The stamped image size comes from the version structure we just copied.
+   Don't let a bad one run past the end of the loaded image. */
+
+	movel	(g_sImageVersion + VERSION_IMAGE_SIZE_OFFSET), %d0
+	movel	%d0, %d1
+	andil	#3, %d1
+	andil	#0xfffffffc, %d0
+	addl	#ROSCOE_BOOT_BASE_SRAM, %d0
+	lea	__bss_start, %a2
+	cmpl	%a2, %d0
+	bls	BootLoaderCopyImageEnd
+	movel	%a2, %d0
+	moveq	#0, %d1
+
+BootLoaderCopyImageEnd:
+	movel	%d0, %a2
+	cmpal	%a1, %a2
+	bcs	BootLoaderCopyRest
+
+/* a6 isn't needed again until a fault is reported, so park the trailing
+   byte count there while the copy uses every data register */
+
+	movel	%d1, %a6
+	CopyVerify	1
+	movel	%a6, %d1
+
+/* CRC any trailing bytes of the image. They live in the next long, so copy
+   and check that one first. */
+
+	movel	%a1, %a5
+	tstw	%d1
+	beq	BootLoaderCopyRest
 	movel	(%a0)+, %d0
-	movel	%d0, (%a1)+
-	cmpl	%a1, %a2
-	bne	BootLoaderCopy
+	movel	%d0, (%a1)
+	CopyCheck	%d0, 0
+	bra	BootLoaderCRCTailNext
 
-/* Now we do a readback to see if the data was copied OK */
+BootLoaderCRCTail:
+	moveq	#0, %d5
+	moveb	(%a5)+, %d5
+	roll	#8, %d4
+	eorb	%d4, %d5
+	clrb	%d4
+	movel	(%a3,%d5.w*4), %d6
+	eorl	%d6, %d4
 
-/* Figure out where the end address of everything is and turn it in to UINT32 counts */
-	movel	%a2, %a0
-	lea	ROSCOE_FLASH_BOOT_BASE, %a0
-	lea	ROSCOE_BOOT_BASE_SRAM, %a1
+BootLoaderCRCTailNext:
+	dbra	%d1, BootLoaderCRCTail
 
-BootLoaderCompare:
-	movel	(%a0)+, %d3		/* Read data from flash */
-	movel	(%a1)+, %d4		/* Read data from DRAM */
-	cmpl	%d3, %d4		/* Are they the same? */
-	bne	BootLoaderDRAMFault
-	cmpl	%a1, %a2
-	bne	BootLoaderCompare
+/* Everything else up to the bss only needs to be copied */
+
+BootLoaderCopyRest:
+	lea	__bss_start, %a2
+	CopyVerify	0
+
+/* See if what's in SRAM matches what stamp said the image should be */
+
+	notl	%d4
+	BSWAP32	%d4
+	movel	(g_sImageVersion + VERSION_IMAGE_CRC32_OFFSET), %d3
+	cmpl	%d3, %d4
+	bne	BootLoaderCRCFault
 
 /* Now init the heap - test it first */
 
@@ -1633,6 +1822,12 @@ DRAMFault:
 	.ascii	"Flash->SRAM readback fault at address 0x"
 	dc.b	0x00
 
+CRCFault:
+	dc.b	0x0d 
+	dc.b	0x0a
+	.ascii	"Flash->SRAM image CRC32 fault"
+	dc.b	0x00
+
 DRAMFault2:
 	.ascii	" - Expected 0x"
 	dc.b	0x00
@@ -1662,14 +1857,15 @@ HeapTestCheckFailed:
 
 /* If we get here, then we had a readback failure/miscompare for the code area. On entry:
 
-   a0 = Flash address + 4
    a1 = DRAM Address + 4
-   d3 = Correct data
-   d4 = Incorrect data
+   d6 = Correct data
+   d7 = Incorrect data
 */
 	.align	4
 
 BootLoaderDRAMFault:
+	movel	%d6, %d3
+	movel	%d7, %d4
 
 /* Flash->RAM Readback fault at address */
 
@@ -1685,6 +1881,7 @@ faultAddress:
 
 /* Expected */
 
+faultExpected:
 	lea	DRAMFault2 + ROSCOE_FLASH_BOOT_BASE, %a5
 	StacklessCall	SendString
 
@@ -1708,6 +1905,17 @@ faultAddress:
 	StacklessCall	SendString
 	HALT
 
+/* Image CRC32 didn't match the stamp. On entry:
+
+   d3 = Expected CRC32
+   d4 = CRC32 of the SRAM copy
+*/
+
+BootLoaderCRCFault:
+	lea	CRCFault + ROSCOE_FLASH_BOOT_BASE, %a5
+	StacklessCall	SendString
+	bra	faultExpected
+
 	.global StackPointerGet
 StackPointerGet:
 	movel	%sp, %d0
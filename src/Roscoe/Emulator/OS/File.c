@@ -11,12 +11,37 @@ static const char *sg_peFilenameChars = "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLM
 // Size of cryptographic buffer
 #define	CRYPT_BUFFER_SIZE				512
 
+// Encrypted file header. Files written before counter mode was introduced
+// are CFB1 with no header at all.
+#define	FILE_CRYPT_SIGNATURE			"FCTR"
+#define	FILE_CRYPT_VERSION				1
+
+// Encrypted reads/writes at least this big get their cipher work split across threads
+#define	FILE_CRYPT_PARALLEL_MIN			(256 * 1024)
+
+// # Of helper threads for large encrypted reads/writes (the caller does a share, too)
+#define	FILE_CRYPT_WORKERS				3
+
+// Largest single piece of cipher work, and the bounce buffer size for large encrypted writes
+#define	FILE_CRYPT_CHUNK				(1024 * 1024)
+
 // File signature
 #define	FILE_SIGNATURE					"FILE"
 
 // Size of buffer during file copy
 #define		FILE_COPY_BUFFER_SIZE		1024
 
+// On-disk header at the start of counter mode encrypted files
+PACKED_BEGIN
+typedef PACKED_STRUCT_START struct PACKED_STRUCT SFileCryptHeader
+{
+	char eSignature[4];					// FILE_CRYPT_SIGNATURE
+	uint16_t u16Version;				// FILE_CRYPT_VERSION
+	uint16_t u16HeaderSize;				// Size of this header - encrypted data starts here
+	uint8_t u8Nonce[CTR_NONCE_SIZE];	// Per-file counter nonce
+} SFileCryptHeader;
+PACKED_END
+
 // Encrypted file
 typedef struct SFileCrypt
 {
@@ -24,8 +49,23 @@ typedef struct SFileCrypt
 	keyInstance sKeyInstance;
 	cipherInstance sCipherInstance;
 	bool bRead;							// Set true if we're reading
+	bool bLegacy;						// Set true if this is a CFB1 file (read only, no seeking)
+	uint8_t u8Nonce[CTR_NONCE_SIZE];	// Counter mode nonce
+	uint32_t u32HeaderSize;				// Counter mode header size (file offset of plaintext position 0)
+	uint64_t u64Position;				// Counter mode plaintext position
 } SFileCrypt;
 
+// One thread's share of a counter mode job
+typedef struct SFileCryptSlice
+{
+	SFileCrypt *psCrypt;
+	uint8_t *pu8Src;
+	uint8_t *pu8Dest;
+	uint64_t u64Position;				// Plaintext position of pu8Src[0]
+	uint64_t u64Size;
+	bool bResult;						// Set true if the cipher was happy
+} SFileCryptSlice;
+
 // Standard file
 typedef struct SFileInternal
 {
@@ -41,6 +81,190 @@ static uint8_t sg_u8FilePrivateKey[] =
 	0x18, 0xd7, 0x04, 0x45, 0x1f, 0x80, 0x07, 0x63, 0x77, 0x23, 0x6d, 0x90, 0x9d, 0x84, 0x53, 0x81
 };
 
+// Helper threads for large encrypted reads/writes. They're started the first
+// time they're needed and handle one job at a time.
+static SOSCriticalSection sg_sFileCryptPoolLock;
+static bool sg_bFileCryptPoolStarted;
+static SOSSemaphore sg_sFileCryptWorkerStart[FILE_CRYPT_WORKERS];
+static SOSSemaphore sg_sFileCryptWorkDone;
+static SFileCryptSlice sg_sFileCryptSlices[FILE_CRYPT_WORKERS];
+
+// Runs counter mode over a slice, FILE_CRYPT_CHUNK at a time
+static void FileCryptSliceRun(SFileCryptSlice *psSlice)
+{
+	uint64_t u64Done = 0;
+
+	psSlice->bResult = true;
+	while (u64Done < psSlice->u64Size)
+	{
+		uint64_t u64Chunk = psSlice->u64Size - u64Done;
+
+		if (u64Chunk > FILE_CRYPT_CHUNK)
+		{
+			u64Chunk = FILE_CRYPT_CHUNK;
+		}
+
+		if (blockCTR(&psSlice->psCrypt->sKeyInstance,
+					 psSlice->psCrypt->u8Nonce,
+					 psSlice->u64Position + u64Done,
+					 psSlice->pu8Src + u64Done,
+					 (int) u64Chunk,
+					 psSlice->pu8Dest + u64Done) != (int) u64Chunk)
+		{
+			psSlice->bResult = false;
+			return;
+		}
+
+		u64Done += u64Chunk;
+	}
+}
+
+static void FileCryptWorkerThread(void *pvThreadValue)
+{
+	uint32_t u32Worker = (uint32_t) (uintptr_t) pvThreadValue;
+	EStatus eStatus;
+
+	while (1)
+	{
+		eStatus = OSSemaphoreGet(sg_sFileCryptWorkerStart[u32Worker],
+								 OS_WAIT_INDEFINITE);
+		BASSERT(ESTATUS_OK == eStatus);
+
+		FileCryptSliceRun(&sg_sFileCryptSlices[u32Worker]);
+
+		eStatus = OSSemaphorePut(sg_sFileCryptWorkDone,
+								 1);
+		BASSERT(ESTATUS_OK == eStatus);
+	}
+}
+
+// Starts up the helper threads. Call with sg_sFileCryptPoolLock held.
+static EStatus FileCryptPoolStart(void)
+{
+	EStatus eStatus;
+	uint32_t u32Loop;
+
+	eStatus = OSSemaphoreCreate(&sg_sFileCryptWorkDone,
+								0,
+								FILE_CRYPT_WORKERS);
+	ERR_GOTO();
+
+	for (u32Loop = 0; u32Loop < FILE_CRYPT_WORKERS; u32Loop++)
+	{
+		eStatus = OSSemaphoreCreate(&sg_sFileCryptWorkerStart[u32Loop],
+									0,
+									1);
+		ERR_GOTO();
+
+		eStatus = OSThreadCreate("File crypt",
+								 (void *) (uintptr_t) u32Loop,
+								 FileCryptWorkerThread,
+								 false,
+								 NULL,
+								 0,
+								 EOSPRIORITY_NORMAL);
+		ERR_GOTO();
+	}
+
+	sg_bFileCryptPoolStarted = true;
+
+errorExit:
+	return(eStatus);
+}
+
+// Runs counter mode over u64Size bytes that sit at plaintext position
+// u64Position. pu8Src and pu8Dest can be the same. Large jobs get split
+// between the helper threads and the caller. Returns false if the cipher
+// rejected it.
+static bool FileCryptCTR(SFileCrypt *psCrypt,
+						 uint8_t *pu8Src,
+						 uint8_t *pu8Dest,
+						 uint64_t u64Position,
+						 uint64_t u64Size)
+{
+	SFileCryptSlice sSlice;
+	bool bParallel = false;
+	uint64_t u64Share = 0;
+	uint32_t u32Loop;
+	EStatus eStatus;
+
+	// The pool lock is created at filesystem init, so no lock means no pool
+	if ((u64Size >= FILE_CRYPT_PARALLEL_MIN) &&
+		(sg_sFileCryptPoolLock))
+	{
+		eStatus = OSCriticalSectionEnter(sg_sFileCryptPoolLock);
+		BASSERT(ESTATUS_OK == eStatus);
+
+		if (false == sg_bFileCryptPoolStarted)
+		{
+			eStatus = FileCryptPoolStart();
+			if (eStatus != ESTATUS_OK)
+			{
+				SyslogFunc("Failed to start encryption helper threads - %s\n", GetErrorText(eStatus));
+			}
+		}
+
+		if (sg_bFileCryptPoolStarted)
+		{
+			bParallel = true;
+		}
+		else
+		{
+			eStatus = OSCriticalSectionLeave(sg_sFileCryptPoolLock);
+			BASSERT(ESTATUS_OK == eStatus);
+		}
+	}
+
+	// Hand out equal, block aligned shares. The caller's share is whatever is left.
+	if (bParallel)
+	{
+		u64Share = (u64Size / (FILE_CRYPT_WORKERS + 1)) & ~((uint64_t) ((BLOCK_SIZE / 8) - 1));
+
+		for (u32Loop = 0; u32Loop < FILE_CRYPT_WORKERS; u32Loop++)
+		{
+			sg_sFileCryptSlices[u32Loop].psCrypt = psCrypt;
+			sg_sFileCryptSlices[u32Loop].pu8Src = pu8Src + (u64Share * u32Loop);
+			sg_sFileCryptSlices[u32Loop].pu8Dest = pu8Dest + (u64Share * u32Loop);
+			sg_sFileCryptSlices[u32Loop].u64Position = u64Position + (u64Share * u32Loop);
+			sg_sFileCryptSlices[u32Loop].u64Size = u64Share;
+
+			eStatus = OSSemaphorePut(sg_sFileCryptWorkerStart[u32Loop],
+									 1);
+			BASSERT(ESTATUS_OK == eStatus);
+		}
+	}
+
+	sSlice.psCrypt = psCrypt;
+	sSlice.pu8Src = pu8Src + (u64Share * FILE_CRYPT_WORKERS);
+	sSlice.pu8Dest = pu8Dest + (u64Share * FILE_CRYPT_WORKERS);
+	sSlice.u64Position = u64Position + (u64Share * FILE_CRYPT_WORKERS);
+	sSlice.u64Size = u64Size - (u64Share * FILE_CRYPT_WORKERS);
+	FileCryptSliceRun(&sSlice);
+
+	if (bParallel)
+	{
+		for (u32Loop = 0; u32Loop < FILE_CRYPT_WORKERS; u32Loop++)
+		{
+			eStatus = OSSemaphoreGet(sg_sFileCryptWorkDone,
+									 OS_WAIT_INDEFINITE);
+			BASSERT(ESTATUS_OK == eStatus);
+		}
+
+		for (u32Loop = 0; u32Loop < FILE_CRYPT_WORKERS; u32Loop++)
+		{
+			if (false == sg_sFileCryptSlices[u32Loop].bResult)
+			{
+				sSlice.bResult = false;
+			}
+		}
+
+		eStatus = OSCriticalSectionLeave(sg_sFileCryptPoolLock);
+		BASSERT(ESTATUS_OK == eStatus);
+	}
+
+	return(sSlice.bResult);
+}
+
 // Checks file pointer for validity - both address-wise and content-wise
 EStatus FileIsValid(SOSFile sFile)
 {
@@ -172,6 +396,11 @@ EStatus FilesystemInit(uint32_t u32Mask,
 										&u32UniqueIDLength);
 	ERR_GOTO();
 
+	// Lock for the encryption helper threads. Without it large encrypted
+	// reads/writes just run on the caller's thread.
+	eStatus = OSCriticalSectionCreate(&sg_sFileCryptPoolLock);
+	ERR_GOTO();
+
 	eStatus = PortFilesystemInit();
 
 errorExit:
@@ -245,7 +474,9 @@ static EStatus FileInternalCreate(SFileInternal **ppsFileInternal,
 	// Are we encrypted? If so, create an encryption structure
 	if (bEncrypted)
 	{
-		BYTE eDirection = DIR_DECRYPT;
+		BYTE eDirection = DIR_ENCRYPT;
+		BYTE eMode = MODE_ECB;
+		SFileCryptHeader sHeader;
 		
 		psFileInternal->psCrypt = MemAlloc(sizeof(*psFileInternal->psCrypt));
 		if (NULL == psFileInternal->psCrypt)
@@ -256,14 +487,85 @@ static EStatus FileInternalCreate(SFileInternal **ppsFileInternal,
 		
 		if (strcmp(peFileMode, "rb") == 0)
 		{
+			uint64_t u64SizeRead = 0;
+
 			// Read
 			psFileInternal->psCrypt->bRead = true;
+
+			// Counter mode files start with a header. Anything else is a legacy CFB1 file.
+			eStatus = PortFilefread((void *) &sHeader,
+									sizeof(sHeader),
+									&u64SizeRead,
+									psFile);
+			ERR_GOTO();
+
+			if ((sizeof(sHeader) == u64SizeRead) &&
+				(memcmp((void *) sHeader.eSignature, (void *) FILE_CRYPT_SIGNATURE, sizeof(sHeader.eSignature)) == 0))
+			{
+				if (sHeader.u16Version > FILE_CRYPT_VERSION)
+				{
+					eStatus = ESTATUS_CIPHER_UNSUPPORTED_VERSION;
+					goto errorExit;
+				}
+
+				if (sHeader.u16HeaderSize < sizeof(sHeader))
+				{
+					eStatus = ESTATUS_CIPHER_INIT_FAILURE;
+					goto errorExit;
+				}
+
+				memcpy((void *) psFileInternal->psCrypt->u8Nonce, (void *) sHeader.u8Nonce, sizeof(psFileInternal->psCrypt->u8Nonce));
+				psFileInternal->psCrypt->u32HeaderSize = sHeader.u16HeaderSize;
+
+				// Skip anything a later (compatible) version tacked on to the header
+				if (sHeader.u16HeaderSize != sizeof(sHeader))
+				{
+					eStatus = PortFilefseek(psFile,
+											(int64_t) sHeader.u16HeaderSize,
+											SEEK_SET);
+					ERR_GOTO();
+				}
+			}
+			else
+			{
+				eStatus = PortFilefseek(psFile,
+										0,
+										SEEK_SET);
+				ERR_GOTO();
+
+				psFileInternal->psCrypt->bLegacy = true;
+				eDirection = DIR_DECRYPT;
+				eMode = MODE_CFB1;
+			}
 		}
 		else
 		if (strcmp(peFileMode, "wb") == 0)
 		{
-			// Write
-			eDirection = DIR_ENCRYPT;
+			uint64_t u64Nonce = SharedRandomNumber();
+			uint64_t u64SizeWritten = 0;
+
+			// Write - new files are always counter mode
+			memset((void *) &sHeader, 0, sizeof(sHeader));
+			memcpy((void *) sHeader.eSignature, (void *) FILE_CRYPT_SIGNATURE, sizeof(sHeader.eSignature));
+			sHeader.u16Version = FILE_CRYPT_VERSION;
+			sHeader.u16HeaderSize = sizeof(sHeader);
+			BASSERT(sizeof(u64Nonce) == sizeof(sHeader.u8Nonce));
+			memcpy((void *) sHeader.u8Nonce, (void *) &u64Nonce, sizeof(sHeader.u8Nonce));
+
+			eStatus = PortFilefwrite((void *) &sHeader,
+									 sizeof(sHeader),
+									 &u64SizeWritten,
+									 psFile);
+			ERR_GOTO();
+
+			if (u64SizeWritten != sizeof(sHeader))
+			{
+				eStatus = ESTATUS_DISK_FULL;
+				goto errorExit;
+			}
+
+			memcpy((void *) psFileInternal->psCrypt->u8Nonce, (void *) sHeader.u8Nonce, sizeof(psFileInternal->psCrypt->u8Nonce));
+			psFileInternal->psCrypt->u32HeaderSize = sHeader.u16HeaderSize;
 		}
 		else
 		{
@@ -279,7 +581,7 @@ static EStatus FileInternalCreate(SFileInternal **ppsFileInternal,
 		}
 		
 		// Cipher init
-		if (cipherInit(&psFileInternal->psCrypt->sCipherInstance, MODE_CFB1, NULL) != true)
+		if (cipherInit(&psFileInternal->psCrypt->sCipherInstance, eMode, NULL) != true)
 		{
 			DebugOut("Failed makeKey\r\n");
 			eStatus = ESTATUS_CIPHER_INIT_FAILURE;
@@ -490,8 +792,37 @@ EStatus Filefread(void *pvBuffer, uint64_t u64SizeToRead, uint64_t *pu64SizeRead
 		{
 			*pu64SizeRead = 0;
 		}
+
+		// Counter mode - read straight into the caller's buffer and decrypt in place
+		if (false == psFileInternal->psCrypt->bLegacy)
+		{
+			uint64_t u64SizeRead = 0;
+
+			eStatus = PortFilefread(pvBuffer,
+									u64SizeToRead,
+									&u64SizeRead,
+									psFileInternal->sFile);
+			ERR_GOTO();
+
+			if (false == FileCryptCTR(psFileInternal->psCrypt,
+									  (uint8_t *) pvBuffer,
+									  (uint8_t *) pvBuffer,
+									  psFileInternal->psCrypt->u64Position,
+									  u64SizeRead))
+			{
+				return(ESTATUS_CIPHER_DECRYPTION_FAULT);
+			}
+
+			psFileInternal->psCrypt->u64Position += u64SizeRead;
+			if (pu64SizeRead)
+			{
+				*pu64SizeRead = u64SizeRead;
+			}
+
+			return(ESTATUS_OK);
+		}
 		
-		// We have an encrypted file. Let's read in chunks and decrypt as we go
+		// Legacy CFB1 file. Let's read in chunks and decrypt as we go
 		while (u64SizeToRead)
 		{
 			uint64_t u64SizeRead;
@@ -569,6 +900,8 @@ EStatus Filefwrite(void *pvBuffer, uint64_t u64SizeToWrite, uint64_t *pu64SizeWr
 	if (psFileInternal->psCrypt)
 	{
 		uint64_t u64Chunk;
+		uint64_t u64BufferSize = CRYPT_BUFFER_SIZE;
+		uint8_t *pu8Buffer = (uint8_t *) psFileInternal->psCrypt->peCryptBuffer;
 		
 		// If we are reading a file, return invalid file mode
 		if (psFileInternal->psCrypt->bRead)
@@ -581,36 +914,59 @@ EStatus Filefwrite(void *pvBuffer, uint64_t u64SizeToWrite, uint64_t *pu64SizeWr
 		{
 			*pu64SizeWritten = 0;
 		}
+
+		// Big writes get a big buffer so the cipher work can be spread across threads
+		if (u64SizeToWrite >= FILE_CRYPT_PARALLEL_MIN)
+		{
+			u64BufferSize = FILE_CRYPT_CHUNK;
+			if (u64BufferSize > u64SizeToWrite)
+			{
+				u64BufferSize = u64SizeToWrite;
+			}
+
+			pu8Buffer = MemAllocNoClear((uint32_t) u64BufferSize);
+			if (NULL == pu8Buffer)
+			{
+				// Fall back to the small buffer
+				u64BufferSize = CRYPT_BUFFER_SIZE;
+				pu8Buffer = (uint8_t *) psFileInternal->psCrypt->peCryptBuffer;
+			}
+		}
 		
 		// We have an encrypted file. Let's write in chunks and encrypt as we go
 		while (u64SizeToWrite)
 		{
-			uint64_t u64SizeWritten;
+			uint64_t u64SizeWritten = 0;
 			
 			u64Chunk = u64SizeToWrite;
-			if (u64Chunk > CRYPT_BUFFER_SIZE)
+			if (u64Chunk > u64BufferSize)
 			{
-				u64Chunk = CRYPT_BUFFER_SIZE;
+				u64Chunk = u64BufferSize;
 			}
    					
 			// Now encrypt to encryption buffer
-			if (blockEncrypt(&psFileInternal->psCrypt->sCipherInstance,
-							 &psFileInternal->psCrypt->sKeyInstance,
-							 (BYTE *) pvBuffer,
-							 (int) (u64Chunk << 3),
-							 (BYTE *) psFileInternal->psCrypt->peCryptBuffer) != (u64Chunk << 3))
+			if (false == FileCryptCTR(psFileInternal->psCrypt,
+									  (uint8_t *) pvBuffer,
+									  pu8Buffer,
+									  psFileInternal->psCrypt->u64Position,
+									  u64Chunk))
 			{
-				return(ESTATUS_CIPHER_ENCRYPTION_FAULT);				
+				eStatus = ESTATUS_CIPHER_ENCRYPTION_FAULT;
+				break;
 			}
 			
 			// Write the chunk from our temporary (encrypted) buffer
-			eStatus = PortFilefwrite(psFileInternal->psCrypt->peCryptBuffer,
+			eStatus = PortFilefwrite(pu8Buffer,
 									 u64Chunk,
 									 &u64SizeWritten,
 									 psFileInternal->sFile);
-			ERR_GOTO();
+			if (eStatus != ESTATUS_OK)
+			{
+				break;
+			}
 
 			// Move pointers and decrrement counters
+			psFileInternal->psCrypt->u64Position += u64SizeWritten;
 			pvBuffer = (void *) (((uint8_t *) pvBuffer) + u64SizeWritten);
 			if (pu64SizeWritten)
 			{
@@ -619,9 +975,20 @@ EStatus Filefwrite(void *pvBuffer, uint64_t u64SizeToWrite, uint64_t *pu64SizeWr
 
 			// Subtract # of bytes to write
 			u64SizeToWrite -= u64SizeWritten;
+
+			// Short write - the port layer is out of room
+			if (u64SizeWritten != u64Chunk)
+			{
+				break;
+			}
+		}
+
+		if (pu8Buffer != (uint8_t *) psFileInternal->psCrypt->peCryptBuffer)
+		{
+			MemFree(pu8Buffer);
 		}
 		
-		return(ESTATUS_OK);
+		return(eStatus);
 	}
 	else
 	{
@@ -643,6 +1010,7 @@ EStatus Filefputc(uint8_t u8Data, SOSFile sFile)
 	// If this is encrypted, then encrypt it
 	if (psFileInternal->psCrypt)
 	{
+		EStatus eStatus;
 		uint8_t u8EncryptedData;
 
 		// If we are reading a file, return invalid file mode
@@ -652,16 +1020,22 @@ EStatus Filefputc(uint8_t u8Data, SOSFile sFile)
 		}
 
 		// Now encrypt to encryption buffer
-		if (blockEncrypt(&psFileInternal->psCrypt->sCipherInstance,
-						 &psFileInternal->psCrypt->sKeyInstance,
-						 (BYTE *) &u8Data,
-						 (int) (sizeof(u8Data) << 3),
-						 (BYTE *) &u8EncryptedData) != (sizeof(u8EncryptedData) << 3))
+		if (false == FileCryptCTR(psFileInternal->psCrypt,
+								  &u8Data,
+								  &u8EncryptedData,
+								  psFileInternal->psCrypt->u64Position,
+								  sizeof(u8Data)))
 		{
 			return(ESTATUS_CIPHER_ENCRYPTION_FAULT);				
 		}
 
-		return(PortFilefputc(u8EncryptedData, psFileInternal->sFile));
+		eStatus = PortFilefputc(u8EncryptedData, psFileInternal->sFile);
+		if (ESTATUS_OK == eStatus)
+		{
+			psFileInternal->psCrypt->u64Position++;
+		}
+
+		return(eStatus);
 	}
 
 	return(PortFilefputc(u8Data, psFileInternal->sFile));
@@ -690,6 +1064,21 @@ EStatus Filefgetc(uint8_t *pu8Data, SOSFile sFile)
 		}
 
 		// Decrypt the data
+		if (false == psFileInternal->psCrypt->bLegacy)
+		{
+			if (false == FileCryptCTR(psFileInternal->psCrypt,
+									  &u8Data,
+									  pu8Data,
+									  psFileInternal->psCrypt->u64Position,
+									  sizeof(u8Data)))
+			{
+				return(ESTATUS_CIPHER_DECRYPTION_FAULT);
+			}
+
+			psFileInternal->psCrypt->u64Position++;
+			return(ESTATUS_OK);
+		}
+
     	if (blockDecrypt(&psFileInternal->psCrypt->sCipherInstance,
 						 &psFileInternal->psCrypt->sKeyInstance,
 						 (BYTE *) &u8Data,
@@ -714,10 +1103,43 @@ EStatus Filefseek(SOSFile psFile, int64_t s64Offset, int32_t s32Origin)
 	eStatus = FileIsValid(psFile);
 	ERR_GOTO();
 
-	// Can't seek on an encrypted file
 	if (psFileInternal->psCrypt)
 	{
-		return(ESTATUS_INVALID_CRYPT_MODE);
+		uint64_t u64Position;
+
+		// Can't seek on a legacy CFB1 file - each byte depends on everything before it
+		if (psFileInternal->psCrypt->bLegacy)
+		{
+			return(ESTATUS_INVALID_CRYPT_MODE);
+		}
+
+		// Counter mode can seek anywhere. Absolute positions are past the header.
+		if (SEEK_SET == s32Origin)
+		{
+			s64Offset += psFileInternal->psCrypt->u32HeaderSize;
+		}
+
+		eStatus = PortFilefseek(psFileInternal->sFile, 
+								s64Offset, 
+								s32Origin);
+		ERR_GOTO();
+
+		eStatus = PortFileftell(psFileInternal->sFile,
+								&u64Position);
+		ERR_GOTO();
+
+		// Don't allow landing in the header
+		if (u64Position < psFileInternal->psCrypt->u32HeaderSize)
+		{
+			(void) PortFilefseek(psFileInternal->sFile,
+								 (int64_t) (psFileInternal->psCrypt->u32HeaderSize + psFileInternal->psCrypt->u64Position),
+								 SEEK_SET);
+			eStatus = ESTATUS_ERRNO_ILLEGAL_SEEK;
+			goto errorExit;
+		}
+
+		psFileInternal->psCrypt->u64Position = u64Position - psFileInternal->psCrypt->u32HeaderSize;
+		return(ESTATUS_OK);
 	}
 	
 	return(PortFilefseek(psFileInternal->sFile, 
@@ -735,6 +1157,14 @@ EStatus Fileftell(SOSFile psFile, uint64_t *pu64Position)
 	eStatus = FileIsValid(psFile);
 	ERR_GOTO();
 
+	// Counter mode files report the plaintext position
+	if ((psFileInternal->psCrypt) &&
+		(false == psFileInternal->psCrypt->bLegacy))
+	{
+		*pu64Position = psFileInternal->psCrypt->u64Position;
+		return(ESTATUS_OK);
+	}
+
 	return(PortFileftell(psFileInternal->sFile, 
 						 pu64Position));
 
@@ -942,11 +1372,69 @@ EStatus FileStat(char *peFilename,
 						pu32FileAttributes));
 }
 
+// Maps a file read-only into memory. Release it with FileUnmap().
+EStatus FileMap(char *peFilename,
+				void **ppvFileData,
+				uint64_t *pu64FileLength)
+{
+	EStatus eStatus;
+	char *peTempPath = NULL;
+
+	eStatus = FileConstructAbsoluteFilename(peFilename,
+											&peTempPath);
+	ERR_GOTO();
+
+	if (peTempPath)
+	{
+		// Rebased filename
+		eStatus = PortFileMap(peTempPath,
+							  ppvFileData,
+							  pu64FileLength);
+		MemFree(peTempPath);
+	}
+	else
+	{
+		// Just the incoming filename
+		eStatus = PortFileMap(peFilename,
+							  ppvFileData,
+							  pu64FileLength);
+	}
+
+errorExit:
+	return(eStatus);
+}
+
+void FileUnmap(void *pvFileData,
+			   uint64_t u64FileLength)
+{
+	if (pvFileData)
+	{
+		PortFileUnmap(pvFileData,
+					  u64FileLength);
+	}
+}
+
 uint64_t FileSize(SOSFile psFile)
 {
 	SFileInternal *psFileInternal = (SFileInternal *) psFile;
+	uint64_t u64Size;
+
+	u64Size = PortFileSize(psFileInternal->sFile);
+
+	// Counter mode files report the plaintext size
+	if (psFileInternal->psCrypt)
+	{
+		if (u64Size > psFileInternal->psCrypt->u32HeaderSize)
+		{
+			u64Size -= psFileInternal->psCrypt->u32HeaderSize;
+		}
+		else
+		{
+			u64Size = 0;
+		}
+	}
 
-	return(PortFileSize(psFileInternal->sFile));
+	return(u64Size);
 }
 
 EStatus FileSetAttributes(char *peFilename,
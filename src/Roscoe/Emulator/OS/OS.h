@@ -235,6 +235,11 @@ extern EStatus FileStat(char *peFilename,
 						uint64_t *pu64Timestamp,
 						uint64_t *pu64FileSize,
 						uint32_t *pu32FileAttributes);
+extern EStatus FileMap(char *peFilename,
+					   void **ppvFileData,
+					   uint64_t *pu64FileLength);
+extern void FileUnmap(void *pvFileData,
+					  uint64_t u64FileLength);
 
 // RTC
 extern uint64_t RTCGet(void);
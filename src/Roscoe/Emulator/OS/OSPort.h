@@ -95,6 +95,11 @@ extern EStatus PortFileStat(char *peFilename,
 							uint64_t *pu64Timestamp,
 							uint64_t *pu64FileSize,
 							uint32_t *pu32FileAttributes);
+extern EStatus PortFileMap(char *peFilename,
+						   void **ppvFileData,
+						   uint64_t *pu64FileLength);
+extern void PortFileUnmap(void *pvFileData,
+						  uint64_t u64FileLength);
 
 // Misc functions
 extern void OSPortSleep(uint64_t u64Milliseconds);
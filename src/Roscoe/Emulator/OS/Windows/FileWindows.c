@@ -608,6 +608,103 @@ errorExit:
 	return(eStatus);
 }
 
+EStatus PortFileMap(char *peFilename,
+					void **ppvFileData,
+					uint64_t *pu64FileLength)
+{
+	EStatus eStatus;
+	HANDLE hFile = INVALID_HANDLE_VALUE;
+	HANDLE hMapping = NULL;
+	LARGE_INTEGER sFileSize;
+	WCHAR eFilenameWide[MAX_PATH];
+	int32_t s32Result;
+
+	*ppvFileData = NULL;
+	*pu64FileLength = 0;
+
+	s32Result = MultiByteToWideChar(CP_UTF8,
+									0,
+									peFilename,
+									-1,
+									eFilenameWide,
+									ARRAYSIZE(eFilenameWide));
+
+	if (0 == s32Result)
+	{
+		eStatus = ESTATUS_INVALID_NAME;
+		goto errorExit;
+	}								
+
+	hFile = CreateFileW(eFilenameWide,
+						GENERIC_READ, 
+						FILE_SHARE_READ,  
+						NULL,  
+						OPEN_EXISTING,  
+						FILE_ATTRIBUTE_NORMAL, 
+						NULL);
+
+	if (INVALID_HANDLE_VALUE == hFile)
+	{
+		eStatus = ESTATUS_NO_FILE;
+		goto errorExit;
+	}
+
+	// Can't map an empty file
+	if ((FALSE == GetFileSizeEx(hFile,
+								&sFileSize)) ||
+		(0 == sFileSize.QuadPart))
+	{
+		eStatus = ESTATUS_INVALID_OBJECT;
+		goto errorExit;
+	}
+
+	hMapping = CreateFileMappingW(hFile,
+								  NULL,
+								  PAGE_READONLY,
+								  0,
+								  0,
+								  NULL);
+	if (NULL == hMapping)
+	{
+		eStatus = ESTATUS_INVALID_OBJECT;
+		goto errorExit;
+	}
+
+	*ppvFileData = MapViewOfFile(hMapping,
+								 FILE_MAP_READ,
+								 0,
+								 0,
+								 0);
+	if (NULL == *ppvFileData)
+	{
+		eStatus = ESTATUS_OUT_OF_MEMORY;
+		goto errorExit;
+	}
+
+	*pu64FileLength = (uint64_t) sFileSize.QuadPart;
+	eStatus = ESTATUS_OK;
+
+errorExit:
+	// The view keeps the mapping alive once it's created
+	if (hMapping)
+	{
+		(void) CloseHandle(hMapping);
+	}
+
+	if (hFile != INVALID_HANDLE_VALUE)
+	{
+		(void) CloseHandle(hFile);
+	}
+
+	return(eStatus);
+}
+
+void PortFileUnmap(void *pvFileData,
+				   uint64_t u64FileLength)
+{
+	(void) UnmapViewOfFile(pvFileData);
+}
+
 EStatus PortFileSetAttributes(char *peFilename,
 							  uint32_t u32Attributes)
 {
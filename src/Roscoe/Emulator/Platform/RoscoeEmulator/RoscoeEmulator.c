@@ -7,6 +7,9 @@
 #include "Platform/RoscoeEmulator/RoscoeEmulator.h"
 #include "Shared/Graphics/Window.h"
 #include "Shared/Graphics/Control.h"
+#include "Shared/Graphics/Blend.h"
+#include "Shared/Sound/SoundMix.h"
+#include "Shared/SHA256/sha256.h"
 #include "../../../Shared/68030\m68k.h"
 
 #define	CPU_SPEED	25000000
@@ -123,6 +126,9 @@ static UINT8 sg_u8RTCRegs[0x80];
 static const SCmdLineOption sg_sCommands[] =
 {
 	{"-fullscreen",		"Make the app full screen",					FALSE,		FALSE},
+	{"-blendbench",		"Benchmark the pixel blend kernels and exit",	FALSE,		FALSE},
+	{"-soundbench",		"Benchmark the sound mixing kernels and exit",	FALSE,		FALSE},
+	{"-imagecache",		"Directory to cache decoded images in",		FALSE,		TRUE},
 
 	// List terminator
 	{NULL}
@@ -967,6 +973,59 @@ static void KeyboardUpdate(void)
 	}
 }
 
+// Hash a loaded image and, if there's a "<image>.sha256" file next to it (in
+// sha256sum format), make sure it matches.
+static EStatus LoadROMVerify(char *peFilename,
+							 UINT8 *pu8Image,
+							 UINT64 u64Size)
+{
+	EStatus eStatus;
+	SOSFile sFile;
+	char eHashFilename[1024];
+	char eExpected[(SHA256_DIGEST_LENGTH * 2) + 1];
+	char eActual[(SHA256_DIGEST_LENGTH * 2) + 1];
+	UINT8 u8SHA256[SHA256_DIGEST_LENGTH];
+	UINT64 u64SizeRead = 0;
+	UINT32 u32Loop;
+
+	MySHA256_Digest(u8SHA256,
+					pu8Image,
+					(size_t) u64Size);
+
+	for (u32Loop = 0; u32Loop < SHA256_DIGEST_LENGTH; u32Loop++)
+	{
+		snprintf(&eActual[u32Loop << 1], 3, "%.2x", u8SHA256[u32Loop]);
+	}
+
+	snprintf(eHashFilename, sizeof(eHashFilename), "%s.sha256", peFilename);
+	eStatus = Filefopen(&sFile,
+						eHashFilename,
+						"rb");
+	if (eStatus != ESTATUS_OK)
+	{
+		// No hash to check against
+		DebugOut("'%s' SHA-256 %s (%s)\n", peFilename, eActual, MySHA256_GetKernelName());
+		return(ESTATUS_OK);
+	}
+
+	eStatus = Filefread((void *) eExpected, sizeof(eExpected) - 1, &u64SizeRead, sFile);
+	(void) Filefclose(&sFile);
+	ERR_GOTO();
+
+	eExpected[u64SizeRead] = '\0';
+	if (Sharedstrcasecmp(eExpected, eActual) != 0)
+	{
+		DebugOut("'%s' SHA-256 %s does not match '%s'\n", peFilename, eActual, eHashFilename);
+		eStatus = ESTATUS_VERSION_BAD_HASH;
+		goto errorExit;
+	}
+
+	DebugOut("'%s' SHA-256 %s verified\n", peFilename, eActual);
+
+errorExit:
+	return(eStatus);
+}
+
 static EStatus LoadROM(char *peFilename,
 					   UINT16 u16Offset,
 					   UINT8 *pu8LoadAddress,
@@ -993,6 +1052,11 @@ static EStatus LoadROM(char *peFilename,
 	{
 		DebugOut("Loaded '%s' - %u bytes at 0x%.4x\n", peFilename, (UINT32) u64SizeRead, u16Offset);
 		eStatus = Filefclose(&sFile);
+		ERR_GOTO();
+
+		eStatus = LoadROMVerify(peFilename,
+								pu8LoadAddress + u16Offset,
+								u64SizeRead);
 	}
 	else
 	{
@@ -1516,6 +1580,26 @@ int RoscoeEmulatorEntry(char *peCommandLine,
 						 NULL);
 	ERR_GOTO();
 
+	// Just benchmarking the pixel kernels?
+	if (CmdLineOption("-blendbench"))
+	{
+		BlendBenchmark();
+		goto errorExit;
+	}
+
+	// Or the sound mixer?
+	if (CmdLineOption("-soundbench"))
+	{
+		SoundMixBenchmark();
+		goto errorExit;
+	}
+
+	// Keep decoded images around between runs?
+	if (CmdLineOption("-imagecache"))
+	{
+		GraphicsImageCacheSetPath(CmdLineOptionValue("-imagecache"));
+	}
+
 	// Init the windowing subsystem
 	eStatus = WindowInit();
 	ERR_GOTO();
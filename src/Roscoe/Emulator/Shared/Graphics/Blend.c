@@ -0,0 +1,662 @@
+#include <string.h>
+#include "Shared/Shared.h"
+#include "Shared/SharedMisc.h"
+#include "Shared/Graphics/Graphics.h"
+#include "Shared/Graphics/Blend.h"
+
+// Fill, mirror copy and coverage kernels come in SSE2 and AVX2 versions on
+// x86. Other hosts only have the scalar ones.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define	BLEND_TARGET_AVX2
+#else
+#define	BLEND_TARGET_AVX2		__attribute__((target("avx2")))
+#endif
+
+// SSE2 is assumed whenever the compiler is allowed to use it. AVX2 is
+// picked by BlendInit() if SharedCPUFeaturesGet() reports it.
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define	BLEND_SSE2				1
+#define	BLEND_AVX2				1
+#endif
+#endif
+
+// Alpha channel mask of an RGBA pixel
+#define	BLEND_ALPHA_MASK		0xff000000
+
+// Set of kernels in use
+typedef struct SBlendKernels
+{
+	const char *peName;
+	void (*Fill)(uint32_t *pu32RGBADest,
+				 uint32_t u32RGBAFillColor,
+				 uint64_t u64Count);
+	void (*CopyMirror)(uint32_t *pu32RGBADest,
+					   uint32_t *pu32RGBASrc,
+					   uint64_t u64Count);
+	void (*CoverageSpan)(uint32_t *pu32RGBADest,
+						 uint8_t *pu8Coverage,
+						 uint32_t *pu32PixelTranslate,
+						 uint32_t u32Count);
+} SBlendKernels;
+
+// Composite one source pixel over a destination pixel. Color channels are
+// (dest * (256 - alpha) + src * alpha) >> 8 and the resulting alpha is the
+// saturated sum of both alphas. The SIMD kernels produce identical results.
+static uint32_t BlendPixel(uint32_t u32RGBADest,
+						   uint32_t u32RGBASrc)
+{
+	uint32_t u32Alpha = u32RGBASrc >> 24;
+	uint32_t u32InvAlpha = 0x100 - u32Alpha;
+	uint32_t u32RB;
+	uint32_t u32G;
+	uint32_t u32AlphaNew;
+
+	u32RB = (((u32InvAlpha * (u32RGBADest & 0xff00ff)) + (u32Alpha * (u32RGBASrc & 0xff00ff))) >> 8) & 0xff00ff;
+	u32G = (((u32InvAlpha * (u32RGBADest & 0x00ff00)) + (u32Alpha * (u32RGBASrc & 0x00ff00))) >> 8) & 0x00ff00;
+	u32AlphaNew = (u32RGBADest >> 24) + u32Alpha;
+	if (u32AlphaNew > 0xff)
+	{
+		u32AlphaNew = 0xff;
+	}
+
+	return(u32RB | u32G | (u32AlphaNew << 24));
+}
+
+static void BlendFillScalar(uint32_t *pu32RGBADest,
+							uint32_t u32RGBAFillColor,
+							uint64_t u64Count)
+{
+	while (u64Count)
+	{
+		*pu32RGBADest = u32RGBAFillColor;
+		++pu32RGBADest;
+		u64Count--;
+	}
+}
+
+static void BlendCopyMirrorScalar(uint32_t *pu32RGBADest,
+								  uint32_t *pu32RGBASrc,
+								  uint64_t u64Count)
+{
+	pu32RGBASrc += u64Count;
+	while (u64Count)
+	{
+		--pu32RGBASrc;
+		*pu32RGBADest = *pu32RGBASrc;
+		++pu32RGBADest;
+		u64Count--;
+	}
+}
+
+static void BlendCoverageSpanScalar(uint32_t *pu32RGBADest,
+									uint8_t *pu8Coverage,
+									uint32_t *pu32PixelTranslate,
+									uint32_t u32Count)
+{
+	while (u32Count)
+	{
+		uint32_t u32RGBASrc = pu32PixelTranslate[*pu8Coverage];
+		uint8_t u8Alpha = (uint8_t) (u32RGBASrc >> 24);
+
+		if (PIXEL_TRANSPARENT == u8Alpha)
+		{
+			// Don't do anything - completely transparent
+		}
+		else
+		if (PIXEL_OPAQUE == u8Alpha)
+		{
+			// Completely solid
+			*pu32RGBADest = u32RGBASrc;
+		}
+		else
+		{
+			// Gotta combine
+			*pu32RGBADest = BlendPixel(*pu32RGBADest,
+									   u32RGBASrc);
+		}
+
+		++pu8Coverage;
+		++pu32RGBADest;
+		u32Count--;
+	}
+}
+
+static const SBlendKernels sg_sBlendKernelsScalar =
+{
+	"scalar",
+	BlendFillScalar,
+	BlendCopyMirrorScalar,
+	BlendCoverageSpanScalar
+};
+
+#ifdef BLEND_SSE2
+
+// Blends 4 source pixels over 4 destination pixels. See BlendPixel().
+static __m128i BlendPixels4SSE2(__m128i sDest,
+								__m128i sSrc)
+{
+	__m128i sZero = _mm_setzero_si128();
+	__m128i s256 = _mm_set1_epi16(0x100);
+	__m128i sAlphaMask = _mm_set1_epi32((int) BLEND_ALPHA_MASK);
+	__m128i sSrcLo = _mm_unpacklo_epi8(sSrc, sZero);
+	__m128i sSrcHi = _mm_unpackhi_epi8(sSrc, sZero);
+	__m128i sDestLo = _mm_unpacklo_epi8(sDest, sZero);
+	__m128i sDestHi = _mm_unpackhi_epi8(sDest, sZero);
+	__m128i sAlphaLo;
+	__m128i sAlphaHi;
+	__m128i sBlended;
+	__m128i sAlpha;
+	__m128i sOpaque;
+
+	// Broadcast each pixel's alpha across its four 16 bit channels
+	sAlphaLo = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sSrcLo, 0xff), 0xff);
+	sAlphaHi = _mm_shufflehi_epi16(_mm_shufflelo_epi16(sSrcHi, 0xff), 0xff);
+
+	// (dest * (256 - alpha) + src * alpha) >> 8 - max 0xff00, so it fits in 16 bits
+	sDestLo = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(sDestLo, _mm_sub_epi16(s256, sAlphaLo)),
+										   _mm_mullo_epi16(sSrcLo, sAlphaLo)), 8);
+	sDestHi = _mm_srli_epi16(_mm_add_epi16(_mm_mullo_epi16(sDestHi, _mm_sub_epi16(s256, sAlphaHi)),
+										   _mm_mullo_epi16(sSrcHi, sAlphaHi)), 8);
+	sBlended = _mm_packus_epi16(sDestLo, sDestHi);
+
+	// Alpha is a saturated add
+	sAlpha = _mm_and_si128(_mm_adds_epu8(sDest, sSrc), sAlphaMask);
+	sBlended = _mm_or_si128(_mm_andnot_si128(sAlphaMask, sBlended), sAlpha);
+
+	// Fully opaque source pixels are copied as-is
+	sOpaque = _mm_cmpeq_epi32(_mm_and_si128(sSrc, sAlphaMask), sAlphaMask);
+	return(_mm_or_si128(_mm_and_si128(sOpaque, sSrc), _mm_andnot_si128(sOpaque, sBlended)));
+}
+
+static void BlendFillSSE2(uint32_t *pu32RGBADest,
+						  uint32_t u32RGBAFillColor,
+						  uint64_t u64Count)
+{
+	__m128i sFill = _mm_set1_epi32((int) u32RGBAFillColor);
+
+	// Get the destination aligned
+	while ((u64Count) && (((uintptr_t) pu32RGBADest) & 0xf))
+	{
+		*pu32RGBADest = u32RGBAFillColor;
+		++pu32RGBADest;
+		u64Count--;
+	}
+
+	while (u64Count >= 16)
+	{
+		_mm_store_si128((__m128i *) (pu32RGBADest + 0), sFill);
+		_mm_store_si128((__m128i *) (pu32RGBADest + 4), sFill);
+		_mm_store_si128((__m128i *) (pu32RGBADest + 8), sFill);
+		_mm_store_si128((__m128i *) (pu32RGBADest + 12), sFill);
+		pu32RGBADest += 16;
+		u64Count -= 16;
+	}
+
+	while (u64Count >= 4)
+	{
+		_mm_store_si128((__m128i *) pu32RGBADest, sFill);
+		pu32RGBADest += 4;
+		u64Count -= 4;
+	}
+
+	BlendFillScalar(pu32RGBADest,
+					u32RGBAFillColor,
+					u64Count);
+}
+
+static void BlendCopyMirrorSSE2(uint32_t *pu32RGBADest,
+								uint32_t *pu32RGBASrc,
+								uint64_t u64Count)
+{
+	// Walk the source backwards 4 pixels at a time, reversing each group
+	while (u64Count >= 4)
+	{
+		__m128i sPixels;
+
+		sPixels = _mm_loadu_si128((__m128i *) (pu32RGBASrc + u64Count - 4));
+		_mm_storeu_si128((__m128i *) pu32RGBADest, _mm_shuffle_epi32(sPixels, _MM_SHUFFLE(0, 1, 2, 3)));
+		pu32RGBADest += 4;
+		u64Count -= 4;
+	}
+
+	BlendCopyMirrorScalar(pu32RGBADest,
+						  pu32RGBASrc,
+						  u64Count);
+}
+
+static void BlendCoverageSpanSSE2(uint32_t *pu32RGBADest,
+								  uint8_t *pu8Coverage,
+								  uint32_t *pu32PixelTranslate,
+								  uint32_t u32Count)
+{
+	__m128i sAlphaMask = _mm_set1_epi32((int) BLEND_ALPHA_MASK);
+	__m128i sZero = _mm_setzero_si128();
+
+	while (u32Count >= 4)
+	{
+		__m128i sSrc;
+		__m128i sAlpha;
+
+		sSrc = _mm_set_epi32((int) pu32PixelTranslate[pu8Coverage[3]],
+							 (int) pu32PixelTranslate[pu8Coverage[2]],
+							 (int) pu32PixelTranslate[pu8Coverage[1]],
+							 (int) pu32PixelTranslate[pu8Coverage[0]]);
+		sAlpha = _mm_and_si128(sSrc, sAlphaMask);
+
+		if (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi32(sAlpha, sZero)))
+		{
+			// All transparent - glyph background is the common case
+		}
+		else
+		if (0xffff == _mm_movemask_epi8(_mm_cmpeq_epi32(sAlpha, sAlphaMask)))
+		{
+			// All solid
+			_mm_storeu_si128((__m128i *) pu32RGBADest, sSrc);
+		}
+		else
+		{
+			_mm_storeu_si128((__m128i *) pu32RGBADest, BlendPixels4SSE2(_mm_loadu_si128((__m128i *) pu32RGBADest),
+																		 sSrc));
+		}
+
+		pu8Coverage += 4;
+		pu32RGBADest += 4;
+		u32Count -= 4;
+	}
+
+	BlendCoverageSpanScalar(pu32RGBADest,
+							pu8Coverage,
+							pu32PixelTranslate,
+							u32Count);
+}
+
+static const SBlendKernels sg_sBlendKernelsSSE2 =
+{
+	"SSE2",
+	BlendFillSSE2,
+	BlendCopyMirrorSSE2,
+	BlendCoverageSpanSSE2
+};
+
+#endif // BLEND_SSE2
+
+#ifdef BLEND_AVX2
+
+// 8 Pixel version of BlendPixels4SSE2(). Unpack/pack both operate within
+// 128 bit lanes, so pixel order is preserved.
+static BLEND_TARGET_AVX2 __m256i BlendPixels8AVX2(__m256i sDest,
+												  __m256i sSrc)
+{
+	__m256i sZero = _mm256_setzero_si256();
+	__m256i s256 = _mm256_set1_epi16(0x100);
+	__m256i sAlphaMask = _mm256_set1_epi32((int) BLEND_ALPHA_MASK);
+	__m256i sSrcLo = _mm256_unpacklo_epi8(sSrc, sZero);
+	__m256i sSrcHi = _mm256_unpackhi_epi8(sSrc, sZero);
+	__m256i sDestLo = _mm256_unpacklo_epi8(sDest, sZero);
+	__m256i sDestHi = _mm256_unpackhi_epi8(sDest, sZero);
+	__m256i sAlphaLo;
+	__m256i sAlphaHi;
+	__m256i sBlended;
+	__m256i sAlpha;
+	__m256i sOpaque;
+
+	sAlphaLo = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sSrcLo, 0xff), 0xff);
+	sAlphaHi = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(sSrcHi, 0xff), 0xff);
+
+	sDestLo = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(sDestLo, _mm256_sub_epi16(s256, sAlphaLo)),
+												 _mm256_mullo_epi16(sSrcLo, sAlphaLo)), 8);
+	sDestHi = _mm256_srli_epi16(_mm256_add_epi16(_mm256_mullo_epi16(sDestHi, _mm256_sub_epi16(s256, sAlphaHi)),
+												 _mm256_mullo_epi16(sSrcHi, sAlphaHi)), 8);
+	sBlended = _mm256_packus_epi16(sDestLo, sDestHi);
+
+	sAlpha = _mm256_and_si256(_mm256_adds_epu8(sDest, sSrc), sAlphaMask);
+	sBlended = _mm256_or_si256(_mm256_andnot_si256(sAlphaMask, sBlended), sAlpha);
+
+	sOpaque = _mm256_cmpeq_epi32(_mm256_and_si256(sSrc, sAlphaMask), sAlphaMask);
+	return(_mm256_blendv_epi8(sBlended, sSrc, sOpaque));
+}
+
+static BLEND_TARGET_AVX2 void BlendFillAVX2(uint32_t *pu32RGBADest,
+											uint32_t u32RGBAFillColor,
+											uint64_t u64Count)
+{
+	__m256i sFill = _mm256_set1_epi32((int) u32RGBAFillColor);
+
+	while ((u64Count) && (((uintptr_t) pu32RGBADest) & 0x1f))
+	{
+		*pu32RGBADest = u32RGBAFillColor;
+		++pu32RGBADest;
+		u64Count--;
+	}
+
+	while (u64Count >= 32)
+	{
+		_mm256_store_si256((__m256i *) (pu32RGBADest + 0), sFill);
+		_mm256_store_si256((__m256i *) (pu32RGBADest + 8), sFill);
+		_mm256_store_si256((__m256i *) (pu32RGBADest + 16), sFill);
+		_mm256_store_si256((__m256i *) (pu32RGBADest + 24), sFill);
+		pu32RGBADest += 32;
+		u64Count -= 32;
+	}
+
+	while (u64Count >= 8)
+	{
+		_mm256_store_si256((__m256i *) pu32RGBADest, sFill);
+		pu32RGBADest += 8;
+		u64Count -= 8;
+	}
+
+	BlendFillScalar(pu32RGBADest,
+					u32RGBAFillColor,
+					u64Count);
+}
+
+static BLEND_TARGET_AVX2 void BlendCopyMirrorAVX2(uint32_t *pu32RGBADest,
+												  uint32_t *pu32RGBASrc,
+												  uint64_t u64Count)
+{
+	__m256i sReverse = _mm256_set_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+
+	while (u64Count >= 8)
+	{
+		__m256i sPixels;
+
+		sPixels = _mm256_loadu_si256((__m256i *) (pu32RGBASrc + u64Count - 8));
+		_mm256_storeu_si256((__m256i *) pu32RGBADest, _mm256_permutevar8x32_epi32(sPixels, sReverse));
+		pu32RGBADest += 8;
+		u64Count -= 8;
+	}
+
+	BlendCopyMirrorScalar(pu32RGBADest,
+						  pu32RGBASrc,
+						  u64Count);
+}
+
+static BLEND_TARGET_AVX2 void BlendCoverageSpanAVX2(uint32_t *pu32RGBADest,
+													uint8_t *pu8Coverage,
+													uint32_t *pu32PixelTranslate,
+													uint32_t u32Count)
+{
+	__m256i sAlphaMask = _mm256_set1_epi32((int) BLEND_ALPHA_MASK);
+	__m256i sZero = _mm256_setzero_si256();
+
+	while (u32Count >= 8)
+	{
+		__m256i sIndex;
+		__m256i sSrc;
+		__m256i sAlpha;
+
+		// Widen 8 coverage bytes to indexes and gather from the translation table
+		sIndex = _mm256_cvtepu8_epi32(_mm_loadl_epi64((__m128i *) pu8Coverage));
+		sSrc = _mm256_i32gather_epi32((const int *) pu32PixelTranslate, sIndex, sizeof(*pu32PixelTranslate));
+		sAlpha = _mm256_and_si256(sSrc, sAlphaMask);
+
+		if (-1 == _mm256_movemask_epi8(_mm256_cmpeq_epi32(sAlpha, sZero)))
+		{
+			// All transparent
+		}
+		else
+		if (-1 == _mm256_movemask_epi8(_mm256_cmpeq_epi32(sAlpha, sAlphaMask)))
+		{
+			// All solid
+			_mm256_storeu_si256((__m256i *) pu32RGBADest, sSrc);
+		}
+		else
+		{
+			_mm256_storeu_si256((__m256i *) pu32RGBADest, BlendPixels8AVX2(_mm256_loadu_si256((__m256i *) pu32RGBADest),
+																			sSrc));
+		}
+
+		pu8Coverage += 8;
+		pu32RGBADest += 8;
+		u32Count -= 8;
+	}
+
+	// Remaining 0-7 pixels go through the SSE2 version
+	BlendCoverageSpanSSE2(pu32RGBADest,
+						  pu8Coverage,
+						  pu32PixelTranslate,
+						  u32Count);
+}
+
+static const SBlendKernels sg_sBlendKernelsAVX2 =
+{
+	"AVX2",
+	BlendFillAVX2,
+	BlendCopyMirrorAVX2,
+	BlendCoverageSpanAVX2
+};
+
+#endif // BLEND_AVX2
+
+// Currently selected kernels. Scalar until BlendInit() runs.
+static const SBlendKernels *sg_psBlendKernels = &sg_sBlendKernelsScalar;
+
+void BlendFill(uint32_t *pu32RGBADest,
+			   uint32_t u32RGBAFillColor,
+			   uint64_t u64Count)
+{
+	sg_psBlendKernels->Fill(pu32RGBADest,
+							u32RGBAFillColor,
+							u64Count);
+}
+
+// The C runtime's memcpy() is already vectorized on every host we build for
+void BlendCopy(uint32_t *pu32RGBADest,
+			   uint32_t *pu32RGBASrc,
+			   uint64_t u64Count)
+{
+	memcpy((void *) pu32RGBADest, (void *) pu32RGBASrc, (size_t) (u64Count * sizeof(*pu32RGBADest)));
+}
+
+void BlendCopyMirror(uint32_t *pu32RGBADest,
+					 uint32_t *pu32RGBASrc,
+					 uint64_t u64Count)
+{
+	sg_psBlendKernels->CopyMirror(pu32RGBADest,
+								  pu32RGBASrc,
+								  u64Count);
+}
+
+void BlendCoverageSpan(uint32_t *pu32RGBADest,
+					   uint8_t *pu8Coverage,
+					   uint32_t *pu32PixelTranslate,
+					   uint32_t u32Count)
+{
+	sg_psBlendKernels->CoverageSpan(pu32RGBADest,
+									pu8Coverage,
+									pu32PixelTranslate,
+									u32Count);
+}
+
+const char *BlendGetKernelName(void)
+{
+	return(sg_psBlendKernels->peName);
+}
+
+void BlendInit(void)
+{
+	sg_psBlendKernels = &sg_sBlendKernelsScalar;
+
+#ifdef BLEND_SSE2
+	sg_psBlendKernels = &sg_sBlendKernelsSSE2;
+#endif
+
+#ifdef BLEND_AVX2
+	if (SharedCPUFeaturesGet() & SHARED_CPU_AVX2)
+	{
+		sg_psBlendKernels = &sg_sBlendKernelsAVX2;
+	}
+#endif
+}
+
+// Benchmark surface - one 1080p frame's worth of pixels, processed a line at
+// a time the same way the font renderer and fill routines do.
+#define	BLEND_BENCH_XSIZE		1920
+#define	BLEND_BENCH_YSIZE		1080
+#define	BLEND_BENCH_PASSES		20
+
+typedef enum
+{
+	EBLENDBENCH_FILL,
+	EBLENDBENCH_COPY_MIRROR,
+	EBLENDBENCH_COVERAGE,
+
+	EBLENDBENCH_COUNT
+} EBlendBench;
+
+static const char *sg_peBlendBenchNames[EBLENDBENCH_COUNT] =
+{
+	"Fill",
+	"Mirror copy",
+	"Coverage blend"
+};
+
+// Runs one benchmark and returns pixels/second
+static double BlendBenchmarkRun(const SBlendKernels *psKernels,
+								EBlendBench eBench,
+								uint32_t *pu32RGBADest,
+								uint32_t *pu32RGBASrc,
+								uint8_t *pu8Coverage,
+								uint32_t *pu32PixelTranslate)
+{
+	uint64_t u64Start;
+	uint64_t u64Elapsed;
+	uint32_t u32Pass;
+	uint32_t u32Line;
+
+	u64Start = SDL_GetPerformanceCounter();
+	for (u32Pass = 0; u32Pass < BLEND_BENCH_PASSES; u32Pass++)
+	{
+		for (u32Line = 0; u32Line < BLEND_BENCH_YSIZE; u32Line++)
+		{
+			uint32_t u32Offset = u32Line * BLEND_BENCH_XSIZE;
+
+			if (EBLENDBENCH_FILL == eBench)
+			{
+				psKernels->Fill(pu32RGBADest + u32Offset,
+								MAKERGBA(0x20, 0x40, 0x80, 0xff) + u32Pass,
+								BLEND_BENCH_XSIZE);
+			}
+			else
+			if (EBLENDBENCH_COPY_MIRROR == eBench)
+			{
+				psKernels->CopyMirror(pu32RGBADest + u32Offset,
+									  pu32RGBASrc + u32Offset,
+									  BLEND_BENCH_XSIZE);
+			}
+			else
+			{
+				psKernels->CoverageSpan(pu32RGBADest + u32Offset,
+										pu8Coverage + u32Offset,
+										pu32PixelTranslate,
+										BLEND_BENCH_XSIZE);
+			}
+		}
+	}
+
+	u64Elapsed = SDL_GetPerformanceCounter() - u64Start;
+	if (0 == u64Elapsed)
+	{
+		u64Elapsed = 1;
+	}
+
+	return(((double) BLEND_BENCH_XSIZE * (double) BLEND_BENCH_YSIZE * (double) BLEND_BENCH_PASSES *
+			(double) SDL_GetPerformanceFrequency()) / (double) u64Elapsed);
+}
+
+void BlendBenchmark(void)
+{
+	EStatus eStatus = ESTATUS_OK;
+	uint32_t *pu32RGBADest = NULL;
+	uint32_t *pu32RGBADestCheck = NULL;
+	uint32_t *pu32RGBASrc = NULL;
+	uint8_t *pu8Coverage = NULL;
+	uint32_t u32PixelTranslate[0x100];
+	uint32_t u32Loop;
+	uint32_t u32Seed = 0x1234567;
+	EBlendBench eBench;
+
+	BlendInit();
+
+	MEMALLOC(pu32RGBADest, BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE * sizeof(*pu32RGBADest));
+	MEMALLOC(pu32RGBADestCheck, BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE * sizeof(*pu32RGBADestCheck));
+	MEMALLOC(pu32RGBASrc, BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE * sizeof(*pu32RGBASrc));
+	MEMALLOC(pu8Coverage, BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE * sizeof(*pu8Coverage));
+
+	// Same table layout the font renderer builds - alpha is the coverage value
+	for (u32Loop = 0; u32Loop < (sizeof(u32PixelTranslate) / sizeof(u32PixelTranslate[0])); u32Loop++)
+	{
+		u32PixelTranslate[u32Loop] = MAKERGBA((0xff * u32Loop) >> 8, (0x80 * u32Loop) >> 8, 0, u32Loop);
+	}
+
+	// Glyph-like coverage: mostly empty or solid, with antialiased edges
+	for (u32Loop = 0; u32Loop < (BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE); u32Loop++)
+	{
+		uint8_t u8Coverage;
+
+		u32Seed = (u32Seed * 1103515245) + 12345;
+		u8Coverage = (uint8_t) (u32Seed >> 16);
+		if (u8Coverage < 0x80)
+		{
+			u8Coverage = PIXEL_TRANSPARENT;
+		}
+		else
+		if (u8Coverage >= 0xc0)
+		{
+			u8Coverage = PIXEL_OPAQUE;
+		}
+
+		pu8Coverage[u32Loop] = u8Coverage;
+		pu32RGBASrc[u32Loop] = u32Seed;
+	}
+
+	DebugOut("Blend benchmark - %ux%u pixels, %u passes, kernels=%s\n", BLEND_BENCH_XSIZE, BLEND_BENCH_YSIZE, BLEND_BENCH_PASSES, BlendGetKernelName());
+
+	for (eBench = EBLENDBENCH_FILL; eBench < EBLENDBENCH_COUNT; eBench++)
+	{
+		double dScalar;
+		double dSelected;
+		bool bMatch;
+
+		memcpy((void *) pu32RGBADest, (void *) pu32RGBASrc, BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE * sizeof(*pu32RGBADest));
+		dScalar = BlendBenchmarkRun(&sg_sBlendKernelsScalar,
+									eBench,
+									pu32RGBADest,
+									pu32RGBASrc,
+									pu8Coverage,
+									u32PixelTranslate);
+
+		memcpy((void *) pu32RGBADestCheck, (void *) pu32RGBASrc, BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE * sizeof(*pu32RGBADestCheck));
+		dSelected = BlendBenchmarkRun(sg_psBlendKernels,
+									  eBench,
+									  pu32RGBADestCheck,
+									  pu32RGBASrc,
+									  pu8Coverage,
+									  u32PixelTranslate);
+
+		// Both runs did identical work so the results must match
+		bMatch = (0 == memcmp((void *) pu32RGBADest, (void *) pu32RGBADestCheck, BLEND_BENCH_XSIZE * BLEND_BENCH_YSIZE * sizeof(*pu32RGBADest)));
+
+		DebugOut("  %-16s scalar %8.1f Mpixels/sec, %-6s %8.1f Mpixels/sec (%.2fx)%s\n",
+				 sg_peBlendBenchNames[eBench],
+				 dScalar / 1000000.0,
+				 BlendGetKernelName(),
+				 dSelected / 1000000.0,
+				 dSelected / dScalar,
+				 bMatch ? "" : " - MISMATCH");
+	}
+
+errorExit:
+	if (eStatus != ESTATUS_OK)
+	{
+		DebugOut("Blend benchmark failed - %s\n", GetErrorText(eStatus));
+	}
+
+	SafeMemFree(pu32RGBADest);
+	SafeMemFree(pu32RGBADestCheck);
+	SafeMemFree(pu32RGBASrc);
+	SafeMemFree(pu8Coverage);
+}
@@ -0,0 +1,40 @@
+#ifndef _BLEND_H_
+#define _BLEND_H_
+
+// Pixel kernels used for software compositing of RGBA images. Each kernel
+// has a scalar implementation plus SSE2/AVX2 variants that are selected at
+// runtime by BlendInit() based on what the host CPU supports.
+
+// Fill u64Count pixels with u32RGBAFillColor
+extern void BlendFill(uint32_t *pu32RGBADest,
+					  uint32_t u32RGBAFillColor,
+					  uint64_t u64Count);
+
+// Copy u64Count pixels (source and destination must not overlap)
+extern void BlendCopy(uint32_t *pu32RGBADest,
+					  uint32_t *pu32RGBASrc,
+					  uint64_t u64Count);
+
+// Copy u64Count pixels, mirrored horizontally. pu32RGBASrc points to the
+// leftmost source pixel, which winds up as the rightmost destination pixel.
+extern void BlendCopyMirror(uint32_t *pu32RGBADest,
+							uint32_t *pu32RGBASrc,
+							uint64_t u64Count);
+
+// Composite a span of 8 bit coverage values (font glyph pixels) onto the
+// destination through a 256 entry coverage->RGBA translation table.
+extern void BlendCoverageSpan(uint32_t *pu32RGBADest,
+							  uint8_t *pu8Coverage,
+							  uint32_t *pu32PixelTranslate,
+							  uint32_t u32Count);
+
+// Returns the name of the kernel set currently in use ("scalar", "SSE2", "AVX2")
+extern const char *BlendGetKernelName(void);
+
+// Select the best kernels for this CPU
+extern void BlendInit(void);
+
+// Time the scalar kernels against the selected kernels and report pixels/sec
+extern void BlendBenchmark(void);
+
+#endif
@@ -104,7 +104,6 @@ errorExit:
 EStatus ControlDestroyCallback(EControlHandle eControlHandle)
 {
 	EStatus eStatus;
-	bool bUpdate = false;
 	SControl *psControl = NULL;
 
 	// Get the psControl pointer
@@ -117,8 +116,12 @@ EStatus ControlDestroyCallback(EControlHandle eControlHandle)
 							ESTATUS_OK);
 	ERR_GOTO();
 
-	// Only do a window update if the control is visible
-	bUpdate = psControl->bVisible;
+	// Only do a window update if the control is visible (and do it while we
+	// still know where it was)
+	if (psControl->bVisible)
+	{
+		ControlUpdated(psControl);
+	}
 
 	// Destroy the control
 	eStatus = HandleDeallocate(sg_psControlHandlePool,
@@ -126,11 +129,6 @@ EStatus ControlDestroyCallback(EControlHandle eControlHandle)
 							   ESTATUS_OK);
 
 errorExit:
-	if (bUpdate)
-	{
-		WindowUpdated();
-	}
-
 	return(eStatus);
 }
 
@@ -216,7 +214,7 @@ EStatus ControlSetVisible(EControlHandle eControlHandle,
 errorExit:
 	if (bUpdate)
 	{
-		WindowUpdated();
+		ControlUpdated(psControl);
 	}
 
 	return(eStatus);
@@ -257,7 +255,7 @@ EStatus ControlSetDisable(EControlHandle eControlHandle,
 errorExit:
 	if (bUpdate)
 	{
-		WindowUpdated();
+		ControlUpdated(psControl);
 	}
 
 	return(eStatus);
@@ -294,6 +292,12 @@ EStatus ControlSetAngle(EControlHandle eControlHandle,
 		bUpdate = false;
 	}
 
+	// Redraw where it used to be
+	if (bUpdate)
+	{
+		ControlUpdated(psControl);
+	}
+
 	psControl->dAngle = dAngle;
 
 	if (psControl->psMethods->Angle)
@@ -305,7 +309,7 @@ EStatus ControlSetAngle(EControlHandle eControlHandle,
 	// If the angle has changed and the control is visible, then update it
 	if (bUpdate)
 	{
-		WindowUpdated();
+		ControlUpdated(psControl);
 	}
 
 errorExit:
@@ -341,13 +345,19 @@ EStatus ControlSetOriginCenter(EControlHandle eControlHandle,
 		bUpdate = false;
 	}
 
+	// Redraw where it used to be
+	if (bUpdate)
+	{
+		ControlUpdated(psControl);
+	}
+
 	// Set center origin regardless of whether or not we're updating the window
 	psControl->bOriginCenter = bOriginCenter;
 
 	// If the angle has changed and the control is visible, then update it
 	if (bUpdate)
 	{
-		WindowUpdated();
+		ControlUpdated(psControl);
 	}
 
 errorExit:
@@ -418,6 +428,58 @@ uint32_t ControlGetGfxAttributes(SControl *psControl)
 	return(u32Attributes);
 }
 
+// Queues a redraw of the (window relative) area this control draws into. Only
+// call with the control's pointer still valid. Controls that don't promise to
+// stay inside their bounding box get a full window update.
+void ControlUpdated(SControl *psControl)
+{
+	int32_t s32XPos = psControl->s32XPos;
+	int32_t s32YPos = psControl->s32YPos;
+	uint32_t u32XSize = psControl->u32XSize;
+	uint32_t u32YSize = psControl->u32YSize;
+
+	if ((NULL == psControl->psMethods) ||
+		(false == psControl->psMethods->bDrawsInBounds))
+	{
+		WindowUpdated();
+		return;
+	}
+
+	if (psControl->dAngle != 0.0)
+	{
+		double dXFar = (double) u32XSize;
+		double dYFar = (double) u32YSize;
+		uint32_t u32Radius;
+
+		// Rotation pivots on the control's position, so anything within reach
+		// of its furthest corner can get touched
+		if (psControl->bOriginCenter)
+		{
+			dXFar /= 2.0;
+			dYFar /= 2.0;
+		}
+
+		u32Radius = (uint32_t) ceil(sqrt((dXFar * dXFar) + (dYFar * dYFar)));
+		s32XPos -= (int32_t) u32Radius;
+		s32YPos -= (int32_t) u32Radius;
+		u32XSize = u32Radius << 1;
+		u32YSize = u32Radius << 1;
+	}
+	else
+	if (psControl->bOriginCenter)
+	{
+		s32XPos -= (int32_t) ((u32XSize + 1) >> 1);
+		s32YPos -= (int32_t) ((u32YSize + 1) >> 1);
+	}
+
+	// A pixel of slop on each side for filtering
+	WindowUpdatedRegion(psControl->eWindowHandle,
+						s32XPos - 1,
+						s32YPos - 1,
+						u32XSize + 2,
+						u32YSize + 2);
+}
+
 EStatus ControlSetFlip(EControlHandle eControlHandle,
 							  bool bHFlip,
 							  bool bVFlip)
@@ -457,7 +519,7 @@ EStatus ControlSetFlip(EControlHandle eControlHandle,
 errorExit:
 	if (bUpdate)
 	{
-		WindowUpdated();
+		ControlUpdated(psControl);
 	}
 
 	return(eStatus);
@@ -601,10 +663,14 @@ EStatus ControlSetPosition(EControlHandle eControlHandle,
 	ERR_GOTO();
 
 	// If our x/y position has changed and the control is visible, do an update
-	if ((psControl->s32XPos != s32WindowXPos) ||
-		(psControl->s32YPos != s32WindowYPos))
+	if (((psControl->s32XPos != s32WindowXPos) ||
+		 (psControl->s32YPos != s32WindowYPos)) &&
+		(psControl->bVisible))
 	{
 		bUpdated = true;
+
+		// Redraw where it used to be
+		ControlUpdated(psControl);
 	}
 	
 	// Set the new X/Y position of this control
@@ -619,6 +685,12 @@ EStatus ControlSetPosition(EControlHandle eControlHandle,
 												 s32WindowYPos);
 	}
 
+	// And where it is now
+	if (bUpdated)
+	{
+		ControlUpdated(psControl);
+	}
+
 	// Time to unlock
 	eStatus = ControlSetLock(eControlHandle,
 							 false,
@@ -627,11 +699,6 @@ EStatus ControlSetPosition(EControlHandle eControlHandle,
 	ERR_GOTO();
 
 errorExit:
-	if (bUpdated)
-	{
-		WindowUpdated();
-	}
-
 	return(eStatus);
 }
 
@@ -1437,6 +1504,12 @@ EStatus ControlSetSize(EControlHandle eControlHandle,
 							 ESTATUS_OK);
 	ERR_GOTO();
 
+	// Redraw the old size
+	if (psControl->bVisible)
+	{
+		ControlUpdated(psControl);
+	}
+
 	psControl->u32XSize = u32XSize;
 	psControl->u32YSize = u32YSize;
 
@@ -1447,16 +1520,17 @@ EStatus ControlSetSize(EControlHandle eControlHandle,
 											 u32YSize);
 	}
 
+	// ...and the new one
+	if (psControl->bVisible)
+	{
+		ControlUpdated(psControl);
+	}
+
 	eStatus = ControlSetLock(eControlHandle,
 							 false,
 							 &psControl,
 							 eStatus);
 errorExit:
-	if (ESTATUS_OK == eStatus)
-	{
-		WindowUpdated();
-	}
-
 	return(eStatus);
 }
 
@@ -127,6 +127,8 @@ typedef struct SControlMethods
 	EStatus (*Size)(struct SControl *psControl,				// Called when the control's size needs to be set
 					uint32_t u32XSize,
 					uint32_t u32YSize);
+
+	bool bDrawsInBounds;									// true If Draw never touches anything outside of the control's bounding box
 } SControlMethods;
 
 // Control list
@@ -275,6 +277,7 @@ extern EStatus ControlSetMethodInterceptTree(EControlHandle eControlInterceptorH
 											 SControlMethods *psInterceptedMethodTable);
 extern bool ControlIsChild(SControl *psControl,
 						   EControlHandle eChildHandle);
+extern void ControlUpdated(SControl *psControl);
 
 // Public APIs meant to be used by UI code
 extern EStatus ControlDestroy(EControlHandle *peControlHandle);
@@ -112,6 +112,7 @@ static SControlMethods sg_sControlImageMethods =
 	NULL,										// Periodic timer
 	NULL,										// Mouseover
 	NULL,										// Size
+	true,										// Draws within its bounding box
 };
 
 EStatus ControlImageCreate(EWindowHandle eWindowHandle,
@@ -134,11 +135,12 @@ EStatus ControlImageCreate(EWindowHandle eWindowHandle,
 	return(eStatus);
 }
 
-EStatus ControlImageSetAssets(EControlImageHandle eControlImageHandle,
-							  uint32_t *pu32RGBAImage,
-							  uint32_t u32XSize,
-							  uint32_t u32YSize,
-							  bool bAutoDeallocate)
+static EStatus ControlImageSetAssetsInternal(EControlImageHandle eControlImageHandle,
+											 uint32_t *pu32RGBAImage,
+											 uint32_t u32XSize,
+											 uint32_t u32YSize,
+											 bool bAutoDeallocate,
+											 bool bShared)
 {
 	EStatus eStatus;
 	bool bLocked = false;
@@ -154,15 +156,31 @@ EStatus ControlImageSetAssets(EControlImageHandle eControlImageHandle,
 
 	psControlImage = (SControlImage *) psControl->pvControlSpecificData;
 
+	// Redraw whatever the old image covered
+	if (psControl->bVisible)
+	{
+		ControlUpdated(psControl);
+	}
+
 	// Clear the existing image
 	GraphicsClearImage(psControlImage->psGraphicsImage);
 
 	// Now copy in the goodies
-	GraphicsSetImage(psControlImage->psGraphicsImage,
-					 pu32RGBAImage,
-					 u32XSize,
-					 u32YSize,
-					 bAutoDeallocate);
+	if (bShared)
+	{
+		GraphicsSetImageShared(psControlImage->psGraphicsImage,
+							   pu32RGBAImage,
+							   u32XSize,
+							   u32YSize);
+	}
+	else
+	{
+		GraphicsSetImage(psControlImage->psGraphicsImage,
+						 pu32RGBAImage,
+						 u32XSize,
+						 u32YSize,
+						 bAutoDeallocate);
+	}
 
 	psControl->u32XSize = u32XSize;
 	psControl->u32YSize = u32YSize;
@@ -171,7 +189,7 @@ EStatus ControlImageSetAssets(EControlImageHandle eControlImageHandle,
 	// do a window update
 	if (psControl->bVisible)
 	{
-		WindowUpdated();
+		ControlUpdated(psControl);
 	}
 
 errorExit:
@@ -183,6 +201,20 @@ errorExit:
 	return(eStatus);
 }
 
+EStatus ControlImageSetAssets(EControlImageHandle eControlImageHandle,
+							  uint32_t *pu32RGBAImage,
+							  uint32_t u32XSize,
+							  uint32_t u32YSize,
+							  bool bAutoDeallocate)
+{
+	return(ControlImageSetAssetsInternal(eControlImageHandle,
+										 pu32RGBAImage,
+										 u32XSize,
+										 u32YSize,
+										 bAutoDeallocate,
+										 false));
+}
+
 EStatus ControlImageSetFromFile(EControlImageHandle eControlImageHandle,
 								char *peImageFilename)
 {
@@ -194,26 +226,27 @@ EStatus ControlImageSetFromFile(EControlImageHandle eControlImageHandle,
 	uint32_t u32XSize;
 	uint32_t u32YSize;
 
-	// Load an image
-	eStatus = GraphicsLoadImage(peImageFilename,
-								&pu32RGBA,
-								&u32XSize,
-								&u32YSize);
+	// Load an image (shared with anything else using the same artwork)
+	eStatus = GraphicsLoadImageShared(peImageFilename,
+									  &pu32RGBA,
+									  &u32XSize,
+									  &u32YSize);
 	ERR_GOTO();
 
 	// Go set the assets
-	eStatus = ControlImageSetAssets(eControlImageHandle,
-									pu32RGBA,
-									u32XSize,
-									u32YSize,
-									true);
+	eStatus = ControlImageSetAssetsInternal(eControlImageHandle,
+											pu32RGBA,
+											u32XSize,
+											u32YSize,
+											false,
+											true);
 	ERR_GOTO();
 
-	// Make sure nothing gets cleared
+	// The control owns the reference now
 	pu32RGBA = NULL;
 
 errorExit:
-	SafeMemFree(pu32RGBA);
+	GraphicsImageRelease(&pu32RGBA);
 	if (bLocked)
 	{
 		eStatus = ControlSetLock(eControlImageHandle,
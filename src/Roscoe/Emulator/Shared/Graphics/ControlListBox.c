@@ -30,10 +30,10 @@ typedef struct SControlListBoxItem
 // List box items
 typedef struct SControlListBox
 {
-	// The graphics for the control's guide (background window + lines)
+	// The graphics for the control's guide (background window, shared from WindowRenderStretch())
 	SGraphicsImage *psControlGuide;
 
-	// Text overlay
+	// Text overlay (separator lines + text)
 	SGraphicsImage *psTextOverlay;
 
 	// Set true if the text list needs to get rerendered
@@ -50,6 +50,11 @@ typedef struct SControlListBox
 	uint32_t u32TextSpacing;
 	uint32_t u32XSeparatorSize;
 
+	// Separator lines, drawn on the text overlay
+	int32_t s32YSeparatorBase;
+	uint32_t u32SeparatorThickness;
+	uint32_t u32RGBASeparatorColor;
+
 	// Offset of text from its calculated position
 	int32_t s32XTextOffset;
 	int32_t s32YTextOffset;
@@ -295,6 +300,19 @@ static void ControlListBoxRenderText(SControl *psControl,
 	GraphicsFillImage(psControlListBox->psTextOverlay,
 					  MAKERGBA(0, 0, 0, PIXEL_TRANSPARENT));
 
+	// Separators go between the lines
+	s32YPos = psControlListBox->s32YSeparatorBase;
+	for (u32Loop = 1; u32Loop < psControlListBox->u32Lines; u32Loop++)
+	{
+		GraphicsFillImageRegion(psControlListBox->psTextOverlay,
+								psControlListBox->s32XTextBase,
+								s32YPos,
+								psControlListBox->u32XSeparatorSize,
+								psControlListBox->u32SeparatorThickness,
+								psControlListBox->u32RGBASeparatorColor);
+		s32YPos += (int32_t) psControlListBox->u32TextSpacing;
+	}
+
 	s32XPos = psControlListBox->s32XTextBase + psControlListBox->s32XTextOffset;
 	s32YPos = psControlListBox->s32YTextBase + psControlListBox->s32YTextOffset;
 	u32Loop = psControlListBox->u32Lines;
@@ -893,6 +911,33 @@ static EStatus ControlListBoxMouseoverMethod(struct SControl *psControl,		// Cal
 	return(eStatus);
 }
 
+// Hands the control guide back to the 9-slice frame cache
+static void ControlListBoxGuideRelease(SControlListBox *psControlListBox)
+{
+	uint32_t *pu32RGBAControlGuide = psControlListBox->psControlGuide->pu32RGBA;
+
+	GraphicsClearImage(psControlListBox->psControlGuide);
+	WindowRenderStretchRelease(&pu32RGBAControlGuide);
+}
+
+static EStatus ControlListBoxDestroyMethod(SControl *psControl)
+{
+	SControlListBox *psControlListBox = (SControlListBox *) psControl->pvControlSpecificData;
+
+	if (psControlListBox)
+	{
+		if (psControlListBox->psControlGuide)
+		{
+			ControlListBoxGuideRelease(psControlListBox);
+		}
+
+		GraphicsDestroyImage(&psControlListBox->psControlGuide);
+		GraphicsDestroyImage(&psControlListBox->psTextOverlay);
+	}
+
+	return(ESTATUS_OK);
+}
+
 // List of methods for this control
 static SControlMethods sg_sControlListBoxMethods =
 {
@@ -901,7 +946,7 @@ static SControlMethods sg_sControlListBoxMethods =
 	sizeof(SControlListBox),					// Size of control specific structure
 
 	ControlListBoxCreateMethod,					// Create a control
-	NULL,										// Destroy a control
+	ControlListBoxDestroyMethod,				// Destroy a control
 	ControlListBoxSetDisableMethod,				// Control enable/disable
 	ControlListBoxSetPositionMethod,			// New position
 	ControlListBoxSetVisibleMethod,				// Set visible
@@ -1849,19 +1894,17 @@ errorExit:
 	return(eStatus);
 }
 
-// Render the separators on the provided image
-static void RenderSeparators(SControlListBoxConfig *psControlListBoxConfig,
-							 uint32_t *pu32RGBA,
+// Work out where the text and separators go
+static void LayoutSeparators(SControlListBoxConfig *psControlListBoxConfig,
 							 uint32_t u32XControlSize,
-							 uint32_t u32YControlSize,
 							 int32_t *ps32XTextBase,
 							 int32_t *ps32YTextBase,
 							 uint32_t *pu32TextSpacing,
 							 uint32_t *pu32XSeparatorSize,
+							 int32_t *ps32YSeparatorBase,
 							 uint32_t u32YFontSize)
 {
 	uint32_t u32XSize = u32XControlSize;
-	uint32_t u32LineCount = psControlListBoxConfig->u32Lines;
 	uint32_t u32XSeparatorSize;
 
 	// Subtract out the edge thicknesses
@@ -1897,31 +1940,10 @@ static void RenderSeparators(SControlListBoxConfig *psControlListBoxConfig,
 		*pu32XSeparatorSize = u32XSeparatorSize;
 	}
 
-	// Find the starting location
-	pu32RGBA += (psControlListBoxConfig->u32EdgeYSize + psControlListBoxConfig->u32SeparatorXOffset) +	// Adjust to the right
-				((psControlListBoxConfig->u32EdgeYSize + psControlListBoxConfig->u32SeparatorSpacing + u32YFontSize) * u32XControlSize);
-
-	BASSERT(u32LineCount);
-	u32LineCount--;
-
-	while (u32LineCount)
+	// First separator sits under the first line of text
+	if (ps32YSeparatorBase)
 	{
-		uint32_t *pu32RGBATemp;
-		uint32_t u32Loop;
-		uint32_t u32Loop2;
-
-		for (u32Loop = 0; u32Loop < psControlListBoxConfig->u32SeparatorThickness; u32Loop++)
-		{
-			pu32RGBATemp = pu32RGBA + (u32Loop * u32XControlSize);
-			for (u32Loop2 = 0; u32Loop2 < u32XSeparatorSize; u32Loop2++)
-			{
-				*pu32RGBATemp = psControlListBoxConfig->u32RGBASeparatorColor;
-				++pu32RGBATemp;
-			}
-		}
-
-		pu32RGBA += ((psControlListBoxConfig->u32SeparatorSpacing << 1) + u32YFontSize + psControlListBoxConfig->u32SeparatorThickness) * u32XControlSize;
-		u32LineCount--;
+		*ps32YSeparatorBase = (int32_t) (psControlListBoxConfig->u32EdgeYSize + psControlListBoxConfig->u32SeparatorSpacing + u32YFontSize);
 	}
 }
 
@@ -2124,26 +2146,27 @@ EStatus ControlListBoxSetAssets(EControlListBoxHandle eControlListBoxHandle,
 								  &pu32RGBAControlGuide);
 	ERR_GOTO();
 
-	// Render the separators
-	RenderSeparators(psControlListBoxConfig,
-					 pu32RGBAControlGuide,
+	// Lay out the separators - they're drawn with the text, since the guide is shared
+	LayoutSeparators(psControlListBoxConfig,
 					 u32XSize,
-					 u32YSize,
 					 &psControlListBox->s32XTextBase,
 					 &psControlListBox->s32YTextBase,
 					 &psControlListBox->u32TextSpacing,
 					 &psControlListBox->u32XSeparatorSize,
+					 &psControlListBox->s32YSeparatorBase,
 					 u32YFontSize);
+	psControlListBox->u32SeparatorThickness = psControlListBoxConfig->u32SeparatorThickness;
+	psControlListBox->u32RGBASeparatorColor = psControlListBoxConfig->u32RGBASeparatorColor;
 
 	// Ditch the existing control guide (if there is one)
-	GraphicsClearImage(psControlListBox->psControlGuide);
+	ControlListBoxGuideRelease(psControlListBox);
 
 	// Set our new control guide
 	GraphicsSetImage(psControlListBox->psControlGuide,
 					 pu32RGBAControlGuide,
 					 u32XSize,
 					 u32YSize,
-					 true);
+					 false);
 
 	// Now the text
 	GraphicsClearImage(psControlListBox->psTextOverlay);
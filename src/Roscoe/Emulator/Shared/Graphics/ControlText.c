@@ -118,6 +118,7 @@ static SControlMethods sg_sControlTextMethods =
 	NULL,										// Periodic timer
 	NULL,										// Mouseover
 	NULL,										// Size
+	true,										// Draws within its bounding box
 };
 
 EStatus ControlTextSet(EControlTextHandle eControlTextHandle,
@@ -210,6 +211,12 @@ EStatus ControlTextSet(EControlTextHandle eControlTextHandle,
 
 	if (bDestroyTextImage)
 	{
+		// Size is about to change - redraw what the old text covered
+		if (psControl->bVisible)
+		{
+			ControlUpdated(psControl);
+		}
+
 		psControl->u32XSize = 0;
 		psControl->u32YSize = 0;
 
@@ -250,8 +257,11 @@ EStatus ControlTextSet(EControlTextHandle eControlTextHandle,
 			GraphicsImageUpdated(psControlText->psGraphicsTextImage);
 		}
 
-		// Force a repaint
-		WindowUpdated();
+		// Force a repaint of where the text is now
+		if (psControl->bVisible)
+		{
+			ControlUpdated(psControl);
+		}
 	}
 
 errorExit:
@@ -4,6 +4,7 @@
 #include "Shared/freetype2/include/ft2build.h"
 #include "Shared/freetype2/include/freetype/ftglyph.h"
 #include "Shared/Graphics/Graphics.h"
+#include "Shared/Graphics/Blend.h"
 
 // A "font", in this context, is defined as both a typeface AND a size.
 
@@ -912,62 +913,17 @@ static void FontRenderCharClipInternal(uint32_t *pu32RGBABufferBase,
 		{
 			while (s32YSizeAdjusted)
 			{
-				uint32_t u32XSize;
-
-				u32XSize = (uint32_t) s32XSizeAdjusted;
-				while (u32XSize)
-				{
-					uint8_t u8AlphaDest;
-
-					u8AlphaDest = (uint8_t) ((pu32PixelTranslate[*pu8SrcData] & 0xFF000000) >> 24);
-
-					if (PIXEL_TRANSPARENT == u8AlphaDest)
-					{
-						// Don't do anything - completely transparent
-					}
-					else
-					if (PIXEL_OPAQUE == u8AlphaDest)
-					{
-						// Completely solid
-						*pu32RGBAPtr = pu32PixelTranslate[*pu8SrcData];
-					}
-					else
-					{
-						// Gotta combine
-						uint32_t u32RB1;
-						uint32_t u32RB2;
-						uint32_t u32G1;
-						uint32_t u32G2;
-						uint16_t u16AlphaNew;
-						uint8_t u8AlphaSrc;
-						uint32_t u32InvAlpha;
-
-						u8AlphaSrc = (uint8_t) ((*pu32RGBAPtr & 0xFF000000) >> 24);
-						u32InvAlpha = (0x100 - u8AlphaDest);
-						u32RB1 = (u32InvAlpha * (*pu32RGBAPtr & 0xFF00FF)) >> 8;
-						u32RB2 = (u8AlphaDest * (pu32PixelTranslate[*pu8SrcData] & 0xFF00FF)) >> 8;
-						u32G1 = (u32InvAlpha * (*pu32RGBAPtr & 0x00FF00)) >> 8;
-						u32G2 = (u8AlphaDest * (pu32PixelTranslate[*pu8SrcData] & 0x00FF00)) >> 8;
-						u16AlphaNew = u8AlphaSrc + u8AlphaDest;
-
-						if (u16AlphaNew > 255)
-						{
-							u16AlphaNew = 255;
-						}
-
-						*pu32RGBAPtr = ((u32RB1 + u32RB2) & 0xFF00FF) + ((u32G1 + u32G2) & 0x00FF00) + (u16AlphaNew << 24);
-					}
-
-					++pu8SrcData;
-					++pu32RGBAPtr;
-					u32XSize--;
-				}
+				// Composite this line of glyph coverage onto the target
+				BlendCoverageSpan(pu32RGBAPtr,
+								  pu8SrcData,
+								  pu32PixelTranslate,
+								  (uint32_t) s32XSizeAdjusted);
 
 				// Adjust target pointer
-				pu32RGBAPtr += (u32RGBABufferPitch - s32XSizeAdjusted);
+				pu32RGBAPtr += u32RGBABufferPitch;
 
 				// Adjust source pixel pointer
-				pu8SrcData += (psFontChar->u32PixelXSize - s32XSizeAdjusted);
+				pu8SrcData += psFontChar->u32PixelXSize;
 				s32YSizeAdjusted--;
 			}
 		}
@@ -4,6 +4,8 @@
 #include "Shared/types.h"
 #include "Shared/Shared.h"
 #include "Shared/Graphics/Graphics.h"
+#include "Shared/Graphics/Blend.h"
+#include "Shared/SHA256/sha256.h"
 #include "Shared/libpng/png.h"
 #include "Platform/Platform.h"
 #include "Shared/UtilTask.h"
@@ -46,6 +48,33 @@ static bool sg_bFullscreen = false;
 // true If we're connected to MQTT
 static bool sg_bMQTTConnected = false;
 
+// Persistent offscreen copy of the desktop. The back buffer's contents are
+// undefined after a swap, so frames are drawn here and GraphicsEndFrame()
+// copies the whole thing to the back buffer. Without framebuffer object
+// support every frame is a full redraw.
+static PFNGLGENFRAMEBUFFERSPROC sg_pfglGenFramebuffers = NULL;
+static PFNGLDELETEFRAMEBUFFERSPROC sg_pfglDeleteFramebuffers = NULL;
+static PFNGLBINDFRAMEBUFFERPROC sg_pfglBindFramebuffer = NULL;
+static PFNGLFRAMEBUFFERTEXTURE2DPROC sg_pfglFramebufferTexture2D = NULL;
+static PFNGLCHECKFRAMEBUFFERSTATUSPROC sg_pfglCheckFramebufferStatus = NULL;
+static PFNGLBLITFRAMEBUFFERPROC sg_pfglBlitFramebuffer = NULL;
+static GLuint sg_eDesktopFramebuffer = 0;
+static GLuint sg_eDesktopTexture = 0;
+static int sg_s32DesktopXSize = 0;
+static int sg_s32DesktopYSize = 0;
+
+// true Once the desktop framebuffer holds a complete frame
+static bool sg_bDesktopValid = false;
+
+// true If the frame in progress is being drawn into the desktop framebuffer
+static bool sg_bDesktopBound = false;
+
+// Called with the on-screen area of an image whose contents have changed
+static void (*sg_DamageCallback)(int32_t s32XPos,
+								 int32_t s32YPos,
+								 uint32_t u32XSize,
+								 uint32_t u32YSize) = NULL;
+
 // Returns true if the app is full screen
 bool GraphicsIsFullscreen(void)
 {
@@ -169,11 +198,13 @@ static void PNGReadData(png_structp psPNGStruct,
 	}
 }
 
-// Loads up a graphics file
-EStatus GraphicsLoadImage(char *peImageFilename,
-						  uint32_t **ppu32RGBA,
-						  uint32_t *pu32XSize,
-						  uint32_t *pu32YSize)
+// Decodes an in-memory PNG file (peImageFilename is only used for messages)
+static EStatus GraphicsDecodePNG(char *peImageFilename,
+								 uint8_t *pu8FileData,
+								 uint64_t u64FileSize,
+								 uint32_t **ppu32RGBA,
+								 uint32_t *pu32XSize,
+								 uint32_t *pu32YSize)
 {
 	EStatus eStatus;
 	png_structp psPNGStruct = NULL;
@@ -185,18 +216,8 @@ EStatus GraphicsLoadImage(char *peImageFilename,
 
 	ZERO_STRUCT(sPNGReadState);
 
-	// Load up the image
-	eStatus = FileLoad(peImageFilename,
-					   &sPNGReadState.pu8GraphicsBase,
-					   &sPNGReadState.u64FileSize,
-					   0);
-	if (eStatus != ESTATUS_OK)
-	{
-		SyslogFunc("Error while loading file '%s' - %s\n", peImageFilename, GetErrorText(eStatus));
-	}
-
-	ERR_GOTO();
-
+	sPNGReadState.pu8GraphicsBase = pu8FileData;
+	sPNGReadState.u64FileSize = u64FileSize;
 	sPNGReadState.pu8DataPtr = sPNGReadState.pu8GraphicsBase;
 
 	// See if this is a PNG file
@@ -386,8 +407,6 @@ EStatus GraphicsLoadImage(char *peImageFilename,
 	}
 
 errorExit:
-	SafeMemFree(sPNGReadState.pu8GraphicsBase);
-
 	// If we have row pointers, delete them
 	if (psRowPointers)
 	{
@@ -406,6 +425,438 @@ errorExit:
 	return(eStatus);
 }
 
+// Decoded image cache. Images are keyed by the SHA-256 of their encoded file
+// contents, so the same artwork is only decoded once no matter how many
+// controls use it or what it's called. Entries nobody references stick around
+// (up to GRAPHICS_IMAGE_CACHE_MAX_PIXELS) for the next time they're needed.
+#define	GRAPHICS_IMAGE_CACHE_MAX_PIXELS		(8*1024*1024)
+
+// Optional on-disk cache of decoded pixels, mapped straight in on a hit
+#define	GRAPHICS_IMAGE_CACHE_SIGNATURE		0x41474d49		// "IMGA"
+#define	GRAPHICS_IMAGE_CACHE_VERSION		1
+#define	GRAPHICS_IMAGE_CACHE_EXTENSION		".rgba"
+
+typedef struct SGraphicsImageCacheHeader
+{
+	uint32_t u32Signature;
+	uint32_t u32Version;
+	uint8_t u8SHA256[SHA256_DIGEST_LENGTH];		// Hash of the source (encoded) file
+	uint32_t u32XSize;
+	uint32_t u32YSize;
+	// RGBA pixels follow
+} SGraphicsImageCacheHeader;
+
+typedef struct SGraphicsImageCacheEntry
+{
+	uint8_t u8SHA256[SHA256_DIGEST_LENGTH];
+
+	// Decoded image
+	uint32_t *pu32RGBA;
+	uint32_t u32XSize;
+	uint32_t u32YSize;
+
+	// # Of outstanding GraphicsLoadImageShared() references
+	uint32_t u32References;
+
+	// Cache tick of last use (for LRU eviction)
+	uint64_t u64LastUsed;
+
+	// Non-NULL if pu32RGBA points into a mapped on-disk cache file
+	void *pvMapBase;
+	uint64_t u64MapSize;
+
+	struct SGraphicsImageCacheEntry *psNextLink;
+} SGraphicsImageCacheEntry;
+
+static SOSCriticalSection sg_sImageCacheLock;
+static SGraphicsImageCacheEntry *sg_psImageCache = NULL;
+static uint64_t sg_u64ImageCacheTick = 0;
+static char *sg_peImageCachePath = NULL;
+
+static void GraphicsImageCacheEntryFree(SGraphicsImageCacheEntry *psEntry)
+{
+	if (psEntry->pvMapBase)
+	{
+		FileUnmap(psEntry->pvMapBase,
+				  psEntry->u64MapSize);
+	}
+	else
+	{
+		SafeMemFree(psEntry->pu32RGBA);
+	}
+
+	MemFree(psEntry);
+}
+
+// Evicts least recently used, unreferenced images until they fit in the pixel
+// budget. Call with sg_sImageCacheLock held.
+static void GraphicsImageCacheTrim(uint64_t u64MaxPixels)
+{
+	while (1)
+	{
+		SGraphicsImageCacheEntry **ppsLink = &sg_psImageCache;
+		SGraphicsImageCacheEntry **ppsVictim = NULL;
+		SGraphicsImageCacheEntry *psEntry;
+		uint64_t u64Pixels = 0;
+
+		while (*ppsLink)
+		{
+			psEntry = *ppsLink;
+
+			if (0 == psEntry->u32References)
+			{
+				u64Pixels += (uint64_t) psEntry->u32XSize * (uint64_t) psEntry->u32YSize;
+				if ((NULL == ppsVictim) ||
+					(psEntry->u64LastUsed < (*ppsVictim)->u64LastUsed))
+				{
+					ppsVictim = ppsLink;
+				}
+			}
+
+			ppsLink = &psEntry->psNextLink;
+		}
+
+		// Within budget, or everything left is in use
+		if ((u64Pixels <= u64MaxPixels) ||
+			(NULL == ppsVictim))
+		{
+			break;
+		}
+
+		psEntry = *ppsVictim;
+		*ppsVictim = psEntry->psNextLink;
+		GraphicsImageCacheEntryFree(psEntry);
+	}
+}
+
+// Builds the on-disk cache filename for a given source hash
+static void GraphicsImageCacheFilename(char *peFilename,
+									   size_t eFilenameSize,
+									   uint8_t *pu8SHA256,
+									   char *peSuffix)
+{
+	char eHash[(SHA256_DIGEST_LENGTH * 2) + 1];
+	uint32_t u32Loop;
+
+	for (u32Loop = 0; u32Loop < SHA256_DIGEST_LENGTH; u32Loop++)
+	{
+		snprintf(&eHash[u32Loop << 1], 3, "%.2x", pu8SHA256[u32Loop]);
+	}
+
+	snprintf(peFilename, eFilenameSize, "%s/%s%s%s", sg_peImageCachePath, eHash, GRAPHICS_IMAGE_CACHE_EXTENSION, peSuffix);
+}
+
+// Tries to map a previously decoded image from the on-disk cache
+static EStatus GraphicsImageCacheMap(SGraphicsImageCacheEntry *psEntry)
+{
+	EStatus eStatus;
+	char eFilename[1024];
+	SGraphicsImageCacheHeader *psHeader;
+
+	GraphicsImageCacheFilename(eFilename,
+							   sizeof(eFilename),
+							   psEntry->u8SHA256,
+							   "");
+
+	eStatus = FileMap(eFilename,
+					  &psEntry->pvMapBase,
+					  &psEntry->u64MapSize);
+	ERR_GOTO();
+
+	psHeader = (SGraphicsImageCacheHeader *) psEntry->pvMapBase;
+
+	// Make sure it's what we're after and it's all there
+	if ((psEntry->u64MapSize < sizeof(*psHeader)) ||
+		(psHeader->u32Signature != GRAPHICS_IMAGE_CACHE_SIGNATURE) ||
+		(psHeader->u32Version != GRAPHICS_IMAGE_CACHE_VERSION) ||
+		(memcmp(psHeader->u8SHA256, psEntry->u8SHA256, sizeof(psHeader->u8SHA256)) != 0) ||
+		(psEntry->u64MapSize != (sizeof(*psHeader) + ((uint64_t) psHeader->u32XSize * (uint64_t) psHeader->u32YSize * sizeof(*psEntry->pu32RGBA)))))
+	{
+		eStatus = ESTATUS_GFX_FILE_CORRUPT;
+		goto errorExit;
+	}
+
+	psEntry->u32XSize = psHeader->u32XSize;
+	psEntry->u32YSize = psHeader->u32YSize;
+	psEntry->pu32RGBA = (uint32_t *) (psHeader + 1);
+
+errorExit:
+	if (eStatus != ESTATUS_OK)
+	{
+		FileUnmap(psEntry->pvMapBase,
+				  psEntry->u64MapSize);
+		psEntry->pvMapBase = NULL;
+		psEntry->u64MapSize = 0;
+	}
+
+	return(eStatus);
+}
+
+// Writes a freshly decoded image out to the on-disk cache. Written under a
+// temporary name and renamed so nobody ever maps a partial file.
+static EStatus GraphicsImageCacheWrite(SGraphicsImageCacheEntry *psEntry)
+{
+	EStatus eStatus;
+	char eFilename[1024];
+	char eFilenameTemp[1024];
+	SOSFile psFile = NULL;
+	SGraphicsImageCacheHeader sHeader;
+	uint64_t u64PixelSize = (uint64_t) psEntry->u32XSize * (uint64_t) psEntry->u32YSize * sizeof(*psEntry->pu32RGBA);
+	uint64_t u64Written = 0;
+
+	GraphicsImageCacheFilename(eFilename,
+							   sizeof(eFilename),
+							   psEntry->u8SHA256,
+							   "");
+	GraphicsImageCacheFilename(eFilenameTemp,
+							   sizeof(eFilenameTemp),
+							   psEntry->u8SHA256,
+							   ".tmp");
+
+	ZERO_STRUCT(sHeader);
+	sHeader.u32Signature = GRAPHICS_IMAGE_CACHE_SIGNATURE;
+	sHeader.u32Version = GRAPHICS_IMAGE_CACHE_VERSION;
+	memcpy((void *) sHeader.u8SHA256, (void *) psEntry->u8SHA256, sizeof(sHeader.u8SHA256));
+	sHeader.u32XSize = psEntry->u32XSize;
+	sHeader.u32YSize = psEntry->u32YSize;
+
+	eStatus = Filefopen(&psFile,
+						eFilenameTemp,
+						"wb");
+	ERR_GOTO();
+
+	eStatus = Filefwrite((void *) &sHeader,
+						 sizeof(sHeader),
+						 &u64Written,
+						 psFile);
+	ERR_GOTO();
+
+	eStatus = Filefwrite((void *) psEntry->pu32RGBA,
+						 u64PixelSize,
+						 &u64Written,
+						 psFile);
+	ERR_GOTO();
+
+	if (u64Written != u64PixelSize)
+	{
+		eStatus = ESTATUS_WRITE_TRUNCATED;
+		goto errorExit;
+	}
+
+	eStatus = Filefclose(&psFile);
+	ERR_GOTO();
+
+	// Whoever got there first wins
+	(void) Fileunlink(eFilename);
+	eStatus = Filerename(eFilenameTemp,
+						 eFilename);
+
+errorExit:
+	if (psFile)
+	{
+		(void) Filefclose(&psFile);
+	}
+
+	if (eStatus != ESTATUS_OK)
+	{
+		(void) Fileunlink(eFilenameTemp);
+	}
+
+	return(eStatus);
+}
+
+// Sets the directory used for the on-disk decoded image cache (NULL to disable)
+void GraphicsImageCacheSetPath(char *peCachePath)
+{
+	SafeMemFree(sg_peImageCachePath);
+
+	if (peCachePath)
+	{
+		sg_peImageCachePath = strdupHeap(peCachePath);
+		if (sg_peImageCachePath)
+		{
+			(void) Filemkdir(sg_peImageCachePath);
+		}
+	}
+}
+
+// Returns a shared, decoded copy of an image file. The pixels must be treated
+// as read only and handed back with GraphicsImageRelease().
+EStatus GraphicsLoadImageShared(char *peImageFilename,
+								uint32_t **ppu32RGBA,
+								uint32_t *pu32XSize,
+								uint32_t *pu32YSize)
+{
+	EStatus eStatus;
+	uint8_t *pu8FileData = NULL;
+	uint64_t u64FileSize = 0;
+	uint8_t u8SHA256[SHA256_DIGEST_LENGTH];
+	MY_SHA256_CTX sSHA256Ctx;
+	SGraphicsImageCacheEntry *psEntry = NULL;
+	bool bLocked = false;
+
+	*ppu32RGBA = NULL;
+
+	// Still need the file to know what's in it
+	eStatus = FileLoad(peImageFilename,
+					   &pu8FileData,
+					   &u64FileSize,
+					   0);
+	if (eStatus != ESTATUS_OK)
+	{
+		SyslogFunc("Error while loading file '%s' - %s\n", peImageFilename, GetErrorText(eStatus));
+	}
+
+	ERR_GOTO();
+
+	ZERO_STRUCT(sSHA256Ctx);
+	MySHA256_Init(&sSHA256Ctx);
+	MySHA256_Update(&sSHA256Ctx,
+					(void *) pu8FileData,
+					(size_t) u64FileSize);
+	MySHA256_Final(u8SHA256, &sSHA256Ctx);
+
+	eStatus = OSCriticalSectionEnter(sg_sImageCacheLock);
+	ERR_GOTO();
+	bLocked = true;
+
+	sg_u64ImageCacheTick++;
+
+	psEntry = sg_psImageCache;
+	while (psEntry)
+	{
+		if (memcmp(psEntry->u8SHA256, u8SHA256, sizeof(u8SHA256)) == 0)
+		{
+			break;
+		}
+
+		psEntry = psEntry->psNextLink;
+	}
+
+	if (NULL == psEntry)
+	{
+		MEMALLOC(psEntry, sizeof(*psEntry));
+		memcpy((void *) psEntry->u8SHA256, (void *) u8SHA256, sizeof(psEntry->u8SHA256));
+
+		// On-disk cache first, then the hard way
+		if ((NULL == sg_peImageCachePath) ||
+			(GraphicsImageCacheMap(psEntry) != ESTATUS_OK))
+		{
+			eStatus = GraphicsDecodePNG(peImageFilename,
+										pu8FileData,
+										u64FileSize,
+										&psEntry->pu32RGBA,
+										&psEntry->u32XSize,
+										&psEntry->u32YSize);
+			if (eStatus != ESTATUS_OK)
+			{
+				SafeMemFree(psEntry->pu32RGBA);
+				SafeMemFree(psEntry);
+				goto errorExit;
+			}
+
+			if (sg_peImageCachePath)
+			{
+				EStatus eStatusWrite;
+
+				// Not fatal if this fails - we've got the image
+				eStatusWrite = GraphicsImageCacheWrite(psEntry);
+				if (eStatusWrite != ESTATUS_OK)
+				{
+					SyslogFunc("Can't write decoded image cache for '%s' - %s\n", peImageFilename, GetErrorText(eStatusWrite));
+				}
+			}
+		}
+
+		psEntry->psNextLink = sg_psImageCache;
+		sg_psImageCache = psEntry;
+	}
+
+	psEntry->u32References++;
+	psEntry->u64LastUsed = sg_u64ImageCacheTick;
+
+	*ppu32RGBA = psEntry->pu32RGBA;
+	*pu32XSize = psEntry->u32XSize;
+	*pu32YSize = psEntry->u32YSize;
+
+errorExit:
+	if (bLocked)
+	{
+		EStatusResultConditional(OSCriticalSectionLeave(sg_sImageCacheLock));
+	}
+
+	SafeMemFree(pu8FileData);
+	return(eStatus);
+}
+
+// Hands back an image obtained from GraphicsLoadImageShared()
+void GraphicsImageRelease(uint32_t **ppu32RGBA)
+{
+	EStatus eStatus;
+	SGraphicsImageCacheEntry *psEntry;
+
+	if (NULL == *ppu32RGBA)
+	{
+		return;
+	}
+
+	eStatus = OSCriticalSectionEnter(sg_sImageCacheLock);
+	BASSERT(ESTATUS_OK == eStatus);
+
+	psEntry = sg_psImageCache;
+	while (psEntry)
+	{
+		if (psEntry->pu32RGBA == *ppu32RGBA)
+		{
+			break;
+		}
+
+		psEntry = psEntry->psNextLink;
+	}
+
+	// If this asserts, the image didn't come from GraphicsLoadImageShared()
+	BASSERT(psEntry);
+	if (psEntry)
+	{
+		BASSERT(psEntry->u32References);
+		psEntry->u32References--;
+	}
+
+	GraphicsImageCacheTrim(GRAPHICS_IMAGE_CACHE_MAX_PIXELS);
+
+	eStatus = OSCriticalSectionLeave(sg_sImageCacheLock);
+	BASSERT(ESTATUS_OK == eStatus);
+
+	*ppu32RGBA = NULL;
+}
+
+// Loads up a graphics file into a private, writable copy
+EStatus GraphicsLoadImage(char *peImageFilename,
+						  uint32_t **ppu32RGBA,
+						  uint32_t *pu32XSize,
+						  uint32_t *pu32YSize)
+{
+	EStatus eStatus;
+	uint32_t *pu32RGBAShared = NULL;
+
+	*ppu32RGBA = NULL;
+
+	eStatus = GraphicsLoadImageShared(peImageFilename,
+									  &pu32RGBAShared,
+									  pu32XSize,
+									  pu32YSize);
+	ERR_GOTO();
+
+	MEMALLOC_NO_CLEAR(*ppu32RGBA, *pu32XSize * *pu32YSize * sizeof(**ppu32RGBA));
+	BlendCopy(*ppu32RGBA,
+			  pu32RGBAShared,
+			  (uint64_t) *pu32XSize * (uint64_t) *pu32YSize);
+
+errorExit:
+	GraphicsImageRelease(&pu32RGBAShared);
+	return(eStatus);
+}
+
 // Creates a blank graphic image
 EStatus GraphicsCreateImage(SGraphicsImage **ppsGraphicsImage,
 							bool bOpenGLTexture,
@@ -469,15 +920,9 @@ void GraphicsFillImage(SGraphicsImage *psGraphicsImage,
 {
 	if (psGraphicsImage)
 	{
-		uint32_t *pu32RGBA = psGraphicsImage->pu32RGBA;
-		uint32_t u32Loop = (psGraphicsImage->u32TotalXSize * psGraphicsImage->u32TotalYSize);
-
-		while (u32Loop)
-		{
-			*pu32RGBA = u32RGBAFillColor;
-			++pu32RGBA;
-			u32Loop--;
-		}
+		BlendFill(psGraphicsImage->pu32RGBA,
+				  u32RGBAFillColor,
+				  (uint64_t) psGraphicsImage->u32TotalXSize * (uint64_t) psGraphicsImage->u32TotalYSize);
 
 		psGraphicsImage->bTextureAssigned = false;
 	}
@@ -542,20 +987,12 @@ void GraphicsFillImageRegion(SGraphicsImage *psGraphicsImage,
 	if ((u32XSize) && (u32YSize))
 	{
 		uint32_t *pu32RGBABase = psGraphicsImage->pu32RGBA + s32XPos + (s32YPos * psGraphicsImage->u32TotalXSize);
-		uint32_t *pu32RGBA;
 
 		while (u32YSize)
 		{
-			uint32_t u32Count;
-
-			pu32RGBA = pu32RGBABase;
-			u32Count = u32XSize;
-			while (u32Count)
-			{
-				*pu32RGBA = u32RGBAFillColor; 
-				++pu32RGBA;
-				--u32Count;
-			}
+			BlendFill(pu32RGBABase,
+					  u32RGBAFillColor,
+					  u32XSize);
 
 			pu32RGBABase += psGraphicsImage->u32TotalXSize;
 			u32YSize--;
@@ -567,6 +1004,12 @@ void GraphicsClearImage(SGraphicsImage *psGraphicsImage)
 {
 	if (psGraphicsImage)
 	{
+		if (psGraphicsImage->bShared)
+		{
+			GraphicsImageRelease(&psGraphicsImage->pu32RGBA);
+			psGraphicsImage->bShared = false;
+		}
+		else
 		if(psGraphicsImage->bAutoDeallocate)
 		{
 			SafeMemFree(psGraphicsImage->pu32RGBA);
@@ -581,6 +1024,7 @@ void GraphicsClearImage(SGraphicsImage *psGraphicsImage)
 		psGraphicsImage->u8Intensity = 0xff;
 		psGraphicsImage->bTextureAssigned = false;
 		psGraphicsImage->u32Attribute = 0;
+		psGraphicsImage->bDrawn = false;
 	}
 }
 
@@ -588,6 +1032,25 @@ void GraphicsClearImage(SGraphicsImage *psGraphicsImage)
 void GraphicsImageUpdated(SGraphicsImage *psGraphicsImage)
 {
 	psGraphicsImage->bTextureAssigned = false;
+
+	// If it's on screen, wherever it was last drawn needs to be redrawn
+	if ((psGraphicsImage->bDrawn) &&
+		(sg_DamageCallback))
+	{
+		sg_DamageCallback(psGraphicsImage->s32DrawnXPos,
+						  psGraphicsImage->s32DrawnYPos,
+						  psGraphicsImage->u32DrawnXSize,
+						  psGraphicsImage->u32DrawnYSize);
+	}
+}
+
+// Sets the callback that gets told about changed on-screen areas
+void GraphicsSetDamageCallback(void (*DamageCallback)(int32_t s32XPos,
+													  int32_t s32YPos,
+													  uint32_t u32XSize,
+													  uint32_t u32YSize))
+{
+	sg_DamageCallback = DamageCallback;
 }
 
 // Set graphical attributes
@@ -625,6 +1088,22 @@ void GraphicsSetImage(SGraphicsImage *psGraphicsImage,
 	psGraphicsImage->u32TotalYSize = u32YSize;
 	psGraphicsImage->bTextureAssigned = false;
 	psGraphicsImage->bAutoDeallocate = bAutoDeallocate;
+	psGraphicsImage->bShared = false;
+}
+
+// Set a shared (GraphicsLoadImageShared()) image for this texture. The image's
+// reference is released when the graphics image is cleared or destroyed.
+void GraphicsSetImageShared(SGraphicsImage *psGraphicsImage,
+							uint32_t *pu32RGBA,
+							uint32_t u32XSize,
+							uint32_t u32YSize)
+{
+	GraphicsSetImage(psGraphicsImage,
+					 pu32RGBA,
+					 u32XSize,
+					 u32YSize,
+					 false);
+	psGraphicsImage->bShared = true;
 }
 
 
@@ -633,6 +1112,12 @@ void GraphicsDestroyImage(SGraphicsImage **ppsGraphicsImage)
 {
 	if (*ppsGraphicsImage)
 	{
+		if ((*ppsGraphicsImage)->bShared)
+		{
+			// Hand the shared image back to the cache
+			GraphicsImageRelease(&(*ppsGraphicsImage)->pu32RGBA);
+		}
+		else
 		if ((*ppsGraphicsImage)->bAutoDeallocate)
 		{
 			// We auto-dealllocate the RGBA image
@@ -679,6 +1164,8 @@ EStatus GraphicsDraw(SGraphicsImage *psGraphicsImage,
 	GLfloat fTexBottom = 1.0f;
 	GLfloat fXOffset = 0.0f;
 	GLfloat fYOffset = 0.0f;
+	GLfloat fXMin, fXMax, fYMin, fYMax;
+	uint8_t u8Loop;
 
 	// If this is a NULL graphics image, just return everything's OK
 	if (NULL == psGraphicsImage)
@@ -757,7 +1244,6 @@ EStatus GraphicsDraw(SGraphicsImage *psGraphicsImage,
 	// Let's see if we need to rotate everything
 	if (dAngle != 0.0 )
 	{
-		uint8_t u8Loop = 0;
 		double dRadians;
 
 		dRadians = dAngle * (M_PI / 180.0);
@@ -793,6 +1279,23 @@ EStatus GraphicsDraw(SGraphicsImage *psGraphicsImage,
 		fTexBottom = fTemp;
 	}
 
+	// Record the bounding box of where this image is landing (for damage tracking)
+	fXMin = fXMax = fX[0];
+	fYMin = fYMax = fY[0];
+	for (u8Loop = 1; u8Loop < (sizeof(fX) / sizeof(fX[0])); u8Loop++)
+	{
+		fXMin = fminf(fXMin, fX[u8Loop]);
+		fXMax = fmaxf(fXMax, fX[u8Loop]);
+		fYMin = fminf(fYMin, fY[u8Loop]);
+		fYMax = fmaxf(fYMax, fY[u8Loop]);
+	}
+
+	psGraphicsImage->s32DrawnXPos = ((int32_t) floorf(fXMin)) + s32X;
+	psGraphicsImage->s32DrawnYPos = ((int32_t) floorf(fYMin)) + s32Y;
+	psGraphicsImage->u32DrawnXSize = (uint32_t) (ceilf(fXMax) - floorf(fXMin));
+	psGraphicsImage->u32DrawnYSize = (uint32_t) (ceilf(fYMax) - floorf(fYMin));
+	psGraphicsImage->bDrawn = true;
+
 	glEnable(GL_BLEND);
 	glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA);
 
@@ -886,13 +1389,197 @@ void GraphicsDrawQuad(int32_t s32X,
 }
 
 
+static void GraphicsDesktopFree(void)
+{
+	if (sg_eDesktopFramebuffer)
+	{
+		sg_pfglDeleteFramebuffers(1, &sg_eDesktopFramebuffer);
+		sg_eDesktopFramebuffer = 0;
+	}
+
+	if (sg_eDesktopTexture)
+	{
+		glDeleteTextures(1, &sg_eDesktopTexture);
+		sg_eDesktopTexture = 0;
+	}
+
+	sg_s32DesktopXSize = 0;
+	sg_s32DesktopYSize = 0;
+	sg_bDesktopValid = false;
+}
+
+// Looks up the framebuffer object entry points. Leaves them NULL (and frames
+// going straight to the back buffer) if the driver doesn't have them.
+static void GraphicsDesktopInit(void)
+{
+	if (SDL_FALSE == SDL_GL_ExtensionSupported("GL_ARB_framebuffer_object"))
+	{
+		Syslog("GL_ARB_framebuffer_object not supported - redrawing full frames\n");
+		return;
+	}
+
+	sg_pfglGenFramebuffers = (PFNGLGENFRAMEBUFFERSPROC) SDL_GL_GetProcAddress("glGenFramebuffers");
+	sg_pfglDeleteFramebuffers = (PFNGLDELETEFRAMEBUFFERSPROC) SDL_GL_GetProcAddress("glDeleteFramebuffers");
+	sg_pfglBindFramebuffer = (PFNGLBINDFRAMEBUFFERPROC) SDL_GL_GetProcAddress("glBindFramebuffer");
+	sg_pfglFramebufferTexture2D = (PFNGLFRAMEBUFFERTEXTURE2DPROC) SDL_GL_GetProcAddress("glFramebufferTexture2D");
+	sg_pfglCheckFramebufferStatus = (PFNGLCHECKFRAMEBUFFERSTATUSPROC) SDL_GL_GetProcAddress("glCheckFramebufferStatus");
+	sg_pfglBlitFramebuffer = (PFNGLBLITFRAMEBUFFERPROC) SDL_GL_GetProcAddress("glBlitFramebuffer");
+
+	if ((NULL == sg_pfglGenFramebuffers) ||
+		(NULL == sg_pfglDeleteFramebuffers) ||
+		(NULL == sg_pfglBindFramebuffer) ||
+		(NULL == sg_pfglFramebufferTexture2D) ||
+		(NULL == sg_pfglCheckFramebufferStatus) ||
+		(NULL == sg_pfglBlitFramebuffer))
+	{
+		Syslog("Framebuffer object entry points missing - redrawing full frames\n");
+		sg_pfglBlitFramebuffer = NULL;
+	}
+}
+
+// Binds the desktop framebuffer for drawing, (re)creating it if the drawable
+// has changed size. Returns false if frames have to go to the back buffer.
+static bool GraphicsDesktopBind(int s32DrawableXSize,
+								int s32DrawableYSize)
+{
+	if (NULL == sg_pfglBlitFramebuffer)
+	{
+		return(false);
+	}
+
+	if ((s32DrawableXSize != sg_s32DesktopXSize) ||
+		(s32DrawableYSize != sg_s32DesktopYSize))
+	{
+		GraphicsDesktopFree();
+
+		glGenTextures(1, &sg_eDesktopTexture);
+		glBindTexture(GL_TEXTURE_2D, sg_eDesktopTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, s32DrawableXSize, s32DrawableYSize, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+
+		sg_pfglGenFramebuffers(1, &sg_eDesktopFramebuffer);
+		sg_pfglBindFramebuffer(GL_FRAMEBUFFER, sg_eDesktopFramebuffer);
+		sg_pfglFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, sg_eDesktopTexture, 0);
+
+		if (sg_pfglCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE)
+		{
+			Syslog("Desktop framebuffer %dx%d incomplete - redrawing full frames\n", s32DrawableXSize, s32DrawableYSize);
+			sg_pfglBindFramebuffer(GL_FRAMEBUFFER, 0);
+			GraphicsDesktopFree();
+			sg_pfglBlitFramebuffer = NULL;
+			return(false);
+		}
+
+		sg_s32DesktopXSize = s32DrawableXSize;
+		sg_s32DesktopYSize = s32DrawableYSize;
+	}
+
+	sg_pfglBindFramebuffer(GL_FRAMEBUFFER, sg_eDesktopFramebuffer);
+	glViewport(0, 0, s32DrawableXSize, s32DrawableYSize);
+	return(true);
+}
+
 void GraphicsStartFrame(void)
 {
+	int s32DrawableXSize = 0;
+	int s32DrawableYSize = 0;
+
+	SDL_GL_GetDrawableSize(sg_psSDLWindow,
+						   &s32DrawableXSize,
+						   &s32DrawableYSize);
+
+	sg_bDesktopBound = GraphicsDesktopBind(s32DrawableXSize,
+										   s32DrawableYSize);
+
+	glDisable(GL_SCISSOR_TEST);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+}
+
+// Starts a frame that only touches the given region (virtual coordinates). Anything
+// outside of it is left as it was last frame. Falls back to a full frame if there's
+// no desktop framebuffer holding the last frame.
+void GraphicsStartFrameRegion(int32_t s32XPos,
+							  int32_t s32YPos,
+							  uint32_t u32XSize,
+							  uint32_t u32YSize)
+{
+	int s32DrawableXSize = 0;
+	int s32DrawableYSize = 0;
+	int64_t s64X1, s64Y1, s64X2, s64Y2;
+
+	SDL_GL_GetDrawableSize(sg_psSDLWindow,
+						   &s32DrawableXSize,
+						   &s32DrawableYSize);
+
+	sg_bDesktopBound = GraphicsDesktopBind(s32DrawableXSize,
+										   s32DrawableYSize);
+	if ((false == sg_bDesktopBound) ||
+		(false == sg_bDesktopValid))
+	{
+		GraphicsStartFrame();
+		return;
+	}
+
+	// Scale to physical pixels, rounding outward with a little slop for
+	// texture filtering bleeding over the edges
+	s64X1 = (((int64_t) s32XPos * s32DrawableXSize) / (int64_t) sg_u32VirtualXSize) - 2;
+	s64Y1 = (((int64_t) s32YPos * s32DrawableYSize) / (int64_t) sg_u32VirtualYSize) - 2;
+	s64X2 = ((((int64_t) s32XPos + u32XSize) * s32DrawableXSize + sg_u32VirtualXSize - 1) / (int64_t) sg_u32VirtualXSize) + 2;
+	s64Y2 = ((((int64_t) s32YPos + u32YSize) * s32DrawableYSize + sg_u32VirtualYSize - 1) / (int64_t) sg_u32VirtualYSize) + 2;
+
+	if (s64X1 < 0)
+	{
+		s64X1 = 0;
+	}
+	if (s64Y1 < 0)
+	{
+		s64Y1 = 0;
+	}
+	if (s64X2 > s32DrawableXSize)
+	{
+		s64X2 = s32DrawableXSize;
+	}
+	if (s64Y2 > s32DrawableYSize)
+	{
+		s64Y2 = s32DrawableYSize;
+	}
+
+	if ((s64X2 <= s64X1) ||
+		(s64Y2 <= s64Y1))
+	{
+		s64X1 = 0;
+		s64Y1 = 0;
+		s64X2 = 0;
+		s64Y2 = 0;
+	}
+
+	// OpenGL's scissor origin is the lower left corner
+	glEnable(GL_SCISSOR_TEST);
+	glScissor((GLint) s64X1,
+			  (GLint) (s32DrawableYSize - s64Y2),
+			  (GLsizei) (s64X2 - s64X1),
+			  (GLsizei) (s64Y2 - s64Y1));
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 }
 
 void GraphicsEndFrame(void)
 {
+	if (sg_bDesktopBound)
+	{
+		// Blits are scissored too
+		glDisable(GL_SCISSOR_TEST);
+		sg_pfglBindFramebuffer(GL_READ_FRAMEBUFFER, sg_eDesktopFramebuffer);
+		sg_pfglBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+		sg_pfglBlitFramebuffer(0, 0, sg_s32DesktopXSize, sg_s32DesktopYSize,
+							   0, 0, sg_s32DesktopXSize, sg_s32DesktopYSize,
+							   GL_COLOR_BUFFER_BIT,
+							   GL_NEAREST);
+		sg_pfglBindFramebuffer(GL_FRAMEBUFFER, 0);
+		sg_bDesktopValid = true;
+		sg_bDesktopBound = false;
+	}
+
 	SDL_GL_SwapWindow(sg_psSDLWindow);
 }
 
@@ -994,6 +1681,12 @@ EStatus GraphicsInit(uint32_t *pu32FPS)
 	double dXPhysicalScale = 1.0;
 	double dYPhysicalScale = 1.0;
 
+	// Pick the fastest pixel kernels this CPU supports
+	BlendInit();
+
+	eStatus = OSCriticalSectionCreate(&sg_sImageCacheLock);
+	ERR_GOTO();
+
 	// Get platform settings
 	PlatformGetGraphicsSettings(&sg_u32PhysicalXSize,
 								&sg_u32PhysicalYSize,
@@ -1210,6 +1903,8 @@ EStatus GraphicsInit(uint32_t *pu32FPS)
 			sg_u32VirtualYSize, 0, 
 			0, 32768.0); 
 
+	GraphicsDesktopInit();
+
 	// Make sure the frame rate is nonzero
 	BASSERT(u32FPS);
 	*pu32FPS = u32FPS;
@@ -1228,6 +1923,29 @@ errorExit:
 // Shuts down the entire graphics subsystem
 EStatus GraphicsShutdown(void)
 {
+	// Free (or unmap) every decoded image, referenced or not - nothing draws after this
+	if (sg_sImageCacheLock)
+	{
+		(void) OSCriticalSectionEnter(sg_sImageCacheLock);
+		while (sg_psImageCache)
+		{
+			SGraphicsImageCacheEntry *psEntry = sg_psImageCache;
+
+			sg_psImageCache = psEntry->psNextLink;
+			GraphicsImageCacheEntryFree(psEntry);
+		}
+		(void) OSCriticalSectionLeave(sg_sImageCacheLock);
+
+		(void) OSCriticalSectionDestroy(&sg_sImageCacheLock);
+	}
+
+	SafeMemFree(sg_peImageCachePath);
+
+	if (sg_pfglBlitFramebuffer)
+	{
+		GraphicsDesktopFree();
+	}
+
 	SDL_Quit();
 	return(ESTATUS_OK);
 }
@@ -46,6 +46,7 @@ typedef struct SGraphicsImage
 	// Pixel data
 	uint32_t *pu32RGBA;
 	bool bAutoDeallocate;		// true If the image should be deallocated when destroyed
+	bool bShared;				// true If pu32RGBA came from GraphicsLoadImageShared() (read only)
 
 	// Runtime data
 	bool bTextureAssigned;		// false If the texture hasn't been assigned yet
@@ -53,12 +54,25 @@ typedef struct SGraphicsImage
 	// Prior viewport data
 	uint32_t u32ViewportYSizePrior;
 	uint32_t u32ViewportYOffsetPrior;
+
+	// Bounding box (virtual coordinates) of where this image was last drawn
+	bool bDrawn;
+	int32_t s32DrawnXPos;
+	int32_t s32DrawnYPos;
+	uint32_t u32DrawnXSize;
+	uint32_t u32DrawnYSize;
 } SGraphicsImage;
 
 extern EStatus GraphicsLoadImage(char *peImageFilename,
 								 uint32_t **ppu32RGBA,
 								 uint32_t *pu32XSize,
 								 uint32_t *pu32YSize);
+extern EStatus GraphicsLoadImageShared(char *peImageFilename,
+									   uint32_t **ppu32RGBA,
+									   uint32_t *pu32XSize,
+									   uint32_t *pu32YSize);
+extern void GraphicsImageRelease(uint32_t **ppu32RGBA);
+extern void GraphicsImageCacheSetPath(char *peCachePath);
 extern EStatus GraphicsCreateImage(SGraphicsImage **ppsGraphicsImage,
 								   bool bOpenGLTexture,
 								   uint32_t u32XSize,
@@ -100,7 +114,15 @@ extern void GraphicsSetImage(SGraphicsImage *psGraphicsImage,
 							 uint32_t u32XSize,
 							 uint32_t u32YSize,
 							 bool bAutoDeallocate);
+extern void GraphicsSetImageShared(SGraphicsImage *psGraphicsImage,
+								   uint32_t *pu32RGBA,
+								   uint32_t u32XSize,
+								   uint32_t u32YSize);
 extern void GraphicsImageUpdated(SGraphicsImage *psGraphicsImage);
+extern void GraphicsSetDamageCallback(void (*DamageCallback)(int32_t s32XPos,
+															 int32_t s32YPos,
+															 uint32_t u32XSize,
+															 uint32_t u32YSize));
 extern void GraphicsGetVirtualSurfaceSize(uint32_t *pu32VirtualXSize,
 										  uint32_t *pu32VirtualYSize);
 extern void GraphicsGetPhysicalSurfaceSize(uint32_t *pu32PhysicalXSize,
@@ -114,6 +136,10 @@ extern void GraphicsSetMinimize(void);
 extern void GraphicsSetMaximize(void);
 extern bool GraphicsIsFullscreen(void);
 extern void GraphicsStartFrame(void);
+extern void GraphicsStartFrameRegion(int32_t s32XPos,
+									 int32_t s32YPos,
+									 uint32_t u32XSize,
+									 uint32_t u32YSize);
 extern void GraphicsEndFrame(void);
 extern EStatus GraphicsInit(uint32_t *pu32FPS);
 extern void GraphicsGLSetCurrent(void);
@@ -1,6 +1,7 @@
 #include <stdio.h>
 #include "Shared/Shared.h"
 #include "Shared/Graphics/Graphics.h"
+#include "Shared/Graphics/Blend.h"
 #include "Shared/Graphics/Window.h"
 #include "Shared/HandlePool.h"
 #include "Shared/Timer.h"
@@ -161,6 +162,77 @@ static SOSCriticalSection sg_sFrameLock;
 // Set true if we want to do a frame blit
 volatile static bool sg_bFramePending = false;
 
+// Damage tracking. Partial updates queue a rectangle (window or screen
+// relative) and the next frame only redraws their union. Anything that calls WindowUpdated() or overflows the
+// queue gets a full redraw. Protected by sg_sFrameLock.
+#define	WINDOW_DAMAGE_MAX		64
+
+typedef struct SWindowDamage
+{
+	bool bScreenRelative;
+	EWindowHandle eWindowHandle;
+	int32_t s32XPos;
+	int32_t s32YPos;
+	uint32_t u32XSize;
+	uint32_t u32YSize;
+} SWindowDamage;
+
+// Screen rectangle (s32X2/s32Y2 are exclusive)
+typedef struct SWindowRect
+{
+	int32_t s32X1;
+	int32_t s32Y1;
+	int32_t s32X2;
+	int32_t s32Y2;
+} SWindowRect;
+
+static SWindowDamage sg_sWindowDamage[WINDOW_DAMAGE_MAX];
+static uint32_t sg_u32WindowDamageCount = 0;
+static bool sg_bWindowDamageFull = true;
+
+// 9-slice frame cache. Frames are keyed by the contents of the corner and edge
+// images rather than their addresses (which get reused), plus the fill pixel
+// and frame size, so identical frames are only ever rendered once. They're
+// handed out by reference, so a hit costs nothing but the key.
+#define	WINDOW_STRETCH_CACHE_MAX_FRAMES		16
+
+// Pixel budget for frames nobody is using - room for a couple of 3840x2160
+// frames. Frames in use don't count against it.
+#define	WINDOW_STRETCH_CACHE_MAX_PIXELS		(16*1024*1024)
+
+typedef struct SWindowStretchKey
+{
+	uint64_t u64CornerHash;
+	uint64_t u64EdgeHash;
+	uint32_t u32CornerXSize;
+	uint32_t u32CornerYSize;
+	uint32_t u32EdgeXSize;
+	uint32_t u32EdgeYSize;
+	uint32_t u32RGBAFillPixel;
+	uint32_t u32XSize;
+	uint32_t u32YSize;
+} SWindowStretchKey;
+
+typedef struct SWindowStretchFrame
+{
+	SWindowStretchKey sKey;
+
+	// Rendered frame
+	uint32_t *pu32RGBA;
+
+	// # Of outstanding WindowRenderStretch() references
+	uint32_t u32References;
+
+	// Cache tick of last use (for LRU eviction)
+	uint64_t u64LastUsed;
+
+	struct SWindowStretchFrame *psNextLink;
+} SWindowStretchFrame;
+
+static SOSCriticalSection sg_sWindowStretchCacheLock;
+static SWindowStretchFrame *sg_psWindowStretchCache = NULL;
+static uint64_t sg_u64WindowStretchCacheTick = 0;
+
 // Lock or unlock the window list. Inherit the incoming status if it's
 // not ESTATUS_OK.
 #define	WindowListSetLock(bLock, eStatusIncoming)	WindowListSetLockInternal(__FUNCTION__, (uint32_t) __LINE__, bLock, eStatusIncoming)
@@ -195,9 +267,203 @@ void WindowUpdatedInternal(char *peFilename,
 						   uint32_t u32LineNumber)
 {
 //	DebugOutFunc("File='%s', line=%u\n", peFilename, u32LineNumber);
+
+	// No idea what changed, so redraw everything
+	if (sg_sFrameLock)
+	{
+		(void) OSCriticalSectionEnter(sg_sFrameLock);
+		sg_bWindowDamageFull = true;
+		(void) OSCriticalSectionLeave(sg_sFrameLock);
+	}
+	else
+	{
+		sg_bWindowDamageFull = true;
+	}
+
+	sg_bFramePending = true;
+}
+
+// Queues a damaged rectangle for the next frame
+static void WindowDamageAdd(bool bScreenRelative,
+							EWindowHandle eWindowHandle,
+							int32_t s32XPos,
+							int32_t s32YPos,
+							uint32_t u32XSize,
+							uint32_t u32YSize)
+{
+	if ((0 == u32XSize) ||
+		(0 == u32YSize))
+	{
+		return;
+	}
+
+	if (NULL == sg_sFrameLock)
+	{
+		WindowUpdated();
+		return;
+	}
+
+	(void) OSCriticalSectionEnter(sg_sFrameLock);
+
+	if (sg_bWindowDamageFull)
+	{
+		// Already redrawing everything
+	}
+	else
+	if (sg_u32WindowDamageCount >= (sizeof(sg_sWindowDamage) / sizeof(sg_sWindowDamage[0])))
+	{
+		// Too much going on - just redraw it all
+		sg_bWindowDamageFull = true;
+	}
+	else
+	{
+		SWindowDamage *psDamage = &sg_sWindowDamage[sg_u32WindowDamageCount++];
+
+		psDamage->bScreenRelative = bScreenRelative;
+		psDamage->eWindowHandle = eWindowHandle;
+		psDamage->s32XPos = s32XPos;
+		psDamage->s32YPos = s32YPos;
+		psDamage->u32XSize = u32XSize;
+		psDamage->u32YSize = u32YSize;
+	}
+
+	(void) OSCriticalSectionLeave(sg_sFrameLock);
+
 	sg_bFramePending = true;
 }
 
+// Called when only a (window relative) region of a window needs redrawing
+void WindowUpdatedRegion(EWindowHandle eWindowHandle,
+						 int32_t s32XPos,
+						 int32_t s32YPos,
+						 uint32_t u32XSize,
+						 uint32_t u32YSize)
+{
+	WindowDamageAdd(false,
+					eWindowHandle,
+					s32XPos,
+					s32YPos,
+					u32XSize,
+					u32YSize);
+}
+
+// Screen relative damage reported by the graphics layer
+static void WindowGraphicsDamageCallback(int32_t s32XPos,
+										 int32_t s32YPos,
+										 uint32_t u32XSize,
+										 uint32_t u32YSize)
+{
+	EWindowHandle eWindowHandle;
+
+	HandleSetInvalid((EHandleGeneric *) &eWindowHandle);
+	WindowDamageAdd(true,
+					eWindowHandle,
+					s32XPos,
+					s32YPos,
+					u32XSize,
+					u32YSize);
+}
+
+// Expands psRect to include the given rectangle
+static void WindowRectUnion(SWindowRect *psRect,
+							int32_t s32X1,
+							int32_t s32Y1,
+							int32_t s32X2,
+							int32_t s32Y2)
+{
+	if ((s32X2 <= s32X1) ||
+		(s32Y2 <= s32Y1))
+	{
+		// Nothing to add
+	}
+	else
+	if (psRect->s32X2 <= psRect->s32X1)
+	{
+		psRect->s32X1 = s32X1;
+		psRect->s32Y1 = s32Y1;
+		psRect->s32X2 = s32X2;
+		psRect->s32Y2 = s32Y2;
+	}
+	else
+	{
+		psRect->s32X1 = MIN(psRect->s32X1, s32X1);
+		psRect->s32Y1 = MIN(psRect->s32Y1, s32Y1);
+		psRect->s32X2 = MAX(psRect->s32X2, s32X2);
+		psRect->s32Y2 = MAX(psRect->s32Y2, s32Y2);
+	}
+}
+
+// Takes everything damaged since the last frame and turns it into a single
+// screen rectangle. Call with the window list locked. Returns true if the
+// whole screen needs redrawing.
+static bool WindowDamageCollect(SWindowRect *psRect)
+{
+	EStatus eStatus;
+	bool bFull;
+	uint32_t u32Count;
+	uint32_t u32Loop;
+	SWindowDamage sDamage[WINDOW_DAMAGE_MAX];
+
+	ZERO_STRUCT(*psRect);
+
+	eStatus = OSCriticalSectionEnter(sg_sFrameLock);
+	BASSERT(ESTATUS_OK == eStatus);
+
+	bFull = sg_bWindowDamageFull;
+	u32Count = sg_u32WindowDamageCount;
+	memcpy((void *) sDamage, (void *) sg_sWindowDamage, sizeof(sDamage[0]) * u32Count);
+	sg_bWindowDamageFull = false;
+	sg_u32WindowDamageCount = 0;
+
+	eStatus = OSCriticalSectionLeave(sg_sFrameLock);
+	BASSERT(ESTATUS_OK == eStatus);
+
+	if (bFull)
+	{
+		return(true);
+	}
+
+	for (u32Loop = 0; u32Loop < u32Count; u32Loop++)
+	{
+		int32_t s32XPos = sDamage[u32Loop].s32XPos;
+		int32_t s32YPos = sDamage[u32Loop].s32YPos;
+
+		if (false == sDamage[u32Loop].bScreenRelative)
+		{
+			SWindow *psWindow = sg_psWindowFar;
+
+			// Window relative - find the window and make it screen relative
+			while (psWindow)
+			{
+				if (psWindow->eWindowHandle == sDamage[u32Loop].eWindowHandle)
+				{
+					break;
+				}
+
+				psWindow = psWindow->psNextLink;
+			}
+
+			// If it's gone or hidden, whatever removed it asked for its own redraw
+			if ((NULL == psWindow) ||
+				(false == psWindow->bVisible))
+			{
+				continue;
+			}
+
+			s32XPos += psWindow->s32XPos;
+			s32YPos += psWindow->s32YPos;
+		}
+
+		WindowRectUnion(psRect,
+						s32XPos,
+						s32YPos,
+						s32XPos + (int32_t) sDamage[u32Loop].u32XSize,
+						s32YPos + (int32_t) sDamage[u32Loop].u32YSize);
+	}
+
+	return(false);
+}
+
 // Wait for a (virtual) frame
 static SOSEventFlag *sg_psFrameWaitEventFlag;
 
@@ -317,7 +583,7 @@ static void WindowFrameTimerCallback(STimer *psTimer,
 			else
 			if (sg_u32FrameBurst)
 			{
-				sg_bFramePending = true;
+				WindowUpdated();
 				sg_u32FrameBurst--;
 			}
 			else
@@ -1261,6 +1527,8 @@ static void WindowFrame(void)
 	bool bFrameStarted = false;
 	bool bWindowListLocked = false;
 	uint8_t u8Intensity = 0xff;
+	bool bDamageFull;
+	SWindowRect sDamage;
 
 	// Indicate that we've gotten the message we've been signaled
 	sg_bFrameSubmitted = false;
@@ -1281,6 +1549,14 @@ static void WindowFrame(void)
 	ERR_GOTO();
 	bWindowListLocked = true;
 
+	// Figure out what's changed since the last frame. If nothing, don't bother.
+	bDamageFull = WindowDamageCollect(&sDamage);
+	if ((false == bDamageFull) &&
+		(sDamage.s32X2 <= sDamage.s32X1))
+	{
+		goto errorExit;
+	}
+
 	// Let's see if there's anything to draw. If not, don't.
 	psWindow = sg_psWindowFar;
 	while (psWindow)
@@ -1296,8 +1572,20 @@ static void WindowFrame(void)
 	// psWindow is non-NULL if there is at least one visible window
 	if (psWindow)
 	{
-		// We're starting a frame and we do have things to draw
-		GraphicsStartFrame();
+		// We're starting a frame and we do have things to draw. Graphics keeps
+		// last frame around, so only what's damaged now needs redrawing.
+		if (bDamageFull)
+		{
+			GraphicsStartFrame();
+		}
+		else
+		{
+			GraphicsStartFrameRegion(sDamage.s32X1,
+									 sDamage.s32Y1,
+									 (uint32_t) (sDamage.s32X2 - sDamage.s32X1),
+									 (uint32_t) (sDamage.s32Y2 - sDamage.s32Y1));
+		}
+
 		bFrameStarted = true;
 //		DebugOut("**** GRAPHICS FRAME ****\n");
 
@@ -1751,6 +2039,14 @@ static void WindowProcessInputEvents(void)
 						sg_bKeyboardFocus = false;
 					}
 					else
+					if ((SDL_WINDOWEVENT_EXPOSED == sEvent.window.event) ||
+						(SDL_WINDOWEVENT_SIZE_CHANGED == sEvent.window.event) ||
+						(SDL_WINDOWEVENT_RESTORED == sEvent.window.event))
+					{
+						// Back buffer contents can't be trusted - redraw all of it
+						WindowUpdated();
+					}
+					else
 					if (SDL_WINDOWEVENT_MOVED == sEvent.window.event)
 					{
 						// Windowed mode and it got moved to:
@@ -3008,6 +3304,12 @@ EStatus WindowInit(void)
 	eStatus = OSCriticalSectionCreate(&sg_sFrameLock);
 	ERR_GOTO();
 
+	eStatus = OSCriticalSectionCreate(&sg_sWindowStretchCacheLock);
+	ERR_GOTO();
+
+	// Images changing on screen damage where they were drawn
+	GraphicsSetDamageCallback(WindowGraphicsDamageCallback);
+
 	eStatus = OSThreadCreate("Windowing library",
 							 NULL,
 							 WindowMainThread,
@@ -3040,123 +3342,91 @@ void WindowSetMaximize(void)
 	WindowUpdated();
 }
 
-EStatus WindowRenderStretch(uint32_t *pu32RGBACornerImage,
-							uint32_t u32CornerXSize,
-							uint32_t u32CornerYSize,
-							uint32_t *pu32RGBAEdgeImage,
-							uint32_t u32EdgeXSize,
-							uint32_t u32EdgeYSize,
-						    uint32_t u32RGBAFillPixel,
-							uint32_t u32WindowStretchXSize,
-							uint32_t u32WindowStretchYSize,
-							uint32_t **ppu32RGBAWindowStretchImage)
+// Renders a 9-slice frame into an already allocated image
+static void WindowRenderStretchInternal(uint32_t *pu32RGBACornerImage,
+										uint32_t u32CornerXSize,
+										uint32_t u32CornerYSize,
+										uint32_t *pu32RGBAEdgeImage,
+										uint32_t u32EdgeXSize,
+										uint32_t u32EdgeYSize,
+										uint32_t u32RGBAFillPixel,
+										uint32_t u32WindowStretchXSize,
+										uint32_t u32WindowStretchYSize,
+										uint32_t *pu32RGBAWindowStretchImage)
 {
-	EStatus eStatus = ESTATUS_OK;
 	uint32_t u32Loop;
 	uint32_t *pu32RGBADest;
 	uint32_t *pu32RGBADest2;
 	uint32_t *pu32RGBASrc;
 
-	// See if X size is too small
-	if ((u32CornerXSize << 1) > u32WindowStretchXSize)
-	{
-		eStatus = ESTATUS_UI_TOO_SMALL;
-		goto errorExit;
-	}
-
-	// Now Y size
-	if ((u32CornerYSize << 1) > u32WindowStretchYSize)
-	{
-		eStatus = ESTATUS_UI_TOO_SMALL;
-		goto errorExit;
-	}
-
-	// Allocate some space for everything
-	MEMALLOC(*ppu32RGBAWindowStretchImage, sizeof(**ppu32RGBAWindowStretchImage) * u32WindowStretchXSize * u32WindowStretchYSize);
-
 	// Fill everything with the fill pixel
-	u32Loop = u32WindowStretchXSize * u32WindowStretchYSize;
-	pu32RGBADest = *ppu32RGBAWindowStretchImage;
-	while (u32Loop)
-	{
-		*pu32RGBADest = u32RGBAFillPixel;
-		++pu32RGBADest;
-		u32Loop--;
-	}
+	BlendFill(pu32RGBAWindowStretchImage,
+			  u32RGBAFillPixel,
+			  (uint64_t) u32WindowStretchXSize * (uint64_t) u32WindowStretchYSize);
 
 	// Copy in the upper left hand corner
-	pu32RGBADest = *ppu32RGBAWindowStretchImage;
+	pu32RGBADest = pu32RGBAWindowStretchImage;
 	pu32RGBASrc = pu32RGBACornerImage;
 	u32Loop = u32CornerYSize;
 	while (u32Loop)
 	{
-		memcpy((void *) pu32RGBADest, (void *) pu32RGBASrc, u32CornerXSize * sizeof(*pu32RGBASrc));
+		BlendCopy(pu32RGBADest,
+				  pu32RGBASrc,
+				  u32CornerXSize);
 		pu32RGBASrc += u32CornerXSize;
 		pu32RGBADest += u32WindowStretchXSize;
 		u32Loop--;
 	}
 
 	// Now the lower left hand corner (vertical flip)
-	pu32RGBADest = *ppu32RGBAWindowStretchImage + ((u32WindowStretchYSize - 1) * u32WindowStretchXSize);
+	pu32RGBADest = pu32RGBAWindowStretchImage + ((u32WindowStretchYSize - 1) * u32WindowStretchXSize);
 	pu32RGBASrc = pu32RGBACornerImage;
 	u32Loop = u32CornerYSize;
 	while (u32Loop)
 	{
-		memcpy((void *) pu32RGBADest, (void *) pu32RGBASrc, u32CornerXSize * sizeof(*pu32RGBASrc));
+		BlendCopy(pu32RGBADest,
+				  pu32RGBASrc,
+				  u32CornerXSize);
 		pu32RGBASrc += u32CornerXSize;
 		pu32RGBADest -= u32WindowStretchXSize;
 		u32Loop--;
 	}
 
 	// Now the upper right hand corner (horizontal flip)
-	pu32RGBADest = *ppu32RGBAWindowStretchImage + (u32WindowStretchXSize - u32CornerXSize);
-	pu32RGBASrc = (pu32RGBACornerImage + u32CornerXSize);
+	pu32RGBADest = pu32RGBAWindowStretchImage + (u32WindowStretchXSize - u32CornerXSize);
+	pu32RGBASrc = pu32RGBACornerImage;
 	u32Loop = u32CornerYSize;
 	while (u32Loop)
 	{
-		uint32_t u32Loop2;
+		BlendCopyMirror(pu32RGBADest,
+						pu32RGBASrc,
+						u32CornerXSize);
 
-		u32Loop2 = u32CornerXSize;
-		while (u32Loop2)
-		{
-			--pu32RGBASrc;
-			*pu32RGBADest = *pu32RGBASrc;
-			++pu32RGBADest;
-			u32Loop2--;
-		}
-
-		// Jump to the end of the next line on the corner
-		pu32RGBASrc += (u32CornerXSize << 1);
-		pu32RGBADest += (u32WindowStretchXSize - u32CornerXSize);
+		// Next line on the corner
+		pu32RGBASrc += u32CornerXSize;
+		pu32RGBADest += u32WindowStretchXSize;
 		u32Loop--;
 	}
 
 	// Now the lower right hand corner (horizontal and vertical flip)
-	pu32RGBADest = *ppu32RGBAWindowStretchImage + (u32WindowStretchXSize * ((u32WindowStretchYSize - u32CornerYSize) + 1)) - u32CornerXSize;
+	pu32RGBADest = pu32RGBAWindowStretchImage + (u32WindowStretchXSize * ((u32WindowStretchYSize - u32CornerYSize) + 1)) - u32CornerXSize;
 	pu32RGBASrc = (pu32RGBACornerImage + (u32CornerXSize * u32CornerYSize));
 	u32Loop = u32CornerYSize;
 	while (u32Loop)
 	{
-		uint32_t u32Loop2;
-
-		u32Loop2 = u32CornerXSize;
-		while (u32Loop2)
-		{
-			--pu32RGBASrc;
-			*pu32RGBADest = *pu32RGBASrc;
-			++pu32RGBADest;
-			u32Loop2--;
-		}
-
-		// Jump to the end of the next line on the corner
-		pu32RGBADest += (u32WindowStretchXSize - u32CornerXSize);
+		// Previous line on the corner
+		pu32RGBASrc -= u32CornerXSize;
+		BlendCopyMirror(pu32RGBADest,
+						pu32RGBASrc,
+						u32CornerXSize);
+		pu32RGBADest += u32WindowStretchXSize;
 		u32Loop--;
 	}
 
 	// Now we need to do the edges
 
 	// Top and bottom
-	pu32RGBADest = *ppu32RGBAWindowStretchImage + u32CornerXSize;
+	pu32RGBADest = pu32RGBAWindowStretchImage + u32CornerXSize;
 	pu32RGBADest2 = pu32RGBADest + (u32WindowStretchXSize * (u32WindowStretchYSize - 1));
 	u32Loop = u32WindowStretchXSize - (u32CornerXSize << 1);
 	while (u32Loop)
@@ -3174,8 +3444,12 @@ EStatus WindowRenderStretch(uint32_t *pu32RGBACornerImage,
 		u32Loop2 = u32EdgeYSize;
 		while (u32Loop2)
 		{
-			memcpy((void *) pu32RGBADest, (void *) pu32RGBASrc, sizeof(*pu32RGBADest) * u32Chunk);
-			memcpy((void *) pu32RGBADest2, (void *) pu32RGBASrc, sizeof(*pu32RGBADest) * u32Chunk);
+			BlendCopy(pu32RGBADest,
+					  pu32RGBASrc,
+					  u32Chunk);
+			BlendCopy(pu32RGBADest2,
+					  pu32RGBASrc,
+					  u32Chunk);
 			pu32RGBADest += u32WindowStretchXSize;
 			pu32RGBADest2 -= u32WindowStretchXSize;
 			pu32RGBASrc += u32EdgeXSize;
@@ -3190,8 +3464,8 @@ EStatus WindowRenderStretch(uint32_t *pu32RGBACornerImage,
 	}
 
 	// Left and right
-	pu32RGBADest = *ppu32RGBAWindowStretchImage + (u32WindowStretchXSize * u32CornerYSize);
-	pu32RGBADest2 = *ppu32RGBAWindowStretchImage + (u32WindowStretchXSize * u32CornerYSize) + (u32WindowStretchXSize - 1);
+	pu32RGBADest = pu32RGBAWindowStretchImage + (u32WindowStretchXSize * u32CornerYSize);
+	pu32RGBADest2 = pu32RGBAWindowStretchImage + (u32WindowStretchXSize * u32CornerYSize) + (u32WindowStretchXSize - 1);
 	u32Loop = u32WindowStretchYSize - (u32CornerYSize << 1);
 	while (u32Loop)
 	{
@@ -3234,12 +3508,265 @@ EStatus WindowRenderStretch(uint32_t *pu32RGBACornerImage,
 
 		u32Loop -= u32Chunk;
 	}
+}
+
+// FNV-1a hash of an image's pixels
+static uint64_t WindowStretchHash(uint32_t *pu32RGBA,
+								  uint64_t u64Count)
+{
+	uint64_t u64Hash = 0xcbf29ce484222325;
+
+	while (u64Count)
+	{
+		u64Hash = (u64Hash ^ *pu32RGBA) * 0x100000001b3;
+		++pu32RGBA;
+		u64Count--;
+	}
+
+	return(u64Hash);
+}
+
+// Validates the stretch parameters and builds a cache key for them
+static EStatus WindowStretchKeyCreate(SWindowStretchKey *psKey,
+									  uint32_t *pu32RGBACornerImage,
+									  uint32_t u32CornerXSize,
+									  uint32_t u32CornerYSize,
+									  uint32_t *pu32RGBAEdgeImage,
+									  uint32_t u32EdgeXSize,
+									  uint32_t u32EdgeYSize,
+									  uint32_t u32RGBAFillPixel,
+									  uint32_t u32WindowStretchXSize,
+									  uint32_t u32WindowStretchYSize)
+{
+	// See if X size is too small
+	if ((u32CornerXSize << 1) > u32WindowStretchXSize)
+	{
+		return(ESTATUS_UI_TOO_SMALL);
+	}
+
+	// Now Y size
+	if ((u32CornerYSize << 1) > u32WindowStretchYSize)
+	{
+		return(ESTATUS_UI_TOO_SMALL);
+	}
+
+	// Zeroed so padding doesn't upset memcmp()
+	memset((void *) psKey, 0, sizeof(*psKey));
+	psKey->u64CornerHash = WindowStretchHash(pu32RGBACornerImage,
+											 (uint64_t) u32CornerXSize * (uint64_t) u32CornerYSize);
+	psKey->u64EdgeHash = WindowStretchHash(pu32RGBAEdgeImage,
+										   (uint64_t) u32EdgeXSize * (uint64_t) u32EdgeYSize);
+	psKey->u32CornerXSize = u32CornerXSize;
+	psKey->u32CornerYSize = u32CornerYSize;
+	psKey->u32EdgeXSize = u32EdgeXSize;
+	psKey->u32EdgeYSize = u32EdgeYSize;
+	psKey->u32RGBAFillPixel = u32RGBAFillPixel;
+	psKey->u32XSize = u32WindowStretchXSize;
+	psKey->u32YSize = u32WindowStretchYSize;
+
+	return(ESTATUS_OK);
+}
+
+// Evicts least recently used, unreferenced frames until the cache is within
+// budget. Call with sg_sWindowStretchCacheLock held.
+static void WindowStretchCacheTrim(uint32_t u32MaxFrames,
+								   uint64_t u64MaxPixels)
+{
+	while (1)
+	{
+		SWindowStretchFrame **ppsLink = &sg_psWindowStretchCache;
+		SWindowStretchFrame **ppsVictim = NULL;
+		SWindowStretchFrame *psFrame;
+		uint32_t u32Frames = 0;
+		uint64_t u64Pixels = 0;
+
+		while (*ppsLink)
+		{
+			psFrame = *ppsLink;
+
+			if (0 == psFrame->u32References)
+			{
+				u32Frames++;
+				u64Pixels += (uint64_t) psFrame->sKey.u32XSize * (uint64_t) psFrame->sKey.u32YSize;
+
+				if ((NULL == ppsVictim) ||
+					(psFrame->u64LastUsed < (*ppsVictim)->u64LastUsed))
+				{
+					ppsVictim = ppsLink;
+				}
+			}
+
+			ppsLink = &psFrame->psNextLink;
+		}
+
+		// Within budget, or everything left is in use
+		if (((u32Frames <= u32MaxFrames) && (u64Pixels <= u64MaxPixels)) ||
+			(NULL == ppsVictim))
+		{
+			break;
+		}
+
+		psFrame = *ppsVictim;
+		*ppsVictim = psFrame->psNextLink;
+		SafeMemFree(psFrame->pu32RGBA);
+		MemFree(psFrame);
+	}
+}
 
+// Finds a frame in the cache, rendering and inserting it if it isn't there.
+// Call with sg_sWindowStretchCacheLock held.
+static EStatus WindowStretchCacheGet(SWindowStretchKey *psKey,
+									 uint32_t *pu32RGBACornerImage,
+									 uint32_t *pu32RGBAEdgeImage,
+									 SWindowStretchFrame **ppsFrame)
+{
+	EStatus eStatus = ESTATUS_OK;
+	SWindowStretchFrame *psFrame = sg_psWindowStretchCache;
+	SWindowStretchFrame *psFrameNew = NULL;
+
+	while (psFrame)
+	{
+		if (0 == memcmp((void *) &psFrame->sKey, (void *) psKey, sizeof(*psKey)))
+		{
+			break;
+		}
+
+		psFrame = psFrame->psNextLink;
+	}
+
+	if (NULL == psFrame)
+	{
+		// Not cached - render it
+		MEMALLOC(psFrameNew, sizeof(*psFrameNew));
+		memcpy((void *) &psFrameNew->sKey, (void *) psKey, sizeof(psFrameNew->sKey));
+		MEMALLOC_NO_CLEAR(psFrameNew->pu32RGBA, sizeof(*psFrameNew->pu32RGBA) * psKey->u32XSize * psKey->u32YSize);
+
+		WindowRenderStretchInternal(pu32RGBACornerImage,
+									psKey->u32CornerXSize,
+									psKey->u32CornerYSize,
+									pu32RGBAEdgeImage,
+									psKey->u32EdgeXSize,
+									psKey->u32EdgeYSize,
+									psKey->u32RGBAFillPixel,
+									psKey->u32XSize,
+									psKey->u32YSize,
+									psFrameNew->pu32RGBA);
+
+		psFrameNew->psNextLink = sg_psWindowStretchCache;
+		sg_psWindowStretchCache = psFrameNew;
+		psFrame = psFrameNew;
+		psFrameNew = NULL;
+	}
+
+	psFrame->u64LastUsed = ++sg_u64WindowStretchCacheTick;
+	*ppsFrame = psFrame;
 
 errorExit:
+	if (psFrameNew)
+	{
+		SafeMemFree(psFrameNew->pu32RGBA);
+		MemFree(psFrameNew);
+	}
+
 	return(eStatus);
 }
 
+// Renders a 9-slice frame (mirrored corners, tiled edges, filled center), or
+// finds an identical one already rendered. The frame is shared and read only -
+// don't draw into it - and must be handed back with WindowRenderStretchRelease().
+EStatus WindowRenderStretch(uint32_t *pu32RGBACornerImage,
+							uint32_t u32CornerXSize,
+							uint32_t u32CornerYSize,
+							uint32_t *pu32RGBAEdgeImage,
+							uint32_t u32EdgeXSize,
+							uint32_t u32EdgeYSize,
+						    uint32_t u32RGBAFillPixel,
+							uint32_t u32WindowStretchXSize,
+							uint32_t u32WindowStretchYSize,
+							uint32_t **ppu32RGBAWindowStretchImage)
+{
+	EStatus eStatus;
+	SWindowStretchKey sKey;
+	SWindowStretchFrame *psFrame = NULL;
+
+	*ppu32RGBAWindowStretchImage = NULL;
+
+	eStatus = WindowStretchKeyCreate(&sKey,
+									 pu32RGBACornerImage,
+									 u32CornerXSize,
+									 u32CornerYSize,
+									 pu32RGBAEdgeImage,
+									 u32EdgeXSize,
+									 u32EdgeYSize,
+									 u32RGBAFillPixel,
+									 u32WindowStretchXSize,
+									 u32WindowStretchYSize);
+	ERR_GOTO();
+
+	eStatus = OSCriticalSectionEnter(sg_sWindowStretchCacheLock);
+	ERR_GOTO();
+
+	eStatus = WindowStretchCacheGet(&sKey,
+									pu32RGBACornerImage,
+									pu32RGBAEdgeImage,
+									&psFrame);
+	if (ESTATUS_OK == eStatus)
+	{
+		psFrame->u32References++;
+		*ppu32RGBAWindowStretchImage = psFrame->pu32RGBA;
+
+		WindowStretchCacheTrim(WINDOW_STRETCH_CACHE_MAX_FRAMES,
+							   WINDOW_STRETCH_CACHE_MAX_PIXELS);
+	}
+
+	EStatusResultConditional(OSCriticalSectionLeave(sg_sWindowStretchCacheLock));
+
+errorExit:
+	return(eStatus);
+}
+
+// Hands back a frame obtained from WindowRenderStretch()
+void WindowRenderStretchRelease(uint32_t **ppu32RGBAWindowStretchImage)
+{
+	EStatus eStatus;
+	SWindowStretchFrame *psFrame;
+
+	if (NULL == *ppu32RGBAWindowStretchImage)
+	{
+		return;
+	}
+
+	eStatus = OSCriticalSectionEnter(sg_sWindowStretchCacheLock);
+	BASSERT(ESTATUS_OK == eStatus);
+
+	psFrame = sg_psWindowStretchCache;
+	while (psFrame)
+	{
+		if (psFrame->pu32RGBA == *ppu32RGBAWindowStretchImage)
+		{
+			break;
+		}
+
+		psFrame = psFrame->psNextLink;
+	}
+
+	// If this asserts, the frame didn't come from WindowRenderStretch()
+	BASSERT(psFrame);
+	if (psFrame)
+	{
+		BASSERT(psFrame->u32References);
+		psFrame->u32References--;
+	}
+
+	WindowStretchCacheTrim(WINDOW_STRETCH_CACHE_MAX_FRAMES,
+						   WINDOW_STRETCH_CACHE_MAX_PIXELS);
+
+	eStatus = OSCriticalSectionLeave(sg_sWindowStretchCacheLock);
+	BASSERT(ESTATUS_OK == eStatus);
+
+	*ppu32RGBAWindowStretchImage = NULL;
+}
+
 EStatus WindowShutdown(void)
 {
 	EStatus eStatus = ESTATUS_OK;
@@ -3257,6 +3784,23 @@ EStatus WindowShutdown(void)
 		eStatus = OSSemaphoreGet(sg_sWindowStartupShutdownSemaphore,
 								 OS_WAIT_INDEFINITE);
 		ERR_GOTO();
+
+		// Toss the cached 9-slice frames, in use or not, and the lock that guards them
+		eStatus = OSCriticalSectionEnter(sg_sWindowStretchCacheLock);
+		ERR_GOTO();
+		while (sg_psWindowStretchCache)
+		{
+			SWindowStretchFrame *psFrame = sg_psWindowStretchCache;
+
+			sg_psWindowStretchCache = psFrame->psNextLink;
+			SafeMemFree(psFrame->pu32RGBA);
+			MemFree(psFrame);
+		}
+		eStatus = OSCriticalSectionLeave(sg_sWindowStretchCacheLock);
+		ERR_GOTO();
+
+		eStatus = OSCriticalSectionDestroy(&sg_sWindowStretchCacheLock);
+		ERR_GOTO();
 	}
 
 errorExit:
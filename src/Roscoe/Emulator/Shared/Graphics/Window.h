@@ -18,6 +18,11 @@ extern EStatus WindowInit(void);
 extern EStatus WindowShutdown(void);
 extern void WindowUpdatedInternal(char *peModule, uint32_t u32LineNumber);
 #define	WindowUpdated()	WindowUpdatedInternal((char *) __FILE__, (uint32_t) __LINE__);
+extern void WindowUpdatedRegion(EWindowHandle eWindowHandle,
+								int32_t s32XPos,
+								int32_t s32YPos,
+								uint32_t u32XSize,
+								uint32_t u32YSize);
 extern void WindowSetFrameLock(bool bLock);
 extern bool WindowScancodeGetState(SDL_Scancode eScancode);
 extern EStatus WindowRemoveControl(EWindowHandle eWindowHandle,
@@ -73,5 +78,6 @@ extern EStatus WindowRenderStretch(uint32_t *pu32RGBACornerImage,
 								   uint32_t u32WindowStretchXSize,
 								   uint32_t u32WindowStretchYSize,
 								   uint32_t **ppu32RGBAWindowStretchImage);
+extern void WindowRenderStretchRelease(uint32_t **ppu32RGBAWindowStretchImage);
 
 #endif
\ No newline at end of file
@@ -63,14 +63,53 @@
 #define sigma0(x)	(ROTR(x,7)  ^ ROTR(x,18) ^ ((x)>>3))
 #define sigma1(x)	(ROTR(x,17) ^ ROTR(x,19) ^ ((x)>>10))
 
-#define A m->counter[0]
-#define B m->counter[1]
-#define C m->counter[2]
-#define D m->counter[3]
-#define E m->counter[4]
-#define F m->counter[5]
-#define G m->counter[6]
-#define H m->counter[7]
+// x86 hosts get SHA-NI and AVX2 kernels, selected at runtime. Everything
+// else (including the 68030) runs the portable version.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#ifdef SHA256_STANDALONE
+// Host tools that don't link the emulator's SharedMisc.c (stamp) ask the
+// compiler about the CPU instead
+#define	SHARED_CPU_AVX2			0x00000001
+#define	SHARED_CPU_SHANI		0x00000002
+
+static uint32_t SharedCPUFeaturesGet(void)
+{
+	uint32_t u32Features = 0;
+
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx2"))
+	{
+		u32Features |= SHARED_CPU_AVX2;
+	}
+
+	if (__builtin_cpu_supports("sha") &&
+		__builtin_cpu_supports("sse4.1") &&
+		__builtin_cpu_supports("ssse3"))
+	{
+		u32Features |= SHARED_CPU_SHANI;
+	}
+
+	return(u32Features);
+}
+#else
+#include "Shared/SharedMisc.h"
+#endif
+#ifdef _MSC_VER
+#define	SHA256_TARGET_SHANI
+#define	SHA256_TARGET_AVX2
+#else
+#define	SHA256_TARGET_SHANI		__attribute__((target("sha,sse4.1,ssse3")))
+#define	SHA256_TARGET_AVX2		__attribute__((target("avx2")))
+#endif
+#define	SHA256_X86				1
+#endif
+
+// Size of a SHA-256 block
+#define	SHA256_BLOCK_SIZE		64
+
+// # Of messages hashed side by side by the multi-buffer kernel
+#define	SHA256_LANES			8
 
 static const uint32_t constant_256[64] = {
     0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5,
@@ -91,112 +130,347 @@ static const uint32_t constant_256[64] = {
     0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
 };
 
+static const uint32_t sg_u32SHA256InitialState[8] =
+{
+	0x6a09e667, 0xbb67ae85, 0x3c6ef372, 0xa54ff53a,
+	0x510e527f, 0x9b05688c, 0x1f83d9ab, 0x5be0cd19
+};
+
 void
 MySHA256_Init (MY_SHA256_CTX *m)
 {
     m->sz[0] = 0;
     m->sz[1] = 0;
-    A = 0x6a09e667;
-    B = 0xbb67ae85;
-    C = 0x3c6ef372;
-    D = 0xa54ff53a;
-    E = 0x510e527f;
-    F = 0x9b05688c;
-    G = 0x1f83d9ab;
-    H = 0x5be0cd19;
+    memcpy(m->counter, sg_u32SHA256InitialState, sizeof(m->counter));
 }
 
-static void
-calc (MY_SHA256_CTX *m, uint32_t *in)
+// Fetch a big endian 32 bit word from the message. The 68030 is big endian
+// and doesn't care about alignment, so it can just load it.
+#if defined(__m68k__) || defined(WORDS_BIGENDIAN)
+#define	SHA256_LOAD(p)			(*((const uint32_t *) (p)))
+#else
+#define	SHA256_LOAD(p)			((((uint32_t) (p)[0]) << 24) | \
+								 (((uint32_t) (p)[1]) << 16) | \
+								 (((uint32_t) (p)[2]) << 8) | \
+								 ((uint32_t) (p)[3]))
+#endif
+
+// One round. The working variables are rotated by renaming them at the call
+// site rather than by moving them around, so 8 rounds in a row put
+// everything back where it started.
+#define	SHA256_ROUND(a, b, c, d, e, f, g, h, i) \
+	u32Temp = (h) + Sigma1(e) + Ch(e, f, g) + constant_256[i] + u32Schedule[(i) & 15]; \
+	(d) += u32Temp; \
+	(h) = u32Temp + Sigma0(a) + Maj(a, b, c);
+
+// Portable kernel. The message schedule is a rolling 16 word window instead
+// of the full 64 words, and the rounds are unrolled 8 at a time so the
+// working variables stay in registers (the 68030 has just enough).
+static void SHA256CompressPortable(uint32_t *pu32State,
+								   const uint8_t *pu8Data,
+								   size_t BlockCount)
 {
-    uint32_t AA, BB, CC, DD, EE, FF, GG, HH;
-    uint32_t data[64];
-    int i;
-
-    AA = A;
-    BB = B;
-    CC = C;
-    DD = D;
-    EE = E;
-    FF = F;
-    GG = G;
-    HH = H;
-
-    for (i = 0; i < 16; ++i)
-	data[i] = in[i];
-    for (i = 16; i < 64; ++i)
-	data[i] = sigma1(data[i-2]) + data[i-7] + 
-	    sigma0(data[i-15]) + data[i - 16];
-
-    for (i = 0; i < 64; i++) {
-	uint32_t T1, T2;
-
-	T1 = HH + Sigma1(EE) + Ch(EE, FF, GG) + constant_256[i] + data[i];
-	T2 = Sigma0(AA) + Maj(AA,BB,CC);
-			     
-	HH = GG;
-	GG = FF;
-	FF = EE;
-	EE = DD + T1;
-	DD = CC;
-	CC = BB;
-	BB = AA;
-	AA = T1 + T2;
-    }
+	while (BlockCount)
+	{
+		uint32_t u32Schedule[16];
+		uint32_t a = pu32State[0];
+		uint32_t b = pu32State[1];
+		uint32_t c = pu32State[2];
+		uint32_t d = pu32State[3];
+		uint32_t e = pu32State[4];
+		uint32_t f = pu32State[5];
+		uint32_t g = pu32State[6];
+		uint32_t h = pu32State[7];
+		uint32_t u32Temp;
+		uint32_t u32Round;
 
-    A += AA;
-    B += BB;
-    C += CC;
-    D += DD;
-    E += EE;
-    F += FF;
-    G += GG;
-    H += HH;
-}
+		for (u32Round = 0; u32Round < 64; u32Round += 8)
+		{
+			uint32_t u32Loop;
 
-/*
- * From `Performance analysis of MD5' by Joseph D. Touch <touch@isi.edu>
- */
+			if (u32Round < 16)
+			{
+				for (u32Loop = u32Round; u32Loop < u32Round + 8; u32Loop++)
+				{
+					u32Schedule[u32Loop] = SHA256_LOAD(pu8Data + (u32Loop << 2));
+				}
+			}
+			else
+			{
+				for (u32Loop = u32Round; u32Loop < u32Round + 8; u32Loop++)
+				{
+					u32Schedule[u32Loop & 15] += sigma1(u32Schedule[(u32Loop - 2) & 15]) +
+												 u32Schedule[(u32Loop - 7) & 15] +
+												 sigma0(u32Schedule[(u32Loop - 15) & 15]);
+				}
+			}
 
-#if !defined(WORDS_BIGENDIAN) || defined(_CRAY)
-/* Vector Crays doesn't have a good 32-bit type, or more precisely,
-   int32_t as defined by <bind/bitypes.h> isn't 32 bits, and we don't
-   want to depend in being able to redefine this type.  To cope with
-   this we have to clamp the result in some places to [0,2^32); no
-   need to do this on other machines.  Did I say this was a mess?
-   */
+			SHA256_ROUND(a, b, c, d, e, f, g, h, u32Round + 0);
+			SHA256_ROUND(h, a, b, c, d, e, f, g, u32Round + 1);
+			SHA256_ROUND(g, h, a, b, c, d, e, f, u32Round + 2);
+			SHA256_ROUND(f, g, h, a, b, c, d, e, u32Round + 3);
+			SHA256_ROUND(e, f, g, h, a, b, c, d, u32Round + 4);
+			SHA256_ROUND(d, e, f, g, h, a, b, c, u32Round + 5);
+			SHA256_ROUND(c, d, e, f, g, h, a, b, u32Round + 6);
+			SHA256_ROUND(b, c, d, e, f, g, h, a, u32Round + 7);
+		}
 
-#ifdef _CRAY
-#define CRAYFIX(X) ((X) & 0xffffffff)
-#else
-#define CRAYFIX(X) (X)
-#endif
+		pu32State[0] += a;
+		pu32State[1] += b;
+		pu32State[2] += c;
+		pu32State[3] += d;
+		pu32State[4] += e;
+		pu32State[5] += f;
+		pu32State[6] += g;
+		pu32State[7] += h;
 
-static inline uint32_t
-cshift (uint32_t x, unsigned int n)
+		pu8Data += SHA256_BLOCK_SIZE;
+		BlockCount--;
+	}
+}
+
+#ifdef SHA256_X86
+
+// SHA-NI kernel. The message schedule is built 4 words at a time with
+// sha256msg1/msg2 and each sha256rnds2 does two rounds.
+SHA256_TARGET_SHANI static void SHA256CompressSHANI(uint32_t *pu32State,
+													const uint8_t *pu8Data,
+													size_t BlockCount)
 {
-    x = CRAYFIX(x);
-    return CRAYFIX((x << n) | (x >> (32 - n)));
+	const __m128i sByteSwap = _mm_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	__m128i sState0;
+	__m128i sState1;
+	__m128i sTemp;
+
+	// The instructions want the state as ABEF/CDGH
+	sTemp = _mm_loadu_si128((const __m128i *) &pu32State[0]);
+	sState1 = _mm_loadu_si128((const __m128i *) &pu32State[4]);
+	sTemp = _mm_shuffle_epi32(sTemp, 0xb1);
+	sState1 = _mm_shuffle_epi32(sState1, 0x1b);
+	sState0 = _mm_alignr_epi8(sTemp, sState1, 8);
+	sState1 = _mm_blend_epi16(sState1, sTemp, 0xf0);
+
+	while (BlockCount)
+	{
+		__m128i sSchedule[16];
+		__m128i sSaveState0 = sState0;
+		__m128i sSaveState1 = sState1;
+		uint32_t u32Loop;
+
+		for (u32Loop = 0; u32Loop < 16; u32Loop++)
+		{
+			__m128i sMessage;
+
+			if (u32Loop < 4)
+			{
+				sSchedule[u32Loop] = _mm_shuffle_epi8(_mm_loadu_si128((const __m128i *) (pu8Data + (u32Loop << 4))), sByteSwap);
+			}
+			else
+			{
+				sTemp = _mm_add_epi32(_mm_sha256msg1_epu32(sSchedule[u32Loop - 4], sSchedule[u32Loop - 3]),
+									  _mm_alignr_epi8(sSchedule[u32Loop - 1], sSchedule[u32Loop - 2], 4));
+				sSchedule[u32Loop] = _mm_sha256msg2_epu32(sTemp, sSchedule[u32Loop - 1]);
+			}
+
+			sMessage = _mm_add_epi32(sSchedule[u32Loop], _mm_loadu_si128((const __m128i *) &constant_256[u32Loop << 2]));
+			sState1 = _mm_sha256rnds2_epu32(sState1, sState0, sMessage);
+			sMessage = _mm_shuffle_epi32(sMessage, 0x0e);
+			sState0 = _mm_sha256rnds2_epu32(sState0, sState1, sMessage);
+		}
+
+		sState0 = _mm_add_epi32(sState0, sSaveState0);
+		sState1 = _mm_add_epi32(sState1, sSaveState1);
+
+		pu8Data += SHA256_BLOCK_SIZE;
+		BlockCount--;
+	}
+
+	// Back to ABCD/EFGH
+	sTemp = _mm_shuffle_epi32(sState0, 0x1b);
+	sState1 = _mm_shuffle_epi32(sState1, 0xb1);
+	sState0 = _mm_blend_epi16(sTemp, sState1, 0xf0);
+	sState1 = _mm_alignr_epi8(sState1, sTemp, 8);
+
+	_mm_storeu_si128((__m128i *) &pu32State[0], sState0);
+	_mm_storeu_si128((__m128i *) &pu32State[4], sState1);
 }
 
-static inline uint32_t
-swap_uint32_t (uint32_t t)
+#define	SHA256X8_ROTR(x, n)		_mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32 - (n)))
+#define	SHA256X8_XOR3(x, y, z)	_mm256_xor_si256(_mm256_xor_si256(x, y), z)
+#define	SHA256X8_ADD3(x, y, z)	_mm256_add_epi32(_mm256_add_epi32(x, y), z)
+
+#define	SHA256X8_ROUND(a, b, c, d, e, f, g, h, i) \
+	sTemp = SHA256X8_ADD3(h, SHA256X8_XOR3(SHA256X8_ROTR(e, 6), SHA256X8_ROTR(e, 11), SHA256X8_ROTR(e, 25)), \
+						  _mm256_xor_si256(_mm256_and_si256(e, f), _mm256_andnot_si256(e, g))); \
+	sTemp = SHA256X8_ADD3(sTemp, _mm256_set1_epi32((int) constant_256[i]), sSchedule[(i) & 15]); \
+	(d) = _mm256_add_epi32(d, sTemp); \
+	(h) = SHA256X8_ADD3(sTemp, SHA256X8_XOR3(SHA256X8_ROTR(a, 2), SHA256X8_ROTR(a, 13), SHA256X8_ROTR(a, 22)), \
+						_mm256_or_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, _mm256_or_si256(a, b))));
+
+// AVX2 multi-buffer kernel. Hashes BlockCount blocks of 8 independent
+// messages at once, one per 32 bit lane. pu32State holds the 8 states one
+// after the other.
+SHA256_TARGET_AVX2 static void SHA256CompressX8AVX2(uint32_t *pu32State,
+													const uint8_t **ppu8Data,
+													size_t BlockCount)
 {
-    uint32_t temp1, temp2;
-
-    temp1   = cshift(t, 16);
-    temp2   = temp1 >> 8;
-    temp1  &= 0x00ff00ff;
-    temp2  &= 0x00ff00ff;
-    temp1 <<= 8;
-    return temp1 | temp2;
+	const __m256i sByteSwap = _mm256_set_epi64x(0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL,
+												0x0c0d0e0f08090a0bULL, 0x0405060700010203ULL);
+	const __m256i sStateIndex = _mm256_set_epi32(7 * 8, 6 * 8, 5 * 8, 4 * 8, 3 * 8, 2 * 8, 1 * 8, 0);
+	const uint8_t *pu8Data[SHA256_LANES];
+	__m256i sState[8];
+	__m256i sTemp;
+	uint32_t u32Loop;
+
+	// Transpose the states so each register holds one working variable for all lanes
+	for (u32Loop = 0; u32Loop < 8; u32Loop++)
+	{
+		sState[u32Loop] = _mm256_i32gather_epi32((const int *) (pu32State + u32Loop), sStateIndex, 4);
+	}
+
+	for (u32Loop = 0; u32Loop < SHA256_LANES; u32Loop++)
+	{
+		pu8Data[u32Loop] = ppu8Data[u32Loop];
+	}
+
+	while (BlockCount)
+	{
+		__m256i sSchedule[16];
+		__m256i a = sState[0];
+		__m256i b = sState[1];
+		__m256i c = sState[2];
+		__m256i d = sState[3];
+		__m256i e = sState[4];
+		__m256i f = sState[5];
+		__m256i g = sState[6];
+		__m256i h = sState[7];
+		uint32_t u32Round;
+
+		for (u32Round = 0; u32Round < 64; u32Round += 8)
+		{
+			if (u32Round < 16)
+			{
+				for (u32Loop = u32Round; u32Loop < u32Round + 8; u32Loop++)
+				{
+					uint32_t u32Offset = u32Loop << 2;
+
+					sSchedule[u32Loop] = _mm256_shuffle_epi8(_mm256_set_epi32(*((const int *) (pu8Data[7] + u32Offset)),
+																			  *((const int *) (pu8Data[6] + u32Offset)),
+																			  *((const int *) (pu8Data[5] + u32Offset)),
+																			  *((const int *) (pu8Data[4] + u32Offset)),
+																			  *((const int *) (pu8Data[3] + u32Offset)),
+																			  *((const int *) (pu8Data[2] + u32Offset)),
+																			  *((const int *) (pu8Data[1] + u32Offset)),
+																			  *((const int *) (pu8Data[0] + u32Offset))),
+															 sByteSwap);
+				}
+			}
+			else
+			{
+				for (u32Loop = u32Round; u32Loop < u32Round + 8; u32Loop++)
+				{
+					__m256i sW2 = sSchedule[(u32Loop - 2) & 15];
+					__m256i sW15 = sSchedule[(u32Loop - 15) & 15];
+
+					sTemp = SHA256X8_ADD3(sSchedule[u32Loop & 15],
+										  sSchedule[(u32Loop - 7) & 15],
+										  SHA256X8_XOR3(SHA256X8_ROTR(sW15, 7), SHA256X8_ROTR(sW15, 18), _mm256_srli_epi32(sW15, 3)));
+					sSchedule[u32Loop & 15] = _mm256_add_epi32(sTemp,
+															   SHA256X8_XOR3(SHA256X8_ROTR(sW2, 17), SHA256X8_ROTR(sW2, 19), _mm256_srli_epi32(sW2, 10)));
+				}
+			}
+
+			SHA256X8_ROUND(a, b, c, d, e, f, g, h, u32Round + 0);
+			SHA256X8_ROUND(h, a, b, c, d, e, f, g, u32Round + 1);
+			SHA256X8_ROUND(g, h, a, b, c, d, e, f, u32Round + 2);
+			SHA256X8_ROUND(f, g, h, a, b, c, d, e, u32Round + 3);
+			SHA256X8_ROUND(e, f, g, h, a, b, c, d, u32Round + 4);
+			SHA256X8_ROUND(d, e, f, g, h, a, b, c, u32Round + 5);
+			SHA256X8_ROUND(c, d, e, f, g, h, a, b, u32Round + 6);
+			SHA256X8_ROUND(b, c, d, e, f, g, h, a, u32Round + 7);
+		}
+
+		sState[0] = _mm256_add_epi32(sState[0], a);
+		sState[1] = _mm256_add_epi32(sState[1], b);
+		sState[2] = _mm256_add_epi32(sState[2], c);
+		sState[3] = _mm256_add_epi32(sState[3], d);
+		sState[4] = _mm256_add_epi32(sState[4], e);
+		sState[5] = _mm256_add_epi32(sState[5], f);
+		sState[6] = _mm256_add_epi32(sState[6], g);
+		sState[7] = _mm256_add_epi32(sState[7], h);
+
+		for (u32Loop = 0; u32Loop < SHA256_LANES; u32Loop++)
+		{
+			pu8Data[u32Loop] += SHA256_BLOCK_SIZE;
+		}
+
+		BlockCount--;
+	}
+
+	// And transpose them back
+	for (u32Loop = 0; u32Loop < 8; u32Loop++)
+	{
+		uint32_t u32Lanes[SHA256_LANES];
+		uint32_t u32Lane;
+
+		_mm256_storeu_si256((__m256i *) u32Lanes, sState[u32Loop]);
+		for (u32Lane = 0; u32Lane < SHA256_LANES; u32Lane++)
+		{
+			pu32State[(u32Lane << 3) + u32Loop] = u32Lanes[u32Lane];
+		}
+	}
 }
+
+#endif	// #ifdef SHA256_X86
+
+static void SHA256CompressSelect(uint32_t *pu32State,
+								 const uint8_t *pu8Data,
+								 size_t BlockCount);
+
+// Single message kernel in use. Starts out pointing at the selector so no
+// init call is needed - the first hash picks the kernel.
+static void (*sg_pfSHA256Compress)(uint32_t *pu32State,
+								   const uint8_t *pu8Data,
+								   size_t BlockCount) = SHA256CompressSelect;
+static const char *sg_peSHA256KernelName = "portable";
+
+// Set true if the multi-buffer kernel should be used for batches
+static bool sg_bSHA256MultiBuffer;
+
+static void SHA256KernelSelect(void)
+{
+	void (*pfCompress)(uint32_t *pu32State,
+					   const uint8_t *pu8Data,
+					   size_t BlockCount) = SHA256CompressPortable;
+
+#ifdef SHA256_X86
+	if (SharedCPUFeaturesGet() & SHARED_CPU_SHANI)
+	{
+		// SHA-NI on one message keeps up with the 8 lane AVX2 kernel, and
+		// doesn't need the messages to be the same size.
+		pfCompress = SHA256CompressSHANI;
+		sg_peSHA256KernelName = "SHA-NI";
+	}
+	else
+	if (SharedCPUFeaturesGet() & SHARED_CPU_AVX2)
+	{
+		sg_bSHA256MultiBuffer = true;
+		sg_peSHA256KernelName = "portable+AVX2 multi-buffer";
+	}
 #endif
 
-struct x32{
-    unsigned int a:32;
-    unsigned int b:32;
-};
+	sg_pfSHA256Compress = pfCompress;
+}
+
+static void SHA256CompressSelect(uint32_t *pu32State,
+								 const uint8_t *pu8Data,
+								 size_t BlockCount)
+{
+	SHA256KernelSelect();
+	sg_pfSHA256Compress(pu32State,
+						pu8Data,
+						BlockCount);
+}
 
 void
 MySHA256_Update (MY_SHA256_CTX *m, const void *v, size_t len)
@@ -204,33 +478,34 @@ MySHA256_Update (MY_SHA256_CTX *m, const void *v, size_t len)
     const unsigned char *p = (const unsigned char *)v;
     size_t old_sz = m->sz[0];
     size_t offset;
+    uint64_t bits = ((uint64_t) len) << 3;
 
-    m->sz[0] += (unsigned int) (len * 8);
+    m->sz[0] += (unsigned int) bits;
     if (m->sz[0] < old_sz)
 	++m->sz[1];
+    m->sz[1] += (unsigned int) (bits >> 32);
     offset = (old_sz / 8) % 64;
-    while(len > 0){
+
+    // Top off a partial block first
+    if (offset) {
 	size_t l = MIN(len, 64 - offset);
 	memcpy(m->save + offset, p, l);
 	offset += l;
 	p += l;
 	len -= l;
-	if(offset == 64){
-#if !defined(WORDS_BIGENDIAN) || defined(_CRAY)
-	    int i;
-	    uint32_t current[16];
-	    struct x32 *u = (struct x32*)m->save;
-	    for(i = 0; i < 8; i++){
-		current[2*i+0] = swap_uint32_t(u[i].a);
-		current[2*i+1] = swap_uint32_t(u[i].b);
-	    }
-	    calc(m, current);
-#else
-	    calc(m, (uint32_t*)m->save);
-#endif
-	    offset = 0;
-	}
+	if (offset < 64)
+	    return;
+	sg_pfSHA256Compress(m->counter, m->save, 1);
     }
+
+    // Whole blocks go straight from the caller's buffer
+    if (len >= 64) {
+	sg_pfSHA256Compress(m->counter, p, len / 64);
+	p += len & ~((size_t) 63);
+	len &= 63;
+    }
+
+    memcpy(m->save, p, len);
 }
 
 void
@@ -263,3 +538,103 @@ MySHA256_Final (void *res, MY_SHA256_CTX *m)
 	}
     }
 }
+
+void MySHA256_Digest(void *pvDigest,
+					 const void *pvData,
+					 size_t Length)
+{
+	MY_SHA256_CTX sContext;
+
+	MySHA256_Init(&sContext);
+	MySHA256_Update(&sContext,
+					pvData,
+					Length);
+	MySHA256_Final(pvDigest,
+				   &sContext);
+}
+
+void MySHA256_Multi(uint8_t (*pu8Digests)[SHA256_DIGEST_LENGTH],
+					const void **ppvData,
+					const size_t *pLengths,
+					uint32_t u32Count)
+{
+	// Make sure the kernel has been picked so sg_bSHA256MultiBuffer is valid
+	if (SHA256CompressSelect == sg_pfSHA256Compress)
+	{
+		SHA256KernelSelect();
+	}
+
+	while (u32Count)
+	{
+		uint32_t u32Group = MIN(u32Count, SHA256_LANES);
+		uint32_t u32Lane;
+
+#ifdef SHA256_X86
+		if (sg_bSHA256MultiBuffer &&
+			(u32Group > 1))
+		{
+			uint32_t u32State[SHA256_LANES * 8];
+			const uint8_t *pu8Data[SHA256_LANES];
+			size_t BlockCount = pLengths[0] / SHA256_BLOCK_SIZE;
+
+			// Run all lanes for as many blocks as the shortest message has.
+			// Unused lanes just hash message 0 again.
+			for (u32Lane = 0; u32Lane < SHA256_LANES; u32Lane++)
+			{
+				uint32_t u32Message = (u32Lane < u32Group) ? u32Lane : 0;
+
+				BlockCount = MIN(BlockCount, pLengths[u32Message] / SHA256_BLOCK_SIZE);
+				pu8Data[u32Lane] = (const uint8_t *) ppvData[u32Message];
+				memcpy((void *) &u32State[u32Lane << 3], (void *) sg_u32SHA256InitialState, sizeof(sg_u32SHA256InitialState));
+			}
+
+			if (BlockCount)
+			{
+				SHA256CompressX8AVX2(u32State,
+									 pu8Data,
+									 BlockCount);
+			}
+
+			// Each message finishes off its tail on its own
+			for (u32Lane = 0; u32Lane < u32Group; u32Lane++)
+			{
+				MY_SHA256_CTX sContext;
+				uint64_t u64Bits = ((uint64_t) BlockCount * SHA256_BLOCK_SIZE) << 3;
+
+				memcpy((void *) sContext.counter, (void *) &u32State[u32Lane << 3], sizeof(sContext.counter));
+				sContext.sz[0] = (unsigned int) u64Bits;
+				sContext.sz[1] = (unsigned int) (u64Bits >> 32);
+				MySHA256_Update(&sContext,
+								pu8Data[u32Lane] + (BlockCount * SHA256_BLOCK_SIZE),
+								pLengths[u32Lane] - (BlockCount * SHA256_BLOCK_SIZE));
+				MySHA256_Final(pu8Digests[u32Lane],
+							   &sContext);
+			}
+		}
+		else
+#endif
+		{
+			for (u32Lane = 0; u32Lane < u32Group; u32Lane++)
+			{
+				MySHA256_Digest(pu8Digests[u32Lane],
+								ppvData[u32Lane],
+								pLengths[u32Lane]);
+			}
+		}
+
+		pu8Digests += u32Group;
+		ppvData += u32Group;
+		pLengths += u32Group;
+		u32Count -= u32Group;
+	}
+}
+
+const char *MySHA256_GetKernelName(void)
+{
+	if (SHA256CompressSelect == sg_pfSHA256Compress)
+	{
+		SHA256KernelSelect();
+	}
+
+	return(sg_peSHA256KernelName);
+}
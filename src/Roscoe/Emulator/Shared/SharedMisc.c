@@ -5,6 +5,20 @@
 #include "Platform/Platform.h"
 #include "Shared/CmdLine.h"
 
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#ifdef _MSC_VER
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#define	SHARED_CPU_X86			1
+#endif
+
+// Set once SharedCPUFeaturesGet() has probed the CPU
+#define	SHARED_CPU_PROBED		0x80000000
+
+static volatile uint32_t sg_u32SharedCPUFeatures;
+
 // Search for UTF8 multi-byte characters in a string
 static bool IsStringUTF8(char *peString)
 {
@@ -76,7 +90,83 @@ void SharedCapitalizeAllWords(char *peString)
 	}
 }
 
+#ifdef SHARED_CPU_X86
+static void SharedCPUID(uint32_t u32Leaf,
+						uint32_t *pu32Regs)
+{
+#ifdef _MSC_VER
+	__cpuidex((int *) pu32Regs, (int) u32Leaf, 0);
+#else
+	__cpuid_count(u32Leaf, 0, pu32Regs[0], pu32Regs[1], pu32Regs[2], pu32Regs[3]);
+#endif
+}
+
+// Reads XCR0 - only valid once CPUID says OSXSAVE is set
+static uint64_t SharedXGETBV(void)
+{
+#ifdef _MSC_VER
+	return(_xgetbv(0));
+#else
+	uint32_t u32Low;
+	uint32_t u32High;
+
+	__asm__ __volatile__ ("xgetbv" : "=a" (u32Low), "=d" (u32High) : "c" (0));
+	return(((uint64_t) u32High << 32) | u32Low);
+#endif
+}
+
+static uint32_t SharedCPUProbe(void)
+{
+	uint32_t u32Regs[4];
+	uint32_t u32Leaf1ECX;
+	uint32_t u32Features = 0;
+
+	SharedCPUID(0, u32Regs);
+	if (u32Regs[0] < 7)
+	{
+		return(0);
+	}
+
+	SharedCPUID(1, u32Regs);
+	u32Leaf1ECX = u32Regs[2];
+	SharedCPUID(7, u32Regs);
+
+	// AVX2 needs OSXSAVE and AVX, and the OS saving the YMM registers
+	if (((u32Leaf1ECX & ((1 << 27) | (1 << 28))) == ((1 << 27) | (1 << 28))) &&
+		((SharedXGETBV() & 0x6) == 0x6) &&
+		(u32Regs[1] & (1 << 5)))
+	{
+		u32Features |= SHARED_CPU_AVX2;
+	}
+
+	// SHA-NI is only any use with SSSE3 and SSE4.1 alongside it
+	if (((u32Leaf1ECX & ((1 << 9) | (1 << 19))) == ((1 << 9) | (1 << 19))) &&
+		(u32Regs[1] & (1 << 29)))
+	{
+		u32Features |= SHARED_CPU_SHANI;
+	}
+
+	return(u32Features);
+}
+#endif
+
+// Racing threads all probe the same CPU and store the same value, so there's
+// no need for a lock around the first call.
+uint32_t SharedCPUFeaturesGet(void)
+{
+	uint32_t u32Features = sg_u32SharedCPUFeatures;
 
+	if (0 == (u32Features & SHARED_CPU_PROBED))
+	{
+		u32Features = SHARED_CPU_PROBED;
+#ifdef SHARED_CPU_X86
+		u32Features |= SharedCPUProbe();
+#endif
+		sg_u32SharedCPUFeatures = u32Features;
+	}
+
+	return(u32Features & ~SHARED_CPU_PROBED);
+}
 
 EStatus SharedMiscInit(void)
 {
@@ -4,6 +4,13 @@
 #include "Shared/Version.h"
 
 
+// Host CPU features that SIMD kernels pick between at runtime. Probed on
+// first use and cached - always 0 on non-x86 hosts.
+#define	SHARED_CPU_AVX2			0x00000001		// AVX2, with the OS saving YMM state
+#define	SHARED_CPU_SHANI		0x00000002		// SHA extensions, SSSE3 and SSE4.1
+
+extern uint32_t SharedCPUFeaturesGet(void);
+
 extern EStatus SharedMiscInit(void);
 extern EStatus SharedMiscShutdown(void);
 
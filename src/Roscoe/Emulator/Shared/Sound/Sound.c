@@ -1,6 +1,8 @@
 #include "Shared/Shared.h"
 #include "Platform/Platform.h"
 #include "Shared/Sound/Sound.h"
+#include "Shared/Sound/SoundMix.h"
+#include "Shared/libsdl/libsdlsrc/include/SDL_atomic.h"
 
 // Some globals to make it fun
 static SSoundProfile *sg_psSoundProfile;
@@ -21,8 +23,17 @@ static uint16_t sg_u16ChannelBufferSize;
 // What's the global engine's volume setting currently?
 static uint16_t sg_u16VolumeGlobal = PITCH_UNITY;
 
-// What channel is being rendered currently?
-static SSoundChannel *sg_psRenderChannel = NULL;
+// Channel snapshot the renderer is currently walking (NULL when it isn't).
+// Updaters won't free a snapshot while it's sitting here.
+static SSoundChannelSnapshot *sg_psRenderSnapshot = NULL;
+
+// Snapshot an updater has swapped out but that was still being rendered. The
+// renderer clears it and puts sg_sSoundRetireSemaphore when it lets go.
+static SSoundChannelSnapshot *sg_psSoundRetiring = NULL;
+static SOSSemaphore sg_sSoundRetireSemaphore;
+
+// What channel (index into sg_psRenderSnapshot) is being rendered currently?
+static uint32_t sg_u32RenderChannel = 0;
 
 // Base timestamp for start of sound engine
 static uint64_t sg_u64SoundBaseTimeStart = 0;
@@ -36,8 +47,9 @@ static uint32_t sg_u32SampleRate = 0;
 // Set to true if we've initialized
 static bool sg_bSoundInitialized = false;
 
-// Critical section for sound renderer
-static SOSCriticalSection sg_sSoundRenderCriticalSection;
+// Serializes everything that changes what the renderer sees. The renderer
+// itself never takes it.
+static SOSCriticalSection sg_sSoundUpdateCriticalSection;
 
 void SoundSetLock(bool bLock)
 {
@@ -45,11 +57,11 @@ void SoundSetLock(bool bLock)
 
 	if (bLock)
 	{
-		eStatus = OSCriticalSectionEnter(sg_sSoundRenderCriticalSection);
+		eStatus = OSCriticalSectionEnter(sg_sSoundUpdateCriticalSection);
 	}
 	else
 	{
-		eStatus = OSCriticalSectionLeave(sg_sSoundRenderCriticalSection);
+		eStatus = OSCriticalSectionLeave(sg_sSoundUpdateCriticalSection);
 	}
 
 	BASSERT(ESTATUS_OK == eStatus);
@@ -60,14 +72,50 @@ uint64_t SoundSamplesToTimeMs(uint64_t u64Samples)
 	return((uint64_t) (((double) u64Samples / (double) sg_u32SampleRate) * 1000.0));
 }
 
+uint64_t SoundTimeMsToSamples(uint64_t u64TimeMs)
+{
+	return((uint64_t) (((double) u64TimeMs / 1000.0) * (double) sg_u32SampleRate));
+}
+
+// Advertises the snapshot the renderer is walking (NULL for none), waking an
+// updater that's waiting to free the one it was on before
+static void SoundRenderSnapshotSet(SSoundChannelSnapshot *psSnapshot)
+{
+	SSoundChannelSnapshot *psPrior;
+
+	psPrior = (SSoundChannelSnapshot *) SDL_AtomicSetPtr((void **) &sg_psRenderSnapshot, psSnapshot);
+	if ((psPrior) &&
+		(psPrior != psSnapshot) &&
+		(SDL_AtomicCASPtr((void **) &sg_psSoundRetiring, psPrior, NULL)))
+	{
+		(void) OSSemaphorePut(sg_sSoundRetireSemaphore,
+							  1);
+	}
+}
+
+// Grabs the profile's current channel snapshot and advertises it as in use
+// by the renderer. It's checked again after advertising in case an updater
+// swapped it out in between.
+static SSoundChannelSnapshot *SoundRenderSnapshotAcquire(SSoundProfile *psProfile)
+{
+	SSoundChannelSnapshot *psSnapshot;
+
+	do
+	{
+		psSnapshot = (SSoundChannelSnapshot *) SDL_AtomicGetPtr((void **) &psProfile->psChannelSnapshot);
+		SoundRenderSnapshotSet(psSnapshot);
+	}
+	while (psSnapshot != (SSoundChannelSnapshot *) SDL_AtomicGetPtr((void **) &psProfile->psChannelSnapshot));
+
+	return(psSnapshot);
+}
+
 bool SoundRender(uint16_t *pu16DestBuffer,
 				 bool bPrimarySoundRequest)
 {
-	uint16_t u16Loop;
-	int32_t s32Data;
 	int32_t *ps32DataPtr;
 	uint16_t u16MixdownRemaining;
-	EStatus eStatus;
+	SSoundChannelSnapshot *psSnapshot;
 	uint64_t u64Time = sg_u64SoundBaseTimeStart + SoundSamplesToTimeMs(sg_u64SamplesRendered);
 
 //	DebugOut("Delta = %u\n", (uint32_t) (RTCGet() - u64Time));
@@ -78,9 +126,6 @@ bool SoundRender(uint16_t *pu16DestBuffer,
 		return(false);
 	}
 
-	eStatus = OSCriticalSectionEnter(sg_sSoundRenderCriticalSection);
-	BASSERT(ESTATUS_OK == eStatus);
-
 	// If we have a profile change, then change it
 	if (sg_bSoundProfilePending)
 	{
@@ -93,8 +138,9 @@ bool SoundRender(uint16_t *pu16DestBuffer,
 		// NULL out any pending sound profile
 		sg_psSoundProfilePending = NULL;
 		
-		// Clear the render channel
-		sg_psRenderChannel = NULL;
+		// Drop whatever we were rendering
+		SoundRenderSnapshotSet(NULL);
+		sg_u32RenderChannel = 0;
 		
 		// Force this to be a primary sound request
 		bPrimarySoundRequest = true;
@@ -103,12 +149,13 @@ bool SoundRender(uint16_t *pu16DestBuffer,
 	// If there isn't a valid profile, make it silent, then silence, and return
 	if (NULL == sg_psSoundProfile)
 	{
-		u16Loop = sg_u16MixdownBufferSize;
-		
 		// Clear out our buffer pointers
 		sg_ps32MixdownBufferPosition = NULL;
 		sg_u16MixdownRemaining = 0;
-		goto renderSilence;
+
+		memset((void *) pu16DestBuffer, 0, sizeof(*pu16DestBuffer) * sg_u16MixdownBufferSize);
+		sg_u64SamplesRendered += sg_u16MixdownBufferSize;
+		return(false);
 	}
 
 //		DebugOut("%s: Primary sound engine request\n", __FUNCTION__);
@@ -119,11 +166,12 @@ bool SoundRender(uint16_t *pu16DestBuffer,
 	BASSERT(NULL == sg_ps32MixdownBufferPosition);
 	BASSERT(0 == sg_u16MixdownRemaining);
 
-	// If there isn't a current render channel, then let's see if there's a render channel. If not, start over.
-	if (NULL == sg_psRenderChannel)
+	// If we aren't partway through a render, pick up the current channel set and start over
+	psSnapshot = sg_psRenderSnapshot;
+	if (NULL == psSnapshot)
 	{
-		// Pointer points to the render channel
-		sg_psRenderChannel = sg_psSoundProfile->psSoundChannels;
+		psSnapshot = SoundRenderSnapshotAcquire(sg_psSoundProfile);
+		sg_u32RenderChannel = 0;
 
 		// Clear out the mixdown buffer
 		memset((void *) sg_ps32MixdownBuffer, 0, sizeof(*sg_ps32MixdownBuffer) * sg_u16MixdownBufferSize);
@@ -137,19 +185,21 @@ bool SoundRender(uint16_t *pu16DestBuffer,
 	}
 
 	// Now loop through the channels and render each one
-	while (sg_psRenderChannel)
+	while ((psSnapshot) &&
+		   (sg_u32RenderChannel < psSnapshot->u32ChannelCount))
 	{
+		SSoundChannel *psChannel = psSnapshot->psChannels[sg_u32RenderChannel];
 		ERenderResult eResult;
 
 		// If this channel has a render function, then render some audio
-		if (sg_psRenderChannel->psMethods)
+		if (psChannel->psMethods)
 		{
-			if (sg_psRenderChannel->psMethods->Render)
+			if (psChannel->psMethods->Render)
 			{
-				eResult = sg_psRenderChannel->psMethods->Render(sg_psRenderChannel,
-																u64Time,
-																&ps32DataPtr,
-																&u16MixdownRemaining);
+				eResult = psChannel->psMethods->Render(psChannel,
+													   u64Time,
+													   &ps32DataPtr,
+													   &u16MixdownRemaining);
 
 				// This means the render needs to do
 				if (ERENDER_EXIT == eResult)
@@ -170,95 +220,87 @@ bool SoundRender(uint16_t *pu16DestBuffer,
 			}
 		}
 
-		sg_psRenderChannel = sg_psRenderChannel->psNextChannel;
+		++sg_u32RenderChannel;
 	}
 
+	// Done with the channel set - updaters are free to retire it now
+	SoundRenderSnapshotSet(NULL);
+	sg_u32RenderChannel = 0;
+
 	// Make sure these are zeroed out 
 	sg_ps32MixdownBufferPosition = NULL;
 	sg_u16MixdownRemaining = 0;
 
 	// Final mixdown!
-	u16Loop = sg_u16MixdownBufferSize;
-
-	// If the volume is at unity, 
-	if (VOLUME_UNITY == sg_u16VolumeGlobal)
-	{
-		while (u16Loop--)
-		{
-			s32Data = *ps32DataPtr;
-			++ps32DataPtr;
+	SoundMixFinal(pu16DestBuffer,
+				  sg_ps32MixdownBuffer,
+				  sg_u16VolumeGlobal,
+				  sg_u16MixdownBufferSize);
 
-			// Clip
-			if (s32Data < -32768)
-			{
-				s32Data = 32768;
-			}
-			if (s32Data > 32767)
-			{
-				s32Data = 32767;
-			}
+//	DebugOut("%s: Render complete exit\n", __FUNCTION__);
 
-			// Loss of precision is A-OK, here
-			*pu16DestBuffer = (uint16_t) s32Data;
-			++pu16DestBuffer;
-		}
-	}
-	else
-	{
-		while (u16Loop--)
-		{
-			s32Data = *ps32DataPtr;
-			++ps32DataPtr;
+	sg_u64SamplesRendered += sg_u16MixdownBufferSize;
+	return(false);
+}
 
-			// Clip
-			if (s32Data < -32768)
-			{
-				s32Data = 32768;
-			}
-			if (s32Data > 32767)
-			{
-				s32Data = 32767;
-			}
+// Builds a fresh channel snapshot from the profile's channel list and
+// publishes it to the renderer. The prior snapshot is freed once the renderer
+// is no longer walking it. Call with the sound lock held.
+static void SoundProfilePublish(SSoundProfile *psProfile)
+{
+	SSoundChannelSnapshot *psSnapshot = NULL;
+	SSoundChannelSnapshot *psOldSnapshot;
+	SSoundChannel *psChannel;
+	uint32_t u32ChannelCount = 0;
 
-			// Volume scale
-			s32Data = (s32Data * sg_u16VolumeGlobal) >> PITCH_FIXED_BITS;
+	for (psChannel = psProfile->psSoundChannels; psChannel; psChannel = psChannel->psNextChannel)
+	{
+		++u32ChannelCount;
+	}
 
-			// Loss of precision is A-OK, here
-			*pu16DestBuffer = (uint16_t) s32Data;
+	if (u32ChannelCount)
+	{
+		psSnapshot = MemAlloc(sizeof(*psSnapshot) + (sizeof(psSnapshot->psChannels[0]) * (u32ChannelCount - 1)));
+		BASSERT(psSnapshot);
 
-			++pu16DestBuffer;
+		for (psChannel = psProfile->psSoundChannels; psChannel; psChannel = psChannel->psNextChannel)
+		{
+			psSnapshot->psChannels[psSnapshot->u32ChannelCount++] = psChannel;
 		}
 	}
 
-//	DebugOut("%s: Render complete exit\n", __FUNCTION__);
-
-	sg_u64SamplesRendered += sg_u16MixdownBufferSize;
-
-	eStatus = OSCriticalSectionLeave(sg_sSoundRenderCriticalSection);
-	BASSERT(ESTATUS_OK == eStatus);
-	return(false);
+	psOldSnapshot = (SSoundChannelSnapshot *) SDL_AtomicSetPtr((void **) &psProfile->psChannelSnapshot, psSnapshot);
 
-renderSilence:
-	while (u16Loop--)
+	// If the renderer is partway through the old one, wait for it to let go.
+	// Whichever side clears sg_psSoundRetiring first decides whether there's
+	// a wakeup coming.
+	if (psOldSnapshot)
 	{
-		*pu16DestBuffer = 0;
-		++pu16DestBuffer;
-	}
+		SDL_AtomicSetPtr((void **) &sg_psSoundRetiring, psOldSnapshot);
 
-	sg_u64SamplesRendered += sg_u16MixdownBufferSize;
+		if ((SDL_AtomicGetPtr((void **) &sg_psRenderSnapshot) == (void *) psOldSnapshot) ||
+			(SDL_FALSE == SDL_AtomicCASPtr((void **) &sg_psSoundRetiring, psOldSnapshot, NULL)))
+		{
+			EStatus eStatus;
 
-	eStatus = OSCriticalSectionLeave(sg_sSoundRenderCriticalSection);
-	BASSERT(ESTATUS_OK == eStatus);
+			eStatus = OSSemaphoreGet(sg_sSoundRetireSemaphore,
+									 OS_WAIT_INDEFINITE);
+			BASSERT(ESTATUS_OK == eStatus);
+		}
 
-	return(false);
+		MemFree(psOldSnapshot);
+	}
 }
 
 void SoundChannelDestroy(SSoundProfile *psProfile,
 						 SSoundChannel *psChannelReference)
 {
 	SSoundChannel *psPrior = NULL;
-	SSoundChannel *psChannel = psProfile->psSoundChannels;
+	SSoundChannel *psChannel;
 
+	SoundSetLock(true);
+
+	psChannel = psProfile->psSoundChannels;
 	while ((psChannel) &&
 		   (psChannel != psChannelReference))
 	{
@@ -278,6 +320,11 @@ void SoundChannelDestroy(SSoundProfile *psProfile,
 	{
 		psPrior->psNextChannel = psChannelReference->psNextChannel;
 	}
+
+	// Once this returns the renderer can no longer see the channel
+	SoundProfilePublish(psProfile);
+
+	SoundSetLock(false);
 	
 	// Unlinked from the channel list. Now go kill off anything connected to that channel
 	if (psChannel->psMethods)
@@ -320,8 +367,11 @@ SSoundChannel *SoundChannelCreate(SSoundProfile *psProfile,
 	psChannel->u32ChannelBufferPos = (sg_u16ChannelBufferSize << PITCH_FIXED_BITS);
 
 	// Attach this channel to the sound profile
+	SoundSetLock(true);
 	psChannel->psNextChannel = psProfile->psSoundChannels;
 	psProfile->psSoundChannels = psChannel;
+	SoundProfilePublish(psProfile);
+	SoundSetLock(false);
 
 	return(psChannel);
 }
@@ -401,9 +451,17 @@ EStatus SoundInit(uint16_t u16MixdownBufferSize,
 {
 	EStatus eStatus = ESTATUS_OK;
 
-	eStatus = OSCriticalSectionCreate(&sg_sSoundRenderCriticalSection);
+	eStatus = OSCriticalSectionCreate(&sg_sSoundUpdateCriticalSection);
 	ERR_GOTO();
 
+	eStatus = OSSemaphoreCreate(&sg_sSoundRetireSemaphore,
+								0,
+								1);
+	ERR_GOTO();
+
+	// Pick the mixing kernels for this CPU
+	SoundMixInit();
+
 	// Better be NULL!
 	BASSERT(NULL == sg_ps32MixdownBuffer);
 
@@ -433,13 +491,21 @@ SSoundQueue *SoundQueueCreate(uint16_t u16Items,
 {
 	SSoundQueue *psQueue;
 
+	// The spare slot below has to fit in the 16 bit queue size
+	if (0xffff == u16Items)
+	{
+		return(NULL);
+	}
+
 	psQueue = MemAlloc(sizeof(*psQueue));
 	BASSERT(psQueue);
-	psQueue->pvQueueData = MemAlloc(u16Items * u32ItemSize);
+
+	// One spare slot so full and empty can be told apart by head/tail alone
+	psQueue->pvQueueData = MemAlloc((u16Items + 1) * u32ItemSize);
 	BASSERT(psQueue->pvQueueData);
 
 	psQueue->u32ItemSize = u32ItemSize;
-	psQueue->u16QueueSize = u16Items;
+	psQueue->u16QueueSize = u16Items + 1;
 
 	return(psQueue);
 }
@@ -459,30 +525,36 @@ void *SoundQueueGetCurrent(SSoundQueue *psQueue)
 	}
 
 	// Nothing in the queue if this is true
-	if (0 == psQueue->u16QueuedItems)
+	if (psQueue->u16Tail == psQueue->u16Head)
 	{
 		return(NULL);
 	}
 
+	// Don't read the item until we've seen the head that published it
+	SDL_MemoryBarrierAcquire();
+
 	// Return the tail
 	return((void *) (((uint8_t *) psQueue->pvQueueData) + (psQueue->u16Tail * psQueue->u32ItemSize)));
 }
 
 void SoundQueueDequeue(SSoundQueue *psQueue)
 {
-	if (0 == psQueue->u16QueuedItems)
+	uint16_t u16NewTail = psQueue->u16Tail + 1;
+
+	if (psQueue->u16Tail == psQueue->u16Head)
 	{
 		// Nothing in the queue. Return.
 		return;
 	}
 
-	++psQueue->u16Tail;
-	if (psQueue->u16Tail >= psQueue->u16QueueSize)
+	if (u16NewTail >= psQueue->u16QueueSize)
 	{
-		psQueue->u16Tail = 0;
+		u16NewTail = 0;
 	}
 
-	psQueue->u16QueuedItems--;
+	// Finish with the item before handing its slot back to the producer
+	SDL_MemoryBarrierRelease();
+	psQueue->u16Tail = u16NewTail;
 }
 
 bool SoundQueueAdd(SSoundQueue *psQueue,
@@ -490,20 +562,21 @@ bool SoundQueueAdd(SSoundQueue *psQueue,
 {
 	uint16_t u16NewHead = psQueue->u16Head + 1;
 
-	if (psQueue->u16QueuedItems == psQueue->u16QueueSize)
+	if (u16NewHead >= psQueue->u16QueueSize)
 	{
-		// Queue full
-		return(false);
+		u16NewHead = 0;
 	}
 
-	if (u16NewHead >= psQueue->u16QueueSize)
+	if (u16NewHead == psQueue->u16Tail)
 	{
-		u16NewHead = 0;
+		// Queue full
+		return(false);
 	}
 
 	memcpy((void *) (((uint8_t *) psQueue->pvQueueData) + (psQueue->u16Head * psQueue->u32ItemSize)), pvQueuedItem, psQueue->u32ItemSize);
 
+	// Item must be fully written before the consumer can see it
+	SDL_MemoryBarrierRelease();
 	psQueue->u16Head = u16NewHead;
-	psQueue->u16QueuedItems++;
 	return(true);
 }
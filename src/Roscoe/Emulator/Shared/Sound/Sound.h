@@ -19,13 +19,15 @@ typedef enum
 	ERENDER_EXIT
 } ERenderResult;
 
+// Single producer/single consumer queue. The producer only moves the head
+// and the consumer only moves the tail, so the renderer can drain it without
+// taking a lock. Multiple producers must serialize with SoundSetLock().
 typedef struct SSoundQueue
 {
 	uint64_t u64QueuedTime;		// When was this item put in the queue?
-	uint16_t u16Head;				// Head pointer
-	uint16_t u16Tail;				// Tail pointer
-	uint16_t u16QueuedItems;		// # Of items in the queue
-	uint16_t u16QueueSize;		// Queue size (# of items total)
+	volatile uint16_t u16Head;	// Head pointer (producer)
+	volatile uint16_t u16Tail;	// Tail pointer (consumer)
+	uint16_t u16QueueSize;		// Queue size (# of slots - one more than the # of items it holds)
 	uint32_t u32ItemSize;			// How big is each item in the queue?
 
 	void *pvQueueData;			// Actual queue data
@@ -69,12 +71,23 @@ typedef struct SSoundChannel
 	struct SSoundChannel *psNextChannel;
 } SSoundChannel;
 
+// Immutable array of a profile's channels. The renderer walks the currently
+// published snapshot, and channel creation/destruction publish a new one.
+typedef struct SSoundChannelSnapshot
+{
+	uint32_t u32ChannelCount;
+	SSoundChannel *psChannels[1];		// Actually u32ChannelCount entries
+} SSoundChannelSnapshot;
+
 typedef struct SSoundProfile
 {
 	int32_t *ps32MixdownBuffer;
 	uint16_t u16MixdownBufferSize;
 
 	SSoundChannel *psSoundChannels;
+
+	// What the renderer sees - only ever swapped atomically
+	SSoundChannelSnapshot *psChannelSnapshot;
 } SSoundProfile;
 
 extern SSoundChannel *SoundChannelCreate(SSoundProfile *psProfile,
@@ -104,5 +117,6 @@ extern bool SoundQueueAdd(SSoundQueue *psQueue,
 						  void *pvQueuedItem);
 extern void SoundSetLock(bool bLock);
 extern uint64_t SoundSamplesToTimeMs(uint64_t u64Samples);
+extern uint64_t SoundTimeMsToSamples(uint64_t u64TimeMs);
 
 #endif	// #ifndef _SOUND_H_
\ No newline at end of file
@@ -0,0 +1,577 @@
+#include <string.h>
+#include "Shared/Shared.h"
+#include "Shared/SharedMisc.h"
+#include "Shared/Sound/Sound.h"
+#include "Shared/Sound/SoundMix.h"
+#include "Shared/libsdl/libsdlsrc/include/SDL.h"
+
+// The resampler and final mixdown have SSE2 and AVX2 versions on x86 hosts,
+// scalar everywhere else.
+#if defined(_M_X64) || defined(_M_IX86) || defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#ifdef _MSC_VER
+#define	SOUNDMIX_TARGET_AVX2
+#else
+#define	SOUNDMIX_TARGET_AVX2	__attribute__((target("avx2")))
+#endif
+
+// The AVX2 kernels are compiled whenever SSE2 is and chosen at runtime
+#if defined(_M_X64) || defined(__SSE2__) || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define	SOUNDMIX_SSE2			1
+#define	SOUNDMIX_AVX2			1
+#endif
+#endif
+
+// Fractional part of a pitch position
+#define	PITCH_FRACTION_MASK		((1 << PITCH_FIXED_BITS) - 1)
+
+// Set of kernels in use
+typedef struct SSoundMixKernels
+{
+	const char *peName;
+	void (*Resample)(int32_t *ps32Dest,
+					 int16_t *ps16Src,
+					 uint32_t u32Position,
+					 uint32_t u32Step,
+					 uint16_t u16Volume,
+					 uint32_t u32Count);
+	void (*Final)(uint16_t *pu16Dest,
+				  int32_t *ps32Src,
+				  uint16_t u16Volume,
+				  uint32_t u32Count);
+} SSoundMixKernels;
+
+// Interpolate between a source sample and the one after it. Written as a
+// weighted sum so the SIMD kernels can do it with a single multiply-add.
+static int32_t SoundMixInterpolate(int16_t *ps16Sample,
+								   uint32_t u32Fraction)
+{
+	return(((ps16Sample[0] * (int32_t) (PITCH_UNITY - u32Fraction)) +
+			(ps16Sample[1] * (int32_t) u32Fraction)) >> PITCH_FIXED_BITS);
+}
+
+static void SoundMixResampleScalar(int32_t *ps32Dest,
+								   int16_t *ps16Src,
+								   uint32_t u32Position,
+								   uint32_t u32Step,
+								   uint16_t u16Volume,
+								   uint32_t u32Count)
+{
+	while (u32Count--)
+	{
+		int32_t s32Sample;
+
+		s32Sample = SoundMixInterpolate(ps16Src + (u32Position >> PITCH_FIXED_BITS),
+										u32Position & PITCH_FRACTION_MASK);
+		*ps32Dest += (s32Sample * u16Volume) >> VOLUME_FIXED_BITS;
+		++ps32Dest;
+		u32Position += u32Step;
+	}
+}
+
+static void SoundMixFinalScalar(uint16_t *pu16Dest,
+								int32_t *ps32Src,
+								uint16_t u16Volume,
+								uint32_t u32Count)
+{
+	while (u32Count--)
+	{
+		int32_t s32Data = *ps32Src;
+
+		// Clip
+		if (s32Data < -32768)
+		{
+			s32Data = -32768;
+		}
+		if (s32Data > 32767)
+		{
+			s32Data = 32767;
+		}
+
+		// Volume scale and clip again, since it can be above unity
+		if (u16Volume != VOLUME_UNITY)
+		{
+			s32Data = (s32Data * u16Volume) >> VOLUME_FIXED_BITS;
+			if (s32Data < -32768)
+			{
+				s32Data = -32768;
+			}
+			if (s32Data > 32767)
+			{
+				s32Data = 32767;
+			}
+		}
+
+		// Loss of precision is A-OK, here
+		*pu16Dest = (uint16_t) s32Data;
+		++pu16Dest;
+		++ps32Src;
+	}
+}
+
+static const SSoundMixKernels sg_sSoundMixKernelsScalar =
+{
+	"scalar",
+	SoundMixResampleScalar,
+	SoundMixFinalScalar
+};
+
+#ifdef SOUNDMIX_SSE2
+
+// Returns a source sample and its successor as a packed pair of 16 bit
+// values, which is the layout _mm_madd_epi16() wants
+static int SoundMixPair(int16_t *ps16Src,
+						uint32_t u32Position)
+{
+	int s32Pair;
+
+	memcpy((void *) &s32Pair, (void *) (ps16Src + (u32Position >> PITCH_FIXED_BITS)), sizeof(s32Pair));
+	return(s32Pair);
+}
+
+static void SoundMixResampleSSE2(int32_t *ps32Dest,
+								 int16_t *ps16Src,
+								 uint32_t u32Position,
+								 uint32_t u32Step,
+								 uint16_t u16Volume,
+								 uint32_t u32Count)
+{
+	// Volume in the low half of each lane so madd yields sample * volume
+	__m128i sVolume = _mm_set1_epi32(u16Volume);
+
+	// Unity pitch on a whole sample - straight widen and scale
+	if ((PITCH_UNITY == u32Step) && (0 == (u32Position & PITCH_FRACTION_MASK)))
+	{
+		ps16Src += (u32Position >> PITCH_FIXED_BITS);
+		while (u32Count >= 8)
+		{
+			__m128i sSamples = _mm_loadu_si128((__m128i *) ps16Src);
+			__m128i sLow = _mm_srai_epi32(_mm_unpacklo_epi16(sSamples, sSamples), 16);
+			__m128i sHigh = _mm_srai_epi32(_mm_unpackhi_epi16(sSamples, sSamples), 16);
+
+			sLow = _mm_srai_epi32(_mm_madd_epi16(sLow, sVolume), VOLUME_FIXED_BITS);
+			sHigh = _mm_srai_epi32(_mm_madd_epi16(sHigh, sVolume), VOLUME_FIXED_BITS);
+			_mm_storeu_si128((__m128i *) (ps32Dest + 0), _mm_add_epi32(_mm_loadu_si128((__m128i *) (ps32Dest + 0)), sLow));
+			_mm_storeu_si128((__m128i *) (ps32Dest + 4), _mm_add_epi32(_mm_loadu_si128((__m128i *) (ps32Dest + 4)), sHigh));
+			ps16Src += 8;
+			ps32Dest += 8;
+			u32Count -= 8;
+		}
+
+		SoundMixResampleScalar(ps32Dest,
+							   ps16Src,
+							   0,
+							   PITCH_UNITY,
+							   u16Volume,
+							   u32Count);
+		return;
+	}
+
+	while (u32Count >= 4)
+	{
+		__m128i sPosition;
+		__m128i sFraction;
+		__m128i sWeights;
+		__m128i sPairs;
+		__m128i sSamples;
+
+		// SSE2 has no gather, so fetch the 4 sample pairs individually
+		sPairs = _mm_set_epi32(SoundMixPair(ps16Src, u32Position + (u32Step * 3)),
+							   SoundMixPair(ps16Src, u32Position + (u32Step * 2)),
+							   SoundMixPair(ps16Src, u32Position + u32Step),
+							   SoundMixPair(ps16Src, u32Position));
+		sPosition = _mm_set_epi32((int) (u32Position + (u32Step * 3)),
+								  (int) (u32Position + (u32Step * 2)),
+								  (int) (u32Position + u32Step),
+								  (int) u32Position);
+
+		// Weights are (unity - fraction) for the sample and fraction for its successor
+		sFraction = _mm_and_si128(sPosition, _mm_set1_epi32(PITCH_FRACTION_MASK));
+		sWeights = _mm_or_si128(_mm_sub_epi32(_mm_set1_epi32(PITCH_UNITY), sFraction),
+								_mm_slli_epi32(sFraction, 16));
+
+		sSamples = _mm_srai_epi32(_mm_madd_epi16(sPairs, sWeights), PITCH_FIXED_BITS);
+		sSamples = _mm_srai_epi32(_mm_madd_epi16(sSamples, sVolume), VOLUME_FIXED_BITS);
+		_mm_storeu_si128((__m128i *) ps32Dest, _mm_add_epi32(_mm_loadu_si128((__m128i *) ps32Dest), sSamples));
+
+		u32Position += (u32Step * 4);
+		ps32Dest += 4;
+		u32Count -= 4;
+	}
+
+	SoundMixResampleScalar(ps32Dest,
+						   ps16Src,
+						   u32Position,
+						   u32Step,
+						   u16Volume,
+						   u32Count);
+}
+
+static void SoundMixFinalSSE2(uint16_t *pu16Dest,
+							  int32_t *ps32Src,
+							  uint16_t u16Volume,
+							  uint32_t u32Count)
+{
+	__m128i sVolume = _mm_set1_epi32(u16Volume);
+
+	while (u32Count >= 8)
+	{
+		__m128i sSamples;
+
+		// Saturating pack does the clip
+		sSamples = _mm_packs_epi32(_mm_loadu_si128((__m128i *) (ps32Src + 0)),
+								   _mm_loadu_si128((__m128i *) (ps32Src + 4)));
+
+		if (u16Volume != VOLUME_UNITY)
+		{
+			__m128i sLow = _mm_srai_epi32(_mm_unpacklo_epi16(sSamples, sSamples), 16);
+			__m128i sHigh = _mm_srai_epi32(_mm_unpackhi_epi16(sSamples, sSamples), 16);
+
+			sLow = _mm_srai_epi32(_mm_madd_epi16(sLow, sVolume), VOLUME_FIXED_BITS);
+			sHigh = _mm_srai_epi32(_mm_madd_epi16(sHigh, sVolume), VOLUME_FIXED_BITS);
+			sSamples = _mm_packs_epi32(sLow, sHigh);
+		}
+
+		_mm_storeu_si128((__m128i *) pu16Dest, sSamples);
+		ps32Src += 8;
+		pu16Dest += 8;
+		u32Count -= 8;
+	}
+
+	SoundMixFinalScalar(pu16Dest,
+						ps32Src,
+						u16Volume,
+						u32Count);
+}
+
+static const SSoundMixKernels sg_sSoundMixKernelsSSE2 =
+{
+	"SSE2",
+	SoundMixResampleSSE2,
+	SoundMixFinalSSE2
+};
+
+#endif // SOUNDMIX_SSE2
+
+#ifdef SOUNDMIX_AVX2
+
+static SOUNDMIX_TARGET_AVX2 void SoundMixResampleAVX2(int32_t *ps32Dest,
+													  int16_t *ps16Src,
+													  uint32_t u32Position,
+													  uint32_t u32Step,
+													  uint16_t u16Volume,
+													  uint32_t u32Count)
+{
+	__m256i sVolume = _mm256_set1_epi32(u16Volume);
+	__m256i sPosition;
+	__m256i sStep;
+
+	// Unity pitch on a whole sample - straight widen and scale
+	if ((PITCH_UNITY == u32Step) && (0 == (u32Position & PITCH_FRACTION_MASK)))
+	{
+		ps16Src += (u32Position >> PITCH_FIXED_BITS);
+		while (u32Count >= 16)
+		{
+			__m256i sLow = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *) (ps16Src + 0)));
+			__m256i sHigh = _mm256_cvtepi16_epi32(_mm_loadu_si128((__m128i *) (ps16Src + 8)));
+
+			sLow = _mm256_srai_epi32(_mm256_mullo_epi32(sLow, sVolume), VOLUME_FIXED_BITS);
+			sHigh = _mm256_srai_epi32(_mm256_mullo_epi32(sHigh, sVolume), VOLUME_FIXED_BITS);
+			_mm256_storeu_si256((__m256i *) (ps32Dest + 0), _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (ps32Dest + 0)), sLow));
+			_mm256_storeu_si256((__m256i *) (ps32Dest + 8), _mm256_add_epi32(_mm256_loadu_si256((__m256i *) (ps32Dest + 8)), sHigh));
+			ps16Src += 16;
+			ps32Dest += 16;
+			u32Count -= 16;
+		}
+
+		SoundMixResampleScalar(ps32Dest,
+							   ps16Src,
+							   0,
+							   PITCH_UNITY,
+							   u16Volume,
+							   u32Count);
+		return;
+	}
+
+	sPosition = _mm256_add_epi32(_mm256_set1_epi32((int) u32Position),
+								 _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7),
+													_mm256_set1_epi32((int) u32Step)));
+	sStep = _mm256_set1_epi32((int) (u32Step * 8));
+
+	while (u32Count >= 8)
+	{
+		__m256i sFraction;
+		__m256i sWeights;
+		__m256i sPairs;
+		__m256i sSamples;
+
+		// A 32 bit gather at a 2 byte scale picks up each sample along with
+		// its successor in one go
+		sPairs = _mm256_i32gather_epi32((const int *) ps16Src,
+										_mm256_srli_epi32(sPosition, PITCH_FIXED_BITS),
+										2);
+
+		sFraction = _mm256_and_si256(sPosition, _mm256_set1_epi32(PITCH_FRACTION_MASK));
+		sWeights = _mm256_or_si256(_mm256_sub_epi32(_mm256_set1_epi32(PITCH_UNITY), sFraction),
+								   _mm256_slli_epi32(sFraction, 16));
+
+		sSamples = _mm256_srai_epi32(_mm256_madd_epi16(sPairs, sWeights), PITCH_FIXED_BITS);
+		sSamples = _mm256_srai_epi32(_mm256_mullo_epi32(sSamples, sVolume), VOLUME_FIXED_BITS);
+		_mm256_storeu_si256((__m256i *) ps32Dest, _mm256_add_epi32(_mm256_loadu_si256((__m256i *) ps32Dest), sSamples));
+
+		sPosition = _mm256_add_epi32(sPosition, sStep);
+		u32Position += (u32Step * 8);
+		ps32Dest += 8;
+		u32Count -= 8;
+	}
+
+	SoundMixResampleScalar(ps32Dest,
+						   ps16Src,
+						   u32Position,
+						   u32Step,
+						   u16Volume,
+						   u32Count);
+}
+
+static SOUNDMIX_TARGET_AVX2 void SoundMixFinalAVX2(uint16_t *pu16Dest,
+												   int32_t *ps32Src,
+												   uint16_t u16Volume,
+												   uint32_t u32Count)
+{
+	__m256i sVolume = _mm256_set1_epi32(u16Volume);
+	__m256i sMin = _mm256_set1_epi32(-32768);
+	__m256i sMax = _mm256_set1_epi32(32767);
+
+	while (u32Count >= 16)
+	{
+		__m256i sLow = _mm256_loadu_si256((__m256i *) (ps32Src + 0));
+		__m256i sHigh = _mm256_loadu_si256((__m256i *) (ps32Src + 8));
+
+		if (u16Volume != VOLUME_UNITY)
+		{
+			sLow = _mm256_min_epi32(_mm256_max_epi32(sLow, sMin), sMax);
+			sHigh = _mm256_min_epi32(_mm256_max_epi32(sHigh, sMin), sMax);
+			sLow = _mm256_srai_epi32(_mm256_mullo_epi32(sLow, sVolume), VOLUME_FIXED_BITS);
+			sHigh = _mm256_srai_epi32(_mm256_mullo_epi32(sHigh, sVolume), VOLUME_FIXED_BITS);
+		}
+
+		// Pack saturates (the clip) but works within 128 bit lanes, so put
+		// the 64 bit chunks back in order afterward
+		_mm256_storeu_si256((__m256i *) pu16Dest,
+							_mm256_permute4x64_epi64(_mm256_packs_epi32(sLow, sHigh), _MM_SHUFFLE(3, 1, 2, 0)));
+		ps32Src += 16;
+		pu16Dest += 16;
+		u32Count -= 16;
+	}
+
+	SoundMixFinalScalar(pu16Dest,
+						ps32Src,
+						u16Volume,
+						u32Count);
+}
+
+static const SSoundMixKernels sg_sSoundMixKernelsAVX2 =
+{
+	"AVX2",
+	SoundMixResampleAVX2,
+	SoundMixFinalAVX2
+};
+
+#endif // SOUNDMIX_AVX2
+
+// Currently selected kernels. Scalar until SoundMixInit() runs.
+static const SSoundMixKernels *sg_psSoundMixKernels = &sg_sSoundMixKernelsScalar;
+
+void SoundMixResample(int32_t *ps32Dest,
+					  int16_t *ps16Src,
+					  uint32_t u32Position,
+					  uint32_t u32Step,
+					  uint16_t u16Volume,
+					  uint32_t u32Count)
+{
+	if (u16Volume > SOUND_MIX_VOLUME_MAX)
+	{
+		u16Volume = SOUND_MIX_VOLUME_MAX;
+	}
+
+	sg_psSoundMixKernels->Resample(ps32Dest,
+								   ps16Src,
+								   u32Position,
+								   u32Step,
+								   u16Volume,
+								   u32Count);
+}
+
+void SoundMixFinal(uint16_t *pu16Dest,
+				   int32_t *ps32Src,
+				   uint16_t u16Volume,
+				   uint32_t u32Count)
+{
+	if (u16Volume > SOUND_MIX_VOLUME_MAX)
+	{
+		u16Volume = SOUND_MIX_VOLUME_MAX;
+	}
+
+	sg_psSoundMixKernels->Final(pu16Dest,
+								ps32Src,
+								u16Volume,
+								u32Count);
+}
+
+const char *SoundMixGetKernelName(void)
+{
+	return(sg_psSoundMixKernels->peName);
+}
+
+void SoundMixInit(void)
+{
+	sg_psSoundMixKernels = &sg_sSoundMixKernelsScalar;
+
+#ifdef SOUNDMIX_SSE2
+	sg_psSoundMixKernels = &sg_sSoundMixKernelsSSE2;
+#endif
+
+#ifdef SOUNDMIX_AVX2
+	if (SharedCPUFeaturesGet() & SHARED_CPU_AVX2)
+	{
+		sg_psSoundMixKernels = &sg_sSoundMixKernelsAVX2;
+	}
+#endif
+}
+
+// Benchmark - 64 channels mixed into a 2048 sample render buffer, which is
+// what the platform layer asks for per callback
+#define	SOUNDMIX_BENCH_CHANNELS		64
+#define	SOUNDMIX_BENCH_BUFFER		2048
+#define	SOUNDMIX_BENCH_SOURCE		(SOUNDMIX_BENCH_BUFFER * 4)
+#define	SOUNDMIX_BENCH_PASSES		500
+
+// Per channel pitch and volume for the benchmark
+typedef struct SSoundMixBenchChannel
+{
+	uint32_t u32Step;
+	uint16_t u16Volume;
+} SSoundMixBenchChannel;
+
+// Runs the benchmark and returns channel samples/second
+static double SoundMixBenchmarkRun(const SSoundMixKernels *psKernels,
+								   SSoundMixBenchChannel *psChannels,
+								   int16_t *ps16Source,
+								   int32_t *ps32Mixdown,
+								   uint16_t *pu16Output)
+{
+	uint64_t u64Start;
+	uint64_t u64Elapsed;
+	uint32_t u32Pass;
+	uint32_t u32Channel;
+
+	u64Start = SDL_GetPerformanceCounter();
+	for (u32Pass = 0; u32Pass < SOUNDMIX_BENCH_PASSES; u32Pass++)
+	{
+		memset((void *) ps32Mixdown, 0, sizeof(*ps32Mixdown) * SOUNDMIX_BENCH_BUFFER);
+		for (u32Channel = 0; u32Channel < SOUNDMIX_BENCH_CHANNELS; u32Channel++)
+		{
+			psKernels->Resample(ps32Mixdown,
+								ps16Source,
+								(u32Pass * 7) & PITCH_FRACTION_MASK,
+								psChannels[u32Channel].u32Step,
+								psChannels[u32Channel].u16Volume,
+								SOUNDMIX_BENCH_BUFFER);
+		}
+
+		psKernels->Final(pu16Output + ((u32Pass & 1) * SOUNDMIX_BENCH_BUFFER),
+						 ps32Mixdown,
+						 (u32Pass & 1) ? VOLUME_UNITY : SOUND_GAIN_PERCENT(75),
+						 SOUNDMIX_BENCH_BUFFER);
+	}
+
+	u64Elapsed = SDL_GetPerformanceCounter() - u64Start;
+	if (0 == u64Elapsed)
+	{
+		u64Elapsed = 1;
+	}
+
+	return(((double) SOUNDMIX_BENCH_CHANNELS * (double) SOUNDMIX_BENCH_BUFFER * (double) SOUNDMIX_BENCH_PASSES *
+			(double) SDL_GetPerformanceFrequency()) / (double) u64Elapsed);
+}
+
+void SoundMixBenchmark(void)
+{
+	EStatus eStatus = ESTATUS_OK;
+	SSoundMixBenchChannel sChannels[SOUNDMIX_BENCH_CHANNELS];
+	int16_t *ps16Source = NULL;
+	int32_t *ps32Mixdown = NULL;
+	uint16_t *pu16Output = NULL;
+	uint16_t *pu16OutputCheck = NULL;
+	uint32_t u32Loop;
+	uint32_t u32Seed = 0x1234567;
+	double dScalar;
+	double dSelected;
+	bool bMatch;
+
+	SoundMixInit();
+
+	MEMALLOC(ps16Source, SOUNDMIX_BENCH_SOURCE * sizeof(*ps16Source));
+	MEMALLOC(ps32Mixdown, SOUNDMIX_BENCH_BUFFER * sizeof(*ps32Mixdown));
+	MEMALLOC(pu16Output, SOUNDMIX_BENCH_BUFFER * 2 * sizeof(*pu16Output));
+	MEMALLOC(pu16OutputCheck, SOUNDMIX_BENCH_BUFFER * 2 * sizeof(*pu16OutputCheck));
+
+	// Full scale noise so the final stage has plenty of clipping to do
+	for (u32Loop = 0; u32Loop < SOUNDMIX_BENCH_SOURCE; u32Loop++)
+	{
+		u32Seed = (u32Seed * 1103515245) + 12345;
+		ps16Source[u32Loop] = (int16_t) (u32Seed >> 16);
+	}
+
+	// A quarter of the channels at unity pitch, the rest spread between
+	// roughly half and double speed (the source is long enough for 2x)
+	for (u32Loop = 0; u32Loop < SOUNDMIX_BENCH_CHANNELS; u32Loop++)
+	{
+		u32Seed = (u32Seed * 1103515245) + 12345;
+		if (0 == (u32Loop & 3))
+		{
+			sChannels[u32Loop].u32Step = PITCH_UNITY;
+		}
+		else
+		{
+			sChannels[u32Loop].u32Step = (PITCH_UNITY / 2) + ((u32Seed >> 8) % (PITCH_UNITY * 3 / 2));
+		}
+
+		sChannels[u32Loop].u16Volume = (uint16_t) ((u32Seed >> 4) % (VOLUME_UNITY * 2));
+	}
+
+	DebugOut("Sound mix benchmark - %u channels, %u samples, %u passes, kernels=%s\n", SOUNDMIX_BENCH_CHANNELS, SOUNDMIX_BENCH_BUFFER, SOUNDMIX_BENCH_PASSES, SoundMixGetKernelName());
+
+	dScalar = SoundMixBenchmarkRun(&sg_sSoundMixKernelsScalar,
+								   sChannels,
+								   ps16Source,
+								   ps32Mixdown,
+								   pu16Output);
+
+	dSelected = SoundMixBenchmarkRun(sg_psSoundMixKernels,
+									 sChannels,
+									 ps16Source,
+									 ps32Mixdown,
+									 pu16OutputCheck);
+
+	// Both runs did identical work so the results must match
+	bMatch = (0 == memcmp((void *) pu16Output, (void *) pu16OutputCheck, SOUNDMIX_BENCH_BUFFER * 2 * sizeof(*pu16Output)));
+
+	DebugOut("  scalar %8.1f Msamples/sec, %-6s %8.1f Msamples/sec (%.2fx)%s\n",
+			 dScalar / 1000000.0,
+			 SoundMixGetKernelName(),
+			 dSelected / 1000000.0,
+			 dSelected / dScalar,
+			 bMatch ? "" : " - MISMATCH");
+
+errorExit:
+	if (eStatus != ESTATUS_OK)
+	{
+		DebugOut("Sound mix benchmark failed - %s\n", GetErrorText(eStatus));
+	}
+
+	SafeMemFree(ps16Source);
+	SafeMemFree(ps32Mixdown);
+	SafeMemFree(pu16Output);
+	SafeMemFree(pu16OutputCheck);
+}
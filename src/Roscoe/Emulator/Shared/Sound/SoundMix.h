@@ -0,0 +1,41 @@
+#ifndef _SOUNDMIX_H_
+#define _SOUNDMIX_H_
+
+// Sample kernels used by the sound mixer. Each kernel has a scalar
+// implementation plus SSE2/AVX2 variants that are selected at runtime by
+// SoundMixInit() based on what the host CPU supports. All variants produce
+// bit identical output.
+
+// Largest per channel volume the kernels accept (just under 8x unity)
+#define	SOUND_MIX_VOLUME_MAX		0x7fff
+
+// Resample u32Count samples from ps16Src with linear interpolation, scale by
+// u16Volume and accumulate into ps32Dest. u32Position is the starting
+// (PITCH_FIXED_BITS fixed point) position relative to ps16Src and u32Step is
+// the per output sample step. Every source sample touched AND the one
+// following it must be valid, so the last output sample reads
+// ps16Src[((u32Position + (u32Count - 1) * u32Step) >> PITCH_FIXED_BITS) + 1].
+extern void SoundMixResample(int32_t *ps32Dest,
+							 int16_t *ps16Src,
+							 uint32_t u32Position,
+							 uint32_t u32Step,
+							 uint16_t u16Volume,
+							 uint32_t u32Count);
+
+// Clip the accumulated mixdown to 16 bits, scale by u16Volume, clip again and
+// write it out as 16 bit samples
+extern void SoundMixFinal(uint16_t *pu16Dest,
+						  int32_t *ps32Src,
+						  uint16_t u16Volume,
+						  uint32_t u32Count);
+
+// Returns the name of the kernel set currently in use ("scalar", "SSE2", "AVX2")
+extern const char *SoundMixGetKernelName(void);
+
+// Select the best kernels for this CPU
+extern void SoundMixInit(void);
+
+// Time a 64 channel mixdown with the scalar kernels against the selected ones
+extern void SoundMixBenchmark(void);
+
+#endif	// #ifndef _SOUNDMIX_H_
@@ -1,6 +1,7 @@
 #include "Shared/Shared.h"
 #include "Shared/Sound/Sound.h"
 #include "Shared/Sound/SoundWav.h"
+#include "Shared/Sound/SoundMix.h"
 #include "Platform/Platform.h"
 
 PACKED_BEGIN
@@ -80,6 +81,131 @@ typedef struct SSoundWaveChannelState
 // Command queue size for wave 
 #define	WAV_CMD_DEPTH	10
 
+// Returns the sample count (relative to the start of this render) at which a
+// command stamped u64CmdTimestamp becomes due - the first one whose time is at
+// or after the timestamp. Never earlier than u64SampleCount.
+static uint64_t WaveCommandDue(uint64_t u64BaseTimestamp,
+							   uint64_t u64SampleCount,
+							   uint64_t u64CmdTimestamp)
+{
+	uint64_t u64Due;
+
+	if ((u64BaseTimestamp + SoundSamplesToTimeMs(u64SampleCount)) >= u64CmdTimestamp)
+	{
+		return(u64SampleCount);
+	}
+
+	// Estimate, then nudge it to the exact sample since ms<->samples rounds
+	u64Due = SoundTimeMsToSamples(u64CmdTimestamp - u64BaseTimestamp);
+	if (u64Due <= u64SampleCount)
+	{
+		u64Due = u64SampleCount + 1;
+	}
+
+	while ((u64BaseTimestamp + SoundSamplesToTimeMs(u64Due)) < u64CmdTimestamp)
+	{
+		++u64Due;
+	}
+
+	while ((u64Due > (u64SampleCount + 1)) &&
+		   ((u64BaseTimestamp + SoundSamplesToTimeMs(u64Due - 1)) >= u64CmdTimestamp))
+	{
+		--u64Due;
+	}
+
+	return(u64Due);
+}
+
+// Mixes up to u32Count samples of the playing wave into ps32HWSampleBuffer
+// and returns how many it actually did. Runs through the SIMD resampler for as
+// long as the sample after the current one is in the wave, and handles the
+// last sample (which interpolates toward the start when looping) by hand.
+static uint32_t WaveMix(SSoundWaveChannelState *psState,
+						int32_t *ps32HWSampleBuffer,
+						uint32_t u32Count)
+{
+	SSoundWav *psWav = psState->psPlayingSound;
+	int16_t *ps16Samples = (int16_t *) &psWav->pu8PlatformBase[psWav->u32SampleOffset];
+	uint32_t u32Remaining = psWav->u32SampleSize - psState->u32PlaybackSourcePosition;
+	uint32_t u32Step = psState->u16PlaybackStep;
+	uint32_t u32Position;
+
+	if (u32Remaining < 2)
+	{
+		u32Count = 0;
+	}
+	else
+	if (u32Step)
+	{
+		uint64_t u64Limit;
+
+		// Output samples until we'd interpolate against the last one
+		u64Limit = (((((uint64_t) (u32Remaining - 2)) << PITCH_FIXED_BITS) | ((1 << PITCH_FIXED_BITS) - 1)) - psState->u16PlaybackAccumulator) / u32Step + 1;
+		if (u64Limit < u32Count)
+		{
+			u32Count = (uint32_t) u64Limit;
+		}
+	}
+
+	if (u32Count)
+	{
+		SoundMixResample(ps32HWSampleBuffer,
+						 ps16Samples + psState->u32PlaybackSourcePosition,
+						 psState->u16PlaybackAccumulator,
+						 u32Step,
+						 psState->u16PlaybackVolume,
+						 u32Count);
+
+		u32Position = psState->u16PlaybackAccumulator + (u32Count * u32Step);
+	}
+	else
+	{
+		int16_t *ps16Sample = ps16Samples + psState->u32PlaybackSourcePosition;
+		int32_t s32Next = psState->bLoop ? ps16Samples[0] : ps16Sample[0];
+		int32_t s32Fraction = psState->u16PlaybackAccumulator;
+		int32_t s32Sample;
+		uint16_t u16Volume = psState->u16PlaybackVolume;
+
+		if (u16Volume > SOUND_MIX_VOLUME_MAX)
+		{
+			u16Volume = SOUND_MIX_VOLUME_MAX;
+		}
+
+		s32Sample = ((ps16Sample[0] * (PITCH_UNITY - s32Fraction)) + (s32Next * s32Fraction)) >> PITCH_FIXED_BITS;
+		*ps32HWSampleBuffer += (s32Sample * u16Volume) >> VOLUME_FIXED_BITS;
+
+		u32Position = psState->u16PlaybackAccumulator + u32Step;
+		u32Count = 1;
+	}
+
+	psState->u32PlaybackSourcePosition += (u32Position >> PITCH_FIXED_BITS);
+	psState->u16PlaybackAccumulator = (uint16_t) (u32Position & ((1 << PITCH_FIXED_BITS) - 1));
+
+	if (psState->u32PlaybackSourcePosition >= psWav->u32SampleSize)
+	{
+		// End of sample
+		if (psState->bLoop)
+		{
+			psState->u32PlaybackSourcePosition %= psWav->u32SampleSize;
+		}
+		else
+		{
+			// Not looping. Stop it.
+			psState->eState = EWAVE_NONE;
+			psState->psPlayingSound = NULL;
+			psState->u32PlaybackSourcePosition = 0;
+			psState->u16PlaybackAccumulator = 0;
+			psState->u16PlaybackStep = 0;
+		}
+	}
+	else
+	{
+		// Not at the end yet
+	}
+
+	return(u32Count);
+}
+
 static ERenderResult WaveRender(SSoundChannel *psChannel,
 								uint64_t u64BaseTimestamp,
 								int32_t **pps32HWSampleBuffer,
@@ -92,44 +218,49 @@ static ERenderResult WaveRender(SSoundChannel *psChannel,
 
 	psState = (SSoundWaveChannelState *) psChannel->pvMethodData;
 
+	// Work in spans that run up to the next command change or the end of the wave
 	while (u16HWSampleCount)
 	{
 		SWaveCmd sCmd;
-		uint64_t u64Time;
 		SWaveCmd *psWaveCmdPtr = NULL;
+		uint32_t u32Span = u16HWSampleCount;
 
-		// Snag the virtual->real time
-		u64Time = u64BaseTimestamp + SoundSamplesToTimeMs(u64SampleCount);
-
-		// Go peek at whatever command we want done.
-		psWaveCmdPtr = (SWaveCmd *) SoundQueueGetCurrent(psState->psQueue);
-		if (psWaveCmdPtr)
+		// Go peek at whatever commands we want done.
+		while (NULL != (psWaveCmdPtr = (SWaveCmd *) SoundQueueGetCurrent(psState->psQueue)))
 		{
-			// This means we have something inside
-			if (u64Time >= psWaveCmdPtr->u64CmdTimestamp)
-			{
-				memcpy((void *) &sCmd, (void *) psWaveCmdPtr, sizeof(sCmd));
-				SoundQueueDequeue(psState->psQueue);
+			uint64_t u64Due;
 
-				if (EWAVE_PLAY == sCmd.eCmd)
+			u64Due = WaveCommandDue(u64BaseTimestamp,
+									u64SampleCount,
+									psWaveCmdPtr->u64CmdTimestamp);
+			if (u64Due > u64SampleCount)
+			{
+				// Not time to apply this yet - just render up until it is
+				if ((u64Due - u64SampleCount) < u32Span)
 				{
-					psState->bLoop = sCmd.bLooped;
-					psState->psPlayingSound = sCmd.psWave;
-					psState->u16PlaybackAccumulator = 0;
-					psState->u16PlaybackVolume = sCmd.u16Volume;
-					psState->u16SamplesAvailable = psState->psPlayingSound->u32SampleSize;
-					psState->u16PlaybackStep = psState->psPlayingSound->u16SampleRatePitch;
-					psState->u32PlaybackSourcePosition = 0;
-					psState->eState = EWAVE_PLAYING;
+					u32Span = (uint32_t) (u64Due - u64SampleCount);
 				}
+
+				break;
 			}
-			else
+
+			memcpy((void *) &sCmd, (void *) psWaveCmdPtr, sizeof(sCmd));
+			SoundQueueDequeue(psState->psQueue);
+
+			if (EWAVE_PLAY == sCmd.eCmd)
 			{
-				// Not time to apply this yet
+				psState->bLoop = sCmd.bLooped;
+				psState->psPlayingSound = sCmd.psWave;
+				psState->u16PlaybackAccumulator = 0;
+				psState->u16PlaybackVolume = sCmd.u16Volume;
+				psState->u16SamplesAvailable = psState->psPlayingSound->u32SampleSize;
+				psState->u16PlaybackStep = psState->psPlayingSound->u16SampleRatePitch;
+				psState->u32PlaybackSourcePosition = 0;
+				psState->eState = EWAVE_PLAYING;
 			}
 		}
 
-		// If we have a sample playing, copy in appropriate data
+		// If we have a sample playing, mix in appropriate data
 		if (EWAVE_NONE == psState->eState)
 		{
 			// Not doing anything - just fall through
@@ -137,32 +268,9 @@ static ERenderResult WaveRender(SSoundChannel *psChannel,
 		else
 		if (EWAVE_PLAYING == psState->eState)
 		{
-			*ps32HWSampleBuffer += (((*((int16_t *) &psState->psPlayingSound->pu8PlatformBase[psState->psPlayingSound->u32SampleOffset + (psState->u32PlaybackSourcePosition << 1)])) * psState->u16PlaybackVolume) >> VOLUME_FIXED_BITS);
-			psState->u16PlaybackAccumulator += psState->u16PlaybackStep;
-			psState->u32PlaybackSourcePosition += (psState->u16PlaybackAccumulator >> PITCH_FIXED_BITS);
-			psState->u16PlaybackAccumulator &= ((1 << PITCH_FIXED_BITS) - 1);
-
-			if (psState->u32PlaybackSourcePosition >= psState->psPlayingSound->u32SampleSize)
-			{
-				// End of sample
-				if (psState->bLoop)
-				{
-					psState->u32PlaybackSourcePosition -= psState->psPlayingSound->u32SampleSize;
-				}
-				else
-				{
-					// Not looping. Stop it.
-					psState->eState = EWAVE_NONE;
-					psState->psPlayingSound = NULL;
-					psState->u32PlaybackSourcePosition = 0;
-					psState->u16PlaybackAccumulator = 0;
-					psState->u16PlaybackStep = 0;
-				}
-			}
-			else
-			{
-				// Not at the end yet
-			}
+			u32Span = WaveMix(psState,
+							  ps32HWSampleBuffer,
+							  u32Span);
 		}
 		else
 		{
@@ -170,10 +278,9 @@ static ERenderResult WaveRender(SSoundChannel *psChannel,
 			BASSERT(0);
 		}
 
-
-		++u64SampleCount;
-		--u16HWSampleCount;
-		++ps32HWSampleBuffer;
+		u64SampleCount += u32Span;
+		u16HWSampleCount -= (uint16_t) u32Span;
+		ps32HWSampleBuffer += u32Span;
 	}
 
 	*pps32HWSampleBuffer = ps32HWSampleBuffer;
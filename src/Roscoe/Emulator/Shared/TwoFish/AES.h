@@ -48,6 +48,7 @@ INCLUDE IMPLEMENTATION SPECIFIC INFORMATION.
 /* TWOFISH specific definitions */
 #define		MAX_KEY_SIZE		64	/* # of ASCII chars needed to represent a key */
 #define		MAX_IV_SIZE			16	/* # of bytes needed to represent an IV */
+#define		CTR_NONCE_SIZE		8	/* # of nonce bytes in a CTR counter block */
 #define		BAD_INPUT_LEN		-6	/* inputLen not a multiple of block size */
 #define		BAD_PARAMS			-7	/* invalid parameters */
 #define		BAD_IV_MAT			-8	/* invalid IV text */
@@ -146,6 +147,8 @@ int blockDecrypt(cipherInstance *cipher, keyInstance *key, BYTE *input,
 				int inputLen, BYTE *outBuffer);
 
 int	reKey(keyInstance *key);	/* do key schedule using modified key.keyDwords */
+int blockCTR(keyInstance *key, BYTE *nonce, uint64_t position,
+				BYTE *input, int inputLen, BYTE *outBuffer);
 
 /* API to check table usage, for use in ECB_TBL KAT */
 #define		TAB_DISABLE			0
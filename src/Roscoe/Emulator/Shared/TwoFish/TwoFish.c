@@ -1157,6 +1157,104 @@ int blockDecrypt(cipherInstance *cipher, keyInstance *key,CONST BYTE *input,
 	return inputLen;
 	}
 
+/*
++*****************************************************************************
+*
+* Function Name:	blockCTR
+*
+* Function:			Encrypt/decrypt data using Twofish in counter mode
+*
+* Arguments:		key			=	ptr to already initialized keyInstance
+*									(must be keyed for DIR_ENCRYPT)
+*					nonce		=	ptr to CTR_NONCE_SIZE bytes of nonce
+*					position	=	stream byte offset of input[0]
+*					input		=	ptr to data to be ciphered
+*					inputLen	=	# bytes to cipher
+*					outBuffer	=	ptr to where to put ciphered data (may
+*									be the same as input)
+*
+* Return:			# bytes ciphered (>= 0)
+*					else error code (e.g., BAD_KEY_DIR)
+*
+* Notes: Counter block N is the nonce followed by N as a little endian
+*		 64-bit value, so keystream byte P comes from block P/16. Every
+*		 block stands alone, which means any part of the stream can be
+*		 ciphered on its own - seeks and parallel chunks don't need any
+*		 prior state. The key is only read, so multiple threads can share
+*		 it. Encryption and decryption are the same operation.
+*
+-****************************************************************************/
+int blockCTR(keyInstance *key,CONST BYTE *nonce,uint64_t position,
+				CONST BYTE *input,int inputLen,BYTE *outBuffer)
+	{
+	int   i,n;						/* loop counters */
+	DWORD x[BLOCK_SIZE/32];			/* block being encrypted */
+	DWORD t0,t1;					/* temp variables */
+	DWORD ctr[BLOCK_SIZE/32];		/* counter block */
+	DWORD ks[BLOCK_SIZE/32];		/* keystream block */
+	uint64_t blockIndex=position/(BLOCK_SIZE/8);
+	int   skip=(int) (position%(BLOCK_SIZE/8));
+	int	  rounds=key->numRounds;	/* number of rounds */
+	DWORD sk[TOTAL_SUBKEYS];
+
+	GetSboxKey;
+
+	/* can't flip the subkey order here without breaking other users of the key */
+	if (key->direction != DIR_ENCRYPT)
+		return BAD_KEY_DIR;
+
+	/* make local copy of subkeys for speed */
+	memcpy(sk,key->subKeys,sizeof(DWORD)*(ROUND_SUBKEYS+2*rounds));
+	memcpy(ctr,nonce,CTR_NONCE_SIZE);
+
+	for (n=0;n<inputLen;blockIndex++)
+		{
+		/* counter bytes are little endian regardless of host */
+		for (i=0;i<8;i++)
+			((BYTE *) ctr)[CTR_NONCE_SIZE+i]=(BYTE) (blockIndex >> (i*8));
+
+#define	LoadBlockC(N)  x[N]=Bswap(ctr[N]) ^ sk[INPUT_WHITEN+N]
+		LoadBlockC(0);	LoadBlockC(1);	LoadBlockC(2);	LoadBlockC(3);
+
+#if defined(ZERO_KEY)
+		switch (key->keyLen)
+			{
+			case 128:
+				for (i=rounds-2;i>=0;i-=2)
+					Encrypt2(i,_128);
+				break;
+			case 192:
+				for (i=rounds-2;i>=0;i-=2)
+					Encrypt2(i,_192);
+				break;
+			case 256:
+				for (i=rounds-2;i>=0;i-=2)
+					Encrypt2(i,_256);
+				break;
+			}
+#else
+		Encrypt2(14,_);
+		Encrypt2(12,_);
+		Encrypt2(10,_);
+		Encrypt2( 8,_);
+		Encrypt2( 6,_);
+		Encrypt2( 4,_);
+		Encrypt2( 2,_);
+		Encrypt2( 0,_);
+#endif
+
+		/* same output swap/whitening as blockEncrypt() */
+#define	StoreBlockC(N)	{ t0=x[N^2] ^ sk[OUTPUT_WHITEN+N]; ks[N]=Bswap(t0); }
+		StoreBlockC(0);	StoreBlockC(1);	StoreBlockC(2);	StoreBlockC(3);
+
+		for (i=skip;(i<BLOCK_SIZE/8) && (n<inputLen);i++,n++)
+			outBuffer[n] = input[n] ^ ((BYTE *) ks)[i];
+		skip=0;
+		}
+
+	return inputLen;
+	}
+
 #ifdef GetCodeSize
 DWORD TwofishCodeSize(void)
 	{
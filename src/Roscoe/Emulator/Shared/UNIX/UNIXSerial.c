@@ -3,6 +3,7 @@
 #include <errno.h>
 #include <termios.h>
 #include <unistd.h>
+#include <poll.h>
 #include <sys/ioctl.h>
 
 #if defined(__LINUX__)
@@ -23,6 +24,13 @@
 // Serial overlapped read buffers
 #define	OVERLAPPED_READ_BUFFER_COUNT	5
 
+// Receive chunk and transmit coalescing buffer sizes (per consumer)
+#define	SERIAL_RECEIVE_BUFFER_SIZE		4096
+#define	SERIAL_TRANSMIT_BUFFER_SIZE		4096
+
+// How long small writes are held so they can go out as a single write()
+#define	SERIAL_WRITE_COALESCE_MS		2
+
 // Enable serial logging
 #define	SERIAL_LOG_ENABLE
 
@@ -55,6 +63,14 @@ typedef struct SConsumer
 
 	// UNIX specific information
 	int hSerialHandle;						// Platform serial handle
+	int hWakePipe[2];						// Wakes the receive thread (pending transmit data or shutdown)
+
+	// Receive buffer - handed directly to ReceiveCallback
+	UINT8 u8ReceiveBuffer[SERIAL_RECEIVE_BUFFER_SIZE];
+
+	// Coalesced transmit data not yet written to the port
+	UINT8 u8TransmitBuffer[SERIAL_TRANSMIT_BUFFER_SIZE];
+	UINT32 u32TransmitCount;
 
 	// Used to signal a shutdown
 	SOSEventFlag *psShutdownEventFlag;		// Event flag when we've shut down
@@ -442,6 +458,78 @@ errorExit:
 	return(eStatus);
 }
 
+// Write a block to the port, retrying partial writes. Consumer must be locked.
+static EStatus DCSerialWriteBlock(SConsumer *psConsumer,
+								  UINT8 *pu8Data,
+								  UINT64 u64BytesToWrite)
+{
+	EStatus eStatus = ESTATUS_OK;
+	ssize_t s64DataWritten;
+	int s32SystemError;
+
+	while (u64BytesToWrite)
+	{
+		s64DataWritten = write( psConsumer->hSerialHandle, pu8Data, u64BytesToWrite );
+		s32SystemError = errno;
+
+		if( s64DataWritten < 0 )
+		{
+			if (EINTR == s32SystemError)
+			{
+				continue;
+			}
+
+			Syslog("%s: Write error (%d): %s\n", __FUNCTION__, s32SystemError, strerror(s32SystemError));
+			eStatus = ESTATUS_WRITE_TRUNCATED;
+			goto errorExit;
+		}
+
+		if (0 == s64DataWritten)
+		{
+			// Nothing is moving - don't spin
+			eStatus = ESTATUS_WRITE_TRUNCATED;
+			goto errorExit;
+		}
+
+		pu8Data += s64DataWritten;
+		u64BytesToWrite -= s64DataWritten;
+	}
+
+errorExit:
+	return(eStatus);
+}
+
+// Write out anything sitting in the transmit buffer. Consumer must be locked.
+static EStatus DCSerialTransmitFlush(SConsumer *psConsumer)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	if (psConsumer->u32TransmitCount)
+	{
+		eStatus = DCSerialWriteBlock(psConsumer,
+									 psConsumer->u8TransmitBuffer,
+									 psConsumer->u32TransmitCount);
+		psConsumer->u32TransmitCount = 0;
+	}
+
+	return(eStatus);
+}
+
+// Poke the receive thread out of poll()
+static void DCSerialWake(SConsumer *psConsumer)
+{
+	UINT8 u8Wake = 0;
+
+	if (psConsumer->hWakePipe[1] != INVALID_TERMIOS_HANDLE_VALUE)
+	{
+		// Nonblocking - if the pipe is full, the thread is already awake
+		(void) write(psConsumer->hWakePipe[1], &u8Wake, sizeof(u8Wake));
+	}
+}
+
+// Small writes are gathered in the consumer's transmit buffer and written by the receive
+// thread SERIAL_WRITE_COALESCE_MS later, so a burst of them costs a single write() call.
+// Writes that don't fit go out immediately (after anything already buffered).
 EStatus DCSerialWrite(EDCSerialHandle eSerialHandle,
 					  UINT8 *pu8Data,
 					  UINT64 u64BytesToWrite)
@@ -449,9 +537,6 @@ EStatus DCSerialWrite(EDCSerialHandle eSerialHandle,
 	EStatus eStatus = ESTATUS_OK;
 	SConsumer *psConsumer = NULL;
 	BOOL bLocked = FALSE;
-	size_t s64DataWritten = 0;
-	int s32SystemError;
-	BOOL bWriteSuccess = FALSE;
 
 	eStatus = DCHandleToConsumer(eSerialHandle,
 								 &psConsumer,
@@ -468,20 +553,31 @@ EStatus DCSerialWrite(EDCSerialHandle eSerialHandle,
 		goto errorExit;
 	}
 
-	s64DataWritten = write( psConsumer->hSerialHandle, pu8Data, u64BytesToWrite );
-	s32SystemError = errno;
-
-	if( s64DataWritten < 0 )
+	// Make room if this won't fit behind what's already buffered
+	if ((psConsumer->u32TransmitCount + u64BytesToWrite) > sizeof(psConsumer->u8TransmitBuffer))
 	{
-		Syslog("%s: Write error (%d): %s\n", __FUNCTION__, s32SystemError, strerror(s32SystemError));
-		goto errorExit;
+		eStatus = DCSerialTransmitFlush(psConsumer);
+		ERR_GOTO();
 	}
 
-	// If everything went OK, then check to see if we wrote what we thought we did,
-	// and if not, return an error.
-	if (u64BytesToWrite != s64DataWritten)
+	if (u64BytesToWrite >= sizeof(psConsumer->u8TransmitBuffer))
 	{
-		eStatus = ESTATUS_WRITE_TRUNCATED;
+		// Big enough to go on its own
+		eStatus = DCSerialWriteBlock(psConsumer,
+									 pu8Data,
+									 u64BytesToWrite);
+		ERR_GOTO();
+	}
+	else if (u64BytesToWrite)
+	{
+		// If the buffer was empty, the receive thread needs to know there's something to send
+		if (0 == psConsumer->u32TransmitCount)
+		{
+			DCSerialWake(psConsumer);
+		}
+
+		memcpy(&psConsumer->u8TransmitBuffer[psConsumer->u32TransmitCount], pu8Data, u64BytesToWrite);
+		psConsumer->u32TransmitCount += (UINT32) u64BytesToWrite;
 	}
 
 errorExit:
@@ -515,6 +611,10 @@ EStatus DCSerialFlush(EDCSerialHandle eSerialHandle)
 	ERR_GOTO();
 	bLocked = TRUE;
 
+	// Anything still being coalesced goes out first
+	eStatus = DCSerialTransmitFlush(psConsumer);
+	ERR_GOTO();
+
 	// tcdrain() waits until data has been written
 	// tcflush() would be incorrect because it drops all unsent data
 	s32Result = tcdrain( psConsumer->hSerialHandle );
@@ -734,33 +834,90 @@ static void DCSerialReceiveThread(void *pvData)
 {
 	EDCSerialHandle eSerialHandle = (EDCSerialHandle) pvData;
 	SConsumer *psConsumer;
+	struct pollfd sPoll[2];
+	BOOL bTransmitPending = FALSE;
 
 	// Make sure it's in range
 	BASSERT((eSerialHandle >= 1) && 
 			(eSerialHandle <= MAX_CONSUMERS));
 	psConsumer = &sg_sConsumers[eSerialHandle - 1];
 
+	// Wait on the port and on our wake pipe
+	sPoll[0].fd = psConsumer->hSerialHandle;
+	sPoll[0].events = POLLIN;
+	sPoll[1].fd = psConsumer->hWakePipe[0];
+	sPoll[1].events = POLLIN;
+
 	// Loop forever
 	while (psConsumer->eState != ECONSTATE_SHUTDOWN)
 	{
-		size_t s64BytesReceived;
-		UINT8 u8DataBuffer;
-		BOOL bResult;
+		ssize_t s64BytesReceived;
+		int s32Result;
 		int s32SystemError;
 
-		// One byte at a time
+		// If there's transmit data waiting, only give it the coalescing window to grow
+		s32Result = poll(sPoll,
+						 sizeof(sPoll) / sizeof(sPoll[0]),
+						 bTransmitPending ? SERIAL_WRITE_COALESCE_MS : SERIAL_READ_TIMEOUT_MS);
+		s32SystemError = errno;
+
+		if (s32Result < 0)
+		{
+			if (EINTR == s32SystemError)
+			{
+				continue;
+			}
+
+			Syslog( "%s: Poll error (%d): %s - exiting\n", __FUNCTION__, s32SystemError, strerror(s32SystemError) );
+			goto errorExit;
+		}
+
+		// Window's up - send whatever has accumulated
+		if (bTransmitPending)
+		{
+			if (ESTATUS_OK == OSCriticalSectionEnter(psConsumer->sConsumerLock))
+			{
+				(void) DCSerialTransmitFlush(psConsumer);
+				(void) OSCriticalSectionLeave(psConsumer->sConsumerLock);
+			}
+
+			bTransmitPending = FALSE;
+		}
+
+		// Someone queued transmit data (or wants us to shut down)
+		if (sPoll[1].revents & POLLIN)
+		{
+			UINT8 u8Drain[16];
+
+			while (read(psConsumer->hWakePipe[0], u8Drain, sizeof(u8Drain)) > 0);
+			bTransmitPending = TRUE;
+		}
+
+		// Port gone?
+		if (sPoll[0].revents & (POLLERR | POLLHUP | POLLNVAL))
+		{
+			Syslog( "%s: Port error/hangup (0x%x) - exiting\n", __FUNCTION__, sPoll[0].revents );
+			goto errorExit;
+		}
+
+		if (0 == (sPoll[0].revents & POLLIN))
+		{
+			continue;
+		}
+
+		// Take everything that's there
 		s64BytesReceived = read( psConsumer->hSerialHandle,
-								 &u8DataBuffer,
-								 sizeof(u8DataBuffer) );
+								 psConsumer->u8ReceiveBuffer,
+								 sizeof(psConsumer->u8ReceiveBuffer) );
 		s32SystemError = errno;
 
 		if( s64BytesReceived < 0 )
 		{
-			// PVTODO: Allow timeouts if it's an error
-//                if (WAIT_TIMEOUT == u32WaitResult)
-//                {
-//                    // Timeout. That's OK. Just keep looping until we get something
-//                }
+			if ((EINTR == s32SystemError) ||
+				(EAGAIN == s32SystemError))
+			{
+				continue;
+			}
 
 			Syslog( "%s: Read error (%d): %s - exiting\n", __FUNCTION__, s32SystemError, strerror(s32SystemError) );
 			goto errorExit;
@@ -772,8 +929,8 @@ static void DCSerialReceiveThread(void *pvData)
 			if (psConsumer->ReceiveCallback)
 			{
 				psConsumer->ReceiveCallback(eSerialHandle,
-											&u8DataBuffer,
-											s64BytesReceived);
+											psConsumer->u8ReceiveBuffer,
+											(UINT64) s64BytesReceived);
 			}
 		}
 	}
@@ -789,9 +946,18 @@ errorExit:
 		psConsumer->CloseCallback(eSerialHandle);
 	}
 
-	// Close the handle
-	close(psConsumer->hSerialHandle);
-	psConsumer->hSerialHandle = INVALID_TERMIOS_HANDLE_VALUE;
+	// Anything still buffered goes out before the port closes, then the handles go
+	if (ESTATUS_OK == OSCriticalSectionEnter(psConsumer->sConsumerLock))
+	{
+		(void) DCSerialTransmitFlush(psConsumer);
+		close(psConsumer->hSerialHandle);
+		psConsumer->hSerialHandle = INVALID_TERMIOS_HANDLE_VALUE;
+		close(psConsumer->hWakePipe[0]);
+		close(psConsumer->hWakePipe[1]);
+		psConsumer->hWakePipe[0] = INVALID_TERMIOS_HANDLE_VALUE;
+		psConsumer->hWakePipe[1] = INVALID_TERMIOS_HANDLE_VALUE;
+		(void) OSCriticalSectionLeave(psConsumer->sConsumerLock);
+	}
 
 	// Clear out the name of the ports
 	psConsumer->eCOMDeviceName[0] = '\0';
@@ -887,9 +1053,9 @@ static EStatus DCSerialProbe(SCOMPort *psCOMPort)
 			// Outgoing data handling
 			sSerialParams.c_oflag &= ~(OPOST|ONLCR);
 
-			// Timeouts
-			sSerialParams.c_cc[VMIN] = 0;								// When VMIN=0, VTIME is timeout from start of read
-			sSerialParams.c_cc[VTIME] = SERIAL_READ_TIMEOUT_MS/100;		// Read timeout in deciseconds
+			// Timeouts - the receive thread waits in poll(), so read() just takes whatever has arrived
+			sSerialParams.c_cc[VMIN] = 0;
+			sSerialParams.c_cc[VTIME] = 0;
 
 
 			s32Result = tcsetattr( hSerialHandle, TCSANOW, &sSerialParams );
@@ -902,9 +1068,27 @@ static EStatus DCSerialProbe(SCOMPort *psCOMPort)
 				goto errorExit;
 			}
 
+			// Pipe used to wake the receive thread
+			s32Result = pipe( sg_sConsumers[u32Loop].hWakePipe );
+			s32SystemError = errno;
+
+			if (0 == s32Result)
+			{
+				(void) fcntl( sg_sConsumers[u32Loop].hWakePipe[0], F_SETFL, O_NONBLOCK );
+				(void) fcntl( sg_sConsumers[u32Loop].hWakePipe[1], F_SETFL, O_NONBLOCK );
+			}
+			else
+			{
+				SerialLog("%s: Failed to create wake pipe for '%s' - (%d): %s\n", __FUNCTION__, psCOMPort->eCOMDeviceName, s32SystemError, strerror(s32SystemError));
+				sg_sConsumers[u32Loop].hWakePipe[0] = INVALID_TERMIOS_HANDLE_VALUE;
+				sg_sConsumers[u32Loop].hWakePipe[1] = INVALID_TERMIOS_HANDLE_VALUE;
+				goto errorExit;
+			}
+
 			// Copy in serial port information to be used by the consumer's discovery process
 			strncpy(sg_sConsumers[u32Loop].eCOMDeviceName, psCOMPort->eCOMDeviceName, sizeof(sg_sConsumers[u32Loop].eCOMDeviceName) - 1);
 			sg_sConsumers[u32Loop].hSerialHandle = hSerialHandle;
+			sg_sConsumers[u32Loop].u32TransmitCount = 0;
 
 			SerialLog("%s: Probing - '%s'\n", __FUNCTION__, sg_sConsumers[u32Loop].eCOMDeviceName);
 
@@ -1101,6 +1285,8 @@ EStatus DCSerialInit(void)
 
 		sg_sConsumers[u32Loop].eState = ECONSTATE_NOT_ALLOCATED;
 		sg_sConsumers[u32Loop].hSerialHandle = INVALID_TERMIOS_HANDLE_VALUE; 
+		sg_sConsumers[u32Loop].hWakePipe[0] = INVALID_TERMIOS_HANDLE_VALUE;
+		sg_sConsumers[u32Loop].hWakePipe[1] = INVALID_TERMIOS_HANDLE_VALUE;
 	}
 
 	// Consumer allocation lock
@@ -1153,8 +1339,13 @@ EStatus DCSerialClose(EDCSerialHandle eSerialHandle)
 								 FALSE);
 	ERR_GOTO();
 
-	// Flag the port for shutdown
+	// Flag the port for shutdown and kick the receive thread out of poll()
 	psConsumer->eState = ECONSTATE_SHUTDOWN;
+	if (ESTATUS_OK == OSCriticalSectionEnter(psConsumer->sConsumerLock))
+	{
+		DCSerialWake(psConsumer);
+		(void) OSCriticalSectionLeave(psConsumer->sConsumerLock);
+	}
 
 	// Wait for something to do
 	u64Flags = 0;
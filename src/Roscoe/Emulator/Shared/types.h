@@ -437,6 +437,7 @@ typedef enum
 	ESTATUS_CIPHER_INIT_FAILURE = 1200,
 	ESTATUS_CIPHER_DECRYPTION_FAULT,
 	ESTATUS_CIPHER_ENCRYPTION_FAULT,
+	ESTATUS_CIPHER_UNSUPPORTED_VERSION,	// Encrypted file is from a newer format than we understand
 
 	// Misc administrative errors
 	ESTATUS_LOGGED_ASSERT_UNAVAILABLE=1300,
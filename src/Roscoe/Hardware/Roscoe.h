@@ -58,6 +58,10 @@
 // Video memory
 #define	ROSCOE_VIDEO_MEMORY_BASE			0x50000000
 #define ROSCOE_VIDEO_FONT_MEMORY			(ROSCOE_VIDEO_MEMORY_BASE + 0x100000)
+
+// Network window (4K). The board has a LAN9218 (U43) here, which has no driver
+// yet. Shared/NIC.c drives a W5500 on an SPI bridge in this window instead,
+// and is only built with NIC_W5500=1.
 #define	ROSCOE_NIC							(ROSCOE_VIDEO_FONT_MEMORY + 0x100000)
 
 // System DRAM
@@ -30,6 +30,13 @@
 #endif
 #define KEYBOARD_TIMER_UPDATE_DELAY 20000
 
+// Define PREDECODE_CACHE to cache instruction decodes by CS:IP. Off by default: on an x86 host it measured 5-25%
+// slower than decoding every instruction, and it has not been measured on slower targets.
+#ifdef PREDECODE_CACHE
+// Predecode cache size (entries, must be a power of 2)
+#define DECODE_CACHE_SIZE 4096
+#endif
+
 // 16-bit register decodes
 #define REG_AX 0
 #define REG_CX 1
@@ -121,14 +128,17 @@
 // Execute arithmetic/logic operations in emulator memory/registers
 #define R_M_OP(dest,op,src) (i_w ? op_dest = CAST(unsigned short)dest, op_result = CAST(unsigned short)dest op (op_source = CAST(unsigned short)src) \
 								 : (op_dest = dest, op_result = dest op (op_source = CAST(unsigned char)src)))
-#define MEM_OP(dest,op,src) R_M_OP(mem[dest],op,mem[src])
+#define MEM_OP(dest,op,src) (MEM_WRITE_NOTE(dest), R_M_OP(mem[dest],op,mem[src]))
+
+// Note a (byte or word) write to emulated memory at addr, flagging the display for a redraw if it lands on video RAM
+#define MEM_WRITE_NOTE(addr) ((unsigned)(addr) + 1 - 0xB0000 <= VIDEO_RAM_SIZE && (vid_dirty = 1))
 #define OP(op) MEM_OP(op_to_addr,op,op_from_addr)
 
 // Increment or decrement a register #reg_id (usually SI or DI), depending on direction flag and operand size (given by i_w)
 #define INDEX_INC(reg_id) (regs16[reg_id] -= (2 * regs8[FLAG_DF] - 1)*(i_w + 1))
 
 // Helpers for stack operations
-#define R_M_PUSH(a) (i_w = 1, R_M_OP(mem[SEGREG(REG_SS, REG_SP, --)], =, a))
+#define R_M_PUSH(a) (i_w = 1, R_M_OP(mem[SEGREG(REG_SS, REG_SP, --)], =, a), MEM_WRITE_NOTE(SEGREG(REG_SS, REG_SP,)))
 #define R_M_POP(a) (i_w = 1, regs16[REG_SP] += 2, R_M_OP(a, =, mem[SEGREG(REG_SS, REG_SP, -2+)]))
 
 // Convert segment:offset to linear address in emulator memory space
@@ -158,10 +168,25 @@
 unsigned char mem[RAM_SIZE], io_ports[IO_PORT_COUNT], *opcode_stream, *regs8, i_rm, i_w, i_reg, i_mod, i_mod_size, i_d, i_reg4bit, raw_opcode_id, xlat_opcode_id, extra, rep_mode, seg_override_en, rep_override_en, trap_flag, int8_asap, scratch_uchar, io_hi_lo, *vid_mem_base, spkr_en, bios_table_lookup[20][256];
 unsigned short *regs16, reg_ip, seg_override, file_index, wave_counter;
 unsigned int op_source, op_dest, rm_addr, op_to_addr, op_from_addr, i_data0, i_data1, i_data2, scratch_uint, scratch2_uint, inst_counter, set_flags_type, GRAPHICS_X, GRAPHICS_Y, pixel_colors[16], vmem_ctr;
+unsigned char vid_dirty, *vid_mem_shown;
 int op_result, disk[3], scratch_int;
 time_t clock_buf;
 struct timeb ms_clock;
 
+#ifdef PREDECODE_CACHE
+// Predecode cache entry. Holds everything decoded from the instruction bytes alone (i.e. before DECODE_RM_REG, which
+// depends on register contents), plus the (up to 6) bytes it was decoded from. An entry is only used while those
+// bytes are unchanged, so code that has been written since (self-modifying code, overlays, a new program loaded
+// over an old one) is always decoded afresh. An addr of 0 never matches, since execution stops at 0:0.
+struct decode_entry
+{
+	unsigned int addr, code0, i_data0, i_data1, i_data2;
+	unsigned short code4;
+	unsigned char raw_opcode_id, xlat_opcode_id, extra, i_mod_size, set_flags_type, i_w, i_d, i_reg4bit, i_mod, i_rm, i_reg;
+} decode_cache[DECODE_CACHE_SIZE], *decode_hit;
+unsigned int decode_addr;
+#endif
+
 #ifndef NO_GRAPHICS
 SDL_AudioSpec sdl_audio = {44100, AUDIO_U8, 1, 0, 128};
 SDL_Surface *sdl_screen;
@@ -224,6 +249,13 @@ void set_opcode(unsigned char opcode)
 	set_flags_type = bios_table_lookup[TABLE_STD_FLAGS][opcode];
 }
 
+// Note a bulk write (disk read, etc.) to length bytes of emulated memory at addr
+void mem_write_range_noted(unsigned int addr, unsigned int length)
+{
+	if (addr < 0xB0000 + VIDEO_RAM_SIZE && addr + length > 0xB0000)
+		vid_dirty = 1;
+}
+
 // Execute INT #interrupt_num on the emulated machine
 char pc_interrupt(unsigned char interrupt_num)
 {
@@ -297,17 +329,79 @@ int main(int argc, char **argv)
 	// Instruction execution loop. Terminates if CS:IP = 0:0
 	for (; opcode_stream = mem + 16 * regs16[REG_CS] + reg_ip, opcode_stream != mem;)
 	{
-		// Set up variables to prepare for decoding an opcode
-		set_opcode(*opcode_stream);
+#ifdef PREDECODE_CACHE
+		decode_addr = opcode_stream - mem;
+		decode_hit = decode_cache + (decode_addr & (DECODE_CACHE_SIZE - 1));
+		if (decode_hit->addr == decode_addr && decode_hit->code0 == CAST(unsigned)opcode_stream[0] && decode_hit->code4 == CAST(unsigned short)opcode_stream[4])
+		{
+			// Seen this one before (and its bytes haven't changed since), so skip the decode
+			raw_opcode_id = decode_hit->raw_opcode_id;
+			xlat_opcode_id = decode_hit->xlat_opcode_id;
+			extra = decode_hit->extra;
+			i_mod_size = decode_hit->i_mod_size;
+			set_flags_type = decode_hit->set_flags_type;
+			i_w = decode_hit->i_w;
+			i_d = decode_hit->i_d;
+			i_reg4bit = decode_hit->i_reg4bit;
+			i_data0 = decode_hit->i_data0;
+			i_data1 = decode_hit->i_data1;
+			i_data2 = decode_hit->i_data2;
+			if (i_mod_size)
+				i_mod = decode_hit->i_mod,
+				i_rm = decode_hit->i_rm,
+				i_reg = decode_hit->i_reg;
+		}
+		else
+		{
+#endif
+			// Set up variables to prepare for decoding an opcode
+			set_opcode(*opcode_stream);
 
-		// Extract i_w and i_d fields from instruction
-		i_w = (i_reg4bit = raw_opcode_id & 7) & 1;
-		i_d = i_reg4bit / 2 & 1;
+			// Extract i_w and i_d fields from instruction
+			i_w = (i_reg4bit = raw_opcode_id & 7) & 1;
+			i_d = i_reg4bit / 2 & 1;
 
-		// Extract instruction data fields
-		i_data0 = CAST(short)opcode_stream[1];
-		i_data1 = CAST(short)opcode_stream[2];
-		i_data2 = CAST(short)opcode_stream[3];
+			// Extract instruction data fields
+			i_data0 = CAST(short)opcode_stream[1];
+			i_data1 = CAST(short)opcode_stream[2];
+			i_data2 = CAST(short)opcode_stream[3];
+
+			// i_mod_size > 0 indicates that opcode uses i_mod/i_rm/i_reg, so decode them
+			if (i_mod_size)
+			{
+				i_mod = (i_data0 & 0xFF) >> 6;
+				i_rm = i_data0 & 7;
+				i_reg = i_data0 / 8 & 7;
+
+				if ((!i_mod && i_rm == 6) || (i_mod == 2))
+					i_data2 = CAST(short)opcode_stream[4];
+				else if (i_mod != 1)
+					i_data2 = i_data1;
+				else // If i_mod is 1, operand is (usually) 8 bits rather than 16 bits
+					i_data1 = (char)i_data1;
+			}
+
+#ifdef PREDECODE_CACHE
+			// Cache the decode, along with the bytes it was made from
+			decode_hit->addr = decode_addr;
+			decode_hit->code0 = CAST(unsigned)opcode_stream[0];
+			decode_hit->code4 = CAST(unsigned short)opcode_stream[4];
+			decode_hit->raw_opcode_id = raw_opcode_id;
+			decode_hit->xlat_opcode_id = xlat_opcode_id;
+			decode_hit->extra = extra;
+			decode_hit->i_mod_size = i_mod_size;
+			decode_hit->set_flags_type = set_flags_type;
+			decode_hit->i_w = i_w;
+			decode_hit->i_d = i_d;
+			decode_hit->i_reg4bit = i_reg4bit;
+			decode_hit->i_data0 = i_data0;
+			decode_hit->i_data1 = i_data1;
+			decode_hit->i_data2 = i_data2;
+			decode_hit->i_mod = i_mod;
+			decode_hit->i_rm = i_rm;
+			decode_hit->i_reg = i_reg;
+		}
+#endif
 
 		// seg_override_en and rep_override_en contain number of instructions to hold segment override and REP prefix respectively
 		if (seg_override_en)
@@ -315,22 +409,9 @@ int main(int argc, char **argv)
 		if (rep_override_en)
 			rep_override_en--;
 
-		// i_mod_size > 0 indicates that opcode uses i_mod/i_rm/i_reg, so decode them
+		// Work out the operand addresses from the current register contents
 		if (i_mod_size)
-		{
-			i_mod = (i_data0 & 0xFF) >> 6;
-			i_rm = i_data0 & 7;
-			i_reg = i_data0 / 8 & 7;
-
-			if ((!i_mod && i_rm == 6) || (i_mod == 2))
-				i_data2 = CAST(short)opcode_stream[4];
-			else if (i_mod != 1)
-				i_data2 = i_data1;
-			else // If i_mod is 1, operand is (usually) 8 bits rather than 16 bits
-				i_data1 = (char)i_data1;
-
 			DECODE_RM_REG;
-		}
 
 		// Instruction execution unit
 		switch (xlat_opcode_id)
@@ -441,7 +522,8 @@ int main(int argc, char **argv)
 					DECODE_RM_REG,
 					R_M_OP(mem[op_from_addr], =, rm_addr);
 				else // POP
-					R_M_POP(mem[rm_addr])
+					R_M_POP(mem[rm_addr]),
+					MEM_WRITE_NOTE(rm_addr)
 			OPCODE 11: // MOV AL/AX, [loc]
 				i_mod = i_reg = 0;
 				i_rm = 6;
@@ -460,6 +542,7 @@ int main(int argc, char **argv)
 					1;
 				if (scratch_uint)
 				{
+					MEM_WRITE_NOTE(rm_addr);
 					if (i_reg < 4) // Rotate operations
 						scratch_uint %= i_reg / 2 + TOP_BIT,
 						R_M_OP(scratch2_uint, =, mem[rm_addr]);
@@ -570,6 +653,7 @@ int main(int argc, char **argv)
 				else if (!i_d) // RET|RETF imm16
 					regs16[REG_SP] += i_data0
 			OPCODE 20: // MOV r/m, immed
+				MEM_WRITE_NOTE(op_from_addr);
 				R_M_OP(mem[op_from_addr], =, i_data2)
 			OPCODE 21: // IN AL/AX, DX/imm8
 				io_ports[0x20] = 0; // PIC EOI
@@ -671,8 +755,10 @@ int main(int argc, char **argv)
 						ftime(&ms_clock);
 						memcpy(mem + SEGREG(REG_ES, REG_BX,), localtime(&clock_buf), sizeof(struct tm));
 						CAST(short)mem[SEGREG(REG_ES, REG_BX, 36+)] = ms_clock.millitm;
+						mem_write_range_noted(SEGREG(REG_ES, REG_BX,), sizeof(struct tm) + 2);
 					OPCODE 2: // DISK_READ
 					OPCODE_CHAIN 3: // DISK_WRITE
+						(char)i_data0 == 2 && (mem_write_range_noted(SEGREG(REG_ES, REG_BX,), regs16[REG_AX]), 0);
 						regs8[REG_AL] = ~lseek(disk[regs8[REG_DL]], CAST(unsigned)regs16[REG_BP] << 9, 0)
 							? ((char)i_data0 == 3 ? (int(*)())write : (int(*)())read)(disk[regs8[REG_DL]], mem + SEGREG(REG_ES, REG_BX,), regs16[REG_AX])
 							: 0;
@@ -702,7 +788,8 @@ int main(int argc, char **argv)
 			int8_asap = 1;
 
 #ifndef NO_GRAPHICS
-		// Update the video graphics display every GRAPHICS_UPDATE_DELAY instructions
+		// Check the video graphics display every GRAPHICS_UPDATE_DELAY instructions. It is only redrawn if video RAM
+		// has been written since (or a different bank is being shown).
 		if (!(inst_counter % GRAPHICS_UPDATE_DELAY))
 		{
 			// Video card in graphics mode?
@@ -727,15 +814,21 @@ int main(int argc, char **argv)
 
 				// Refresh SDL display from emulated graphics card video RAM
 				vid_mem_base = mem + 0xB0000 + 0x8000*(mem[0x4AC] ? 1 : io_ports[0x3B8] >> 7); // B800:0 for CGA/Hercules bank 2, B000:0 for Hercules bank 1
-				for (int i = 0; i < GRAPHICS_X * GRAPHICS_Y / 4; i++)
-					((unsigned *)sdl_screen->pixels)[i] = pixel_colors[15 & (vid_mem_base[vid_addr_lookup[i]] >> 4*!(i & 1))];
+				if (vid_dirty || vid_mem_base != vid_mem_shown)
+				{
+					vid_dirty = 0;
+					vid_mem_shown = vid_mem_base;
+					for (int i = 0; i < GRAPHICS_X * GRAPHICS_Y / 4; i++)
+						((unsigned *)sdl_screen->pixels)[i] = pixel_colors[15 & (vid_mem_base[vid_addr_lookup[i]] >> 4*!(i & 1))];
 
-				SDL_Flip(sdl_screen);
+					SDL_Flip(sdl_screen);
+				}
 			}
 			else if (sdl_screen) // Application has gone back to text mode, so close the SDL window
 			{
 				SDL_QuitSubSystem(SDL_INIT_VIDEO);
 				sdl_screen = 0;
+				vid_mem_shown = 0;
 			}
 			SDL_PumpEvents();
 		}
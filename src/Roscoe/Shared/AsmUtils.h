@@ -5,8 +5,13 @@ extern void MoveMultipleWrite(void *pvWriteAddress);
 extern void MoveMultipleRead(void *pvReadAddress);
 extern void IDESectorMoveRead(void *pvTargetBuffer);
 extern void IDESectorMoveWrite(void *pvSourceBuffer);
+extern void NICBurstRead(void *pvTargetBuffer,
+						 uint32_t u32Chunks);
+extern void NICBurstWrite(void *pvSourceBuffer,
+						  uint32_t u32Chunks);
 extern void SRSet(uint16_t u16SRValue);
 extern uint16_t SRGet(void);
 extern uint16_t SPGet(void);
+extern void CPUStop(void);
 
 #endif
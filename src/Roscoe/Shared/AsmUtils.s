@@ -16,10 +16,13 @@
 	.global	MoveMultipleRead
 	.global	IDESectorMoveRead
 	.global IDESectorMoveWrite
+	.global	NICBurstRead
+	.global	NICBurstWrite
 	.global RTCGetTickCounts
 	.global	SRSet
 	.global	SRGet
 	.global SPGet
+	.global	CPUStop
 
 /* Back up stack pointer 6 bytes - 4 for the return address and 2 for the word param of the SR value */
 
@@ -38,6 +41,20 @@ SPGet:
 	movel	%sp, %d0
 	rts
 
+/*
+
+void CPUStop(void);
+
+Drops the IPL to 0 and halts until an interrupt is taken. Call it with the IPL
+raised after checking there's nothing to do - STOP loads the SR and stops in one
+instruction, so an interrupt that came in after the check still wakes us.
+
+*/
+
+CPUStop:
+	stop	#0x2000
+	rts
+
 MoveMultipleWrite:
 	moveml	%d2-%d7/%a2,-(%sp)
 	moveml	%d0-%d7,-(%a2)
@@ -210,6 +227,139 @@ IDESectorMoveWrite:
 
 /*
 
+void NICBurstRead(void *pvTargetBuffer, uint32_t u32Chunks);
+
+Reads u32Chunks * 32 bytes through the NIC's data register. The odd chunks
+go first, one MOVEM at a time, then the rest 128 bytes per pass.
+
+*/
+
+NICBurstRead:
+	moveml	%d2-%d7/%a2-%a4,-(%sp)
+
+/* pvTargetBuffer == sp + 4 (rtn addrss) + 24 (data registers) + 12 (address registers), u32Chunks follows it */
+
+	movel	%sp, %a0
+	addl	#4+24+12, %a0
+	movel	(%a0)+, %a2
+	movel	(%a0), %d0
+
+/* a3 = end of the odd chunks, a4 = end of the buffer */
+
+	movel	%d0, %d1
+	andil	#3, %d1
+	lsll	#5, %d1
+	movel	%a2, %a3
+	addal	%d1, %a3
+	lsll	#5, %d0
+	movel	%a2, %a4
+	addal	%d0, %a4
+
+	movel	#ROSCOE_NIC, %a0
+	movel	#32, %a1
+
+/* a0 Is the NIC data register.
+   a2 Is the destination */
+
+	bra	nicReadOddCheck
+
+nicReadOdd:
+	moveml	(%a0), %d0-%d7
+	moveml	%d0-%d7,(%a2)
+	addal	%a1, %a2
+
+nicReadOddCheck:
+	cmpal	%a3, %a2
+	bne	nicReadOdd
+	bra	nicReadCheck
+
+nicReadLoop:
+	moveml	(%a0), %d0-%d7
+	moveml	%d0-%d7,(%a2)
+	addal	%a1, %a2
+
+	moveml	(%a0), %d0-%d7
+	moveml	%d0-%d7,(%a2)
+	addal	%a1, %a2
+
+	moveml	(%a0), %d0-%d7
+	moveml	%d0-%d7,(%a2)
+	addal	%a1, %a2
+
+	moveml	(%a0), %d0-%d7
+	moveml	%d0-%d7,(%a2)
+	addal	%a1, %a2
+
+nicReadCheck:
+	cmpal	%a4, %a2
+	bne	nicReadLoop
+
+	moveml	(%sp)+,%d2-%d7/%a2-%a4
+	rts
+
+/*
+
+void NICBurstWrite(void *pvSourceBuffer, uint32_t u32Chunks);
+
+*/
+
+NICBurstWrite:
+	moveml	%d2-%d7/%a2-%a4,-(%sp)
+
+/* pvSourceBuffer == sp + 4 (rtn addrss) + 24 (data registers) + 12 (address registers), u32Chunks follows it */
+
+	movel	%sp, %a0
+	addl	#4+24+12, %a0
+	movel	(%a0)+, %a2
+	movel	(%a0), %d0
+
+	movel	%d0, %d1
+	andil	#3, %d1
+	lsll	#5, %d1
+	movel	%a2, %a3
+	addal	%d1, %a3
+	lsll	#5, %d0
+	movel	%a2, %a4
+	addal	%d0, %a4
+
+	movel	#ROSCOE_NIC, %a0
+
+/* a0 Is the NIC data register.
+   a2 Is the source */
+
+	bra	nicWriteOddCheck
+
+nicWriteOdd:
+	moveml	(%a2)+, %d0-%d7
+	moveml	%d0-%d7,(%a0)
+
+nicWriteOddCheck:
+	cmpal	%a3, %a2
+	bne	nicWriteOdd
+	bra	nicWriteCheck
+
+nicWriteLoop:
+	moveml	(%a2)+, %d0-%d7
+	moveml	%d0-%d7,(%a0)
+
+	moveml	(%a2)+, %d0-%d7
+	moveml	%d0-%d7,(%a0)
+
+	moveml	(%a2)+, %d0-%d7
+	moveml	%d0-%d7,(%a0)
+
+	moveml	(%a2)+, %d0-%d7
+	moveml	%d0-%d7,(%a0)
+
+nicWriteCheck:
+	cmpal	%a4, %a2
+	bne	nicWriteLoop
+
+	moveml	(%sp)+,%d2-%d7/%a2-%a4
+	rts
+
+/*
+
 uint32_t RTCGetTickCounts(void);
 
 */
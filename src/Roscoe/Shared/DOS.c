@@ -9,8 +9,10 @@
 #include "Hardware/Roscoe.h"
 #include "Shared/DOS.h"
 #include "Shared/FatFS/source/ff.h"
+#include "Shared/FatFS/source/diskio.h"
 #include "Shared/IDE.h"
 #include "Shared/Stream.h"
+#include "Shared/ptc.h"
 
 // How much RAM FatFS has to work with when making a new filesystem
 #define		MKFS_WORK_RAM		(1024*64)
@@ -48,6 +50,7 @@ static EStatus InitFilesystem(uint8_t u8Drive,
 
 	if (sg_psFATFS[u8Drive])
 	{
+		(void) disk_cache_sync(u8Drive);
 		u8FatFSErrorCode = f_unmount(eDriveString);
 		eStatus = FatFSToEStatus(u8FatFSErrorCode);
 
@@ -67,6 +70,22 @@ static EStatus InitFilesystem(uint8_t u8Drive,
 							   1);
 	eStatus = FatFSToEStatus(u8FatFSErrorCode);
 
+	// Keep the FAT (and exFAT's allocation bitmap) resident in the sector cache
+	disk_cache_pin(u8Drive, 0, 0);
+	if (ESTATUS_OK == eStatus)
+	{
+		disk_cache_pin(u8Drive,
+					   sg_psFATFS[u8Drive]->fatbase,
+					   (LBA_t) sg_psFATFS[u8Drive]->fsize * sg_psFATFS[u8Drive]->n_fats);
+
+		if (FS_EXFAT == sg_psFATFS[u8Drive]->fs_type)
+		{
+			disk_cache_pin(u8Drive,
+						   sg_psFATFS[u8Drive]->bitbase,
+						   ((((LBA_t) sg_psFATFS[u8Drive]->n_fatent - 2) + 7) / 8 + (FF_MAX_SS - 1)) / FF_MAX_SS);
+		}
+	}
+
 	if (ESTATUS_OK == eStatus)
 	{
 		uint64_t u64TotalSectors;
@@ -106,6 +125,12 @@ EStatus DOSInit(void)
 	uint64_t u64TotalDriveSpace;
 	uint64_t u64TotalAvailable;
 
+	// The drives share one IDE channel and one sector cache - set up the lock that covers them
+	if (disk_cache_init() != RES_OK)
+	{
+		printf("Disk cache init failed\n");
+	}
+
 	// Try mounting the master disk
 	eStatus = InitFilesystem(0,
 							 &u64TotalDriveSpace,
@@ -140,6 +165,10 @@ EStatus DOSShutdown(void)
 	EStatus eStatus;
 	uint8_t u8FatFSErrorCode;
 
+	// Anything the sector cache is holding goes to disk first
+	(void) disk_cache_sync(0);
+	(void) disk_cache_sync(1);
+
 	// Try mounting the master disk
 	u8FatFSErrorCode = f_unmount("0:");
 	eStatus = FatFSToEStatus(u8FatFSErrorCode);
@@ -576,6 +605,430 @@ errorExit:
 	return(ESTATUS_OK);
 }
 
+// Initial size (in DWORDs) of a file's cluster link map table. Grown if the file is
+// fragmented enough to need more.
+#define	LOADFILE_CLMT_SIZE		64
+
+// Load an entire file to memory. f_read() moves at most a cluster per disk read and
+// goes through the FIL's sector window for anything unaligned, so instead build the
+// file's cluster link map table once and issue one disk read per contiguous run of
+// clusters, straight to the destination. Only the partial sector at the end of the
+// file goes through f_read().
+EStatus DOSLoadFile(char *peFilename,
+					uint8_t *pu8Destination,
+					uint32_t u32MaxSize,
+					uint32_t *pu32FileSize)
+{
+	EStatus eStatus;
+	FIL sFile;
+	bool bFileOpen = false;
+	DWORD *pu32CLMT = NULL;
+	DWORD *pu32Run;
+	FATFS *psFS;
+	uint32_t u32FileSize;
+	uint32_t u32SectorsLeft;
+	uint32_t u32Offset = 0;
+	UINT u32BytesRead;
+
+	ZERO_STRUCT(sFile);
+
+	if (pu32FileSize)
+	{
+		*pu32FileSize = 0;
+	}
+
+	eStatus = FatFSToEStatus(f_open(&sFile,
+									peFilename,
+									FA_READ));
+	ERR_GOTO();
+	bFileOpen = true;
+
+	if (f_size(&sFile) > u32MaxSize)
+	{
+		eStatus = ESTATUS_MONITOR_DATA_SIZE_OUT_OF_RANGE;
+		goto errorExit;
+	}
+
+	u32FileSize = (uint32_t) f_size(&sFile);
+	psFS = sFile.obj.fs;
+
+	// Build the cluster link map table. If it's too small, FatFS tells us what it needs.
+	pu32CLMT = malloc(LOADFILE_CLMT_SIZE * sizeof(*pu32CLMT));
+	if (NULL == pu32CLMT)
+	{
+		eStatus = ESTATUS_OUT_OF_MEMORY;
+		goto errorExit;
+	}
+
+	pu32CLMT[0] = LOADFILE_CLMT_SIZE;
+	sFile.cltbl = pu32CLMT;
+	eStatus = FatFSToEStatus(f_lseek(&sFile,
+									 CREATE_LINKMAP));
+	if (ESTATUS_OUT_OF_MEMORY == eStatus)
+	{
+		DWORD u32CLMTSize = pu32CLMT[0];
+
+		free(pu32CLMT);
+		pu32CLMT = malloc(u32CLMTSize * sizeof(*pu32CLMT));
+		if (NULL == pu32CLMT)
+		{
+			goto errorExit;
+		}
+
+		pu32CLMT[0] = u32CLMTSize;
+		sFile.cltbl = pu32CLMT;
+		eStatus = FatFSToEStatus(f_lseek(&sFile,
+										 CREATE_LINKMAP));
+	}
+	ERR_GOTO();
+
+	// Table is pairs of cluster run length and starting cluster, terminated by a 0 length
+	u32SectorsLeft = u32FileSize / FF_MAX_SS;
+	pu32Run = &pu32CLMT[1];
+	while (u32SectorsLeft && pu32Run[0])
+	{
+		uint32_t u32Sectors = pu32Run[0] * psFS->csize;
+
+		if (u32Sectors > u32SectorsLeft)
+		{
+			u32Sectors = u32SectorsLeft;
+		}
+
+		if (disk_read(psFS->pdrv,
+					  pu8Destination + u32Offset,
+					  psFS->database + ((LBA_t) psFS->csize * (pu32Run[1] - 2)),
+					  u32Sectors) != RES_OK)
+		{
+			eStatus = ESTATUS_DISK_ERROR;
+			goto errorExit;
+		}
+
+		u32Offset += u32Sectors * FF_MAX_SS;
+		u32SectorsLeft -= u32Sectors;
+		pu32Run += 2;
+	}
+
+	// Ran out of clusters before we ran out of file?
+	if (u32SectorsLeft)
+	{
+		eStatus = ESTATUS_DISK_INVALID;
+		goto errorExit;
+	}
+
+	// And whatever's left in the last sector
+	if (u32Offset < u32FileSize)
+	{
+		eStatus = FatFSToEStatus(f_lseek(&sFile,
+										 u32Offset));
+		ERR_GOTO();
+
+		eStatus = FatFSToEStatus(f_read(&sFile,
+										pu8Destination + u32Offset,
+										u32FileSize - u32Offset,
+										&u32BytesRead));
+		ERR_GOTO();
+
+		u32Offset += u32BytesRead;
+	}
+
+	if (pu32FileSize)
+	{
+		*pu32FileSize = u32Offset;
+	}
+
+errorExit:
+	if (bFileOpen)
+	{
+		(void) f_close(&sFile);
+	}
+
+	if (pu32CLMT)
+	{
+		free(pu32CLMT);
+	}
+
+	return(eStatus);
+}
+
+// Load a file to memory
+// loadfile address filename
+EStatus DOSLoad(SLex *psLex,
+				const SMonitorCommands *psMonitorCommand,
+				uint32_t *pu32AddressPointer)
+{
+	EStatus eStatus;
+	SToken sToken;
+	ETokenType eToken;
+	uint32_t u32Address;
+	uint32_t u32FileSize = 0;
+	char *peFilename = NULL;
+
+	ZERO_STRUCT(sToken);
+	eToken = LexGetNextToken(psLex,
+							 &sToken);
+	if (eToken != ELEX_INT_UNSIGNED)
+	{
+		printf("Expected a load address\n");
+		goto errorExit;
+	}
+
+	u32Address = (uint32_t) sToken.uData.u64IntValue;
+	LexClearToken(&sToken);
+
+	eStatus = LexGetBufferPosition(psLex,
+								   &peFilename);
+	assert(ESTATUS_OK == eStatus);
+
+	while (' ' == *peFilename)
+	{
+		peFilename++;
+	}
+
+	if ('\0' == *peFilename)
+	{
+		printf("Expected a filename\n");
+		goto errorExit;
+	}
+
+	eStatus = DOSLoadFile(peFilename,
+						  (uint8_t *) u32Address,
+						  0xffffffff - u32Address,
+						  &u32FileSize);
+	if (ESTATUS_OK == eStatus)
+	{
+		printf("Loaded '%s' to 0x%.8x-0x%.8x (%u bytes)\n", peFilename, u32Address, u32Address + u32FileSize - 1, u32FileSize);
+	}
+	else
+	{
+		printf("Failed to load '%s' - %s\n", peFilename, GetErrorText(eStatus));
+	}
+
+errorExit:
+	return(ESTATUS_OK);
+}
+
+// # Of directory scans per diskbench pass
+#define	DISKBENCH_DIR_PASSES	10
+
+// Read sizes for diskbench's file reads - the small one goes through FatFS's sector
+// buffer (single sector reads), the large one is read straight into the caller's buffer
+#define	DISKBENCH_READ_SMALL	100
+#define	DISKBENCH_READ_LARGE	(32*1024)
+
+// PTC channel 1 runs at PTC_COUNTER1_HZ (10ms)
+static uint32_t DOSBenchTicks(void)
+{
+	uint32_t u32Ticks = 0;
+
+	(void) PTCGetInterruptCounter(1,
+								  &u32Ticks);
+	return(u32Ticks);
+}
+
+// Read through a directory without displaying anything
+static EStatus DOSBenchDirectory(char *peDirectory,
+								 uint32_t *pu32Entries)
+{
+	EStatus eStatus;
+	DIR sDir;
+	FILINFO sFileInfo;
+
+	*pu32Entries = 0;
+	ZERO_STRUCT(sDir);
+
+	eStatus = FatFSToEStatus(f_opendir(&sDir,
+									   peDirectory));
+	ERR_GOTO();
+
+	for (;;)
+	{
+		eStatus = FatFSToEStatus(f_readdir(&sDir,
+										   &sFileInfo));
+		if ((eStatus != ESTATUS_OK) ||
+			('\0' == sFileInfo.fname[0]))
+		{
+			break;
+		}
+
+		(*pu32Entries)++;
+	}
+
+	(void) f_closedir(&sDir);
+
+errorExit:
+	return(eStatus);
+}
+
+// Read a whole file, u32ReadSize bytes at a time
+static EStatus DOSBenchFile(char *peFilename,
+							uint8_t *pu8Buffer,
+							uint32_t u32ReadSize,
+							uint64_t *pu64BytesRead)
+{
+	EStatus eStatus;
+	FIL sFile;
+	UINT u32BytesRead;
+
+	*pu64BytesRead = 0;
+	ZERO_STRUCT(sFile);
+
+	eStatus = FatFSToEStatus(f_open(&sFile,
+									peFilename,
+									FA_READ));
+	ERR_GOTO();
+
+	do
+	{
+		u32BytesRead = 0;
+		eStatus = FatFSToEStatus(f_read(&sFile,
+										pu8Buffer,
+										u32ReadSize,
+										&u32BytesRead));
+		*pu64BytesRead += u32BytesRead;
+	}
+	while ((ESTATUS_OK == eStatus) && (u32BytesRead == u32ReadSize));
+
+	(void) f_close(&sFile);
+
+errorExit:
+	return(eStatus);
+}
+
+static void DOSBenchReport(char *peTest,
+						   uint64_t u64Bytes,
+						   uint32_t u32Ticks)
+{
+	uint32_t u32Milliseconds = u32Ticks * (1000 / PTC_COUNTER1_HZ);
+
+	if (0 == u32Milliseconds)
+	{
+		u32Milliseconds = 1000 / PTC_COUNTER1_HZ;
+	}
+
+	printf("  %-28s %7ums  %6uk/sec\n", peTest, u32Milliseconds, (uint32_t) ((u64Bytes * 1000) / u32Milliseconds) >> 10);
+}
+
+// Directory listing and file read benchmark, with the sector cache off then on
+// diskbench
+// diskbench filename
+EStatus DOSDiskBench(SLex *psLex,
+					 const SMonitorCommands *psMonitorCommand,
+					 uint32_t *pu32AddressPointer)
+{
+	EStatus eStatus;
+	char *peFilename = NULL;
+	uint8_t *pu8Buffer = NULL;
+	char eCWD[256];
+	uint8_t u8Pass;
+
+	eStatus = LexGetBufferPosition(psLex,
+								   &peFilename);
+	assert(ESTATUS_OK == eStatus);
+
+	eStatus = DOSGetDrivePath(eCWD,
+							  sizeof(eCWD) - 1);
+	ERR_GOTO();
+
+	pu8Buffer = malloc(DISKBENCH_READ_LARGE);
+	if (NULL == pu8Buffer)
+	{
+		printf("Out of memory while trying to allocate %u bytes\n", DISKBENCH_READ_LARGE);
+		goto errorExit;
+	}
+
+	for (u8Pass = 0; u8Pass < 2; u8Pass++)
+	{
+		uint32_t u32Ticks;
+		uint32_t u32Entries = 0;
+		uint32_t u32Loop;
+		uint64_t u64Bytes;
+		DISKCACHE_STATS sStats;
+
+		// Start each pass with an empty cache
+		(void) disk_cache_enable(0);
+		(void) disk_cache_enable(u8Pass);
+		disk_cache_stats(NULL, 1);
+
+		printf("Sector cache %s:\n", u8Pass ? "on" : "off");
+
+		u32Ticks = DOSBenchTicks();
+		eStatus = DOSBenchDirectory(eCWD,
+									&u32Entries);
+		ERR_GOTO();
+		printf("  %-28s %7ums  (%u entries)\n", "Directory scan (first)", (DOSBenchTicks() - u32Ticks) * (1000 / PTC_COUNTER1_HZ), u32Entries);
+
+		u32Ticks = DOSBenchTicks();
+		for (u32Loop = 0; u32Loop < DISKBENCH_DIR_PASSES; u32Loop++)
+		{
+			eStatus = DOSBenchDirectory(eCWD,
+										&u32Entries);
+			ERR_GOTO();
+		}
+		printf("  %-28s %7ums  (x%u)\n", "Directory scan (repeated)", (DOSBenchTicks() - u32Ticks) * (1000 / PTC_COUNTER1_HZ), DISKBENCH_DIR_PASSES);
+
+		if (peFilename && peFilename[0])
+		{
+			u32Ticks = DOSBenchTicks();
+			eStatus = DOSBenchFile(peFilename,
+								   pu8Buffer,
+								   DISKBENCH_READ_SMALL,
+								   &u64Bytes);
+			ERR_GOTO();
+			DOSBenchReport("File read (100 byte reads)", u64Bytes, DOSBenchTicks() - u32Ticks);
+
+			u32Ticks = DOSBenchTicks();
+			eStatus = DOSBenchFile(peFilename,
+								   pu8Buffer,
+								   DISKBENCH_READ_LARGE,
+								   &u64Bytes);
+			ERR_GOTO();
+			DOSBenchReport("File read (32K reads)", u64Bytes, DOSBenchTicks() - u32Ticks);
+
+			// And the whole thing in one go, if there's room for it
+			if (u64Bytes && (u64Bytes < 0x80000000))
+			{
+				uint8_t *pu8File = malloc((size_t) u64Bytes);
+
+				if (pu8File)
+				{
+					uint32_t u32FileSize;
+
+					u32Ticks = DOSBenchTicks();
+					eStatus = DOSLoadFile(peFilename,
+										  pu8File,
+										  (uint32_t) u64Bytes,
+										  &u32FileSize);
+					free(pu8File);
+					ERR_GOTO();
+					DOSBenchReport("File load (DOSLoadFile)", u32FileSize, DOSBenchTicks() - u32Ticks);
+				}
+			}
+		}
+
+		if (u8Pass)
+		{
+			disk_cache_stats(&sStats, 0);
+			printf("  Cache: %u hits, %u misses, %u read-aheads, %u bypassed, %u write-backs, %u/%u pinned\n",
+				   sStats.u32Hits, sStats.u32Misses, sStats.u32ReadAheads, sStats.u32Bypassed, sStats.u32WriteBacks, sStats.u32Pinned, sStats.u32Sectors);
+		}
+	}
+
+errorExit:
+	(void) disk_cache_enable(1);
+
+	if (eStatus != ESTATUS_OK)
+	{
+		printf("diskbench failed - %s\n", GetErrorText(eStatus));
+	}
+
+	if (pu8Buffer)
+	{
+		free(pu8Buffer);
+	}
+
+	return(ESTATUS_OK);
+}
+
 
 
 
@@ -33,6 +33,16 @@ extern EStatus DOSDir(SLex *psLex,
 extern EStatus DOSDelete(SLex *psLex,
 						 const SMonitorCommands *psMonitorCommand,
 						 uint32_t *pu32AddressPointer);
+extern EStatus DOSLoadFile(char *peFilename,
+						   uint8_t *pu8Destination,
+						   uint32_t u32MaxSize,
+						   uint32_t *pu32FileSize);
+extern EStatus DOSLoad(SLex *psLex,
+					   const SMonitorCommands *psMonitorCommand,
+					   uint32_t *pu32AddressPointer);
+extern EStatus DOSDiskBench(SLex *psLex,
+							const SMonitorCommands *psMonitorCommand,
+							uint32_t *pu32AddressPointer);
 
 
 #endif
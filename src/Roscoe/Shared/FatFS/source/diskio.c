@@ -8,13 +8,490 @@
 /*-----------------------------------------------------------------------*/
 
 #include <assert.h>
+#include <stdlib.h>
+#include <string.h>
 #include "ff.h"			/* Obtains integer types */
 #include "diskio.h"		/* Declarations of disk functions */
 #include "Shared/Shared.h"
+#include "Hardware/Roscoe.h"
 #include "Shared/IDE.h"
 
 #define	DEV_IDE0_MASTER		0
 #define	DEV_IDE0_SLAVE		1
+#define	DEV_COUNT			2
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache                                                          */
+/*-----------------------------------------------------------------------*/
+/* IDE is 16-bit PIO, so every sector costs 256 bus cycles plus command  */
+/* overhead. FatFs reads the same FAT and directory sectors over and     */
+/* over, so they are kept in an LRU cache here. The cache's data comes   */
+/* off the heap, which sits just above the BIOS image, unless            */
+/* DISKIO_CACHE_BASE places it at a fixed address (DRAM, for example).   */
+/*                                                                       */
+/* - Single sector reads go through the cache. A miss on the sector      */
+/*   right after the previous miss is treated as a sequential scan, and  */
+/*   DISKIO_READ_AHEAD sectors are read with one command.                */
+/* - Multi-sector reads go straight to the caller's buffer (this is file */
+/*   data on its way to the application, and it would only push the     */
+/*   FAT out). Dirty cached sectors in range are copied over the result. */
+/* - Single sector writes are held in the cache (write-back) until       */
+/*   CTRL_SYNC, until they're evicted, or until DISKIO_DIRTY_MAX of them */
+/*   are waiting. Multi-sector writes go straight to disk and update     */
+/*   any cached copies.                                                  */
+/* - Sectors in a drive's pinned ranges (its FAT, set up by the mount    */
+/*   code via disk_cache_pin()) are skipped by eviction, up to           */
+/*   DISKIO_PINNED_MAX of them.                                          */
+/*                                                                       */
+/* With FF_FS_REENTRANT, FatFs only locks each volume, so two volumes    */
+/* can be in here at once. Both drives share the cache, the read-ahead   */
+/* buffer and the one IDE channel, so every entry point below takes      */
+/* DISKIO_MUTEX (created by disk_cache_init()) for its duration.         */
+/*-----------------------------------------------------------------------*/
+
+#ifndef DISKIO_CACHE_SECTORS
+#define	DISKIO_CACHE_SECTORS	256							// Cache size in sectors (128K)
+#endif
+#define	DISKIO_CACHE_HASH		64							// Hash buckets (power of 2)
+#define	DISKIO_READ_AHEAD		((DISKIO_CACHE_SECTORS < 64) ? (DISKIO_CACHE_SECTORS / 4) : 16)	// Sectors fetched on a sequential miss
+#define	DISKIO_DIRTY_MAX		(DISKIO_CACHE_SECTORS / 2)	// Write everything back at this many dirty sectors
+#define	DISKIO_PINNED_MAX		(DISKIO_CACHE_SECTORS / 2)	// Most of the cache pinned sectors can hold
+#define	DISKIO_PIN_RANGES		2							// Pinned ranges per drive (FAT + exFAT bitmap)
+#define	DISKIO_SECTOR_SIZE		512
+#define	DISKIO_NONE				0xffff
+
+#if FF_FS_REENTRANT
+#define	DISKIO_LOCK()			ff_mutex_take(DISKIO_MUTEX)
+#define	DISKIO_UNLOCK()			ff_mutex_give(DISKIO_MUTEX)
+#else
+#define	DISKIO_LOCK()			1
+#define	DISKIO_UNLOCK()
+#endif
+
+typedef struct SDiskCacheEntry
+{
+	LBA_t u64Sector;				// Which sector this is
+	uint16_t u16HashNext;			// Next entry in this hash bucket
+	uint16_t u16LRUPrev;			// Next more recently used entry
+	uint16_t u16LRUNext;			// Next less recently used entry
+	uint8_t u8Drive;				// Which drive it's from
+	bool bValid;					// Holds a sector?
+	bool bDirty;					// Newer than what's on disk?
+	bool bPinned;					// Skipped by eviction?
+} SDiskCacheEntry;
+
+typedef struct SDiskPinRange
+{
+	LBA_t u64Sector;
+	LBA_t u64Count;
+} SDiskPinRange;
+
+static SDiskCacheEntry sg_sCacheEntries[DISKIO_CACHE_SECTORS];
+static uint8_t *sg_pu8CacheData;
+static uint16_t sg_u16CacheHash[DISKIO_CACHE_HASH];
+static uint16_t sg_u16LRUHead;								// Most recently used
+static uint16_t sg_u16LRUTail;								// Least recently used
+static uint16_t sg_u16DirtyCount;
+static uint16_t sg_u16PinnedCount;
+static SDiskPinRange sg_sPinRanges[DEV_COUNT][DISKIO_PIN_RANGES];
+static LBA_t sg_u64SequentialNext[DEV_COUNT];				// Sector following the last read
+static bool sg_bCacheInit;
+#if FF_FS_REENTRANT
+static bool sg_bLockInit;
+#endif
+static bool sg_bCacheEnabled = true;
+static DISKCACHE_STATS sg_sCacheStats;
+
+// Read-ahead staging area (uint32_t for the IDE data port's alignment)
+static uint32_t sg_u32ReadAhead[(DISKIO_READ_AHEAD * DISKIO_SECTOR_SIZE) / sizeof(uint32_t)];
+
+#define	CACHE_DATA(index)		(sg_pu8CacheData + ((uint32_t) (index) * DISKIO_SECTOR_SIZE))
+#define	CACHE_HASH(drive, sector)	((((uint32_t) (sector)) ^ ((uint32_t) (drive) << 5)) & (DISKIO_CACHE_HASH - 1))
+
+static DRESULT EStatusToDResult(EStatus eStatus)
+{
+	if (ESTATUS_OK == eStatus)
+	{
+		return(RES_OK);
+	}
+	else
+	if (ESTATUS_TIMEOUT == eStatus)
+	{
+		return(RES_NOTRDY);
+	}
+	else
+	{
+		// Assume an error
+		return(RES_ERROR);
+	}
+}
+
+// Set up the cache's bookkeeping and data area. If there's no memory for it,
+// everything passes straight through to the drive.
+static void DiskCacheInit(void)
+{
+	uint16_t u16Loop;
+
+	sg_bCacheInit = true;
+
+#ifdef DISKIO_CACHE_BASE
+	sg_pu8CacheData = (uint8_t *) DISKIO_CACHE_BASE;
+#else
+	sg_pu8CacheData = malloc(DISKIO_CACHE_SECTORS * DISKIO_SECTOR_SIZE);
+#endif
+
+	memset((void *) sg_sCacheEntries, 0, sizeof(sg_sCacheEntries));
+
+	// Everything starts out empty and chained together on the LRU list
+	for (u16Loop = 0; u16Loop < DISKIO_CACHE_SECTORS; u16Loop++)
+	{
+		sg_sCacheEntries[u16Loop].u16HashNext = DISKIO_NONE;
+		sg_sCacheEntries[u16Loop].u16LRUPrev = u16Loop ? (u16Loop - 1) : DISKIO_NONE;
+		sg_sCacheEntries[u16Loop].u16LRUNext = (u16Loop < (DISKIO_CACHE_SECTORS - 1)) ? (u16Loop + 1) : DISKIO_NONE;
+	}
+
+	sg_u16LRUHead = 0;
+	sg_u16LRUTail = DISKIO_CACHE_SECTORS - 1;
+
+	for (u16Loop = 0; u16Loop < DISKIO_CACHE_HASH; u16Loop++)
+	{
+		sg_u16CacheHash[u16Loop] = DISKIO_NONE;
+	}
+
+	sg_u16DirtyCount = 0;
+	sg_u16PinnedCount = 0;
+}
+
+static bool DiskCacheActive(void)
+{
+	if (false == sg_bCacheInit)
+	{
+		DiskCacheInit();
+	}
+
+	return(sg_bCacheEnabled && (sg_pu8CacheData != NULL));
+}
+
+static uint16_t DiskCacheLookup(BYTE pdrv,
+								LBA_t sector)
+{
+	uint16_t u16Index = sg_u16CacheHash[CACHE_HASH(pdrv, sector)];
+
+	while ((u16Index != DISKIO_NONE) &&
+		   ((sg_sCacheEntries[u16Index].u64Sector != sector) ||
+			(sg_sCacheEntries[u16Index].u8Drive != pdrv)))
+	{
+		u16Index = sg_sCacheEntries[u16Index].u16HashNext;
+	}
+
+	return(u16Index);
+}
+
+static void DiskCacheLRUUnlink(uint16_t u16Index)
+{
+	SDiskCacheEntry *psEntry = &sg_sCacheEntries[u16Index];
+
+	if (psEntry->u16LRUPrev != DISKIO_NONE)
+	{
+		sg_sCacheEntries[psEntry->u16LRUPrev].u16LRUNext = psEntry->u16LRUNext;
+	}
+	else
+	{
+		sg_u16LRUHead = psEntry->u16LRUNext;
+	}
+
+	if (psEntry->u16LRUNext != DISKIO_NONE)
+	{
+		sg_sCacheEntries[psEntry->u16LRUNext].u16LRUPrev = psEntry->u16LRUPrev;
+	}
+	else
+	{
+		sg_u16LRUTail = psEntry->u16LRUPrev;
+	}
+}
+
+// Make an entry the most recently used
+static void DiskCacheTouch(uint16_t u16Index)
+{
+	if (sg_u16LRUHead == u16Index)
+	{
+		return;
+	}
+
+	DiskCacheLRUUnlink(u16Index);
+
+	sg_sCacheEntries[u16Index].u16LRUPrev = DISKIO_NONE;
+	sg_sCacheEntries[u16Index].u16LRUNext = sg_u16LRUHead;
+	sg_sCacheEntries[sg_u16LRUHead].u16LRUPrev = u16Index;
+	sg_u16LRUHead = u16Index;
+}
+
+// Make an entry the least recently used (so it's reused first)
+static void DiskCacheDemote(uint16_t u16Index)
+{
+	if (sg_u16LRUTail == u16Index)
+	{
+		return;
+	}
+
+	DiskCacheLRUUnlink(u16Index);
+
+	sg_sCacheEntries[u16Index].u16LRUNext = DISKIO_NONE;
+	sg_sCacheEntries[u16Index].u16LRUPrev = sg_u16LRUTail;
+	sg_sCacheEntries[sg_u16LRUTail].u16LRUNext = u16Index;
+	sg_u16LRUTail = u16Index;
+}
+
+static void DiskCacheHashRemove(uint16_t u16Index)
+{
+	uint16_t *pu16Link = &sg_u16CacheHash[CACHE_HASH(sg_sCacheEntries[u16Index].u8Drive, sg_sCacheEntries[u16Index].u64Sector)];
+
+	while (*pu16Link != u16Index)
+	{
+		pu16Link = &sg_sCacheEntries[*pu16Link].u16HashNext;
+	}
+
+	*pu16Link = sg_sCacheEntries[u16Index].u16HashNext;
+	sg_sCacheEntries[u16Index].u16HashNext = DISKIO_NONE;
+}
+
+static bool DiskCacheSectorPinned(BYTE pdrv,
+								  LBA_t sector)
+{
+	uint8_t u8Loop;
+
+	for (u8Loop = 0; u8Loop < DISKIO_PIN_RANGES; u8Loop++)
+	{
+		if ((sector >= sg_sPinRanges[pdrv][u8Loop].u64Sector) &&
+			((sector - sg_sPinRanges[pdrv][u8Loop].u64Sector) < sg_sPinRanges[pdrv][u8Loop].u64Count))
+		{
+			return(true);
+		}
+	}
+
+	return(false);
+}
+
+static EStatus DiskCacheWriteBack(uint16_t u16Index)
+{
+	EStatus eStatus;
+	SDiskCacheEntry *psEntry = &sg_sCacheEntries[u16Index];
+
+	eStatus = IDEWriteSector(psEntry->u8Drive,
+							 psEntry->u64Sector,
+							 1,
+							 CACHE_DATA(u16Index));
+	ERR_GOTO();
+
+	psEntry->bDirty = false;
+	sg_u16DirtyCount--;
+	sg_sCacheStats.u32WriteBacks++;
+
+errorExit:
+	return(eStatus);
+}
+
+// Drop whatever an entry holds (it must not be dirty)
+static void DiskCacheRelease(uint16_t u16Index)
+{
+	SDiskCacheEntry *psEntry = &sg_sCacheEntries[u16Index];
+
+	if (psEntry->bValid)
+	{
+		DiskCacheHashRemove(u16Index);
+		if (psEntry->bPinned)
+		{
+			sg_u16PinnedCount--;
+		}
+	}
+
+	psEntry->bValid = false;
+	psEntry->bPinned = false;
+}
+
+// Get an entry for a sector that isn't cached, evicting the least recently used
+// unpinned one (writing it back first if need be). Returns with the entry most
+// recently used, or DISKIO_NONE if the write back failed.
+static uint16_t DiskCacheAllocate(BYTE pdrv,
+								  LBA_t sector)
+{
+	uint16_t u16Index = sg_u16LRUTail;
+	SDiskCacheEntry *psEntry;
+
+	while ((u16Index != DISKIO_NONE) &&
+		   (sg_sCacheEntries[u16Index].bPinned))
+	{
+		u16Index = sg_sCacheEntries[u16Index].u16LRUPrev;
+	}
+
+	// Everything pinned? Can't happen with DISKIO_PINNED_MAX < DISKIO_CACHE_SECTORS, but just in case
+	if (DISKIO_NONE == u16Index)
+	{
+		u16Index = sg_u16LRUTail;
+	}
+
+	psEntry = &sg_sCacheEntries[u16Index];
+
+	if (psEntry->bDirty)
+	{
+		if (DiskCacheWriteBack(u16Index) != ESTATUS_OK)
+		{
+			return(DISKIO_NONE);
+		}
+	}
+
+	DiskCacheRelease(u16Index);
+
+	psEntry->u8Drive = pdrv;
+	psEntry->u64Sector = sector;
+	psEntry->bValid = true;
+	psEntry->bDirty = false;
+
+	if ((sg_u16PinnedCount < DISKIO_PINNED_MAX) &&
+		(DiskCacheSectorPinned(pdrv, sector)))
+	{
+		psEntry->bPinned = true;
+		sg_u16PinnedCount++;
+	}
+
+	psEntry->u16HashNext = sg_u16CacheHash[CACHE_HASH(pdrv, sector)];
+	sg_u16CacheHash[CACHE_HASH(pdrv, sector)] = u16Index;
+
+	DiskCacheTouch(u16Index);
+
+	return(u16Index);
+}
+
+// Write back all of a drive's dirty sectors, in sector order so the drive sees
+// one pass across the disk
+static EStatus DiskCacheSync(BYTE pdrv)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	while (sg_u16DirtyCount)
+	{
+		uint16_t u16Loop;
+		uint16_t u16Lowest = DISKIO_NONE;
+
+		for (u16Loop = 0; u16Loop < DISKIO_CACHE_SECTORS; u16Loop++)
+		{
+			if ((sg_sCacheEntries[u16Loop].bDirty) &&
+				(sg_sCacheEntries[u16Loop].u8Drive == pdrv) &&
+				((DISKIO_NONE == u16Lowest) ||
+				 (sg_sCacheEntries[u16Loop].u64Sector < sg_sCacheEntries[u16Lowest].u64Sector)))
+			{
+				u16Lowest = u16Loop;
+			}
+		}
+
+		// Nothing left for this drive
+		if (DISKIO_NONE == u16Lowest)
+		{
+			break;
+		}
+
+		eStatus = DiskCacheWriteBack(u16Lowest);
+		ERR_GOTO();
+	}
+
+errorExit:
+	return(eStatus);
+}
+
+static EStatus DiskCacheSyncAll(void)
+{
+	EStatus eStatus = ESTATUS_OK;
+	BYTE pdrv;
+
+	for (pdrv = 0; pdrv < DEV_COUNT; pdrv++)
+	{
+		eStatus = DiskCacheSync(pdrv);
+		ERR_GOTO();
+	}
+
+errorExit:
+	return(eStatus);
+}
+
+// A single sector read that missed. If it follows on from the last read, fetch
+// DISKIO_READ_AHEAD sectors in one go and cache them all.
+static EStatus DiskCacheReadMiss(BYTE pdrv,
+								 BYTE *buff,
+								 LBA_t sector)
+{
+	EStatus eStatus;
+	uint64_t u64SectorCount = 0;
+	uint32_t u32Count = 1;
+	uint32_t u32Loop;
+	uint16_t u16Index;
+
+	if ((sector == sg_u64SequentialNext[pdrv]) &&
+		(ESTATUS_OK == IDEGetSize(pdrv, &u64SectorCount)) &&
+		(sector < u64SectorCount))
+	{
+		u32Count = DISKIO_READ_AHEAD;
+		if ((u64SectorCount - sector) < u32Count)
+		{
+			u32Count = (uint32_t) (u64SectorCount - sector);
+		}
+	}
+
+	if (1 == u32Count)
+	{
+		u16Index = DiskCacheAllocate(pdrv,
+									 sector);
+		if (DISKIO_NONE == u16Index)
+		{
+			eStatus = ESTATUS_DISK_ERROR;
+			goto errorExit;
+		}
+
+		eStatus = IDEReadSector(pdrv,
+								sector,
+								1,
+								CACHE_DATA(u16Index));
+		if (eStatus != ESTATUS_OK)
+		{
+			DiskCacheRelease(u16Index);
+			DiskCacheDemote(u16Index);
+			goto errorExit;
+		}
+
+		memcpy((void *) buff, CACHE_DATA(u16Index), DISKIO_SECTOR_SIZE);
+		goto errorExit;
+	}
+
+	eStatus = IDEReadSector(pdrv,
+							sector,
+							u32Count,
+							(uint8_t *) sg_u32ReadAhead);
+	ERR_GOTO();
+
+	sg_sCacheStats.u32ReadAheads++;
+
+	// Cache everything that came in, other than sectors we already have (they may be newer)
+	for (u32Loop = 0; u32Loop < u32Count; u32Loop++)
+	{
+		if (DiskCacheLookup(pdrv, sector + u32Loop) != DISKIO_NONE)
+		{
+			continue;
+		}
+
+		u16Index = DiskCacheAllocate(pdrv,
+									 sector + u32Loop);
+		if (DISKIO_NONE == u16Index)
+		{
+			break;
+		}
+
+		memcpy(CACHE_DATA(u16Index), ((uint8_t *) sg_u32ReadAhead) + (u32Loop * DISKIO_SECTOR_SIZE), DISKIO_SECTOR_SIZE);
+	}
+
+	memcpy((void *) buff, (void *) sg_u32ReadAhead, DISKIO_SECTOR_SIZE);
+
+errorExit:
+	return(eStatus);
+}
 
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
@@ -59,35 +536,92 @@ DSTATUS disk_initialize (
 /* Read Sector(s)                                                        */
 /*-----------------------------------------------------------------------*/
 
-DRESULT disk_read (
-	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
-	BYTE *buff,		/* Data buffer to store read data */
-	LBA_t sector,	/* Start sector in LBA */
-	UINT count		/* Number of sectors to read */
-)
+static DRESULT DiskCacheRead(BYTE pdrv,
+							 BYTE *buff,
+							 LBA_t sector,
+							 UINT count)
 {
 	EStatus eStatus;
+	uint16_t u16Index;
+	UINT u32Loop;
 
-	// Go read 1 or more sectors
-	eStatus = IDEReadSector(pdrv,
-							sector,
-							count,
-							buff);
+	if ((pdrv >= DEV_COUNT) ||
+		(false == DiskCacheActive()))
+	{
+		// Go read 1 or more sectors
+		eStatus = IDEReadSector(pdrv,
+								sector,
+								count,
+								buff);
+		return(EStatusToDResult(eStatus));
+	}
 
-	if (ESTATUS_OK == eStatus)
+	if (count > 1)
 	{
-		return(RES_OK);
+		// Bulk reads go straight to the caller
+		eStatus = IDEReadSector(pdrv,
+								sector,
+								count,
+								buff);
+		if ((ESTATUS_OK == eStatus) && sg_u16DirtyCount)
+		{
+			// Anything we're holding that hasn't been written yet is newer than what was just read
+			for (u32Loop = 0; u32Loop < count; u32Loop++)
+			{
+				u16Index = DiskCacheLookup(pdrv, sector + u32Loop);
+				if ((u16Index != DISKIO_NONE) &&
+					(sg_sCacheEntries[u16Index].bDirty))
+				{
+					memcpy((void *) (buff + (u32Loop * DISKIO_SECTOR_SIZE)), CACHE_DATA(u16Index), DISKIO_SECTOR_SIZE);
+				}
+			}
+		}
+
+		sg_sCacheStats.u32Bypassed++;
+		sg_u64SequentialNext[pdrv] = sector + count;
+		return(EStatusToDResult(eStatus));
 	}
-	else
-	if (ESTATUS_TIMEOUT == eStatus)
+
+	u16Index = DiskCacheLookup(pdrv,
+							   sector);
+	if (u16Index != DISKIO_NONE)
 	{
-		return(RES_NOTRDY);
+		memcpy((void *) buff, CACHE_DATA(u16Index), DISKIO_SECTOR_SIZE);
+		DiskCacheTouch(u16Index);
+		sg_sCacheStats.u32Hits++;
+		eStatus = ESTATUS_OK;
 	}
 	else
 	{
-		// Assume an error
-		return(RES_ERROR);
+		sg_sCacheStats.u32Misses++;
+		eStatus = DiskCacheReadMiss(pdrv,
+									buff,
+									sector);
 	}
+
+	sg_u64SequentialNext[pdrv] = sector + 1;
+	return(EStatusToDResult(eStatus));
+}
+
+DRESULT disk_read (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	BYTE *buff,		/* Data buffer to store read data */
+	LBA_t sector,	/* Start sector in LBA */
+	UINT count		/* Number of sectors to read */
+)
+{
+	DRESULT eResult = RES_NOTRDY;
+
+	if (DISKIO_LOCK())
+	{
+		eResult = DiskCacheRead(pdrv,
+								buff,
+								sector,
+								count);
+		DISKIO_UNLOCK();
+	}
+
+	return(eResult);
 }
 
 
@@ -98,35 +632,105 @@ DRESULT disk_read (
 
 #if FF_FS_READONLY == 0
 
-DRESULT disk_write (
-	BYTE pdrv,			/* Physical drive nmuber to identify the drive */
-	const BYTE *buff,	/* Data to be written */
-	LBA_t sector,		/* Start sector in LBA */
-	UINT count			/* Number of sectors to write */
-)
+static DRESULT DiskCacheWrite(BYTE pdrv,
+							  const BYTE *buff,
+							  LBA_t sector,
+							  UINT count)
 {
 	EStatus eStatus;
+	uint16_t u16Index;
+	UINT u32Loop;
 
-	// Go read 1 or more sectors
-	eStatus = IDEWriteSector(pdrv,
-							 sector,
-							 count,
-							 (uint8_t *) buff);
+	if ((pdrv >= DEV_COUNT) ||
+		(false == DiskCacheActive()))
+	{
+		// Go write 1 or more sectors
+		eStatus = IDEWriteSector(pdrv,
+								 sector,
+								 count,
+								 (uint8_t *) buff);
+		return(EStatusToDResult(eStatus));
+	}
 
-	if (ESTATUS_OK == eStatus)
+	if (count > 1)
 	{
-		return(RES_OK);
+		// Bulk writes go straight to disk. Any cached copies pick up the new data and are now clean.
+		eStatus = IDEWriteSector(pdrv,
+								 sector,
+								 count,
+								 (uint8_t *) buff);
+		if (ESTATUS_OK == eStatus)
+		{
+			for (u32Loop = 0; u32Loop < count; u32Loop++)
+			{
+				u16Index = DiskCacheLookup(pdrv, sector + u32Loop);
+				if (u16Index != DISKIO_NONE)
+				{
+					memcpy(CACHE_DATA(u16Index), (void *) (buff + (u32Loop * DISKIO_SECTOR_SIZE)), DISKIO_SECTOR_SIZE);
+					if (sg_sCacheEntries[u16Index].bDirty)
+					{
+						sg_sCacheEntries[u16Index].bDirty = false;
+						sg_u16DirtyCount--;
+					}
+				}
+			}
+		}
+
+		return(EStatusToDResult(eStatus));
 	}
-	else
-	if (ESTATUS_TIMEOUT == eStatus)
+
+	// Single sectors (FAT, directory and partial data updates) are held until sync
+	u16Index = DiskCacheLookup(pdrv,
+							   sector);
+	if (DISKIO_NONE == u16Index)
 	{
-		return(RES_NOTRDY);
+		u16Index = DiskCacheAllocate(pdrv,
+									 sector);
+		if (DISKIO_NONE == u16Index)
+		{
+			return(RES_ERROR);
+		}
 	}
 	else
 	{
-		// Assume an error
-		return(RES_ERROR);
+		DiskCacheTouch(u16Index);
+	}
+
+	memcpy(CACHE_DATA(u16Index), (void *) buff, DISKIO_SECTOR_SIZE);
+	if (false == sg_sCacheEntries[u16Index].bDirty)
+	{
+		sg_sCacheEntries[u16Index].bDirty = true;
+		sg_u16DirtyCount++;
+	}
+
+	eStatus = ESTATUS_OK;
+	if (sg_u16DirtyCount >= DISKIO_DIRTY_MAX)
+	{
+		eStatus = DiskCacheSyncAll();
+	}
+
+	return(EStatusToDResult(eStatus));
+}
+
+DRESULT disk_write (
+	BYTE pdrv,			/* Physical drive nmuber to identify the drive */
+	const BYTE *buff,	/* Data to be written */
+	LBA_t sector,		/* Start sector in LBA */
+	UINT count			/* Number of sectors to write */
+)
+{
+	DRESULT eResult = RES_NOTRDY;
+
+	if (DISKIO_LOCK())
+	{
+		eResult = DiskCacheWrite(pdrv,
+								 buff,
+								 sector,
+								 count);
+		DISKIO_UNLOCK();
 	}
+
+	return(eResult);
 }
 
 #endif
@@ -147,7 +751,7 @@ DRESULT disk_ioctl (
 
 	if (CTRL_SYNC == cmd)
 	{
-		stat = RES_OK;
+		stat = disk_cache_sync(pdrv);
 	}
 
 	if (GET_SECTOR_COUNT == cmd)
@@ -174,3 +778,249 @@ DRESULT disk_ioctl (
 	return(stat);
 }
 
+
+
+/*-----------------------------------------------------------------------*/
+/* Sector cache control                                                  */
+/*-----------------------------------------------------------------------*/
+
+// Create the lock the drives share and set up the cache. Called once at startup, before
+// anything is mounted.
+DRESULT disk_cache_init (void)
+{
+	DRESULT eResult = RES_OK;
+
+#if FF_FS_REENTRANT
+	if (false == sg_bLockInit)
+	{
+		if (0 == ff_mutex_create(DISKIO_MUTEX))
+		{
+			return(RES_ERROR);
+		}
+
+		sg_bLockInit = true;
+	}
+#endif
+
+	if (DISKIO_LOCK())
+	{
+		(void) DiskCacheActive();
+		DISKIO_UNLOCK();
+	}
+	else
+	{
+		eResult = RES_NOTRDY;
+	}
+
+	return(eResult);
+}
+
+static DRESULT DiskCacheFlush(BYTE pdrv)
+{
+	if ((pdrv >= DEV_COUNT) ||
+		(false == sg_bCacheInit) ||
+		(NULL == sg_pu8CacheData))
+	{
+		return(RES_OK);
+	}
+
+	return(EStatusToDResult(DiskCacheSync(pdrv)));
+}
+
+// Write back everything the cache is holding for a drive
+DRESULT disk_cache_sync (
+	BYTE pdrv		/* Physical drive nmuber (0..) */
+)
+{
+	DRESULT eResult = RES_NOTRDY;
+
+	if (DISKIO_LOCK())
+	{
+		eResult = DiskCacheFlush(pdrv);
+		DISKIO_UNLOCK();
+	}
+
+	return(eResult);
+}
+
+static DRESULT DiskCacheInvalidate(BYTE pdrv)
+{
+	DRESULT eResult;
+	uint16_t u16Loop;
+
+	eResult = DiskCacheFlush(pdrv);
+	if ((eResult != RES_OK) ||
+		(pdrv >= DEV_COUNT) ||
+		(false == sg_bCacheInit) ||
+		(NULL == sg_pu8CacheData))
+	{
+		return(eResult);
+	}
+
+	for (u16Loop = 0; u16Loop < DISKIO_CACHE_SECTORS; u16Loop++)
+	{
+		if ((sg_sCacheEntries[u16Loop].bValid) &&
+			(sg_sCacheEntries[u16Loop].u8Drive == pdrv))
+		{
+			DiskCacheRelease(u16Loop);
+			DiskCacheDemote(u16Loop);
+		}
+	}
+
+	sg_u64SequentialNext[pdrv] = 0;
+	return(RES_OK);
+}
+
+// Write back and forget everything cached for a drive. Needed whenever the drive is
+// accessed (or changed) behind FatFs's back.
+DRESULT disk_cache_invalidate (
+	BYTE pdrv		/* Physical drive nmuber (0..) */
+)
+{
+	DRESULT eResult = RES_NOTRDY;
+
+	if (DISKIO_LOCK())
+	{
+		eResult = DiskCacheInvalidate(pdrv);
+		DISKIO_UNLOCK();
+	}
+
+	return(eResult);
+}
+
+static void DiskCachePin(BYTE pdrv,
+						 LBA_t sector,
+						 LBA_t count)
+{
+	uint16_t u16Loop;
+	uint8_t u8Range;
+
+	if (pdrv >= DEV_COUNT)
+	{
+		return;
+	}
+
+	if (0 == count)
+	{
+		memset((void *) sg_sPinRanges[pdrv], 0, sizeof(sg_sPinRanges[pdrv]));
+	}
+	else
+	{
+		for (u8Range = 0; u8Range < DISKIO_PIN_RANGES; u8Range++)
+		{
+			if (0 == sg_sPinRanges[pdrv][u8Range].u64Count)
+			{
+				sg_sPinRanges[pdrv][u8Range].u64Sector = sector;
+				sg_sPinRanges[pdrv][u8Range].u64Count = count;
+				break;
+			}
+		}
+	}
+
+	if (false == sg_bCacheInit)
+	{
+		return;
+	}
+
+	// Bring what's already cached in line with the new ranges
+	for (u16Loop = 0; u16Loop < DISKIO_CACHE_SECTORS; u16Loop++)
+	{
+		SDiskCacheEntry *psEntry = &sg_sCacheEntries[u16Loop];
+		bool bPinned;
+
+		if ((false == psEntry->bValid) ||
+			(psEntry->u8Drive != pdrv))
+		{
+			continue;
+		}
+
+		bPinned = DiskCacheSectorPinned(pdrv, psEntry->u64Sector);
+		if (bPinned && (false == psEntry->bPinned) && (sg_u16PinnedCount < DISKIO_PINNED_MAX))
+		{
+			psEntry->bPinned = true;
+			sg_u16PinnedCount++;
+		}
+		else
+		if ((false == bPinned) && psEntry->bPinned)
+		{
+			psEntry->bPinned = false;
+			sg_u16PinnedCount--;
+		}
+	}
+}
+
+// Keep a range of sectors (a FAT, for instance) cached in preference to everything else.
+// A count of 0 clears all of the drive's pinned ranges.
+void disk_cache_pin (
+	BYTE pdrv,		/* Physical drive nmuber (0..) */
+	LBA_t sector,	/* Start sector in LBA */
+	LBA_t count		/* Number of sectors */
+)
+{
+	if (DISKIO_LOCK())
+	{
+		DiskCachePin(pdrv,
+					 sector,
+					 count);
+		DISKIO_UNLOCK();
+	}
+}
+
+// Turn the cache on or off (off writes everything back and empties it)
+DRESULT disk_cache_enable (
+	BYTE enable		/* 0 = Pass everything through to the drive */
+)
+{
+	BYTE pdrv;
+	DRESULT eResult = RES_OK;
+
+	if (0 == DISKIO_LOCK())
+	{
+		return(RES_NOTRDY);
+	}
+
+	if (0 == enable)
+	{
+		for (pdrv = 0; pdrv < DEV_COUNT; pdrv++)
+		{
+			eResult = DiskCacheInvalidate(pdrv);
+			if (eResult != RES_OK)
+			{
+				goto errorExit;
+			}
+		}
+	}
+
+	sg_bCacheEnabled = (enable != 0);
+
+errorExit:
+	DISKIO_UNLOCK();
+	return(eResult);
+}
+
+// Get (and optionally reset) the cache's counters
+void disk_cache_stats (
+	DISKCACHE_STATS *stats,	/* Where to put the counters (NULL to just reset them) */
+	BYTE reset				/* Nonzero to zero them afterward */
+)
+{
+	if (0 == DISKIO_LOCK())
+	{
+		return;
+	}
+
+	if (stats)
+	{
+		*stats = sg_sCacheStats;
+		stats->u32Sectors = DISKIO_CACHE_SECTORS;
+		stats->u32Dirty = sg_u16DirtyCount;
+		stats->u32Pinned = sg_u16PinnedCount;
+	}
+
+	if (reset)
+	{
+		memset((void *) &sg_sCacheStats, 0, sizeof(sg_sCacheStats));
+	}
+
+	DISKIO_UNLOCK();
+}
@@ -33,6 +33,30 @@ DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
 
+/* Sector cache (diskio.c) */
+
+typedef struct {
+	DWORD	u32Hits;		/* Single sector reads satisfied from the cache */
+	DWORD	u32Misses;		/* Single sector reads that went to the drive */
+	DWORD	u32ReadAheads;	/* Misses that fetched a read-ahead block */
+	DWORD	u32Bypassed;	/* Multi-sector reads passed straight through */
+	DWORD	u32WriteBacks;	/* Dirty sectors written to the drive */
+	DWORD	u32Sectors;		/* Cache size (sectors) */
+	DWORD	u32Dirty;		/* Sectors currently awaiting write back */
+	DWORD	u32Pinned;		/* Sectors currently pinned */
+} DISKCACHE_STATS;
+
+/* ff_mutex_*() ID of the lock diskio.c shares between drives (after the volume and system mutexes) */
+#define DISKIO_MUTEX	(FF_VOLUMES + 1)
+
+DRESULT disk_cache_init (void);
+DRESULT disk_cache_sync (BYTE pdrv);
+DRESULT disk_cache_invalidate (BYTE pdrv);
+void disk_cache_pin (BYTE pdrv, LBA_t sector, LBA_t count);
+DRESULT disk_cache_enable (BYTE enable);
+void disk_cache_stats (DISKCACHE_STATS* stats, BYTE reset);
+
+
 /* Disk Status Bits (DSTATUS) */
 
 #define STA_NOINIT		0x01	/* Drive not initialized */
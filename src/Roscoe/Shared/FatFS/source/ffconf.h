@@ -275,7 +275,9 @@
 /      lock control is independent of re-entrancy. */
 
 
+#ifndef FF_FS_REENTRANT
 #define FF_FS_REENTRANT	0
+#endif
 #define FF_FS_TIMEOUT	1000
 /* The option FF_FS_REENTRANT switches the re-entrancy (thread safe) of the FatFs
 /  module itself. Note that regardless of this option, file access to different
@@ -289,6 +291,12 @@
 /      function, must be added to the project. Samples are available in ffsystem.c.
 /
 /  The FF_FS_TIMEOUT defines timeout period in unit of O/S time tick.
+/
+/  Roscoe: Off in every current build - FatFs is only linked into the boot
+/  loader, which is single threaded. Building with FF_FS_REENTRANT=1 selects
+/  the per-volume locks (OS_TYPE 5 in ffsystem.c) and diskio.c's DISKIO_MUTEX,
+/  and needs an OS layer providing OSSemaphoreCreate/Get/Put/Destroy(). The
+/  BIOS doesn't have one yet. FF_FS_TIMEOUT is in milliseconds there.
 */
 
 
@@ -39,7 +39,7 @@ void ff_memfree (
 /* Definitions of Mutex                                                   */
 /*------------------------------------------------------------------------*/
 
-#define OS_TYPE	0	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS */
+#define OS_TYPE	5	/* 0:Win32, 1:uITRON4.0, 2:uC/OS-II, 3:FreeRTOS, 4:CMSIS-RTOS, 5:Roscoe OS layer */
 
 
 #if   OS_TYPE == 0	/* Win32 */
@@ -64,6 +64,11 @@ static SemaphoreHandle_t Mutex[FF_VOLUMES + 1];	/* Table of mutex handle */
 #include "cmsis_os.h"
 static osMutexId Mutex[FF_VOLUMES + 1];	/* Table of mutex ID */
 
+#elif OS_TYPE == 5	/* Roscoe OS layer (needs OSSemaphore*(), which the BIOS doesn't provide yet) */
+#include "Shared/Shared.h"
+#include "diskio.h"
+static SOSSemaphore Mutex[DISKIO_MUTEX + 1];	/* Volumes, system, then the lock diskio.c shares between drives */
+
 #endif
 
 
@@ -106,6 +111,9 @@ int ff_mutex_create (	/* Returns 1:Function succeeded or 0:Could not create the
 	Mutex[vol] = osMutexCreate(osMutex(cmsis_os_mutex));
 	return (int)(Mutex[vol] != NULL);
 
+#elif OS_TYPE == 5	/* Roscoe - a binary semaphore, so it can be released by whoever holds it */
+	return (int)(OSSemaphoreCreate(&Mutex[vol], 1, 1) == ESTATUS_OK);
+
 #endif
 }
 
@@ -138,6 +146,9 @@ void ff_mutex_delete (	/* Returns 1:Function succeeded or 0:Could not delete due
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexDelete(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* Roscoe */
+	(void) OSSemaphoreDestroy(&Mutex[vol]);
+
 #endif
 }
 
@@ -171,6 +182,9 @@ int ff_mutex_take (	/* Returns 1:Succeeded or 0:Timeout */
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	return (int)(osMutexWait(Mutex[vol], FF_FS_TIMEOUT) == osOK);
 
+#elif OS_TYPE == 5	/* Roscoe */
+	return (int)(OSSemaphoreGet(Mutex[vol], FF_FS_TIMEOUT) == ESTATUS_OK);
+
 #endif
 }
 
@@ -201,6 +215,9 @@ void ff_mutex_give (
 #elif OS_TYPE == 4	/* CMSIS-RTOS */
 	osMutexRelease(Mutex[vol]);
 
+#elif OS_TYPE == 5	/* Roscoe */
+	(void) OSSemaphorePut(Mutex[vol], 1);
+
 #endif
 }
 
@@ -41,6 +41,7 @@ typedef struct SIDEInfo
 	uint32_t u32CommandSets;			// Command sets supported
 	uint64_t u64DiskSectorCount;   		// How many sectors does this disk have?
 	EIDEBlockMode eBlockMode;			// What block mode does this disk support?
+	uint8_t u8MultipleSectors;			// Sectors per DRQ block (1=READ/WRITE MULTIPLE not in use)
 } SIDEDiskInfo;
 
 // Set TRUE if we have the master disk currently selected
@@ -389,6 +390,7 @@ EStatus IDEReadWriteSectors(uint8_t u8Disk,
 	EStatus eStatus;
 	uint32_t u32Loop;
 	bool bUnaligned = false;
+	SIDEDiskInfo *psDisk;
 
 	eStatus = IDECheckRanges(u8Disk,
 							 u64Sector,
@@ -402,6 +404,8 @@ EStatus IDEReadWriteSectors(uint8_t u8Disk,
 		bUnaligned = true;
 	}
 
+	psDisk = &sg_sDisks[u8Disk];
+
 	while (u64SectorCount)
 	{
 		uint8_t u8SectorChunk;
@@ -430,64 +434,90 @@ EStatus IDEReadWriteSectors(uint8_t u8Disk,
 						u64Sector,
 						u8SectorChunk);
 
+		// With READ/WRITE MULTIPLE, the disk only raises DRQ once per block of
+		// u8MultipleSectors sectors rather than once per sector
 		if (bWrite)
 		{
 			// Now issue the command to write
-			IDE_REG_CMD = IDE_CMD_WRITE_PIO;
+			IDE_REG_CMD = (psDisk->u8MultipleSectors > 1) ? IDE_CMD_WRITE_MULTIPLE : IDE_CMD_WRITE_PIO;
 
 			while (u8SectorCounter)
 			{
+				uint8_t u8BlockCounter = psDisk->u8MultipleSectors;
+
+				if (u8BlockCounter > u8SectorCounter)
+				{
+					u8BlockCounter = u8SectorCounter;
+				}
+
+				u8SectorCounter -= u8BlockCounter;
+
 				// Wait until the disk is ready to accept the data
 				eStatus = IDEWaitBusyDRQ();
 				ERR_GOTO();
 
-				if (bUnaligned)
-				{
-					IDESectorMoveWrite((void *) pu8Buffer);
-					pu8Buffer += (1 << 9);
-				}
-				else
+				while (u8BlockCounter)
 				{
-					u32Loop = 128;
-					while (u32Loop)
+					if (bUnaligned)
 					{
-						IDE_REG_DATA = *((uint32_t *) pu8Buffer);
-						pu8Buffer += sizeof(uint32_t);
-						u32Loop--;
+						IDESectorMoveWrite((void *) pu8Buffer);
+						pu8Buffer += (1 << 9);
+					}
+					else
+					{
+						u32Loop = 128;
+						while (u32Loop)
+						{
+							IDE_REG_DATA = *((uint32_t *) pu8Buffer);
+							pu8Buffer += sizeof(uint32_t);
+							u32Loop--;
+						}
 					}
-				}
 
-				--u8SectorCounter;
+					--u8BlockCounter;
+				}
 			}
 		}
 		else
 		{
 			// Now issue the command to read
-			IDE_REG_CMD = IDE_CMD_READ_PIO;
+			IDE_REG_CMD = (psDisk->u8MultipleSectors > 1) ? IDE_CMD_READ_MULTIPLE : IDE_CMD_READ_PIO;
 
 			while (u8SectorCounter)
 			{
+				uint8_t u8BlockCounter = psDisk->u8MultipleSectors;
+
+				if (u8BlockCounter > u8SectorCounter)
+				{
+					u8BlockCounter = u8SectorCounter;
+				}
+
+				u8SectorCounter -= u8BlockCounter;
+
 				// Wait until we have data
 				eStatus = IDEWaitBusyDRQ();
 				ERR_GOTO();
 
-				if (bUnaligned)
+				while (u8BlockCounter)
 				{
-					u32Loop = 128;
-					while (u32Loop)
+					if (bUnaligned)
 					{
-						*((uint32_t *) pu8Buffer) = IDE_REG_DATA;
-						pu8Buffer += sizeof(uint32_t);
-						u32Loop--;
+						u32Loop = 128;
+						while (u32Loop)
+						{
+							*((uint32_t *) pu8Buffer) = IDE_REG_DATA;
+							pu8Buffer += sizeof(uint32_t);
+							u32Loop--;
+						}
+					}
+					else
+					{
+						IDESectorMoveRead((void *) pu8Buffer);
+						pu8Buffer += (1 << 9);
 					}
-				}
-				else
-				{
-					IDESectorMoveRead((void *) pu8Buffer);
-					pu8Buffer += (1 << 9);
-				}
 
-				--u8SectorCounter;
+					--u8BlockCounter;
+				}
 			}
 		}
 
@@ -524,9 +554,47 @@ errorExit:
 	return(eStatus);
 }
 
+// Put the disk in to READ/WRITE MULTIPLE mode with the largest block size (a power of 2) it
+// and IDE_MULTIPLE_MAX allow. Falls back to a sector per DRQ if the disk won't do it.
+static void IDESetMultiple(SIDEDiskInfo *psDisk,
+						   uint8_t u8DiskMax)
+{
+	EStatus eStatus;
+	uint8_t u8Sectors = IDE_MULTIPLE_MAX;
+
+	psDisk->u8MultipleSectors = 1;
+
+	while (u8Sectors > u8DiskMax)
+	{
+		u8Sectors >>= 1;
+	}
+
+	if (u8Sectors < 2)
+	{
+		return;
+	}
+
+	eStatus = IDEWaitBusy();
+	if (eStatus != ESTATUS_OK)
+	{
+		return;
+	}
+
+	IDE_REG_SECCOUNT0 = u8Sectors;
+	IDE_REG_CMD = IDE_CMD_SET_MULTIPLE;
+
+	// If it's aborted, the disk doesn't support it (or that block size)
+	eStatus = IDEWaitBusy();
+	if (ESTATUS_OK == eStatus)
+	{
+		psDisk->u8MultipleSectors = u8Sectors;
+	}
+}
+
 // Identify structure offsets
 #define	IDE_DEVICETYPE			0
 #define	IDE_IDENT_MODEL			54
+#define	IDE_MULTIPLE			94
 #define	IDE_CAPABILITIES		98
 #define	IDE_MAX_LBA				120
 #define	IDE_COMMANDSETS			164
@@ -638,8 +706,17 @@ static EStatus IDEProbeDisk(SIDEDiskInfo *psDisk,
 			psDisk->eBlockMode = EIDEBLOCK_CHS;
 		}
 
+		// Low byte of the multiple word is the most sectors per DRQ block the disk supports
+		IDESetMultiple(psDisk,
+					   (uint8_t) pu16IdentifyInfo[IDE_MULTIPLE >> 1]);
+
 		// Convert # of 512 byte sectors to megabytes
-		printf("IDE %s         : %s - %uMB (%s)\n", peDisk, psDisk->eDriveModel, (uint32_t) (psDisk->u64DiskSectorCount >> 11), peSectorAccess);
+		printf("IDE %s         : %s - %uMB (%s", peDisk, psDisk->eDriveModel, (uint32_t) (psDisk->u64DiskSectorCount >> 11), peSectorAccess);
+		if (psDisk->u8MultipleSectors > 1)
+		{
+			printf(", %u sector multiple", psDisk->u8MultipleSectors);
+		}
+		printf(")\n");
 	}
 	else
 	{
@@ -21,6 +21,9 @@ extern EStatus IDEGetSize(uint8_t u8Disk,
 // Default wait time (in milliseconds)
 #define	IDE_DEFAULT_WAIT_MS		10000
 
+// Most sectors we'll move per DRQ block with READ/WRITE MULTIPLE
+#define	IDE_MULTIPLE_MAX		16
+
 // 100ms timer counter
 #define	IDE_TIMEOUT_COUNTER	   	1
 
@@ -42,6 +45,9 @@ extern EStatus IDEGetSize(uint8_t u8Disk,
 // IDE Commands
 #define	IDE_CMD_READ_PIO		0x20
 #define	IDE_CMD_WRITE_PIO		0x30
+#define	IDE_CMD_READ_MULTIPLE	0xc4
+#define	IDE_CMD_WRITE_MULTIPLE	0xc5
+#define	IDE_CMD_SET_MULTIPLE	0xc6
 #define	IDE_CMD_SPINDOWN		0xe0
 #define	IDE_CMD_SPINUP			0xe1
 #define	IDE_CMD_IDENTIFY   		0xec
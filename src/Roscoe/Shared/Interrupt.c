@@ -94,6 +94,7 @@ EStatus InterruptMaskSet(uint8_t u8InterruptVector,
 {
 	EStatus eStatus = ESTATUS_OK;
 	const SInterruptDefinition *psInterruptDefinition;
+	uint16_t u16SR;
 
 	psInterruptDefinition = InterruptDefinitionGetByVector(u8InterruptVector);
 	if (NULL == psInterruptDefinition)
@@ -102,8 +103,10 @@ EStatus InterruptMaskSet(uint8_t u8InterruptVector,
 		goto errorExit;
 	}
 
-	// Need to disable interrupts since we're doing a read/modify/write
-	InterruptDisable();
+	// Need to disable interrupts since we're doing a read/modify/write. Put the
+	// IPL back the way we found it afterward so this is safe from a handler.
+	u16SR = SRGet();
+	SRSet(u16SR | SR_IPL_MASK);
 
 	// We're either masking or unmasking it. Update the mirror first.
 	if (bMaskInterrupt)
@@ -118,8 +121,8 @@ EStatus InterruptMaskSet(uint8_t u8InterruptVector,
 	// Set the mask
 	*psInterruptDefinition->pu8MaskAddress = *psInterruptDefinition->pu8InterruptMaskMirror;
 
-	// Reenable interrupts
-	InterruptEnable();
+	// Restore the prior IPL
+	SRSet(u16SR);
 
 errorExit:
 	return(eStatus);
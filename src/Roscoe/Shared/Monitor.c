@@ -21,12 +21,15 @@
 #include "Shared/Shared.h"
 #include "Shared/ptc.h"
 #include "Shared/Stream.h"
-#include "Shared/YModem.h"
+#include "Shared/Transfer.h"
 #include "Shared/elf.h"
 #include "Shared/Interrupt.h"
 #include "Shared/FaultHandler.h"
 #include "Shared/LinkerDefines.h"
 #include "Shared/DOS.h"
+#include "Shared/NIC.h"
+#include "Shared/FatFS/source/ff.h"
+#include "Shared/FatFS/source/diskio.h"
 #include "Shared/82C42.h"
 
 // Maximum # of characters per input line
@@ -41,7 +44,7 @@
 // # Of lines to dump/disassemble
 static uint16_t sg_u16DumpLines = 8;
 
-static SYModem sg_sYModem;
+static STransfer sg_sTransfer;
 
 static EStatus MonitorDataCallback(EStatus eStatusIncoming,
 								   uint32_t u32Offset,
@@ -96,7 +99,7 @@ static EStatus MonitorInputGet(char *peInputChar)
 			break;
 		}
 
-		eStatus = YModemPump(&sg_sYModem);
+		eStatus = TransferPump(&sg_sTransfer);
 		ERR_GOTO();
 	}
 
@@ -119,7 +122,7 @@ static bool MonitorInputAvailable(void)
 	EStatus eStatus;
 	uint16_t u16DataCount;
 
-	YModemPump(&sg_sYModem);
+	(void) TransferPump(&sg_sTransfer);
 
 	eStatus = SerialReceiveDataGetCount(MONITOR_CONSOLE_UART,
 										&u16DataCount);
@@ -1823,6 +1826,17 @@ static EStatus MonitorIDEReadWrite(SLex *psLex,
 	// u32SectorCount = # Of sectors to read/write
 	// u32Address = Data buffer
 
+	// We're going around the filesystem, so get the sector cache's held writes out
+	// (and forget what it has if we're about to change the disk underneath it)
+	if (bWrite)
+	{
+		(void) disk_cache_invalidate(0);
+	}
+	else
+	{
+		(void) disk_cache_sync(0);
+	}
+
 	if (bWrite)
 	{
 		if (false == bAddressProvided)
@@ -2393,6 +2407,9 @@ static EStatus MonitorIDEReadWriteTest(SLex *psLex,
 
 	printf("IDE read/write test - %u passes, %u byte buffer\n", u32PassesRemaining, IDERW_BUFFER_SIZE);
 
+	// This overwrites the disk, so the sector cache's copy is about to go stale
+	(void) disk_cache_invalidate(0);
+
 	while (u32PassesRemaining)
 	{
 		uint32_t *pu32BufferBase = NULL;
@@ -2509,6 +2526,9 @@ static EStatus MonitorIDEProbe(SLex *psLex,
 							   const SMonitorCommands *psMonitorCommand,
 							   uint32_t *pu32AddressPointer)
 {
+	// The disks may not be the same ones afterward
+	(void) disk_cache_invalidate(0);
+	(void) disk_cache_invalidate(1);
 	(void) IDEProbe();
 
 	return(ESTATUS_OK);
@@ -2737,7 +2757,15 @@ static const SMonitorCommands sg_sMonitorCommands[] =
 	{"cd",		"Change directory",								DOSChdir},
 	{"dir",		"View contents of directory",					DOSDir},
 	{"del",		"Delete a file",								DOSDelete},
+	{"loadfile",	"Load a file to memory at the supplied address",	DOSLoad},
+	{"diskbench","Directory/file read benchmark (sector cache)",	DOSDiskBench},
 	{"rxfile",	"Receive a file with the name provided",		MonitorRxFile},
+#ifdef NIC_W5500
+	{"nic",		"Reset the network interface and show its status",	NICCommand},
+#ifdef NETBENCH
+	{"netbench","Network benchmark target for Utils/netbench",	NICBenchCommand},
+#endif
+#endif
 };
 
 // Function needs to come after sg_sMonitorCommands[] due to a forward reference
@@ -2921,11 +2949,11 @@ EStatus MonitorStart(void)
 	eStatus = LineInputInit(&sLineInput);
 	assert(ESTATUS_OK == eStatus);
 
-	eStatus = YModemInit(&sg_sYModem,
-						 1,
-						 FLASH_UPDATE_BAUD_RATE,
-						 &sELF,
-						 MonitorDataCallback);
+	eStatus = TransferInit(&sg_sTransfer,
+						   1,
+						   FLASH_UPDATE_BAUD_RATE,
+						   &sELF,
+						   MonitorDataCallback);
 	assert(ESTATUS_OK == eStatus);
 
 	while (1)
@@ -2984,18 +3012,11 @@ EStatus MonitorStart(void)
 			}
 			else
 			{
-				SELFProgramHeader32 *psELFProgramHeader32 = (SELFProgramHeader32 *) sELF.u8ProgramHeader;
-
 				// Stop interrupts
 				InterruptDisable();
 
 				// If appropriate, copy in the part of the vector table that makes sense to do so
-				if (psELFProgramHeader32->u32PhysicalAddress < sizeof(sELF.u8VectorTable))
-				{
-					memcpy((void *) psELFProgramHeader32->u32PhysicalAddress,
-						   (void *) &sELF.u8VectorTable[psELFProgramHeader32->u32PhysicalAddress],
-						   sizeof(sELF.u8VectorTable) - psELFProgramHeader32->u32PhysicalAddress);
-				}
+				(void) ELFVectorTableInstall(&sELF);
 
 				// Mask all interrupts, otherwise bad things happen
 				*((volatile uint8_t *)ROSCOE_INTC_MASK) = 0xff;
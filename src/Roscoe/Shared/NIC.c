@@ -0,0 +1,381 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <string.h>
+#include "Hardware/Roscoe.h"
+#include "BIOS/OS.h"
+#include "Shared/Shared.h"
+#include "Shared/AsmUtils.h"
+#include "Shared/Interrupt.h"
+#include "Shared/rtc.h"
+#include "Shared/NIC.h"
+#include "Shared/ioLibrary/Ethernet/wizchip_conf.h"
+
+// Expected W5500 VERSIONR value
+#define	W5500_VERSION				0x04
+
+// Status register interrupt priority field
+#define	SR_INT_PRIORITY_MASK		0x0700
+
+// 2K of TX and RX buffer for each of the 8 sockets (the power on default)
+static uint8_t sg_u8SocketBufferSizes[2][_WIZCHIP_SOCK_NUM_] =
+{
+	{2, 2, 2, 2, 2, 2, 2, 2},
+	{2, 2, 2, 2, 2, 2, 2, 2}
+};
+
+// SR before the ioLibrary entered its critical section
+static uint16_t sg_u16CriticalSR;
+
+// Reactor handler for each socket
+typedef struct SNICHandler
+{
+	NICSocketHandler Handler;
+	void *pvContext;
+} SNICHandler;
+
+static SNICHandler sg_sNICHandlers[_WIZCHIP_SOCK_NUM_];
+
+// Sockets whose handlers asked to be called again on the next pass
+static uint8_t sg_u8NICPollMask;
+
+// Sockets with CON pending and masked off in Sn_IMR until their handler clears it
+static uint8_t sg_u8NICConMask;
+
+// Set by the interrupt handler, cleared once SIR has been read
+static volatile bool sg_bNICInterrupt;
+
+// Half second count the handlers were last ticked at
+static uint32_t sg_u32NICTick;
+
+// The ioLibrary brackets every chip access with these. Keep interrupts out so
+// nothing else can get at the bridge in the middle of a frame.
+static void NICCriticalEnter(void)
+{
+	uint16_t u16SR = SRGet();
+
+	SRSet(u16SR | SR_INT_PRIORITY_MASK);
+	sg_u16CriticalSR = u16SR;
+}
+
+static void NICCriticalExit(void)
+{
+	SRSet(sg_u16CriticalSR);
+}
+
+static void NICSelect(void)
+{
+	NIC_REG_CTRL = NIC_CTRL_SELECT;
+}
+
+static void NICDeselect(void)
+{
+	NIC_REG_CTRL = 0;
+}
+
+static uint8_t NICReadByte(void)
+{
+	return(NIC_REG_DATA8);
+}
+
+static void NICWriteByte(uint8_t u8Data)
+{
+	NIC_REG_DATA8 = u8Data;
+}
+
+// Whole 32 byte chunks go through the MOVEM routines, then longs, then bytes.
+// Most of what comes through here is socket data; register accesses are the 3
+// byte address phase plus one byte.
+static void NICReadBurst(uint8_t *pu8Buffer,
+						 uint16_t u16Length)
+{
+	if (u16Length >= NIC_BURST_SIZE)
+	{
+		NICBurstRead((void *) pu8Buffer,
+					 u16Length / NIC_BURST_SIZE);
+		pu8Buffer += u16Length & ~(NIC_BURST_SIZE - 1);
+		u16Length &= (NIC_BURST_SIZE - 1);
+	}
+
+	while (u16Length >= sizeof(uint32_t))
+	{
+		*((uint32_t *) pu8Buffer) = NIC_REG_DATA32;
+		pu8Buffer += sizeof(uint32_t);
+		u16Length -= sizeof(uint32_t);
+	}
+
+	while (u16Length)
+	{
+		*pu8Buffer = NIC_REG_DATA8;
+		pu8Buffer++;
+		u16Length--;
+	}
+}
+
+static void NICWriteBurst(uint8_t *pu8Buffer,
+						  uint16_t u16Length)
+{
+	if (u16Length >= NIC_BURST_SIZE)
+	{
+		NICBurstWrite((void *) pu8Buffer,
+					  u16Length / NIC_BURST_SIZE);
+		pu8Buffer += u16Length & ~(NIC_BURST_SIZE - 1);
+		u16Length &= (NIC_BURST_SIZE - 1);
+	}
+
+	while (u16Length >= sizeof(uint32_t))
+	{
+		NIC_REG_DATA32 = *((uint32_t *) pu8Buffer);
+		pu8Buffer += sizeof(uint32_t);
+		u16Length -= sizeof(uint32_t);
+	}
+
+	while (u16Length)
+	{
+		NIC_REG_DATA8 = *pu8Buffer;
+		pu8Buffer++;
+		u16Length--;
+	}
+}
+
+// INTn stays asserted until Sn_IR is cleared, and that's SPI work that belongs
+// in NICReactorRun(). Mask it at the controller until then.
+static __attribute__ ((interrupt)) void NICInterruptHandler(void)
+{
+	(void) InterruptMaskSet(INTVECT_IRQ5A_NIC,
+							true);
+	sg_bNICInterrupt = true;
+}
+
+// Reset the W5500, hook the ioLibrary up to the bridge and set up the socket buffers
+EStatus NICInit(void)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	// The reset drops SIMR/Sn_IMR, so any registered handlers go with it
+	eStatus = InterruptMaskSet(INTVECT_IRQ5A_NIC,
+							   true);
+	ERR_GOTO();
+	memset((void *) sg_sNICHandlers, 0, sizeof(sg_sNICHandlers));
+	sg_u8NICPollMask = 0;
+	sg_u8NICConMask = 0;
+	sg_bNICInterrupt = false;
+
+	reg_wizchip_cris_cbfunc(NICCriticalEnter,
+							NICCriticalExit);
+	reg_wizchip_cs_cbfunc(NICSelect,
+						  NICDeselect);
+	reg_wizchip_spi_cbfunc(NICReadByte,
+						   NICWriteByte);
+	reg_wizchip_spiburst_cbfunc(NICReadBurst,
+								NICWriteBurst);
+
+	// RSTn needs to be low for at least 500us, then the PLL needs 1ms to lock
+	NIC_REG_CTRL = NIC_CTRL_RESET;
+	SharedSleep(1000);
+	NIC_REG_CTRL = 0;
+	SharedSleep(2000);
+
+	if (getVERSIONR() != W5500_VERSION)
+	{
+		eStatus = ESTATUS_NIC_NOT_PRESENT;
+		goto errorExit;
+	}
+
+	if (wizchip_init(sg_u8SocketBufferSizes[0],
+					 sg_u8SocketBufferSizes[1]) != 0)
+	{
+		eStatus = ESTATUS_NIC_NOT_PRESENT;
+		goto errorExit;
+	}
+
+	// Nothing is enabled in SIMR yet, so INTn stays quiet until a handler registers
+	eStatus = InterruptHook(INTVECT_IRQ5A_NIC,
+							NICInterruptHandler);
+	ERR_GOTO();
+
+	eStatus = InterruptMaskSet(INTVECT_IRQ5A_NIC,
+							   false);
+	ERR_GOTO();
+
+errorExit:
+	return(eStatus);
+}
+
+// Dispatch u8Socket's events to its handler
+EStatus NICReactorRegister(uint8_t u8Socket,
+						   NICSocketHandler Handler,
+						   void *pvContext)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	if (u8Socket >= _WIZCHIP_SOCK_NUM_)
+	{
+		eStatus = ESTATUS_NIC_SOCKET_OUT_OF_RANGE;
+		goto errorExit;
+	}
+
+	sg_sNICHandlers[u8Socket].Handler = Handler;
+	sg_sNICHandlers[u8Socket].pvContext = pvContext;
+
+	// Call it on the next pass so it can open its socket
+	sg_u8NICPollMask |= (1 << u8Socket);
+	sg_u8NICConMask &= (uint8_t) ~(1 << u8Socket);
+
+	setSn_IMR(u8Socket, NIC_EVENT_SOCKET_MASK);
+	setSIMR(getSIMR() | (1 << u8Socket));
+
+errorExit:
+	return(eStatus);
+}
+
+// Stop dispatching u8Socket. Its events are masked off at the chip.
+EStatus NICReactorUnregister(uint8_t u8Socket)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	if (u8Socket >= _WIZCHIP_SOCK_NUM_)
+	{
+		eStatus = ESTATUS_NIC_SOCKET_OUT_OF_RANGE;
+		goto errorExit;
+	}
+
+	setSIMR(getSIMR() & (uint8_t) ~(1 << u8Socket));
+	setSn_IMR(u8Socket, 0);
+
+	sg_sNICHandlers[u8Socket].Handler = NULL;
+	sg_sNICHandlers[u8Socket].pvContext = NULL;
+	sg_u8NICPollMask &= (uint8_t) ~(1 << u8Socket);
+	sg_u8NICConMask &= (uint8_t) ~(1 << u8Socket);
+
+errorExit:
+	return(eStatus);
+}
+
+// One pass of the reactor: read SIR once, fetch and clear Sn_IR for just the
+// sockets it flags, then call those sockets' handlers along with any that
+// asked to be polled. If bSleep is set and there's nothing to do, STOP until
+// an interrupt comes in - the NIC's, or the RTC's half second tick.
+void NICReactorRun(bool bSleep)
+{
+	uint8_t u8Events[_WIZCHIP_SOCK_NUM_];
+	uint8_t u8Pending;
+	uint8_t u8Socket;
+	uint32_t u32Tick;
+
+	if (bSleep &&
+		(0 == sg_u8NICPollMask))
+	{
+		// Look with interrupts held off. CPUStop() drops the IPL and stops in
+		// one instruction, so one that arrives after the check still wakes us.
+		InterruptDisable();
+		if ((false == sg_bNICInterrupt) &&
+			(RTCGetPowerOnHalfSeconds() == sg_u32NICTick))
+		{
+			CPUStop();
+		}
+		else
+		{
+			InterruptEnable();
+		}
+	}
+
+	memset((void *) u8Events, 0, sizeof(u8Events));
+	u8Pending = sg_u8NICPollMask;
+
+	if (sg_bNICInterrupt)
+	{
+		uint8_t u8SIR;
+
+		sg_bNICInterrupt = false;
+		u8SIR = getSIR();
+
+		for (u8Socket = 0; u8Socket < _WIZCHIP_SOCK_NUM_; u8Socket++)
+		{
+			if (u8SIR & (1 << u8Socket))
+			{
+				u8Events[u8Socket] = getSn_IR(u8Socket) & NIC_EVENT_SOCKET_MASK;
+
+				// The ioLibrary services clear CON themselves to spot a new
+				// connection, so leave it set and mask it off until they do
+				if (u8Events[u8Socket] & NIC_EVENT_CON)
+				{
+					setSn_IMR(u8Socket, NIC_EVENT_SOCKET_MASK & ~NIC_EVENT_CON);
+					sg_u8NICConMask |= (1 << u8Socket);
+				}
+
+				// Clear the rest before dispatch so anything arriving while the
+				// handler runs raises INTn again
+				setSn_IR(u8Socket, u8Events[u8Socket] & ~NIC_EVENT_CON);
+			}
+		}
+
+		u8Pending |= u8SIR;
+
+		// If SIR went up again since we read it, this takes the interrupt right away
+		(void) InterruptMaskSet(INTVECT_IRQ5A_NIC,
+								false);
+	}
+
+	u32Tick = RTCGetPowerOnHalfSeconds();
+	if (u32Tick != sg_u32NICTick)
+	{
+		sg_u32NICTick = u32Tick;
+		for (u8Socket = 0; u8Socket < _WIZCHIP_SOCK_NUM_; u8Socket++)
+		{
+			u8Events[u8Socket] |= NIC_EVENT_TICK;
+		}
+		u8Pending = 0xff;
+	}
+
+	for (u8Socket = 0; u8Socket < _WIZCHIP_SOCK_NUM_; u8Socket++)
+	{
+		SNICHandler *psHandler = &sg_sNICHandlers[u8Socket];
+
+		if ((0 == (u8Pending & (1 << u8Socket))) ||
+			(NULL == psHandler->Handler))
+		{
+			continue;
+		}
+
+		if (psHandler->Handler(u8Socket,
+							   u8Events[u8Socket],
+							   psHandler->pvContext))
+		{
+			sg_u8NICPollMask |= (1 << u8Socket);
+		}
+		else
+		{
+			sg_u8NICPollMask &= (uint8_t) ~(1 << u8Socket);
+		}
+
+		// Rearm CON once the handler has taken it
+		if ((sg_u8NICConMask & (1 << u8Socket)) &&
+			(0 == (getSn_IR(u8Socket) & NIC_EVENT_CON)))
+		{
+			setSn_IMR(u8Socket, NIC_EVENT_SOCKET_MASK);
+			sg_u8NICConMask &= (uint8_t) ~(1 << u8Socket);
+		}
+	}
+}
+
+// Reset/initialize the network interface and show its state
+EStatus NICCommand(SLex *psLex,
+				   const SMonitorCommands *psMonitorCommand,
+				   uint32_t *pu32AddressPointer)
+{
+	EStatus eStatus;
+	uint8_t u8MAC[6];
+
+	eStatus = NICInit();
+	ERR_GOTO();
+
+	getSHAR(u8MAC);
+	printf("W5500 version 0x%.2x, MAC %.2x:%.2x:%.2x:%.2x:%.2x:%.2x, link %s\n",
+		   getVERSIONR(),
+		   u8MAC[0], u8MAC[1], u8MAC[2], u8MAC[3], u8MAC[4], u8MAC[5],
+		   (getPHYCFGR() & PHYCFGR_LNK_ON) ? "up" : "down");
+
+errorExit:
+	return(eStatus);
+}
@@ -0,0 +1,63 @@
+#ifndef _NIC_H_
+#define _NIC_H_
+
+#include "Shared/DOS.h"
+
+// W5500 SPI bridge. This is not what the board carries (that's a LAN9218,
+// U43) - it's an SPI bridge decoded in the NIC window with a W5500 behind it,
+// and is only built with NIC_W5500=1. Like the IDE interface, each register is
+// decoded across 32 bytes, so a MOVEM of 8 longs streams 32 bytes through the
+// data register.
+#define	NIC_REG8(reg)				*((volatile uint8_t *) (ROSCOE_NIC + ((reg) << 5)))
+#define	NIC_REG32(reg)				*((volatile uint32_t *) (ROSCOE_NIC + ((reg) << 5)))
+
+#define	NIC_REG_DATA8				NIC_REG8(0)		// Byte access shifts one byte through SPI
+#define	NIC_REG_DATA32				NIC_REG32(0)	// Long access shifts four, MSB first
+#define	NIC_REG_CTRL				NIC_REG8(1)
+#define	NIC_REG_STATUS				NIC_REG8(2)
+
+// NIC_REG_CTRL bits
+#define	NIC_CTRL_SELECT				0x01			// Drive SCSn low
+#define	NIC_CTRL_RESET				0x02			// Hold RSTn low
+
+// NIC_REG_STATUS bits
+#define	NIC_STATUS_INT				0x01			// INTn is asserted
+
+// Bytes moved per MOVEM by NICBurstRead()/NICBurstWrite()
+#define	NIC_BURST_SIZE				32
+
+// Events passed to reactor handlers. The low bits are the W5500's Sn_IR
+// CON/DISCON/RECV bits. SENDOK and TIMEOUT are left to socket.c, which waits on
+// and clears them itself. CON is left set in Sn_IR for the handler to clear,
+// as the ioLibrary services expect.
+#define	NIC_EVENT_CON				0x01
+#define	NIC_EVENT_DISCON			0x02
+#define	NIC_EVENT_RECV				0x04
+#define	NIC_EVENT_SOCKET_MASK		(NIC_EVENT_CON | NIC_EVENT_DISCON | NIC_EVENT_RECV)
+#define	NIC_EVENT_TICK				0x80			// Half second tick, for timeouts
+
+// Called by NICReactorRun() for a socket with pending events, on each tick, and
+// right after registration so the handler can open its socket. Return true to
+// be called again on the next pass regardless of events - RECV only fires when
+// new data lands, so a handler that leaves data in the buffer (or is waiting
+// on TX space) must ask to be polled.
+typedef bool (*NICSocketHandler)(uint8_t u8Socket,
+								 uint8_t u8Events,
+								 void *pvContext);
+
+extern EStatus NICInit(void);
+extern EStatus NICReactorRegister(uint8_t u8Socket,
+								  NICSocketHandler Handler,
+								  void *pvContext);
+extern EStatus NICReactorUnregister(uint8_t u8Socket);
+extern void NICReactorRun(bool bSleep);
+extern EStatus NICCommand(SLex *psLex,
+						  const SMonitorCommands *psMonitorCommand,
+						  uint32_t *pu32AddressPointer);
+#ifdef NETBENCH
+extern EStatus NICBenchCommand(SLex *psLex,
+							   const SMonitorCommands *psMonitorCommand,
+							   uint32_t *pu32AddressPointer);
+#endif
+
+#endif
@@ -0,0 +1,274 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+#include "Hardware/Roscoe.h"
+#include "BIOS/OS.h"
+#include "Shared/Shared.h"
+#include "Shared/rtc.h"
+#include "Shared/NIC.h"
+#include "Shared/16550.h"
+#include "Shared/ptc.h"
+#include "Shared/ioLibrary/Ethernet/wizchip_conf.h"
+#include "Shared/ioLibrary/Ethernet/socket.h"
+#include "Shared/ioLibrary/Application/netbench/netbench.h"
+
+// Network benchmark target for Utils/netbench. Only built with NETBENCH=1 (see
+// BootLoader/Makefile), along with the ioLibrary HTTP and TFTP code it drives.
+
+// Console UART, checked for a key to stop the benchmark
+#define	NICBENCH_CONSOLE_UART		0
+
+// Scratch buffer for the sink/source/echo sockets, and httpServer's DATA_BUF_SIZE
+#define	NICBENCH_BUFFER_SIZE		2048
+#define	NICBENCH_HTTP_BUFFER_SIZE	2048
+
+// Largest file the TFTP benchmark will read
+#define	NICBENCH_TFTP_MAX			(1024 * 1024)
+
+// Locally administered MAC for the benchmark, which sets up the interface itself
+static const uint8_t sg_u8NICBenchMAC[6] = {0x02, 0x52, 0x4f, 0x53, 0x43, 0x45};
+
+static uint8_t sg_u8NICBenchBuffer[NICBENCH_BUFFER_SIZE];
+static uint8_t sg_u8NICBenchHTTPTx[NICBENCH_HTTP_BUFFER_SIZE];
+static uint8_t sg_u8NICBenchHTTPRx[NICBENCH_HTTP_BUFFER_SIZE];
+
+static uint32_t NICBenchMilliseconds(void)
+{
+	uint32_t u32Ticks = 0;
+
+	(void) PTCGetInterruptCounter(1,
+								  &u32Ticks);
+	return(u32Ticks * (1000 / PTC_COUNTER1_HZ));
+}
+
+static bool NICBenchKeyPressed(void)
+{
+	EStatus eStatus;
+	uint16_t u16DataCount = 0;
+
+	eStatus = SerialReceiveDataGetCount(NICBENCH_CONSOLE_UART,
+										&u16DataCount);
+	return((ESTATUS_OK == eStatus) && u16DataCount);
+}
+
+// Parse a dotted quad
+static bool NICBenchParseIP(char *peText,
+							uint8_t *pu8IP)
+{
+	uint8_t u8Loop;
+
+	for (u8Loop = 0; u8Loop < 4; u8Loop++)
+	{
+		char *peEnd;
+		unsigned long u32Value;
+
+		if (NULL == peText)
+		{
+			return(false);
+		}
+
+		u32Value = strtoul(peText,
+						   &peEnd,
+						   10);
+		if ((peEnd == peText) ||
+			(u32Value > 255) ||
+			(*peEnd != ((u8Loop < 3) ? '.' : '\0')))
+		{
+			return(false);
+		}
+
+		pu8IP[u8Loop] = (uint8_t) u32Value;
+		peText = peEnd + 1;
+	}
+
+	return(true);
+}
+
+static bool NICBenchHandler(uint8_t u8Socket,
+							uint8_t u8Events,
+							void *pvContext)
+{
+	return(netbench_run(u8Socket) != 0);
+}
+
+// Serve the layout's roles from the reactor until a key is pressed
+static EStatus NICBenchServe(char *peLayout)
+{
+	EStatus eStatus = ESTATUS_OK;
+	uint32_t u32Start;
+	uint32_t u32HalfSeconds;
+	uint8_t u8Socket;
+	int8_t s8SocketKB;
+	uint8_t u8Key;
+	uint16_t u16Received;
+
+	s8SocketKB = netbench_init(peLayout,
+							   sg_u8NICBenchBuffer,
+							   sizeof(sg_u8NICBenchBuffer),
+							   sg_u8NICBenchHTTPTx,
+							   sg_u8NICBenchHTTPRx);
+	if (s8SocketKB < 0)
+	{
+		printf("Bad layout '%s' - one of s (sink), r (source), e (echo), u (udp), h (http) or - per socket\n", peLayout);
+		goto errorExit;
+	}
+
+	// netbench_init() resets the chip, which drops SIMR/Sn_IMR, so register after it
+	for (u8Socket = 0; u8Socket < _WIZCHIP_SOCK_NUM_; u8Socket++)
+	{
+		if (netbench_stats(u8Socket)->role)
+		{
+			eStatus = NICReactorRegister(u8Socket,
+										 NICBenchHandler,
+										 NULL);
+			ERR_GOTO();
+		}
+	}
+
+	printf("Serving %s with %dK per socket - press any key to stop\n", peLayout ? peLayout : NB_DEFAULT_LAYOUT, s8SocketKB);
+
+	u32Start = NICBenchMilliseconds();
+	u32HalfSeconds = RTCGetPowerOnHalfSeconds();
+	while (false == NICBenchKeyPressed())
+	{
+		NICReactorRun(true);
+
+		// httpServer's keep-alive timeout runs off a 1 second tick
+		if ((RTCGetPowerOnHalfSeconds() - u32HalfSeconds) >= 2)
+		{
+			u32HalfSeconds += 2;
+			netbench_time_handler();
+		}
+	}
+
+	(void) SerialReceiveData(NICBENCH_CONSOLE_UART,
+							 &u8Key,
+							 sizeof(u8Key),
+							 &u16Received);
+
+	netbench_report(NICBenchMilliseconds() - u32Start,
+					0);
+
+errorExit:
+	for (u8Socket = 0; u8Socket < _WIZCHIP_SOCK_NUM_; u8Socket++)
+	{
+		if (netbench_stats(u8Socket)->role)
+		{
+			(void) NICReactorUnregister(u8Socket);
+			(void) close(u8Socket);
+		}
+	}
+
+	return(eStatus);
+}
+
+// Time TFTP reads of peFile from peServer with 2K, 8K and 16K of RX memory, or just peKB
+static EStatus NICBenchTFTP(char *peServer,
+							char *peFile,
+							char *peKB)
+{
+	uint8_t u8Server[4];
+	uint8_t u8KB[] = {2, 8, 16};
+	uint8_t u8KBCount = sizeof(u8KB);
+	uint8_t *pu8File;
+	uint8_t u8Loop;
+
+	if ((false == NICBenchParseIP(peServer, u8Server)) ||
+		(NULL == peFile))
+	{
+		printf("Usage: netbench ip tftp server file [rx KB]\n");
+		return(ESTATUS_OK);
+	}
+
+	if (peKB)
+	{
+		u8KB[0] = (uint8_t) strtoul(peKB, NULL, 10);
+		u8KBCount = 1;
+	}
+
+	pu8File = malloc(NICBENCH_TFTP_MAX);
+	if (NULL == pu8File)
+	{
+		printf("Out of memory while trying to allocate %u bytes\n", NICBENCH_TFTP_MAX);
+		return(ESTATUS_OK);
+	}
+
+	for (u8Loop = 0; u8Loop < u8KBCount; u8Loop++)
+	{
+		(void) netbench_tftp(0,
+							 u8KB[u8Loop],
+							 ((uint32_t) u8Server[0] << 24) | ((uint32_t) u8Server[1] << 16) | ((uint32_t) u8Server[2] << 8) | u8Server[3],
+							 (uint8_t *) peFile,
+							 pu8File,
+							 NICBENCH_TFTP_MAX,
+							 NICBenchMilliseconds,
+							 NULL);
+	}
+
+	free(pu8File);
+	return(ESTATUS_OK);
+}
+
+// Network benchmark target, driven by Utils/netbench from a host. Results
+// are printed as JSON lines.
+// netbench ip [layout]
+// netbench ip tftp server file [rx KB]
+EStatus NICBenchCommand(SLex *psLex,
+						const SMonitorCommands *psMonitorCommand,
+						uint32_t *pu32AddressPointer)
+{
+	EStatus eStatus;
+	char *peArguments = NULL;
+	char eArguments[128];
+	char *peToken;
+	wiz_NetInfo sNetInfo;
+
+	eStatus = LexGetBufferPosition(psLex,
+								   &peArguments);
+	assert(ESTATUS_OK == eStatus);
+
+	strncpy(eArguments, peArguments, sizeof(eArguments) - 1);
+	eArguments[sizeof(eArguments) - 1] = '\0';
+
+	ZERO_STRUCT(sNetInfo);
+	peToken = strtok(eArguments, " \t");
+	if (false == NICBenchParseIP(peToken, sNetInfo.ip))
+	{
+		printf("Usage: netbench ip [layout]\n");
+		printf("       netbench ip tftp server file [rx KB]\n");
+		goto errorExit;
+	}
+
+	eStatus = NICInit();
+	ERR_GOTO();
+
+	// A /24 with the gateway on .1
+	memcpy((void *) sNetInfo.mac, (void *) sg_u8NICBenchMAC, sizeof(sNetInfo.mac));
+	memset((void *) sNetInfo.sn, 0xff, 3);
+	memcpy((void *) sNetInfo.gw, (void *) sNetInfo.ip, 3);
+	sNetInfo.gw[3] = 1;
+	sNetInfo.dhcp = NETINFO_STATIC;
+	wizchip_setnetinfo(&sNetInfo);
+
+	peToken = strtok(NULL, " \t");
+	if (peToken &&
+		(0 == strcmp(peToken, "tftp")))
+	{
+		char *peServer = strtok(NULL, " \t");
+		char *peFile = strtok(NULL, " \t");
+
+		eStatus = NICBenchTFTP(peServer,
+							   peFile,
+							   strtok(NULL, " \t"));
+	}
+	else
+	{
+		eStatus = NICBenchServe(peToken);
+	}
+
+errorExit:
+	return(eStatus);
+}
@@ -88,4 +88,20 @@ void MySHA256_Init (MY_SHA256_CTX *);
 void MySHA256_Update (MY_SHA256_CTX *, const void *, size_t);
 void MySHA256_Final (void *, MY_SHA256_CTX *);
 
+// One shot hash of a single buffer
+extern void MySHA256_Digest(void *pvDigest,
+							const void *pvData,
+							size_t Length);
+
+// Hash u32Count independent buffers. On hosts with AVX2 (and no SHA-NI) up
+// to 8 of them are hashed side by side, so this is the fast way to check a
+// batch of images.
+extern void MySHA256_Multi(uint8_t (*pu8Digests)[SHA256_DIGEST_LENGTH],
+						   const void **ppvData,
+						   const size_t *pLengths,
+						   uint32_t u32Count);
+
+// Returns the name of the SHA-256 kernel in use on this host
+extern const char *MySHA256_GetKernelName(void);
+
 #endif /* HEIM_SHA_H */
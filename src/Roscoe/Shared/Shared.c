@@ -425,6 +425,10 @@ static const SEStatusToText sg_sErrors[] =
 	{ESTATUS_KB_MOUSE_NOT_FOUND,							"Mouse not found"},
 	{ESTATUS_KB_CONTROLLER_RESET_FAULT,						"Keyboard failed reset command"},
 	{ESTATUS_KB_IDENT_FAULT,								"Keyboard reset/identity fault"},
+
+	// Network related
+	{ESTATUS_NIC_NOT_PRESENT,								"Network interface not present"},
+	{ESTATUS_NIC_SOCKET_OUT_OF_RANGE,						"Network socket out of range"},
 };
 
 static char sg_eErrorString[60];
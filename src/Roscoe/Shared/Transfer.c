@@ -0,0 +1,661 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <assert.h>
+#include "Shared/Shared.h"
+#include "BIOS/OS.h"
+#include "Hardware/Roscoe.h"
+#include "Shared/Transfer.h"
+#include "Shared/16550.h"
+#include "Shared/Stream.h"
+#include "Shared/ptc.h"
+#include "Shared/Interrupt.h"
+
+// Sliding window transfer receiver. The sender streams frames without
+// waiting, and we ACK every few frames with the next sequence # we need plus
+// a map of what we've buffered past it. The target is big endian, so the
+// wire structures are used as-is.
+
+// Send an ACK if we haven't heard from the sender in this long (milliseconds)
+#define	TRANSFER_ACK_TIMEOUT		250
+
+// Give up on a transfer if we haven't heard from the sender in this long (milliseconds)
+#define	TRANSFER_IDLE_TIMEOUT		5000
+
+// ACK at least this often (in accepted frames)
+#define	TRANSFER_ACK_INTERVAL		(TRANSFER_WINDOW / 4)
+
+// Which timer are we using to time things out?
+#define	TRANSFER_TIMER_CHANNEL		0
+
+// Timeouts converted to system ticks
+static uint32_t sg_u32AckTicks;
+static uint32_t sg_u32IdleTicks;
+
+// Build and send a frame
+static void TransferSendFrame(STransfer *psTransfer,
+							  ETransferFrameType eType,
+							  uint32_t u32Sequence,
+							  void *pvPayload,
+							  uint16_t u16Length)
+{
+	uint8_t u8Frame[sizeof(STransferFrameHeader) + sizeof(STransferAck) + sizeof(uint32_t)];
+	STransferFrameHeader *psHeader = (STransferFrameHeader *) u8Frame;
+	uint32_t u32CRC;
+
+	assert(u16Length <= sizeof(STransferAck));
+
+	psHeader->u16Sync = TRANSFER_SYNC;
+	psHeader->u8Type = (uint8_t) eType;
+	psHeader->u8Reserved = 0;
+	psHeader->u32Sequence = u32Sequence;
+	psHeader->u16Length = u16Length;
+	psHeader->u16LengthCheck = (uint16_t) ~u16Length;
+	memcpy((void *) (psHeader + 1), pvPayload, u16Length);
+
+	u32CRC = crc32(0,
+				   u8Frame,
+				   sizeof(*psHeader) + u16Length);
+	memcpy((void *) &u8Frame[sizeof(*psHeader) + u16Length], (void *) &u32CRC, sizeof(u32CRC));
+
+	(void) SerialTransmitDataAll(psTransfer->u8SerialIndex,
+								 u8Frame,
+								 sizeof(*psHeader) + u16Length + sizeof(u32CRC),
+								 NULL);
+}
+
+// Tell the sender where we are
+static void TransferSendAck(STransfer *psTransfer,
+							uint32_t u32TimerCount)
+{
+	STransferAck sAck;
+
+	sAck.u32NextSequence = psTransfer->u32NextSequence;
+	sAck.u32ReceivedMap = psTransfer->u32ReceivedMap;
+
+	TransferSendFrame(psTransfer,
+					  ETRANSFER_FRAME_ACK,
+					  0,
+					  &sAck,
+					  sizeof(sAck));
+
+	psTransfer->u8FramesSinceAck = 0;
+	psTransfer->u32LastAckTimer = u32TimerCount;
+}
+
+// Forget everything about the current transfer
+static void TransferReset(STransfer *psTransfer)
+{
+	if (psTransfer->bInflateInit)
+	{
+		(void) inflateEnd(&psTransfer->sInflate);
+		psTransfer->bInflateInit = false;
+	}
+
+	psTransfer->bActive = false;
+	psTransfer->bComplete = false;
+	psTransfer->bConsumerDone = false;
+	psTransfer->u32TransferID = 0;
+	psTransfer->u32DataSize = 0;
+	psTransfer->u32Offset = 0;
+	psTransfer->u32DataCRC32 = 0;
+	psTransfer->bDeflate = false;
+	psTransfer->u32NextSequence = 0;
+	psTransfer->u32ReceivedMap = 0;
+	psTransfer->u8FramesSinceAck = 0;
+}
+
+// Hand data to the consumer
+static EStatus TransferDeliverData(STransfer *psTransfer,
+								   uint8_t *pu8Data,
+								   uint16_t u16Length)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	if ((psTransfer->u32DataSize - psTransfer->u32Offset) < u16Length)
+	{
+		eStatus = ESTATUS_PROTOCOL_BLOCK_FAULT;
+		goto errorExit;
+	}
+
+	psTransfer->u32DataCRC32 = crc32(psTransfer->u32DataCRC32,
+									 pu8Data,
+									 u16Length);
+
+	if ((psTransfer->DataCallback) &&
+		(false == psTransfer->bConsumerDone))
+	{
+		eStatus = psTransfer->DataCallback(ESTATUS_OK,
+										   psTransfer->u32Offset,
+										   pu8Data,
+										   u16Length,
+										   psTransfer->pvUserData);
+
+		// The consumer has all it wants. The rest is still received and
+		// CRCed so the END frame can be checked before it's told it's done.
+		if (ESTATUS_TRANSFER_COMPLETE == eStatus)
+		{
+			psTransfer->bConsumerDone = true;
+			eStatus = ESTATUS_OK;
+		}
+	}
+
+	psTransfer->u32Offset += u16Length;
+
+errorExit:
+	return(eStatus);
+}
+
+// Hand a DATA frame's payload to the consumer, inflating it if need be
+static EStatus TransferDeliver(STransfer *psTransfer,
+							   uint8_t *pu8Data,
+							   uint16_t u16Length)
+{
+	EStatus eStatus = ESTATUS_OK;
+	int s32Result;
+	uint16_t u16Inflated;
+
+	if (false == psTransfer->bDeflate)
+	{
+		return(TransferDeliverData(psTransfer,
+								   pu8Data,
+								   u16Length));
+	}
+
+	psTransfer->sInflate.next_in = pu8Data;
+	psTransfer->sInflate.avail_in = u16Length;
+
+	do
+	{
+		psTransfer->sInflate.next_out = psTransfer->u8Inflate;
+		psTransfer->sInflate.avail_out = sizeof(psTransfer->u8Inflate);
+
+		s32Result = inflate(&psTransfer->sInflate,
+							Z_NO_FLUSH);
+		if ((s32Result != Z_OK) &&
+			(s32Result != Z_STREAM_END) &&
+			(s32Result != Z_BUF_ERROR))
+		{
+			eStatus = ESTATUS_PROTOCOL_BLOCK_FAULT;
+			goto errorExit;
+		}
+
+		u16Inflated = (uint16_t) (sizeof(psTransfer->u8Inflate) - psTransfer->sInflate.avail_out);
+		if (u16Inflated)
+		{
+			eStatus = TransferDeliverData(psTransfer,
+										  psTransfer->u8Inflate,
+										  u16Inflated);
+			ERR_GOTO();
+		}
+	}
+	while ((Z_OK == s32Result) &&
+		   ((psTransfer->sInflate.avail_in) || (0 == psTransfer->sInflate.avail_out)));
+
+errorExit:
+	return(eStatus);
+}
+
+// Process a START frame
+static void TransferStart(STransfer *psTransfer,
+						  STransferStart *psStart,
+						  uint16_t u16Length,
+						  uint32_t u32TimerCount)
+{
+	if ((psTransfer->bActive) &&
+		(psTransfer->u32TransferID == psStart->u32TransferID))
+	{
+		// Retransmit - they didn't get our ACK
+		TransferSendAck(psTransfer,
+						u32TimerCount);
+		return;
+	}
+
+	TransferReset(psTransfer);
+
+	if ((u16Length < sizeof(*psStart)) ||
+		(psStart->u8Version != TRANSFER_VERSION) ||
+		(psStart->u8Flags & ~TRANSFER_FLAG_DEFLATE))
+	{
+		TransferSendFrame(psTransfer,
+						  ETRANSFER_FRAME_CANCEL,
+						  0,
+						  NULL,
+						  0);
+		return;
+	}
+
+	if (psStart->u8Flags & TRANSFER_FLAG_DEFLATE)
+	{
+		memset((void *) &psTransfer->sInflate, 0, sizeof(psTransfer->sInflate));
+		if (inflateInit2(&psTransfer->sInflate, -MAX_WBITS) != Z_OK)
+		{
+			TransferSendFrame(psTransfer,
+							  ETRANSFER_FRAME_CANCEL,
+							  0,
+							  NULL,
+							  0);
+			return;
+		}
+
+		psTransfer->bInflateInit = true;
+		psTransfer->bDeflate = true;
+	}
+
+	psTransfer->bActive = true;
+	psTransfer->u32TransferID = psStart->u32TransferID;
+	psTransfer->u32DataSize = psStart->u32DataSize;
+	psTransfer->u32NextSequence = 1;
+
+	TransferSendAck(psTransfer,
+					u32TimerCount);
+}
+
+// Process an END frame once everything before it has been delivered
+static EStatus TransferEnd(STransfer *psTransfer,
+						   STransferEnd *psEnd,
+						   uint16_t u16Length)
+{
+	if ((u16Length < sizeof(*psEnd)) ||
+		(psTransfer->u32Offset != psTransfer->u32DataSize))
+	{
+		return(ESTATUS_PROTOCOL_BLOCK_FAULT);
+	}
+
+	if (psEnd->u32DataCRC32 != psTransfer->u32DataCRC32)
+	{
+		return(ESTATUS_PROTOCOL_BAD_CRC);
+	}
+
+	psTransfer->bComplete = true;
+	return(ESTATUS_OK);
+}
+
+// Something went wrong. Let the sender and the consumer know.
+static EStatus TransferAbort(STransfer *psTransfer,
+							 EStatus eStatus)
+{
+	TransferSendFrame(psTransfer,
+					  ETRANSFER_FRAME_CANCEL,
+					  0,
+					  NULL,
+					  0);
+
+	if (psTransfer->DataCallback)
+	{
+		(void) psTransfer->DataCallback(eStatus,
+										psTransfer->u32Offset,
+										NULL,
+										0,
+										psTransfer->pvUserData);
+	}
+
+	TransferReset(psTransfer);
+	return(ESTATUS_CANCELED);
+}
+
+// Process a sequenced (DATA or END) frame
+static EStatus TransferSequenced(STransfer *psTransfer,
+								 STransferFrameHeader *psHeader,
+								 uint32_t u32TimerCount)
+{
+	EStatus eStatus = ESTATUS_OK;
+	uint32_t u32WindowOffset;
+	uint8_t u8Slot;
+	bool bAckNow = false;
+
+	if (false == psTransfer->bActive)
+	{
+		// Haven't seen a START. The sender will resend this once it has one.
+		goto errorExit;
+	}
+
+	u32WindowOffset = psHeader->u32Sequence - psTransfer->u32NextSequence;
+	if (psHeader->u32Sequence < psTransfer->u32NextSequence)
+	{
+		// Already have it - they must have missed an ACK
+		bAckNow = true;
+		goto errorExit;
+	}
+
+	if (u32WindowOffset >= TRANSFER_WINDOW)
+	{
+		// Beyond our window
+		bAckNow = true;
+		goto errorExit;
+	}
+
+	// Anything other than the next one means there's a hole
+	if (u32WindowOffset)
+	{
+		bAckNow = true;
+	}
+
+	if (0 == (psTransfer->u32ReceivedMap & ((uint32_t) 1 << u32WindowOffset)))
+	{
+		u8Slot = (uint8_t) (psHeader->u32Sequence % TRANSFER_WINDOW);
+		psTransfer->u8WindowType[u8Slot] = psHeader->u8Type;
+		psTransfer->u16WindowLength[u8Slot] = psHeader->u16Length;
+		memcpy((void *) psTransfer->u8Window[u8Slot], (void *) (psHeader + 1), psHeader->u16Length);
+		psTransfer->u32ReceivedMap |= ((uint32_t) 1 << u32WindowOffset);
+		psTransfer->u8FramesSinceAck++;
+	}
+
+	// Hand over everything that's now in order
+	while ((psTransfer->u32ReceivedMap & 1) &&
+		   (false == psTransfer->bComplete))
+	{
+		u8Slot = (uint8_t) (psTransfer->u32NextSequence % TRANSFER_WINDOW);
+
+		if (ETRANSFER_FRAME_END == psTransfer->u8WindowType[u8Slot])
+		{
+			eStatus = TransferEnd(psTransfer,
+								  (STransferEnd *) psTransfer->u8Window[u8Slot],
+								  psTransfer->u16WindowLength[u8Slot]);
+			bAckNow = true;
+		}
+		else
+		{
+			eStatus = TransferDeliver(psTransfer,
+									  psTransfer->u8Window[u8Slot],
+									  psTransfer->u16WindowLength[u8Slot]);
+		}
+
+		if (eStatus != ESTATUS_OK)
+		{
+			eStatus = TransferAbort(psTransfer,
+									eStatus);
+			goto errorExit;
+		}
+
+		psTransfer->u32ReceivedMap >>= 1;
+		psTransfer->u32NextSequence++;
+	}
+
+	if (psTransfer->bComplete)
+	{
+		// Let the sender know before the consumer goes off and does something with it
+		TransferSendAck(psTransfer,
+						u32TimerCount);
+		bAckNow = false;
+
+		if (psTransfer->bConsumerDone)
+		{
+			// It finished with the data earlier. Now the END CRC has vouched for it.
+			eStatus = ESTATUS_TRANSFER_COMPLETE;
+		}
+		else
+		if (psTransfer->DataCallback)
+		{
+			eStatus = psTransfer->DataCallback(ESTATUS_TRANSFER_COMPLETE,
+											   psTransfer->u32Offset,
+											   NULL,
+											   0,
+											   psTransfer->pvUserData);
+		}
+	}
+
+errorExit:
+	if ((psTransfer->bActive) &&
+		((bAckNow) || (psTransfer->u8FramesSinceAck >= TRANSFER_ACK_INTERVAL)))
+	{
+		TransferSendAck(psTransfer,
+						u32TimerCount);
+	}
+
+	return(eStatus);
+}
+
+// A whole frame has arrived. Check it and act on it.
+static EStatus TransferProcessFrame(STransfer *psTransfer,
+									uint32_t u32TimerCount)
+{
+	EStatus eStatus = ESTATUS_OK;
+	STransferFrameHeader *psHeader = (STransferFrameHeader *) psTransfer->u8Frame;
+	uint32_t u32CRC;
+
+	memcpy((void *) &u32CRC, (void *) &psTransfer->u8Frame[sizeof(*psHeader) + psHeader->u16Length], sizeof(u32CRC));
+	if (crc32(0, psTransfer->u8Frame, sizeof(*psHeader) + psHeader->u16Length) != u32CRC)
+	{
+		// Damaged - the next ACK will show the hole
+		goto errorExit;
+	}
+
+	switch (psHeader->u8Type)
+	{
+		case ETRANSFER_FRAME_START:
+		{
+			TransferStart(psTransfer,
+						  (STransferStart *) (psHeader + 1),
+						  psHeader->u16Length,
+						  u32TimerCount);
+			break;
+		}
+
+		case ETRANSFER_FRAME_DATA:
+		case ETRANSFER_FRAME_END:
+		{
+			eStatus = TransferSequenced(psTransfer,
+										psHeader,
+										u32TimerCount);
+			break;
+		}
+
+		case ETRANSFER_FRAME_CANCEL:
+		{
+			if (psTransfer->bActive)
+			{
+				if ((false == psTransfer->bComplete) &&
+					(psTransfer->DataCallback))
+				{
+					(void) psTransfer->DataCallback(ESTATUS_CANCELED,
+													psTransfer->u32Offset,
+													NULL,
+													0,
+													psTransfer->pvUserData);
+				}
+
+				TransferReset(psTransfer);
+			}
+			break;
+		}
+
+		default:
+		{
+			// Not for us
+			break;
+		}
+	}
+
+errorExit:
+	return(eStatus);
+}
+
+// Pull in whatever the UART has and act on any complete frames
+EStatus TransferPump(STransfer *psTransfer)
+{
+	EStatus eStatus = ESTATUS_OK;
+	STransferFrameHeader *psHeader = (STransferFrameHeader *) psTransfer->u8Frame;
+	uint32_t u32InterruptTimerCount;
+	uint16_t u16Needed;
+	uint16_t u16BytesReceived;
+
+	eStatus = PTCGetInterruptCounter(TRANSFER_TIMER_CHANNEL,
+									 &u32InterruptTimerCount);
+	ERR_GOTO();
+
+	for (;;)
+	{
+		if (psTransfer->u16FrameOffset < sizeof(*psHeader))
+		{
+			u16Needed = sizeof(*psHeader) - psTransfer->u16FrameOffset;
+		}
+		else
+		{
+			u16Needed = (sizeof(*psHeader) + psHeader->u16Length + sizeof(uint32_t)) - psTransfer->u16FrameOffset;
+		}
+
+		eStatus = SerialReceiveData(psTransfer->u8SerialIndex,
+									&psTransfer->u8Frame[psTransfer->u16FrameOffset],
+									u16Needed,
+									&u16BytesReceived);
+		ERR_GOTO();
+
+		if (0 == u16BytesReceived)
+		{
+			if (false == psTransfer->bActive)
+			{
+				// Nothing going on
+			}
+			else
+			if ((u32InterruptTimerCount - psTransfer->u32LastTimerInterrupt) >= sg_u32IdleTicks)
+			{
+				// Sender has gone away
+				if ((false == psTransfer->bComplete) &&
+					(psTransfer->DataCallback))
+				{
+					(void) psTransfer->DataCallback(ESTATUS_TIMEOUT,
+													psTransfer->u32Offset,
+													NULL,
+													0,
+													psTransfer->pvUserData);
+				}
+
+				TransferReset(psTransfer);
+			}
+			else
+			if ((false == psTransfer->bComplete) &&
+				((u32InterruptTimerCount - psTransfer->u32LastAckTimer) >= sg_u32AckTicks) &&
+				((u32InterruptTimerCount - psTransfer->u32LastTimerInterrupt) >= sg_u32AckTicks))
+			{
+				// Things have gone quiet. Nudge the sender.
+				TransferSendAck(psTransfer,
+								u32InterruptTimerCount);
+			}
+
+			break;
+		}
+
+		psTransfer->u32LastTimerInterrupt = u32InterruptTimerCount;
+		psTransfer->u16FrameOffset += u16BytesReceived;
+
+		if (psTransfer->u16FrameOffset == sizeof(*psHeader))
+		{
+			// Header's in. If it doesn't look right, slide along a byte and look again.
+			if ((psHeader->u16Sync != TRANSFER_SYNC) ||
+				((psHeader->u16LengthCheck ^ psHeader->u16Length) != 0xffff) ||
+				(psHeader->u16Length > TRANSFER_PAYLOAD_MAX))
+			{
+				psTransfer->u16FrameOffset--;
+				memmove((void *) psTransfer->u8Frame, (void *) &psTransfer->u8Frame[1], psTransfer->u16FrameOffset);
+			}
+		}
+		else
+		if (psTransfer->u16FrameOffset == (sizeof(*psHeader) + psHeader->u16Length + sizeof(uint32_t)))
+		{
+			psTransfer->u16FrameOffset = 0;
+
+			eStatus = TransferProcessFrame(psTransfer,
+										   u32InterruptTimerCount);
+			ERR_GOTO();
+
+			// If the sender has paused, bring it up to date now rather than
+			// waiting for TRANSFER_ACK_INTERVAL frames
+			if ((psTransfer->bActive) &&
+				(psTransfer->u8FramesSinceAck))
+			{
+				uint16_t u16Pending = 0;
+
+				(void) SerialReceiveDataGetCount(psTransfer->u8SerialIndex,
+												 &u16Pending);
+				if (0 == u16Pending)
+				{
+					TransferSendAck(psTransfer,
+									u32InterruptTimerCount);
+				}
+			}
+		}
+	}
+
+errorExit:
+	return(eStatus);
+}
+
+// Init a transfer receiver
+EStatus TransferInit(STransfer *psTransfer,
+					 uint8_t u8SerialIndex,
+					 uint32_t u32BaudRate,
+					 void *pvUserData,
+					 EStatus (*DataCallback)(EStatus eStatus,
+											 uint32_t u32Offset,
+											 uint8_t *pu8RXData,
+											 uint16_t u16BytesReceived,
+											 void *pvUserData))
+{
+	EStatus eStatus;
+	bool bResult;
+	uint32_t u32InterruptRate;
+
+	// Turn timeouts to ticks
+	eStatus = PTCGetInterruptRate(TRANSFER_TIMER_CHANNEL,
+								  &u32InterruptRate);
+	ERR_GOTO();
+
+	sg_u32AckTicks = TRANSFER_ACK_TIMEOUT / (1000 / u32InterruptRate);
+	sg_u32IdleTicks = TRANSFER_IDLE_TIMEOUT / (1000 / u32InterruptRate);
+
+	// Clear out our structure
+	ZERO_STRUCT(*psTransfer);
+
+	// Fill in appropriate info
+	psTransfer->u8SerialIndex = u8SerialIndex;
+	psTransfer->DataCallback = DataCallback;
+	psTransfer->pvUserData = pvUserData;
+
+	// Wait for the console UART to clear its buffer
+	eStatus = SerialFlush(0);
+	ERR_GOTO();
+
+	// Shut off all UART B's interrupts
+	eStatus = InterruptMaskSet(INTVECT_IRQ4B_UART2,
+							   true);
+	ERR_GOTO();
+
+	// Init UART B
+	bResult = SerialInit((S16550UART *) ROSCOE_UART_B,
+						 8,
+						 1,
+						 EUART_PARITY_NONE);
+	assert(bResult);
+
+	// Turn on interrupts for both UARTs
+	eStatus = StreamSetConsoleSerialInterruptMode(true);
+	if (eStatus != ESTATUS_OK)
+	{
+		printf("StreamSetConsoleSerialInterruptMode failed - %s\n", GetErrorText(eStatus));
+		goto errorExit;
+	}
+
+	// Turn on RTS and DTR and the OUTs
+	SerialSetOutputs((S16550UART *) ROSCOE_UART_B,
+					 true,
+					 true,
+					 true,
+					 true);
+
+	// Set UART B's baud rate
+	SerialSetBaudRate((S16550UART *) ROSCOE_UART_B,
+					  UART_BAUD_CLOCK,
+					  u32BaudRate,
+					  NULL);
+
+	// Now reenable interrupts
+	eStatus = InterruptMaskSet(INTVECT_IRQ4B_UART2,
+							   false);
+
+errorExit:
+	return(eStatus);
+}
@@ -0,0 +1,57 @@
+#ifndef _TRANSFER_H_
+#define _TRANSFER_H_
+
+#include "Shared/TransferProtocol.h"
+#include "Shared/zlib/zlib.h"
+
+typedef struct STransfer
+{
+	uint8_t u8SerialIndex;			// Which UART are we dealing with?
+	uint32_t u32LastTimerInterrupt;	// Last time we heard from the sender
+	uint32_t u32LastAckTimer;		// Last time we sent an ACK
+
+	// Frame being received
+	uint8_t u8Frame[TRANSFER_FRAME_MAX];
+	uint16_t u16FrameOffset;		// How much of it we have so far
+
+	// Current transfer
+	bool bActive;					// Have we seen a START?
+	bool bComplete;					// Have we seen the END?
+	bool bConsumerDone;				// Has the consumer got all it wants?
+	uint32_t u32TransferID;			// From the START frame
+	uint32_t u32DataSize;			// Expected size of the data
+	uint32_t u32Offset;				// Overall offset within the data
+	uint32_t u32DataCRC32;			// CRC32 of everything delivered so far
+	bool bDeflate;					// Is the stream compressed?
+	bool bInflateInit;				// Has sInflate been initialized?
+	z_stream sInflate;
+	uint8_t u8Inflate[TRANSFER_PAYLOAD_MAX];
+
+	// Receive window
+	uint32_t u32NextSequence;		// Next sequence # to hand to the consumer
+	uint32_t u32ReceivedMap;		// Bit n set = u32NextSequence + n is in the window
+	uint8_t u8FramesSinceAck;		// Frames accepted since the last ACK
+	uint8_t u8WindowType[TRANSFER_WINDOW];
+	uint16_t u16WindowLength[TRANSFER_WINDOW];
+	uint8_t u8Window[TRANSFER_WINDOW][TRANSFER_PAYLOAD_MAX];
+
+	void *pvUserData;				// User data to pass to the callback
+	EStatus (*DataCallback)(EStatus eStatus,
+							uint32_t u32Offset,
+							uint8_t *pu8RXData,
+							uint16_t u16BytesReceived,
+							void *pvUserData);
+} STransfer;
+
+extern EStatus TransferInit(STransfer *psTransfer,
+							uint8_t u8SerialIndex,
+							uint32_t u32BaudRate,
+							void *pvUserData,
+							EStatus (*DataCallback)(EStatus eStatus,
+													uint32_t u32Offset,
+													uint8_t *pu8RXData,
+													uint16_t u16BytesReceived,
+													void *pvUserData));
+extern EStatus TransferPump(STransfer *psTransfer);
+
+#endif
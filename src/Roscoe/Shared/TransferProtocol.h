@@ -0,0 +1,94 @@
+#ifndef _TRANSFERPROTOCOL_H_
+#define _TRANSFERPROTOCOL_H_
+
+// Wire format for the sliding window transfer protocol. Shared between the
+// monitor (receiver) and the host uploader (sender). Everything on the wire
+// is big endian.
+//
+// Every frame is an STransferFrameHeader, u16Length bytes of payload, then a
+// CRC32 (zlib's, seeded with 0) of the header and payload. Frames the sender
+// sends (START, DATA, END) are numbered consecutively from 0 and the
+// receiver buffers up to TRANSFER_WINDOW of them out of order, so a lost or
+// damaged frame only costs a retransmit of that frame.
+
+// Frame sync ("XF")
+#define	TRANSFER_SYNC				0x5846
+
+// Protocol version (in the START frame)
+#define	TRANSFER_VERSION			1
+
+// Largest payload in a frame
+#define	TRANSFER_PAYLOAD_MAX		1024
+
+// # Of frames the sender may have outstanding past the receiver's next
+// expected sequence #. Must be <= 32 (size of the ACK's received map).
+#define	TRANSFER_WINDOW				16
+
+// Largest frame on the wire
+#define	TRANSFER_FRAME_MAX			(sizeof(STransferFrameHeader) + TRANSFER_PAYLOAD_MAX + sizeof(uint32_t))
+
+// Frame types
+typedef enum
+{
+	ETRANSFER_FRAME_START = 1,		// Sender->receiver - STransferStart, always sequence 0
+	ETRANSFER_FRAME_DATA,			// Sender->receiver - up to TRANSFER_PAYLOAD_MAX bytes of stream data
+	ETRANSFER_FRAME_END,			// Sender->receiver - STransferEnd, last sequence #
+	ETRANSFER_FRAME_ACK,			// Receiver->sender - STransferAck
+	ETRANSFER_FRAME_FINISHED,		// Receiver->sender - receiver has everything it wants (no payload)
+	ETRANSFER_FRAME_CANCEL			// Either direction - abort the transfer (no payload)
+} ETransferFrameType;
+
+// START frame flags
+#define	TRANSFER_FLAG_DEFLATE		0x01	// Stream is raw deflate (no zlib/gzip wrapper)
+
+#ifdef _WIN32
+#pragma pack(push, 1)
+typedef struct STransferFrameHeader
+#else
+typedef struct __attribute__ ((packed)) STransferFrameHeader
+#endif
+{
+	uint16_t u16Sync;				// TRANSFER_SYNC
+	uint8_t u8Type;					// ETransferFrameType
+	uint8_t u8Reserved;
+	uint32_t u32Sequence;			// Sequence # (0 for ACK/FINISHED/CANCEL)
+	uint16_t u16Length;				// Payload length
+	uint16_t u16LengthCheck;		// ~u16Length so a damaged length doesn't stall the receiver
+} STransferFrameHeader;
+
+#ifdef _WIN32
+typedef struct STransferStart
+#else
+typedef struct __attribute__ ((packed)) STransferStart
+#endif
+{
+	uint32_t u32TransferID;			// Picked by the sender - a repeated START with the same ID is a retransmit
+	uint8_t u8Version;				// TRANSFER_VERSION
+	uint8_t u8Flags;				// TRANSFER_FLAG_*
+	uint16_t u16Reserved;
+	uint32_t u32DataSize;			// Size of the data once inflated (if applicable)
+} STransferStart;
+
+#ifdef _WIN32
+typedef struct STransferEnd
+#else
+typedef struct __attribute__ ((packed)) STransferEnd
+#endif
+{
+	uint32_t u32DataCRC32;			// CRC32 of the data once inflated (if applicable)
+} STransferEnd;
+
+#ifdef _WIN32
+typedef struct STransferAck
+#else
+typedef struct __attribute__ ((packed)) STransferAck
+#endif
+{
+	uint32_t u32NextSequence;		// Everything before this has been received
+	uint32_t u32ReceivedMap;		// Bit n set = u32NextSequence + n has been received
+} STransferAck;
+#ifdef _WIN32
+#pragma pack(pop)
+#endif
+
+#endif
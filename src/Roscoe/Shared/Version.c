@@ -26,7 +26,9 @@ static const SVersionCodeText sg_sVersionCodeTable[] =
 	{EVERSION_BAD_BSS_START,		"Bad start of _bss"},
 	{EVERSION_BAD_END,				"Bad _end"},
 	{EVERSION_BAD_STACK_TOP,		"Bad top of stack"},
-	{EVERSION_BAD_IMAGE_SIZE,		"Bad image size"}
+	{EVERSION_BAD_IMAGE_SIZE,		"Bad image size"},
+	{EVERSION_BAD_ZIMAGE_HEADER,	"Bad compressed image header"},
+	{EVERSION_BAD_ZIMAGE_DATA,		"Bad compressed image data"}
 };
 
 // Returns textual equivalent of eVersionCode
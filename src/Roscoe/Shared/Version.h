@@ -30,7 +30,9 @@ typedef enum
 	EVERSION_BAD_BSS_START,
 	EVERSION_BAD_END,
 	EVERSION_BAD_STACK_TOP,
-	EVERSION_BAD_IMAGE_SIZE
+	EVERSION_BAD_IMAGE_SIZE,
+	EVERSION_BAD_ZIMAGE_HEADER,
+	EVERSION_BAD_ZIMAGE_DATA
 } EVersionCode;
 
 // Firmware version structure
@@ -0,0 +1,172 @@
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include "Shared/ZImage.h"
+#include "Shared/zlib/zlib.h"
+
+// How much compressed data gets pulled out of flash at a time
+#define	ZIMAGE_READ_CHUNK			4096
+
+// Flash is read into here so it's only touched once
+static uint8_t sg_u8ZImageReadBuffer[ZIMAGE_READ_CHUNK];
+
+#ifdef _BOOTLOADER
+// The boot loader doesn't link zutil.c (it needs the BIOS status codes), so
+// inflate's default allocator lives here
+void *zcalloc(void *pvOpaque,
+			  unsigned int u32Items,
+			  unsigned int u32Size)
+{
+	(void) pvOpaque;
+	return(calloc(u32Items, u32Size));
+}
+
+void zcfree(void *pvOpaque,
+			void *pvPtr)
+{
+	(void) pvOpaque;
+	free(pvPtr);
+}
+#endif
+
+bool ZImageIsPresent(const uint8_t *pu8Image)
+{
+	SZImageHeader sHeader;
+
+	memcpy((void *) &sHeader, (void *) pu8Image, sizeof(sHeader));
+	return((ZIMAGE_SIGNATURE == sHeader.u32Signature) ? true : false);
+}
+
+EVersionCode ZImageInflate(const uint8_t *pu8Image,
+						   uint32_t u32ImageSize,
+						   uint8_t *pu8Destination,
+						   uint32_t u32DestinationSize,
+						   uint32_t *pu32InflatedSize)
+{
+	EVersionCode eVersionCode;
+	SZImageHeader sHeader;
+	z_stream sStream;
+	uint32_t u32CompressedCRC = 0;
+	uint32_t u32UncompressedCRC = 0;
+	uint32_t u32Offset;
+	uint32_t u32Remaining;
+	int s32Result = Z_OK;
+	bool bStreamInit = false;
+
+	if (u32ImageSize < sizeof(sHeader))
+	{
+		eVersionCode = EVERSION_BAD_ZIMAGE_HEADER;
+		goto errorExit;
+	}
+
+	memcpy((void *) &sHeader, (void *) pu8Image, sizeof(sHeader));
+
+	// Sanity check the header before trusting any of it
+	if ((sHeader.u32Signature != ZIMAGE_SIGNATURE) ||
+		(sHeader.u16Version != ZIMAGE_VERSION) ||
+		(sHeader.u16HeaderSize < sizeof(sHeader)) ||
+		(sHeader.u32HeaderCRC32 != crc32(0, (const unsigned char *) &sHeader, offsetof(SZImageHeader, u32HeaderCRC32))))
+	{
+		eVersionCode = EVERSION_BAD_ZIMAGE_HEADER;
+		goto errorExit;
+	}
+
+	if ((sHeader.u32CompressedSize > (u32ImageSize - sHeader.u16HeaderSize)) ||
+		(sHeader.u32UncompressedSize > u32DestinationSize))
+	{
+		eVersionCode = EVERSION_BAD_IMAGE_SIZE;
+		goto errorExit;
+	}
+
+	// Raw deflate - the header carries the checks
+	memset((void *) &sStream, 0, sizeof(sStream));
+	if (inflateInit2(&sStream, -MAX_WBITS) != Z_OK)
+	{
+		eVersionCode = EVERSION_BAD_ZIMAGE_DATA;
+		goto errorExit;
+	}
+
+	bStreamInit = true;
+	sStream.next_out = pu8Destination;
+	sStream.avail_out = sHeader.u32UncompressedSize;
+
+	u32Offset = sHeader.u16HeaderSize;
+	u32Remaining = sHeader.u32CompressedSize;
+	while ((u32Remaining) &&
+		   (s32Result != Z_STREAM_END))
+	{
+		uint32_t u32Chunk = u32Remaining;
+
+		if (u32Chunk > sizeof(sg_u8ZImageReadBuffer))
+		{
+			u32Chunk = sizeof(sg_u8ZImageReadBuffer);
+		}
+
+		memcpy((void *) sg_u8ZImageReadBuffer, (void *) (pu8Image + u32Offset), u32Chunk);
+		u32CompressedCRC = crc32(u32CompressedCRC,
+								 sg_u8ZImageReadBuffer,
+								 u32Chunk);
+
+		sStream.next_in = sg_u8ZImageReadBuffer;
+		sStream.avail_in = u32Chunk;
+
+		while (sStream.avail_in)
+		{
+			uint8_t *pu8Output = sStream.next_out;
+
+			s32Result = inflate(&sStream, Z_NO_FLUSH);
+
+			// CRC what just came out while it's still in the cache
+			u32UncompressedCRC = crc32(u32UncompressedCRC,
+									   pu8Output,
+									   (uint32_t) (sStream.next_out - pu8Output));
+
+			if (Z_STREAM_END == s32Result)
+			{
+				break;
+			}
+
+			if (s32Result != Z_OK)
+			{
+				eVersionCode = EVERSION_BAD_ZIMAGE_DATA;
+				goto errorExit;
+			}
+		}
+
+		u32Offset += u32Chunk;
+		u32Remaining -= u32Chunk;
+	}
+
+	if ((s32Result != Z_STREAM_END) ||
+		(u32Remaining) ||
+		(sStream.avail_in) ||
+		(sStream.total_out != sHeader.u32UncompressedSize))
+	{
+		eVersionCode = EVERSION_BAD_ZIMAGE_DATA;
+		goto errorExit;
+	}
+
+	if ((u32CompressedCRC != sHeader.u32CompressedCRC32) ||
+		(u32UncompressedCRC != sHeader.u32UncompressedCRC32))
+	{
+		eVersionCode = EVERSION_BAD_IMAGE_CRC;
+		goto errorExit;
+	}
+
+	if (pu32InflatedSize)
+	{
+		*pu32InflatedSize = sHeader.u32UncompressedSize;
+	}
+
+	eVersionCode = EVERSION_OK;
+
+errorExit:
+	if (bStreamInit)
+	{
+		(void) inflateEnd(&sStream);
+	}
+
+	return(eVersionCode);
+}
@@ -0,0 +1,49 @@
+#ifndef _ZIMAGE_H_
+#define _ZIMAGE_H_
+
+#include <stdbool.h>
+
+#include "Shared/Version.h"
+
+// Compressed operational image header. A compressed image is this header
+// followed by u32CompressedSize bytes of raw deflate data. Like the version
+// structure, all fields are big endian.
+#ifdef _WIN32
+#pragma pack(push, 1)
+typedef struct SZImageHeader
+#else
+typedef struct __attribute__ ((packed)) __attribute ((aligned (4))) SZImageHeader
+#endif
+{
+	uint32_t u32Signature;				// ZIMAGE_SIGNATURE
+	uint16_t u16Version;				// ZIMAGE_VERSION
+	uint16_t u16HeaderSize;				// Offset of the compressed data from the start of the header
+	uint32_t u32CompressedSize;			// Size of the deflate data
+	uint32_t u32CompressedCRC32;		// CRC32 of the deflate data
+	uint32_t u32UncompressedSize;		// Size of the image once inflated
+	uint32_t u32UncompressedCRC32;		// CRC32 of the image once inflated
+	uint32_t u32HeaderCRC32;			// CRC32 of everything above this field
+} SZImageHeader;
+#ifdef _WIN32
+#pragma pack(pop)
+#endif
+
+// "ZIMG"
+#define	ZIMAGE_SIGNATURE			0x5a494d47
+
+// Header version
+#define	ZIMAGE_VERSION				1
+
+// Inflates the compressed image at pu8Image (up to u32ImageSize bytes of
+// flash) into pu8Destination. Flash is read once - each chunk is CRC'd and
+// inflated on the way through, and the output is CRC'd as it's produced.
+extern EVersionCode ZImageInflate(const uint8_t *pu8Image,
+								  uint32_t u32ImageSize,
+								  uint8_t *pu8Destination,
+								  uint32_t u32DestinationSize,
+								  uint32_t *pu32InflatedSize);
+
+// Returns true if there's a compressed image header at pu8Image
+extern bool ZImageIsPresent(const uint8_t *pu8Image);
+
+#endif
@@ -11,6 +11,14 @@
 
 // NOTE: This module is not endian safe and assumes big endian. It is by no means
 // a complete implementation of an ELF loader.
+//
+// The loader is a streaming state machine fed straight from the transfer
+// protocol's receive buffers. It takes in the ELF header and the program header
+// table, then copies each PT_LOAD segment to its final address as the bytes
+// arrive. BSS is zeroed a chunk at a time in between incoming blocks, so once
+// the last byte of the last segment lands the image is ready to run. The
+// transfer layer still takes in what follows (section headers, symbols,
+// etc...) so the END frame's CRC32 is checked before the image is run.
 
 // Standard ELF header
 static const uint8_t sg_u8ELFHeader[] = {0x7f, 0x45, 0x4c, 0x46};
@@ -29,6 +37,9 @@ static const uint8_t sg_u8ELFHeader[] = {0x7f, 0x45, 0x4c, 0x46};
 // Program header p_type values
 #define	PT_LOAD					0x0001		// Loadable segment
 
+// # Of BSS bytes to zero per incoming block while the transfer is running
+#define	ELF_BSS_ZERO_CHUNK		4096
+
 // ELF 32 bit program info
 typedef struct SELFHeaderProgram32
 {
@@ -37,6 +48,229 @@ typedef struct SELFHeaderProgram32
 	uint32_t u32SectionHeaderTable;	// Section header table
 } __attribute__((packed)) SELFHeaderProgram32;
 
+// Copies data to its final location, or zeroes it if pu8Source is NULL. Anything
+// in the first ELF_VECTOR_TABLE_SIZE bytes of the address space is held in the
+// vector table shadow since the monitor is still using its own vectors.
+static EStatus ELFPlace(SELF *psELF,
+						uint32_t u32Address,
+						uint8_t *pu8Source,
+						uint32_t u32Length)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	if (u32Address < sizeof(psELF->u8VectorTable))
+	{
+		uint32_t u32Chunk;
+
+		u32Chunk = sizeof(psELF->u8VectorTable) - u32Address;
+		if (u32Chunk > u32Length)
+		{
+			u32Chunk = u32Length;
+		}
+
+		if (pu8Source)
+		{
+			memcpy((void *) &psELF->u8VectorTable[u32Address],
+				   (void *) pu8Source,
+				   u32Chunk);
+			pu8Source += u32Chunk;
+		}
+		else
+		{
+			memset((void *) &psELF->u8VectorTable[u32Address], 0, u32Chunk);
+		}
+
+		// Keep track of how much of it needs installing
+		if (u32Address < psELF->u32VectorTableLow)
+		{
+			psELF->u32VectorTableLow = u32Address;
+		}
+
+		if ((u32Address + u32Chunk) > psELF->u32VectorTableHigh)
+		{
+			psELF->u32VectorTableHigh = u32Address + u32Chunk;
+		}
+
+		u32Address += u32Chunk;
+		u32Length -= u32Chunk;
+	}
+
+	if (0 == u32Length)
+	{
+		// All in the vector table
+	}
+	else
+	if (pu8Source)
+	{
+		memcpy((void *) u32Address,
+			   (void *) pu8Source,
+			   u32Length);
+
+		// Read it back. The data itself is already CRC checked by the transfer
+		// protocol - this catches a load address with nothing (or ROM) behind it.
+		if (memcmp((void *) u32Address,
+				   (void *) pu8Source,
+				   u32Length) != 0)
+		{
+			printf("Segment data at 0x%.8x-0x%.8x didn't read back correctly\n",
+				   u32Address,
+				   u32Address + u32Length - 1);
+			eStatus = ESTATUS_CANCELED;
+		}
+	}
+	else
+	{
+		memset((void *) u32Address, 0, u32Length);
+	}
+
+	return(eStatus);
+}
+
+// Zeroes up to u32Budget bytes of outstanding BSS
+static EStatus ELFZeroBSS(SELF *psELF,
+						  uint32_t u32Budget)
+{
+	EStatus eStatus = ESTATUS_OK;
+
+	while ((psELF->u8SegmentBSS < psELF->u8SegmentCount) &&
+		   (u32Budget))
+	{
+		SELFSegment *psSegment = &psELF->sSegments[psELF->u8SegmentBSS];
+		uint32_t u32Chunk;
+
+		u32Chunk = psSegment->u32MemorySize - psSegment->u32FileSize - psSegment->u32Zeroed;
+		if (0 == u32Chunk)
+		{
+			// This one's done
+			psELF->u8SegmentBSS++;
+			continue;
+		}
+
+		if (u32Chunk > u32Budget)
+		{
+			u32Chunk = u32Budget;
+		}
+
+		eStatus = ELFPlace(psELF,
+						   psSegment->u32Address + psSegment->u32FileSize + psSegment->u32Zeroed,
+						   NULL,
+						   u32Chunk);
+		ERR_GOTO();
+
+		psSegment->u32Zeroed += u32Chunk;
+		u32Budget -= u32Chunk;
+	}
+
+errorExit:
+	return(eStatus);
+}
+
+// Pulls the loadable segments out of the program header table and sorts them
+// by file offset, since that's the order they'll arrive in.
+static EStatus ELFSegmentsBuild(SELF *psELF,
+								uint16_t u16ProgramHeaderCount)
+{
+	SELFProgramHeader32 *psELFProgramHeader32 = (SELFProgramHeader32 *) psELF->u8ProgramHeader;
+	uint32_t u32FileOffset = psELF->u32ELFOffset;
+	uint16_t u16Loop;
+	uint8_t u8Index;
+
+	psELF->u8SegmentCount = 0;
+	psELF->u32LoadTotal = 0;
+
+	for (u16Loop = 0; u16Loop < u16ProgramHeaderCount; u16Loop++, psELFProgramHeader32++)
+	{
+		SELFSegment *psSegment;
+
+		// Anything that isn't loadable (notes, stack hints, etc...) doesn't concern us
+		if ((psELFProgramHeader32->u32Type != PT_LOAD) ||
+			(0 == psELFProgramHeader32->u32MemoryFileImage))
+		{
+			continue;
+		}
+
+		if (psELFProgramHeader32->u32SegmentFileImage > psELFProgramHeader32->u32MemoryFileImage)
+		{
+			printf("Segment at 0x%.8x has a file size larger than its memory size\n", psELFProgramHeader32->u32PhysicalAddress);
+			return(ESTATUS_CANCELED);
+		}
+
+		// Insertion sort by file offset
+		u8Index = psELF->u8SegmentCount;
+		while ((u8Index) &&
+			   (psELF->sSegments[u8Index - 1].u32Offset > psELFProgramHeader32->u32SegmentOffset))
+		{
+			psELF->sSegments[u8Index] = psELF->sSegments[u8Index - 1];
+			--u8Index;
+		}
+
+		psSegment = &psELF->sSegments[u8Index];
+		psSegment->u32Offset = psELFProgramHeader32->u32SegmentOffset;
+		psSegment->u32Address = psELFProgramHeader32->u32PhysicalAddress;
+		psSegment->u32FileSize = psELFProgramHeader32->u32SegmentFileImage;
+		psSegment->u32MemorySize = psELFProgramHeader32->u32MemoryFileImage;
+		psSegment->u32Zeroed = 0;
+
+		psELF->u8SegmentCount++;
+		psELF->u32LoadTotal += psSegment->u32FileSize;
+	}
+
+	if (0 == psELF->u8SegmentCount)
+	{
+		printf("No PT_LOAD segments in image\n");
+		return(ESTATUS_CANCELED);
+	}
+
+	// The file only goes forward, so segment data can't come before the end of
+	// the headers or overlap the previous segment's data.
+	for (u8Index = 0; u8Index < psELF->u8SegmentCount; u8Index++)
+	{
+		SELFSegment *psSegment = &psELF->sSegments[u8Index];
+
+		printf("Program load address of 0x%.8x for 0x%.8x bytes",
+			   psSegment->u32Address,
+			   psSegment->u32FileSize);
+		if (psSegment->u32MemorySize != psSegment->u32FileSize)
+		{
+			printf(" (+0x%.8x zeroed)", psSegment->u32MemorySize - psSegment->u32FileSize);
+		}
+		printf("\n");
+
+		if (0 == psSegment->u32FileSize)
+		{
+			continue;
+		}
+
+		if (psSegment->u32Offset < u32FileOffset)
+		{
+			printf("Segment at file offset 0x%.8x overlaps data before it in the file\n", psSegment->u32Offset);
+			return(ESTATUS_CANCELED);
+		}
+
+		u32FileOffset = psSegment->u32Offset + psSegment->u32FileSize;
+	}
+
+	return(ESTATUS_OK);
+}
+
+// Moves on to the next segment with data in the file. Returns false if there
+// aren't any more.
+static bool ELFSegmentNext(SELF *psELF)
+{
+	while (psELF->u8Segment < psELF->u8SegmentCount)
+	{
+		if (psELF->sSegments[psELF->u8Segment].u32FileSize)
+		{
+			psELF->eELFState = ELFSTATE_PROGRAM_FIND;
+			return(true);
+		}
+
+		psELF->u8Segment++;
+	}
+
+	return(false);
+}
+
 // Process the incoming ELF state machine data
 EStatus ELFProcessRXData(SELF *psELF,
 						 uint8_t *pu8Buffer,
@@ -45,7 +279,7 @@ EStatus ELFProcessRXData(SELF *psELF,
 	EStatus eStatus = ESTATUS_OK;
 	SELFHeaderPrefix *psELFPrefix = (SELFHeaderPrefix *) psELF->u8ELFHeader;
 	SELFHeaderProgram32 *psELFHeaderProgram32 = (SELFHeaderProgram32 *) (psELFPrefix + 1);
-	SELFProgramHeader32 *psELFProgramHeader32 = (SELFProgramHeader32 *) psELF->u8ProgramHeader;
+	SELFHeaderSuffix *psELFSuffix = (SELFHeaderSuffix *) (psELFHeaderProgram32 + 1);
 
 	while (u32DataLength)
 	{
@@ -158,6 +392,26 @@ EStatus ELFProcessRXData(SELF *psELF,
 				// See if we're done or not
 				if (psELF->u32DataOffset >= psELF->u32DataSize)
 				{
+					// Make sure we can hold the program header table
+					if (psELFSuffix->u16PHentSize != sizeof(SELFProgramHeader32))
+					{
+						printf("Unexpected program header size of %u bytes\n", psELFSuffix->u16PHentSize);
+						goto errorExitCancel;
+					}
+
+					if ((0 == psELFSuffix->u16PNum) ||
+						(psELFSuffix->u16PNum > ELF_PROGRAM_HEADERS_MAX))
+					{
+						printf("Program header count of %u not supported (max %u)\n", psELFSuffix->u16PNum, ELF_PROGRAM_HEADERS_MAX);
+						goto errorExitCancel;
+					}
+
+					if (psELFHeaderProgram32->u32ProgramHeaderTable < psELF->u32ELFOffset)
+					{
+						printf("Program header table at 0x%.8x overlaps the ELF header\n", psELFHeaderProgram32->u32ProgramHeaderTable);
+						goto errorExitCancel;
+					}
+
 					// Go find the program header
 					psELF->eELFState = ELFSTATE_PROGRAM_HEADER_FIND;
 				}
@@ -169,17 +423,16 @@ EStatus ELFProcessRXData(SELF *psELF,
 			{
 				uint32_t u32Chunk;
 
-				assert(psELF->u32DataOffset <= psELFHeaderProgram32->u32ProgramHeaderTable);
-				u32Chunk = psELFHeaderProgram32->u32ProgramHeaderTable - psELF->u32DataOffset;
+				u32Chunk = psELFHeaderProgram32->u32ProgramHeaderTable - psELF->u32ELFOffset;
 
 				if (0 == u32Chunk)
 				{
-					// We're here already! Advance 
+					// We're here already! Advance
 					psELF->eELFState = ELFSTATE_PROGRAM_HEADER_CONSUME;
 
 					psELF->pu8DataPtr = psELF->u8ProgramHeader;
 					psELF->u32DataOffset = 0;
-					psELF->u32DataSize = sizeof(SELFProgramHeader32);
+					psELF->u32DataSize = psELFSuffix->u16PNum * sizeof(SELFProgramHeader32);
 
 					POST_SET(POSTCODE_ELF_HEADER);
 				}
@@ -200,38 +453,44 @@ EStatus ELFProcessRXData(SELF *psELF,
 
 			case ELFSTATE_PROGRAM_HEADER_CONSUME:
 			{
-				*psELF->pu8DataPtr = *pu8Buffer;
-				++psELF->pu8DataPtr;
-				++pu8Buffer;
-				--u32DataLength;
-				++psELF->u32DataOffset;
-				++psELF->u32ELFOffset;
+				uint32_t u32Chunk;
+
+				u32Chunk = psELF->u32DataSize - psELF->u32DataOffset;
+				if (u32Chunk > u32DataLength)
+				{
+					u32Chunk = u32DataLength;
+				}
+
+				memcpy((void *) psELF->pu8DataPtr,
+					   (void *) pu8Buffer,
+					   u32Chunk);
+
+				psELF->pu8DataPtr += u32Chunk;
+				pu8Buffer += u32Chunk;
+				u32DataLength -= u32Chunk;
+				psELF->u32DataOffset += u32Chunk;
+				psELF->u32ELFOffset += u32Chunk;
+
 				if (psELF->u32DataOffset == psELF->u32DataSize)
 				{
-					if (psELFProgramHeader32->u32Type != PT_LOAD)
+					eStatus = ELFSegmentsBuild(psELF,
+											   psELFSuffix->u16PNum);
+					if (eStatus != ESTATUS_OK)
 					{
-						printf("Program p_type field not PT_LOAD - 0x%.4x\n", psELFProgramHeader32->u32Type);
 						goto errorExitCancel;
 					}
 
-/*					printf("p_type   = 0x%.8x\n", psELFProgramHeader32->u32Type);
-					printf("p_offset = 0x%.8x\n", psELFProgramHeader32->u32SegmentOffset);
-					printf("p_vaddr  = 0x%.8x\n", psELFProgramHeader32->u32VirtualAddress);
-					printf("p_paddr  = 0x%.8x\n", psELFProgramHeader32->u32PhysicalAddress);
-					printf("p_filesz = 0x%.8x\n", psELFProgramHeader32->u32SegmentFileImage);
-					printf("p_memsz  = 0x%.8x\n", psELFProgramHeader32->u32MemoryFileImage);
-					printf("p_flags  = 0x%.8x\n", psELFProgramHeader32->u32SegmentFlags);
-					printf("p_align  = 0x%.8x\n", psELFProgramHeader32->u32Alignment); */
-
-					printf("Program load address of 0x%.8x for 0x%.8x bytes\n",
-						   psELFProgramHeader32->u32PhysicalAddress,
-						   psELFProgramHeader32->u32SegmentFileImage);
-
 					// Copy in the execution address
 					psELF->u32ExecStart = psELFHeaderProgram32->u32EntryPoint;
 
 					// We got it! Now let's find the program itself
-					psELF->eELFState = ELFSTATE_PROGRAM_FIND;
+					psELF->u8Segment = 0;
+					psELF->u8SegmentBSS = 0;
+					if (false == ELFSegmentNext(psELF))
+					{
+						// Nothing but BSS
+						goto loadComplete;
+					}
 				}
 
 				break;
@@ -241,17 +500,13 @@ EStatus ELFProcessRXData(SELF *psELF,
 			{
 				uint32_t u32Chunk;
 
-				assert(psELF->u32ELFOffset <= psELFProgramHeader32->u32SegmentOffset);
-				u32Chunk = psELFProgramHeader32->u32SegmentOffset - psELF->u32ELFOffset;
+				u32Chunk = psELF->sSegments[psELF->u8Segment].u32Offset - psELF->u32ELFOffset;
 
 				if (0 == u32Chunk)
 				{
-					// We're here already! Advance 
+					// We're here already! Advance
 					psELF->eELFState = ELFSTATE_PROGRAM_CONSUME;
-
-					psELF->pu8DataPtr = (uint8_t *) psELFProgramHeader32->u32PhysicalAddress;
 					psELF->u32DataOffset = 0;
-					psELF->u32DataSize = psELFProgramHeader32->u32SegmentFileImage;
 
 					POST_SET(POSTCODE_ELF_PROGRAM_HEADER);
 				}
@@ -273,8 +528,8 @@ EStatus ELFProcessRXData(SELF *psELF,
 
 			case ELFSTATE_PROGRAM_CONSUME:
 			{
+				SELFSegment *psSegment = &psELF->sSegments[psELF->u8Segment];
 				uint32_t u32Chunk;
-				uint32_t u32PhysicalAddress;
 
 				if (psELF->bTransferToggle)
 				{
@@ -287,53 +542,26 @@ EStatus ELFProcessRXData(SELF *psELF,
 					POST_SET(POSTCODE_ELF_PROGRAM_CONSUME2);
 				}
 
-				// Print out a xxK every 8K.
-				if (0 == (psELF->u32DataOffset & 0x1fff))
-				{
-					printf("%uK/%uK\n", psELF->u32DataOffset >> 10, psELFProgramHeader32->u32SegmentFileImage >> 10);
-				}
-
-				u32Chunk = psELFProgramHeader32->u32SegmentFileImage - psELF->u32DataOffset;
-				if (0 == u32Chunk)
-				{
-//					printf("Load complete!\n");
-					printf("%uK/%uK\n", psELF->u32DataOffset >> 10, psELFProgramHeader32->u32SegmentFileImage >> 10);
-					eStatus = ESTATUS_TRANSFER_COMPLETE;
-					psELF->eELFState = ELFSTATE_INIT;
-					POST_SET(POSTCODE_ELF_COMPLETE);
-					goto errorExit;
-				}
-
 				// Clip the chunk size to the length of our data
+				u32Chunk = psSegment->u32FileSize - psELF->u32DataOffset;
 				if (u32Chunk > u32DataLength)
 				{
 					u32Chunk = u32DataLength;
 				}
 
-				u32PhysicalAddress = psELFProgramHeader32->u32PhysicalAddress + psELF->u32DataOffset;
-//				printf("Chunk size=%u, address=0x%.8x, u32DataOffset=0x%.8x\n", u32Chunk, u32PhysicalAddress, psELF->u32DataOffset);
-
-				// If we're in the first 4K of address space, we need to put it in the *psELF structure's
-				// vector table
-				if (u32PhysicalAddress < sizeof(psELF->u8VectorTable))
+				eStatus = ELFPlace(psELF,
+								   psSegment->u32Address + psELF->u32DataOffset,
+								   pu8Buffer,
+								   u32Chunk);
+				if (eStatus != ESTATUS_OK)
 				{
-					u32Chunk = sizeof(psELF->u8VectorTable) - psELF->u32DataOffset;
-					if (u32Chunk > u32DataLength)
-					{
-						u32Chunk = u32DataLength;
-					}
-
-//					printf(" Chunk size2=%u, address=0x%.8x, u32DataOffset=0x%.8x\n", u32Chunk, u32PhysicalAddress, psELF->u32DataOffset);
-					memcpy((void *) &psELF->u8VectorTable[u32PhysicalAddress],
-						   (void *) pu8Buffer,
-						   u32Chunk);
+					goto errorExitCancel;
 				}
-				else
+
+				// Print out a xxK every 8K.
+				if ((psELF->u32LoadOffset ^ (psELF->u32LoadOffset + u32Chunk)) & ~0x1fff)
 				{
-					// Just copy the data
-					memcpy((void *) u32PhysicalAddress,
-						   (void *) pu8Buffer,
-						   u32Chunk);
+					printf("%uK/%uK\n", (psELF->u32LoadOffset + u32Chunk) >> 10, psELF->u32LoadTotal >> 10);
 				}
 
 				// Advance our pointers
@@ -341,6 +569,19 @@ EStatus ELFProcessRXData(SELF *psELF,
 				u32DataLength -= u32Chunk;
 				psELF->u32DataOffset += u32Chunk;
 				psELF->u32ELFOffset += u32Chunk;
+				psELF->u32LoadOffset += u32Chunk;
+
+				if (psELF->u32DataOffset == psSegment->u32FileSize)
+				{
+					// On to the next one, or if that was the last, we're done - there's
+					// no need to wait for the rest of the file.
+					psELF->u8Segment++;
+					if (false == ELFSegmentNext(psELF))
+					{
+						goto loadComplete;
+					}
+				}
+
 				break;
 			}
 
@@ -353,9 +594,35 @@ EStatus ELFProcessRXData(SELF *psELF,
 
 	}
 
+	// Use the time until the next block shows up to get some BSS zeroed
+	if (psELF->u8SegmentCount)
+	{
+		eStatus = ELFZeroBSS(psELF,
+							 ELF_BSS_ZERO_CHUNK);
+		if (eStatus != ESTATUS_OK)
+		{
+			goto errorExitCancel;
+		}
+	}
+
 	// All good so far
 	return(ESTATUS_OK);
 
+loadComplete:
+	// Finish off whatever BSS is left
+	eStatus = ELFZeroBSS(psELF,
+						 0xffffffff);
+	if (eStatus != ESTATUS_OK)
+	{
+		goto errorExitCancel;
+	}
+
+	printf("%uK/%uK\n", psELF->u32LoadOffset >> 10, psELF->u32LoadTotal >> 10);
+	eStatus = ESTATUS_TRANSFER_COMPLETE;
+	psELF->eELFState = ELFSTATE_INIT;
+	POST_SET(POSTCODE_ELF_COMPLETE);
+	goto errorExit;
+
 errorExitCancel:
 	eStatus = ESTATUS_CANCELED;
 	psELF->eELFState = ELFSTATE_INIT;
@@ -366,11 +633,25 @@ errorExit:
 	return(eStatus);
 }
 
+// Copies whatever the image loaded into the vector table shadow to its real
+// home. This overwrites the monitor's vectors, so interrupts must be off.
+EStatus ELFVectorTableInstall(SELF *psELF)
+{
+	if (psELF->u32VectorTableHigh > psELF->u32VectorTableLow)
+	{
+		memcpy((void *) psELF->u32VectorTableLow,
+			   (void *) &psELF->u8VectorTable[psELF->u32VectorTableLow],
+			   psELF->u32VectorTableHigh - psELF->u32VectorTableLow);
+	}
+
+	return(ESTATUS_OK);
+}
+
 // Resets the ELF state machine
 EStatus ELFInit(SELF *psELF)
 {
 	memset((void *) psELF, 0, sizeof(*psELF));
 	psELF->eELFState = ELFSTATE_INIT;
+	psELF->u32VectorTableLow = sizeof(psELF->u8VectorTable);
 	return(ESTATUS_OK);
 }
-
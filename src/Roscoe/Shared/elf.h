@@ -11,6 +11,13 @@ typedef enum
 	ELFSTATE_PROGRAM_CONSUME
 } EELFState;
 
+// Most program headers we'll take in an image
+#define	ELF_PROGRAM_HEADERS_MAX		8
+
+// Size of the low memory shadow (vector table) - anything loaded below this
+// is held in SELF until ELFVectorTableInstall() is called
+#define	ELF_VECTOR_TABLE_SIZE		0x1000
+
 // ELF header prefix
 typedef struct SELFHeaderPrefix
 {
@@ -73,15 +80,35 @@ typedef struct SELFProgramHeader64
 	uint32_t u64Alignment;			// Alignment
 } __attribute__((packed)) SELFProgramHeader64;
 
+// A loadable segment, in the order it appears in the file
+typedef struct SELFSegment
+{
+	uint32_t u32Offset;			// Offset of the segment's data in the file
+	uint32_t u32Address;		// Physical address to load it at
+	uint32_t u32FileSize;		// # Of bytes to copy from the file
+	uint32_t u32MemorySize;		// # Of bytes in memory (the rest is zeroed)
+	uint32_t u32Zeroed;			// # Of bytes past u32FileSize zeroed so far
+} SELFSegment;
+
 typedef struct SELF
 {
 	EELFState eELFState;		// What state are we in in our state machine?
 	uint8_t u8ELFHeader[sizeof(SELFHeaderPrefix) + sizeof(SELFHeaderSuffix) + sizeof(SELFHeaderProgram64)];	// ELF Header (big enough for 32 or 64 bit)
-	uint8_t u8ProgramHeader[sizeof(SELFProgramHeader64)];	// Program header block
-	uint8_t u8VectorTable[0x1000];	// Vector table (if image loads it)
+	uint8_t u8ProgramHeader[ELF_PROGRAM_HEADERS_MAX * sizeof(SELFProgramHeader32)];	// Program header table
+	uint8_t u8VectorTable[ELF_VECTOR_TABLE_SIZE];	// Vector table (if image loads it)
+	uint32_t u32VectorTableLow;		// Lowest vector table address loaded
+	uint32_t u32VectorTableHigh;	// One past the highest vector table address loaded
 	uint32_t u32ExecStart;		// Entry point for the ELF program
 	bool bTransferToggle;		// Boolean to show activity on POST LEDs
 
+	// Loadable segments, sorted by file offset
+	SELFSegment sSegments[ELF_PROGRAM_HEADERS_MAX];
+	uint8_t u8SegmentCount;		// # Of entries in sSegments
+	uint8_t u8Segment;			// Segment currently being received
+	uint8_t u8SegmentBSS;		// First segment that may still have BSS to zero
+	uint32_t u32LoadTotal;		// Total # Of file bytes across all segments
+	uint32_t u32LoadOffset;		// # Of file bytes loaded so far
+
 	// Generic variables used for consuming blocks of data
 	uint8_t *pu8DataPtr;		// Pointer to next location to write data
 	uint32_t u32DataOffset;		// # Of bytes received in this data accumulation
@@ -90,6 +117,7 @@ typedef struct SELF
 } SELF;
 
 extern EStatus ELFInit(SELF *psELF);
+extern EStatus ELFVectorTableInstall(SELF *psELF);
 extern EStatus ELFProcessRXData(SELF *psELF,
 								uint8_t *pu8Buffer,
 								uint32_t u32DataLength);
@@ -0,0 +1,375 @@
+#include <stdio.h>
+#include <string.h>
+#include "netbench.h"
+#include "socket.h"
+#include "wizchip_conf.h"
+#include "../../Internet/httpServer/httpServer.h"
+#include "../../Internet/TFTP/tftp.h"
+
+static NB_SOCK nb_sock[_WIZCHIP_SOCK_NUM_];
+static uint8_t *nb_buf;
+static uint16_t nb_buf_size;
+static uint8_t nb_mem_kb;
+static uint8_t nb_txsize[_WIZCHIP_SOCK_NUM_];
+static uint8_t nb_rxsize[_WIZCHIP_SOCK_NUM_];
+
+/* httpServer addresses its sockets by index into its own list */
+static uint8_t nb_http_socklist[_WIZCHIP_SOCK_NUM_];
+static uint8_t nb_http_seq[_WIZCHIP_SOCK_NUM_];
+static uint8_t nb_http_cnt;
+static uint8_t nb_http_object[NB_HTTP_OBJECT_SIZE + 1];
+static uint8_t nb_http_registered;
+
+static uint8_t nb_tftp_buf[MAX_MTU_SIZE];
+
+static const struct {
+	uint8_t		role;
+	const char	*name;
+	uint16_t	port;
+} nb_roles[] = {
+	{'s', "sink",	NB_PORT_SINK},
+	{'r', "source",	NB_PORT_SOURCE},
+	{'e', "echo",	NB_PORT_ECHO},
+	{'u', "udp",	NB_PORT_UDP},
+	{'h', "http",	NB_PORT_HTTP},
+};
+
+#define NB_ROLES	(sizeof(nb_roles) / sizeof(nb_roles[0]))
+
+static uint16_t nb_role_port(uint8_t role)
+{
+	uint8_t i;
+
+	for(i = 0; i < NB_ROLES; i++)
+		if(nb_roles[i].role == role) return nb_roles[i].port;
+	return 0;
+}
+
+int8_t netbench_init(const char *layout, uint8_t *buf, uint16_t buf_size, uint8_t *http_tx, uint8_t *http_rx)
+{
+	uint8_t sn, used = 0;
+	uint16_t i;
+
+	if(!layout) layout = NB_DEFAULT_LAYOUT;
+
+	memset(nb_sock, 0, sizeof(nb_sock));
+	nb_http_cnt = 0;
+
+	for(sn = 0; sn < _WIZCHIP_SOCK_NUM_ && layout[sn]; sn++)
+	{
+		if(layout[sn] == '-') continue;
+		if(!nb_role_port((uint8_t)layout[sn])) return -1;
+		nb_sock[sn].role = (uint8_t)layout[sn];
+		used++;
+
+		if(layout[sn] == 'h')
+		{
+			nb_http_seq[sn] = nb_http_cnt;
+			nb_http_socklist[nb_http_cnt++] = sn;
+		}
+	}
+	if(!used || !buf || !buf_size) return -1;
+	if(nb_http_cnt && (!http_tx || !http_rx)) return -1;
+
+	/* Largest power of two that lets every socket in use have the same share */
+	for(nb_mem_kb = NB_CHIP_MEM_KB; nb_mem_kb * used > NB_CHIP_MEM_KB; nb_mem_kb >>= 1);
+	for(sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+		nb_txsize[sn] = nb_rxsize[sn] = nb_sock[sn].role ? nb_mem_kb : 0;
+	if(wizchip_init(nb_txsize, nb_rxsize) != 0) return -1;
+
+	/* Every socket starts from CLOSED so the first netbench_run() opens it */
+	for(sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+		if(getSn_SR(sn) != SOCK_CLOSED) close(sn);
+
+	nb_buf = buf;
+	nb_buf_size = buf_size;
+	for(i = 0; i < buf_size; i++) nb_buf[i] = (uint8_t)i;
+
+	if(nb_http_cnt)
+	{
+		if(!nb_http_registered)
+		{
+			for(i = 0; i < NB_HTTP_OBJECT_SIZE; i++) nb_http_object[i] = (i % 64) == 63 ? '\n' : 'a' + (i % 26);
+			nb_http_object[NB_HTTP_OBJECT_SIZE] = 0;
+			reg_httpServer_webContent((uint8_t *)NB_HTTP_OBJECT, nb_http_object);
+			nb_http_registered = 1;
+		}
+		httpServer_init(http_tx, http_rx, nb_http_cnt, nb_http_socklist);
+	}
+
+	return (int8_t)nb_mem_kb;
+}
+
+/* Count a new connection; CON is cleared here as the other services do */
+static void nb_check_con(uint8_t sn)
+{
+	if(getSn_IR(sn) & Sn_IR_CON)
+	{
+		setSn_IR(sn, Sn_IR_CON);
+		nb_sock[sn].connects++;
+	}
+}
+
+/* The parts of the TCP state machine every role shares. Returns 1 if
+   the caller should carry on with an established connection. */
+static int32_t nb_tcp_state(uint8_t sn, uint8_t status, int32_t *ret)
+{
+	switch(status)
+	{
+	case SOCK_ESTABLISHED:
+		nb_check_con(sn);
+		return 1;
+
+	case SOCK_CLOSE_WAIT:
+		/* Whatever the peer sent before its FIN still counts */
+		if(getSn_RX_RSR(sn) > 0) return 1;
+		*ret = disconnect(sn);
+		if(*ret == SOCK_BUSY) *ret = 1;
+		break;
+
+	case SOCK_INIT:
+		*ret = listen(sn);
+		break;
+
+	case SOCK_CLOSED:
+		*ret = socket(sn, Sn_MR_TCP, nb_role_port(nb_sock[sn].role), SF_IO_NONBLOCK);
+		*ret = (*ret == sn) ? 1 : SOCKERR_SOCKINIT;
+		break;
+
+	case SOCK_LISTEN:
+		*ret = 0;
+		break;
+
+	default:
+		/* SYNRECV, FIN_WAIT and friends; they're on their way somewhere */
+		*ret = 1;
+		break;
+	}
+	return 0;
+}
+
+static int32_t nb_tcp_sink(uint8_t sn)
+{
+	int32_t ret = 0;
+	uint16_t len;
+
+	if(!nb_tcp_state(sn, getSn_SR(sn), &ret)) return ret;
+
+	if((len = getSn_RX_RSR(sn)) == 0) return 0;
+	if(len > nb_buf_size) len = nb_buf_size;
+	if((ret = recv(sn, nb_buf, len)) <= 0) return ret;
+	nb_sock[sn].rx_bytes += ret;
+
+	return ret == nb_buf_size;
+}
+
+static int32_t nb_tcp_source(uint8_t sn)
+{
+	int32_t ret = 0;
+	uint16_t len;
+
+	if(!nb_tcp_state(sn, getSn_SR(sn), &ret)) return ret;
+
+	/* Send what fits rather than waiting for room for a whole buffer */
+	if((len = getSn_TX_FSR(sn)) == 0) return 1;
+	if(len > nb_buf_size) len = nb_buf_size;
+	if((ret = send(sn, nb_buf, len)) < 0)
+	{
+		close(sn);
+		return ret;
+	}
+	nb_sock[sn].tx_bytes += ret;
+
+	return 1;
+}
+
+static int32_t nb_tcp_echo(uint8_t sn)
+{
+	int32_t ret = 0;
+	uint16_t len, sent = 0;
+
+	if(!nb_tcp_state(sn, getSn_SR(sn), &ret)) return ret;
+
+	if((len = getSn_RX_RSR(sn)) == 0) return 0;
+	if(len > nb_buf_size) len = nb_buf_size;
+	if((ret = recv(sn, nb_buf, len)) <= 0) return ret;
+	len = (uint16_t)ret;
+	nb_sock[sn].rx_bytes += len;
+	nb_sock[sn].packets++;
+
+	while(sent != len)
+	{
+		if((ret = send(sn, nb_buf + sent, len - sent)) < 0)
+		{
+			close(sn);
+			return ret;
+		}
+		sent += ret;		/* SOCK_BUSY is 0 */
+	}
+	nb_sock[sn].tx_bytes += len;
+
+	return len == nb_buf_size;
+}
+
+static int32_t nb_udp_echo(uint8_t sn)
+{
+	int32_t ret;
+	uint16_t len, port;
+	uint8_t ip[4];
+
+	switch(getSn_SR(sn))
+	{
+	case SOCK_UDP:
+		if((len = getSn_RX_RSR(sn)) == 0) return 0;
+		if((ret = recvfrom(sn, nb_buf, nb_buf_size, ip, &port)) <= 0) return ret;
+		len = (uint16_t)ret;
+		nb_sock[sn].rx_bytes += len;
+		nb_sock[sn].packets++;
+		if((ret = sendto(sn, nb_buf, len, ip, port)) < 0) return ret;
+		nb_sock[sn].tx_bytes += len;
+		return getSn_RX_RSR(sn) > 0;
+
+	case SOCK_CLOSED:
+		ret = socket(sn, Sn_MR_UDP, NB_PORT_UDP, SF_IO_NONBLOCK);
+		return (ret == sn) ? 1 : SOCKERR_SOCKINIT;
+
+	default:
+		return 0;
+	}
+}
+
+static int32_t nb_http(uint8_t sn)
+{
+	uint8_t status;
+
+	/* httpServer clears CON itself on this pass */
+	if(getSn_SR(sn) == SOCK_ESTABLISHED && (getSn_IR(sn) & Sn_IR_CON)) nb_sock[sn].connects++;
+	httpServer_run(nb_http_seq[sn]);
+
+	/* Only a listening socket can wait for the next CON */
+	status = getSn_SR(sn);
+	return status != SOCK_LISTEN;
+}
+
+int32_t netbench_run(uint8_t sn)
+{
+	if(sn >= _WIZCHIP_SOCK_NUM_) return SOCKERR_SOCKNUM;
+
+	switch(nb_sock[sn].role)
+	{
+	case 's': return nb_tcp_sink(sn);
+	case 'r': return nb_tcp_source(sn);
+	case 'e': return nb_tcp_echo(sn);
+	case 'u': return nb_udp_echo(sn);
+	case 'h': return nb_http(sn);
+	default:  return 0;
+	}
+}
+
+void netbench_time_handler(void)
+{
+	if(nb_http_cnt) httpServer_time_handler();
+}
+
+const NB_SOCK *netbench_stats(uint8_t sn)
+{
+	if(sn >= _WIZCHIP_SOCK_NUM_) return 0;
+	return &nb_sock[sn];
+}
+
+static unsigned long nb_rate(uint32_t bytes, uint32_t ms)
+{
+	if(!ms) return 0;
+	return (unsigned long)(((uint64_t)bytes * 1000) / ms);
+}
+
+void netbench_report(uint32_t elapsed_ms, uint8_t reset)
+{
+	uint8_t i, sn, socks;
+	uint32_t connects, packets, rx, tx;
+
+	for(i = 0; i < NB_ROLES; i++)
+	{
+		socks = 0;
+		connects = packets = rx = tx = 0;
+		for(sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+		{
+			if(nb_sock[sn].role != nb_roles[i].role) continue;
+			socks++;
+			connects += nb_sock[sn].connects;
+			packets += nb_sock[sn].packets;
+			rx += nb_sock[sn].rx_bytes;
+			tx += nb_sock[sn].tx_bytes;
+		}
+		if(!socks) continue;
+
+		printf("{\"netbench\":\"target\",\"role\":\"%s\",\"port\":%u,\"sockets\":%u,\"sock_kb\":%u,\"ms\":%lu,"
+			   "\"connects\":%lu,\"packets\":%lu,\"rx_bytes\":%lu,\"tx_bytes\":%lu,"
+			   "\"rx_bytes_per_sec\":%lu,\"tx_bytes_per_sec\":%lu,\"packets_per_sec\":%lu}\r\n",
+			   nb_roles[i].name, nb_roles[i].port, socks, nb_mem_kb, (unsigned long)elapsed_ms,
+			   (unsigned long)connects, (unsigned long)packets, (unsigned long)rx, (unsigned long)tx,
+			   nb_rate(rx, elapsed_ms), nb_rate(tx, elapsed_ms), nb_rate(packets, elapsed_ms));
+	}
+
+	if(reset)
+	{
+		for(sn = 0; sn < _WIZCHIP_SOCK_NUM_; sn++)
+		{
+			nb_sock[sn].connects = nb_sock[sn].packets = 0;
+			nb_sock[sn].rx_bytes = nb_sock[sn].tx_bytes = 0;
+		}
+	}
+}
+
+#ifdef F_STORAGE
+/* tftp.c's storage hook. netbench only reads into memory with TFTP_read_request_to(), so nothing arrives here. */
+void save_data(uint8_t *data, uint32_t data_len, uint16_t block_number)
+{
+	(void)data;
+	(void)data_len;
+	(void)block_number;
+}
+#endif
+
+int32_t netbench_tftp(uint8_t sn, uint8_t rx_kb, uint32_t server_ip, uint8_t *filename,
+					  uint8_t *dest, uint32_t dest_size, uint32_t (*now_ms)(void), void (*poll)(void))
+{
+	uint8_t txsize[_WIZCHIP_SOCK_NUM_] = {0, }, rxsize[_WIZCHIP_SOCK_NUM_] = {0, };
+	uint32_t start, tick, ms;
+	int32_t len = -1;
+	int ret;
+
+	if(sn >= _WIZCHIP_SOCK_NUM_ || !rx_kb || rx_kb > NB_CHIP_MEM_KB || !now_ms) return -1;
+
+	/* TFTP gets the chip to itself; the window it asks for depends on rx_kb */
+	txsize[sn] = 2;
+	rxsize[sn] = rx_kb;
+	if(wizchip_init(txsize, rxsize) != 0) return -1;
+
+	TFTP_init(sn, nb_tftp_buf);
+	start = tick = now_ms();
+	TFTP_read_request_to(server_ip, filename, dest, dest_size);
+
+	while((ret = TFTP_run()) == TFTP_PROGRESS)
+	{
+		if(now_ms() - tick >= 1000)
+		{
+			tick += 1000;
+			tftp_timeout_handler();
+		}
+		if(poll) poll();
+	}
+	ms = now_ms() - start;
+	if(ret == TFTP_SUCCESS) len = (int32_t)TFTP_get_length();
+	TFTP_exit();
+
+	printf("{\"netbench\":\"target\",\"test\":\"tftp\",\"file\":\"%s\",\"rx_kb\":%u,\"ok\":%s,"
+		   "\"bytes\":%lu,\"ms\":%lu,\"bytes_per_sec\":%lu}\r\n",
+		   (char *)filename, rx_kb, ret == TFTP_SUCCESS ? "true" : "false",
+		   (unsigned long)(len < 0 ? 0 : len), (unsigned long)ms, nb_rate(len < 0 ? 0 : (uint32_t)len, ms));
+
+	/* Put back whatever netbench_init() set up */
+	if(nb_mem_kb) wizchip_init(nb_txsize, nb_rxsize);
+
+	return len;
+}
@@ -0,0 +1,79 @@
+#ifndef _NETBENCH_H_
+#define _NETBENCH_H_
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+#include <stdint.h>
+
+/*
+ * Target side of the network benchmark. Each socket is given a role by one
+ * letter of a layout string; the host counterpart (Utils/netbench) drives
+ * them and measures. Results are printed as one JSON object per line.
+ *
+ *   's'  TCP sink      - reads and discards          (host tcp_tx)
+ *   'r'  TCP source    - sends until the peer closes (host tcp_rx)
+ *   'e'  TCP echo      - latency and connect rate    (host echo, connect)
+ *   'u'  UDP echo      - packets/sec                 (host udp)
+ *   'h'  HTTP          - httpServer serving NB_HTTP_OBJECT (host http)
+ *   '-'  unused
+ *
+ * Several sockets can share a role; they listen on the same port, so the
+ * layout sets how many connections the target can take at once.
+ */
+
+#define NB_PORT_SINK			5001
+#define NB_PORT_SOURCE			5002
+#define NB_PORT_ECHO			5003
+#define NB_PORT_UDP				5004
+#define NB_PORT_HTTP			80
+
+#define NB_DEFAULT_LAYOUT		"ssrreuhh"
+
+/* Registered with httpServer; the host fetches "/" NB_HTTP_OBJECT */
+#define NB_HTTP_OBJECT			"bench.txt"
+#define NB_HTTP_OBJECT_SIZE		1024
+
+/* The W5500's 16K of TX and 16K of RX memory is split evenly among the sockets in use */
+#define NB_CHIP_MEM_KB			16
+
+/* Per-socket counters */
+typedef struct {
+	uint8_t		role;
+	uint32_t	rx_bytes;
+	uint32_t	tx_bytes;
+	uint32_t	connects;
+	uint32_t	packets;
+} NB_SOCK;
+
+/* buf is the sink/source/echo scratch buffer; http_tx/http_rx are httpServer's
+   DATA_BUF_SIZE buffers. Returns the per-socket buffer size in KB, or -1. */
+int8_t netbench_init(const char *layout, uint8_t *buf, uint16_t buf_size, uint8_t *http_tx, uint8_t *http_rx);
+
+/* Service one socket. Returns 1 if there's more to do right away (data left
+   in the RX memory, a response or stream in progress), 0 if idle until the
+   next event, < 0 on a socket error. Fits NICReactorRun()'s handler contract. */
+int32_t netbench_run(uint8_t sn);
+
+/* 1 second tick, for httpServer's keep-alive timeout */
+void netbench_time_handler(void);
+
+/* Counters since netbench_init() or the last netbench_report(..., 1) */
+const NB_SOCK *netbench_stats(uint8_t sn);
+
+/* One JSON line per role in use. elapsed_ms is the measurement interval. */
+void netbench_report(uint32_t elapsed_ms, uint8_t reset);
+
+/* Time a TFTP read of filename from server_ip into dest on socket sn, with rx_kb of
+   RX memory for that socket. now_ms is a millisecond clock, poll is called between
+   TFTP_run() passes (or NULL). Prints a JSON line and returns the bytes received,
+   or -1 on failure. */
+int32_t netbench_tftp(uint8_t sn, uint8_t rx_kb, uint32_t server_ip, uint8_t *filename,
+					  uint8_t *dest, uint32_t dest_size, uint32_t (*now_ms)(void), void (*poll)(void));
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
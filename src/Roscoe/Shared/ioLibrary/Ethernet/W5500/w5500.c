@@ -255,6 +255,55 @@ void wiz_recv_data(uint8_t sn, uint8_t *wizdata, uint16_t len)
 }
 
 
+void wiz_send_data_vec(uint8_t sn, wiz_iovec *iov, uint8_t iovcnt, uint16_t len)
+{
+   uint16_t ptr = 0;
+   uint16_t seglen;
+   uint32_t addrsel = 0;
+
+   if(len == 0) return;
+   ptr = getSn_TX_WR(sn);
+   // Each segment goes straight from where it lives. TX_WR is read and written once for the lot.
+   while(iovcnt-- && len)
+   {
+      seglen = (iov->len < len) ? iov->len : len;
+      if(seglen)
+      {
+         addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_TXBUF_BLOCK(sn) << 3);
+         WIZCHIP_WRITE_BUF(addrsel, iov->buf, seglen);
+         ptr += seglen;
+         len -= seglen;
+      }
+      iov++;
+   }
+
+   setSn_TX_WR(sn,ptr);
+}
+
+void wiz_recv_data_vec(uint8_t sn, wiz_iovec *iov, uint8_t iovcnt, uint16_t len)
+{
+   uint16_t ptr = 0;
+   uint16_t seglen;
+   uint32_t addrsel = 0;
+
+   if(len == 0) return;
+   ptr = getSn_RX_RD(sn);
+   while(iovcnt-- && len)
+   {
+      seglen = (iov->len < len) ? iov->len : len;
+      if(seglen)
+      {
+         addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
+         WIZCHIP_READ_BUF(addrsel, iov->buf, seglen);
+         ptr += seglen;
+         len -= seglen;
+      }
+      iov++;
+   }
+
+   setSn_RX_RD(sn,ptr);
+}
+
 void wiz_recv_ignore(uint8_t sn, uint16_t len)
 {
    uint16_t ptr = 0;
@@ -264,4 +313,15 @@ void wiz_recv_ignore(uint8_t sn, uint16_t len)
    setSn_RX_RD(sn,ptr);
 }
 
+void wiz_peek_data(uint8_t sn, uint8_t *wizdata, uint16_t len)
+{
+   uint16_t ptr = 0;
+   uint32_t addrsel = 0;
+
+   if(len == 0) return;
+   ptr = getSn_RX_RD(sn);
+   addrsel = ((uint32_t)ptr << 8) + (WIZCHIP_RXBUF_BLOCK(sn) << 3);
+   WIZCHIP_READ_BUF(addrsel, wizdata, len);
+}
+
 #endif
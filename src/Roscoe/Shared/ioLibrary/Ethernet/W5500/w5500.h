@@ -2152,6 +2152,44 @@ void wiz_recv_data(uint8_t sn, uint8_t *wizdata, uint16_t len);
  */
 void wiz_recv_ignore(uint8_t sn, uint16_t len);
 
+/**
+ * @ingroup Basic_IO_function
+ * @brief It copies received data without consuming it.
+ * @details Copies <i>len</i> bytes from internal RX memory like wiz_recv_data(), but leaves
+ * the Rx read pointer register alone, so the same data is seen again by the next read.
+ * Follow it with wiz_recv_data() or wiz_recv_ignore() and a RECV command to consume it.
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param wizdata Pointer buffer to read data
+ * @param len Data length
+ */
+void wiz_peek_data(uint8_t sn, uint8_t *wizdata, uint16_t len);
+
+/**
+ * @ingroup Basic_IO_function
+ * @brief Gathering version of wiz_send_data()
+ * @details Copies up to <i>len</i> bytes from the segments in <i>iov</i>, in order, straight
+ * into internal TX memory, then updates the Tx write pointer register once.
+ * This function is being called by sendv().
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param iov Segments to send
+ * @param iovcnt Number of segments in iov
+ * @param len Total data length
+ */
+void wiz_send_data_vec(uint8_t sn, wiz_iovec *iov, uint8_t iovcnt, uint16_t len);
+
+/**
+ * @ingroup Basic_IO_function
+ * @brief Scattering version of wiz_recv_data()
+ * @details Copies up to <i>len</i> bytes of received data from internal RX memory straight
+ * into the segments in <i>iov</i>, in order, then updates the Rx read pointer register once.
+ * This function is being called by recvv().
+ * @param (uint8_t)sn Socket number. It should be <b>0 ~ 7</b>.
+ * @param iov Segments to fill
+ * @param iovcnt Number of segments in iov
+ * @param len Total data length
+ */
+void wiz_recv_data_vec(uint8_t sn, wiz_iovec *iov, uint8_t iovcnt, uint16_t len);
+
 /// @cond DOXY_APPLY_CODE
 #endif
 /// @endcond
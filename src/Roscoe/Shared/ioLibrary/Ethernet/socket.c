@@ -324,7 +324,8 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
    CHECK_SOCKDATA();
    tmp = getSn_SR(sn);
    if(tmp != SOCK_ESTABLISHED && tmp != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
-   if( sock_is_sending & (1<<sn) )
+   // A blocking socket waits here for the previous SEND to complete, rather than returning SOCK_BUSY
+   while( sock_is_sending & (1<<sn) )
    {
       tmp = getSn_IR(sn);
       if(tmp & Sn_IR_SENDOK)
@@ -337,7 +338,8 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
             {
                setSn_CR(sn,Sn_CR_SEND);
                while(getSn_CR(sn));
-               return SOCK_BUSY;
+               if(sock_io_mode & (1<<sn)) return SOCK_BUSY;
+               continue;
             }
          #endif
          sock_is_sending &= ~(1<<sn);         
@@ -347,7 +349,13 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len)
          close(sn);
          return SOCKERR_TIMEOUT;
       }
-      else return SOCK_BUSY;
+      else if(getSn_SR(sn) == SOCK_CLOSED)
+      {
+         // Reset by the peer with the SEND still outstanding; SENDOK will never come
+         close(sn);
+         return SOCKERR_SOCKSTATUS;
+      }
+      else if(sock_io_mode & (1<<sn)) return SOCK_BUSY;
    }
    freesize = getSn_TxMAX(sn);
    if (len > freesize) len = freesize; // check size not to exceed MAX size.
@@ -487,6 +495,113 @@ int32_t recv(uint8_t sn, uint8_t * buf, uint16_t len)
    return (int32_t)len;
 }
 
+#if _WIZCHIP_ == 5500
+int32_t sendv(uint8_t sn, wiz_iovec * iov, uint8_t iovcnt)
+{
+   uint8_t tmp=0;
+   uint16_t freesize=0;
+   uint32_t total=0;
+   uint16_t len=0;
+   uint8_t i;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   for(i = 0; i < iovcnt; i++) total += iov[i].len;
+   freesize = getSn_TxMAX(sn);
+   len = (total > freesize) ? freesize : (uint16_t)total; // check size not to exceed MAX size.
+   CHECK_SOCKDATA();
+   tmp = getSn_SR(sn);
+   if(tmp != SOCK_ESTABLISHED && tmp != SOCK_CLOSE_WAIT) return SOCKERR_SOCKSTATUS;
+   // As send(), a blocking socket waits for the previous SEND to complete
+   while( sock_is_sending & (1<<sn) )
+   {
+      tmp = getSn_IR(sn);
+      if(tmp & Sn_IR_SENDOK)
+      {
+         setSn_IR(sn, Sn_IR_SENDOK);
+         sock_is_sending &= ~(1<<sn);
+      }
+      else if(tmp & Sn_IR_TIMEOUT)
+      {
+         close(sn);
+         return SOCKERR_TIMEOUT;
+      }
+      else if(getSn_SR(sn) == SOCK_CLOSED)
+      {
+         // Reset by the peer with the SEND still outstanding; SENDOK will never come
+         close(sn);
+         return SOCKERR_SOCKSTATUS;
+      }
+      else if(sock_io_mode & (1<<sn)) return SOCK_BUSY;
+   }
+   while(1)
+   {
+      freesize = getSn_TX_FSR(sn);
+      tmp = getSn_SR(sn);
+      if ((tmp != SOCK_ESTABLISHED) && (tmp != SOCK_CLOSE_WAIT))
+      {
+         close(sn);
+         return SOCKERR_SOCKSTATUS;
+      }
+      if( (sock_io_mode & (1<<sn)) && (len > freesize) ) return SOCK_BUSY;
+      if(len <= freesize) break;
+   }
+   wiz_send_data_vec(sn, iov, iovcnt, len);
+   setSn_CR(sn,Sn_CR_SEND);
+   /* wait to process the command... */
+   while(getSn_CR(sn));
+   sock_is_sending |= (1 << sn);
+   return (int32_t)len;
+}
+
+int32_t recvv(uint8_t sn, wiz_iovec * iov, uint8_t iovcnt)
+{
+   uint8_t  tmp = 0;
+   uint16_t recvsize = 0;
+   uint32_t total = 0;
+   uint16_t len = 0;
+   uint8_t i;
+
+   CHECK_SOCKNUM();
+   CHECK_SOCKMODE(Sn_MR_TCP);
+   for(i = 0; i < iovcnt; i++) total += iov[i].len;
+   recvsize = getSn_RxMAX(sn);
+   len = (total > recvsize) ? recvsize : (uint16_t)total;
+   CHECK_SOCKDATA();
+
+   while(1)
+   {
+      recvsize = getSn_RX_RSR(sn);
+      tmp = getSn_SR(sn);
+      if (tmp != SOCK_ESTABLISHED)
+      {
+         if(tmp == SOCK_CLOSE_WAIT)
+         {
+            if(recvsize != 0) break;
+            else if(getSn_TX_FSR(sn) == getSn_TxMAX(sn))
+            {
+               close(sn);
+               return SOCKERR_SOCKSTATUS;
+            }
+         }
+         else
+         {
+            close(sn);
+            return SOCKERR_SOCKSTATUS;
+         }
+      }
+      if((sock_io_mode & (1<<sn)) && (recvsize == 0)) return SOCK_BUSY;
+      if(recvsize != 0) break;
+   };
+
+   if(recvsize < len) len = recvsize;
+   wiz_recv_data_vec(sn, iov, iovcnt, len);
+   setSn_CR(sn,Sn_CR_RECV);
+   while(getSn_CR(sn));
+   return (int32_t)len;
+}
+#endif
+
 int32_t sendto(uint8_t sn, uint8_t * buf, uint16_t len, uint8_t * addr, uint16_t port)
 {
    uint8_t tmp = 0;
@@ -271,6 +271,36 @@ int32_t send(uint8_t sn, uint8_t * buf, uint16_t len);
  */
 int32_t recv(uint8_t sn, uint8_t * buf, uint16_t len);
 
+#if _WIZCHIP_ == 5500
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Gathering version of send().
+ * @details Sends the segments in <I>iov</I>, in order, as one block of data. Each segment is written
+ *          straight from where it lives (a file system sector buffer, a header built on the stack...)
+ *          so nothing has to be copied into one contiguous buffer first.
+ * @note    Same rules as send(). At most the socket's TX buffer size is sent, starting with the first segment.
+ * @param sn     Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param iov    Segments to send.
+ * @param iovcnt Number of segments in iov.
+ * @return	@b Success : The sent data size \n
+ *          @b Fail    : Same as send()
+ */
+int32_t sendv(uint8_t sn, wiz_iovec * iov, uint8_t iovcnt);
+
+/**
+ * @ingroup WIZnet_socket_APIs
+ * @brief	Scattering version of recv().
+ * @details Reads incoming data straight into the segments in <I>iov</I>, filling each in turn.
+ * @note    Same rules as recv(). Returns as soon as some data has been read, which may not fill every segment.
+ * @param sn     Socket number. It should be <b>0 ~ @ref \_WIZCHIP_SOCK_NUM_</b>.
+ * @param iov    Segments to fill.
+ * @param iovcnt Number of segments in iov.
+ * @return	@b Success : The real received data size \n
+ *          @b Fail    : Same as recv()
+ */
+int32_t recvv(uint8_t sn, wiz_iovec * iov, uint8_t iovcnt);
+#endif
+
 /**
  * @ingroup WIZnet_socket_APIs
  * @brief	Sends datagram to the peer with destination IP address and port number passed as parameter.
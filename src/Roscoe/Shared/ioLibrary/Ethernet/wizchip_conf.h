@@ -75,6 +75,16 @@ extern "C" {
 #define _WIZCHIP_                      W5500   // W5100, W5100S, W5200, W5300, W5500
 #endif
 
+/**
+ * @ingroup DATA_TYPE
+ * @brief One segment of a scatter/gather transfer. See sendv() and recvv().
+ */
+typedef struct wiz_iovec_t
+{
+   uint8_t* buf;                    ///< Start of the segment
+   uint16_t len;                    ///< Segment length in bytes
+}wiz_iovec;
+
 #define _WIZCHIP_IO_MODE_NONE_         0x0000
 #define _WIZCHIP_IO_MODE_BUS_          0x0100 /**< Bus interface mode */
 #define _WIZCHIP_IO_MODE_SPI_          0x0200 /**< SPI interface mode */
@@ -96,18 +96,13 @@ char sizefail[] = "550 File not found\r\n";
 #define ftp_ID 		"wiznet"
 #define ftp_PW 		"wiznet54321"
 
-un_l2cval remote_ip;
-uint16_t  remote_port;
-un_l2cval local_ip;
 uint16_t  local_port;
-uint8_t connect_state_control = 0;
-uint8_t connect_state_control1 = 0;
-uint8_t connect_state_data = 0;
-uint8_t connect_count = 0;
-uint32_t con_remain_cnt1 = 0;
-uint32_t con_remain_cnt2 = 0;
-uint8_t cur_sn = CTRL_SOCK;
-struct ftpd ftp;
+un_l2cval local_ip;
+struct ftpd ftp_sessions[FTP_MAX_SESSIONS];
+uint8_t ftp_session_cnt = 0;
+
+/* Data channel staging buffers, one per session */
+static uint8_t ftp_xbuf[FTP_MAX_SESSIONS][FTP_DATA_BUF_SIZE] __attribute__((aligned(4)));
 
 int current_year = 2014;
 int current_month = 12;
@@ -116,6 +111,13 @@ int current_hour = 10;
 int current_min = 10;
 int current_sec = 30;
 
+#if defined(F_FILESYSTEM)
+static const char *month_names[] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+/* Longest line a directory entry can need in a listing */
+#define LIST_LINE_MAX	(FF_LFN_BUF + 64)
+#endif
+
 int fsprintf(uint8_t s, const char *format, ...)
 {
 	int i;
@@ -137,635 +139,683 @@ int fsprintf(uint8_t s, const char *format, ...)
 	return i;
 }
 
-void ftpd_init(uint8_t * src_ip)
+static struct ftpd *ftp_session(uint8_t sn)
+{
+	uint8_t i;
+
+	for(i = 0; i < ftp_session_cnt; i++)
+	{
+		if(ftp_sessions[i].control == sn)
+			return &ftp_sessions[i];
+	}
+
+	return NULL;
+}
+
+/* Absolute names are used as they are, anything else is under the working directory */
+static void ftp_make_path(struct ftpd *ftp, char *arg, char *path)
+{
+	if(arg[0] == '/')
+		snprintf(path, LINELEN, "%s", arg);
+	else if(strlen(ftp->workingdir) == 1)
+		snprintf(path, LINELEN, "/%s", arg);
+	else
+		snprintf(path, LINELEN, "%s/%s", ftp->workingdir, arg);
+}
+
+#if defined(F_FILESYSTEM)
+/* Size of a file, 0 for a directory or -1 if there's no such thing */
+static long get_filesize(char *path)
+{
+	FILINFO fno;
+
+	if(strcmp(path, "/") == 0)
+		return 0;
+	if(f_stat(path, &fno) != FR_OK)
+		return -1;
+	if(fno.fattrib & AM_DIR)
+		return 0;
+
+	return (long)fno.fsize;
+}
+
+static int ftp_list_entry(struct ftpd *ftp, FILINFO *fno, char *buf)
 {
-	ftp.state = FTPS_NOT_LOGIN;
-	ftp.current_cmd = NO_CMD;
-	ftp.dsock_mode = ACTIVE_MODE;
+	int month = ((fno->fdate >> 5) & 0x0f);
 
-	ftp.ID_Enable = STATUS_USED;
-	ftp.PW_Enable = STATUS_USED;
+	if(month < 1 || month > 12)
+		month = 1;
 
-	if(ftp.ID_Enable == STATUS_USED)
+	if(ftp->current_cmd == MLSD_CMD)
 	{
-		strcpy(ftp.username, ftp_ID);
-		printf(" FTP ID[%d]:%s \r\n", strlen(ftp.username), ftp.username);
+		return sprintf(buf, "type=%s;size=%lu;modify=%04d%02d%02d%02d%02d%02d; %s\r\n",
+					   (fno->fattrib & AM_DIR) ? "dir" : "file", (unsigned long)fno->fsize,
+					   (fno->fdate >> 9) + 1980, month, fno->fdate & 0x1f,
+					   fno->ftime >> 11, (fno->ftime >> 5) & 0x3f, (fno->ftime & 0x1f) * 2,
+					   fno->fname);
 	}
-	if(ftp.PW_Enable == STATUS_USED)
+
+	return sprintf(buf, "%s 1 ftp ftp %10lu %s %2d %5d %s\r\n",
+				   (fno->fattrib & AM_DIR) ? "drwxr-xr-x" : ((fno->fattrib & AM_RDO) ? "-r--r--r--" : "-rw-r--r--"),
+				   (unsigned long)fno->fsize, month_names[month - 1], fno->fdate & 0x1f,
+				   (fno->fdate >> 9) + 1980, fno->fname);
+}
+#endif
+
+/* Transfers move whole sectors, as much as fits in the socket buffer size given */
+static uint32_t ftp_chunk_size(uint32_t sock_buf_size)
+{
+	uint32_t chunk = sock_buf_size & ~(_MAX_SS - 1);
+
+	if(chunk < _MAX_SS)
+		chunk = _MAX_SS;
+	if(chunk > FTP_DATA_BUF_SIZE)
+		chunk = FTP_DATA_BUF_SIZE;
+
+	return chunk;
+}
+
+static void ftp_xfer_start(struct ftpd *ftp, enum ftp_cmd cmd)
+{
+	ftp->xbuf_len = 0;
+	ftp->xbuf_ofs = 0;
+	ftp->xfer_eof = 0;
+	ftp->xfer_bytes = 0;
+	ftp->current_cmd = cmd;
+}
+
+/* Drop any transfer in progress, with no reply */
+static void ftp_xfer_close(struct ftpd *ftp)
+{
+#if defined(F_FILESYSTEM)
+	if(ftp->xfer_open)
 	{
-		strcpy(ftp.userpassword, ftp_PW);
-		printf(" FTP PW[%d]:%s \r\n", strlen(ftp.userpassword), ftp.userpassword);
+		if(ftp->current_cmd == LIST_CMD || ftp->current_cmd == MLSD_CMD)
+			f_closedir(&(ftp->dir));
+		else
+			f_close(&(ftp->fil));
+		ftp->xfer_open = 0;
 	}
-	
+#endif
+	ftp->current_cmd = NO_CMD;
+	ftp->xbuf_len = 0;
+	ftp->xbuf_ofs = 0;
+}
+
+/* Finish the transfer with a reply on the control connection */
+static void ftp_xfer_end(struct ftpd *ftp, char *reply)
+{
+#if defined(_FTP_DEBUG_)
+	printf("%d:%lu bytes, %s", ftp->data, ftp->xfer_bytes, reply);
+#endif
+	ftp_xfer_close(ftp);
+	disconnect(ftp->data);
+	send(ftp->control, (uint8_t *)reply, strlen(reply));
+}
+
+/* Stage the next chunk for RETR, LIST or MLSD. Returns -1 on a read error. */
+static int ftp_fill(struct ftpd *ftp)
+{
+	uint32_t chunk;
+#if defined(F_FILESYSTEM)
+	UINT blocklen;
+	FILINFO fno;
+#endif
 
+	ftp->xbuf_len = 0;
+	ftp->xbuf_ofs = 0;
+
+	if(ftp->current_cmd == RETR_CMD)
+	{
+		/* Half the TX memory, so one chunk can be going out while the next is queued behind it */
+		chunk = ftp_chunk_size(getSn_TxMAX(ftp->data) / 2);
+#if defined(F_FILESYSTEM)
+		ftp->fr = f_read(&(ftp->fil), ftp->xbuf, chunk, &blocklen);
+		if(ftp->fr != FR_OK)
+			return -1;
+		ftp->xbuf_len = blocklen;
+		if(blocklen < chunk)
+			ftp->xfer_eof = 1;
+#else
+		ftp->xbuf_len = sprintf((char *)ftp->xbuf, "%s", ftp->filename);
+		ftp->xfer_eof = 1;
+#endif
+		return 0;
+	}
+
+	/* Directory listings */
+#if defined(F_FILESYSTEM)
+	while(ftp->xbuf_len + LIST_LINE_MAX <= FTP_DATA_BUF_SIZE)
+	{
+		ftp->fr = f_readdir(&(ftp->dir), &fno);
+		if(ftp->fr != FR_OK)
+			return -1;
+		if(fno.fname[0] == 0)
+		{
+			ftp->xfer_eof = 1;
+			break;
+		}
+		ftp->xbuf_len += ftp_list_entry(ftp, &fno, (char *)ftp->xbuf + ftp->xbuf_len);
+	}
+#else
+	if (strncmp(ftp->workingdir, "/$Recycle.Bin", sizeof("/$Recycle.Bin")) != 0)
+		ftp->xbuf_len = sprintf((char *)ftp->xbuf, "drwxr-xr-x 1 ftp ftp 0 Dec 31 2014 $Recycle.Bin\r\n-rwxr-xr-x 1 ftp ftp 512 Dec 31 2014 test.txt\r\n");
+	ftp->xfer_eof = 1;
+#endif
+	return 0;
+}
+
+/* RETR, LIST and MLSD. The W5500 transmits a chunk from its TX memory while the
+   next is read from the disk into the staging buffer, so disk and network overlap. */
+static void ftp_send_step(struct ftpd *ftp)
+{
+	char sendbuf[LINELEN + 50];
+	int32_t ret;
+
+	if(getSn_SR(ftp->data) != SOCK_ESTABLISHED)
+	{
+		sprintf(sendbuf, "426 Connection closed; transfer aborted.\r\n");
+		ftp_xfer_end(ftp, sendbuf);
+		return;
+	}
+
+	if(ftp->xbuf_ofs == ftp->xbuf_len && !ftp->xfer_eof)
+	{
+		if(ftp_fill(ftp) < 0)
+		{
+			sprintf(sendbuf, "451 Read error.\r\n");
+			ftp_xfer_end(ftp, sendbuf);
+			return;
+		}
+	}
+
+	if(ftp->xbuf_ofs < ftp->xbuf_len)
+	{
+		/* SOCK_BUSY until the last SEND is done and there's room for this one */
+		ret = send(ftp->data, ftp->xbuf + ftp->xbuf_ofs, ftp->xbuf_len - ftp->xbuf_ofs);
+		if(ret < 0)
+		{
+			sprintf(sendbuf, "426 Connection closed; transfer aborted.\r\n");
+			ftp_xfer_end(ftp, sendbuf);
+			return;
+		}
+
+		ftp->xbuf_ofs += ret;
+		ftp->xfer_bytes += ret;
+
+		/* Read ahead while that goes out */
+		if(ret && ftp->xbuf_ofs == ftp->xbuf_len && !ftp->xfer_eof)
+		{
+			if(ftp_fill(ftp) < 0)
+			{
+				sprintf(sendbuf, "451 Read error.\r\n");
+				ftp_xfer_end(ftp, sendbuf);
+			}
+		}
+		return;
+	}
+
+	/* All sent; let it all be ACKed before the FIN */
+	if(getSn_TX_FSR(ftp->data) != getSn_TxMAX(ftp->data))
+		return;
+
+	if(ftp->current_cmd == RETR_CMD)
+		snprintf(sendbuf, sizeof(sendbuf), "226 Successfully transferred \"%s\"\r\n", ftp->filename);
+	else
+		snprintf(sendbuf, sizeof(sendbuf), "226 Successfully transferred \"%s\"\r\n", ftp->workingdir);
+	ftp_xfer_end(ftp, sendbuf);
+}
+
+/* STOR and APPE. A whole chunk is gathered before it's written, so every write is
+   whole sectors; the W5500 keeps receiving into its RX memory during the write. */
+static void ftp_recv_step(struct ftpd *ftp)
+{
+	char sendbuf[LINELEN + 50];
+	uint32_t chunk = ftp_chunk_size(getSn_RxMAX(ftp->data));
+	uint16_t size;
+	int32_t ret;
+	uint8_t closing;
+	uint8_t sr;
+#if defined(F_FILESYSTEM)
+	UINT blocklen;
+#endif
+
+	/* SOCK_CLOSED is a reset (or a timeout) and whatever was in flight is gone. Only an
+	   orderly close (SOCK_CLOSE_WAIT) ends the file. */
+	sr = getSn_SR(ftp->data);
+	if(sr == SOCK_CLOSED)
+	{
+		sprintf(sendbuf, "426 Connection closed; transfer aborted.\r\n");
+		ftp_xfer_end(ftp, sendbuf);
+		return;
+	}
+	closing = (sr == SOCK_CLOSE_WAIT);
+
+	size = getSn_RX_RSR(ftp->data);
+	if(size > 0)
+	{
+		if(size > chunk - ftp->xbuf_len)
+			size = chunk - ftp->xbuf_len;
+
+		ret = recv(ftp->data, ftp->xbuf + ftp->xbuf_len, size);
+		if(ret < 0)
+		{
+			sprintf(sendbuf, "426 Connection closed; transfer aborted.\r\n");
+			ftp_xfer_end(ftp, sendbuf);
+			return;
+		}
+		ftp->xbuf_len += ret;
+		ftp->xfer_bytes += ret;
+	}
+
+	/* The peer has finished sending once it has closed and everything has been read */
+	if(closing && getSn_RX_RSR(ftp->data) == 0)
+		ftp->xfer_eof = 1;
+
+	if(ftp->xbuf_len == chunk || (ftp->xfer_eof && ftp->xbuf_len))
+	{
+#if defined(F_FILESYSTEM)
+		ftp->fr = f_write(&(ftp->fil), ftp->xbuf, ftp->xbuf_len, &blocklen);
+		if(ftp->fr != FR_OK || blocklen != ftp->xbuf_len)
+		{
+			sprintf(sendbuf, "552 Write error.\r\n");
+			ftp_xfer_end(ftp, sendbuf);
+			return;
+		}
+#endif
+		ftp->xbuf_len = 0;
+	}
+
+	if(ftp->xfer_eof)
+	{
+#if defined(F_FILESYSTEM)
+		ftp->xfer_open = 0;
+		if(f_close(&(ftp->fil)) != FR_OK)
+		{
+			sprintf(sendbuf, "552 Write error.\r\n");
+			ftp_xfer_end(ftp, sendbuf);
+			return;
+		}
+#endif
+		snprintf(sendbuf, sizeof(sendbuf), "226 Successfully transferred \"%s\"\r\n", ftp->filename);
+		ftp_xfer_end(ftp, sendbuf);
+	}
+}
+
+void ftpd_init(uint8_t * src_ip)
+{
+	ftpd_init_socks(src_ip, FTP_SOCK_MASK);
+}
+
+/* Sessions are made from the sockets in sock_mask, two each, so the number of
+   concurrent sessions is bounded by the sockets given to the server. */
+void ftpd_init_socks(uint8_t * src_ip, uint8_t sock_mask)
+{
+	struct ftpd *ftp;
+	uint8_t sn, pending = 0xff;
+
+	ftp_session_cnt = 0;
+	for(sn = 0; sn < _WIZCHIP_SOCK_NUM_ && ftp_session_cnt < FTP_MAX_SESSIONS; sn++)
+	{
+		if(!(sock_mask & (1 << sn)))
+			continue;
+		if(pending == 0xff)
+		{
+			pending = sn;
+			continue;
+		}
+
+		ftp = &ftp_sessions[ftp_session_cnt];
+		memset(ftp, 0, sizeof(*ftp));
+		ftp->control = pending;
+		ftp->data = sn;
+		ftp->xbuf = ftp_xbuf[ftp_session_cnt];
+
+		ftp->state = FTPS_NOT_LOGIN;
+		ftp->current_cmd = NO_CMD;
+		ftp->dsock_mode = ACTIVE_MODE;
+		ftp->dsock_state = DATASOCK_IDLE;
+
+		ftp->ID_Enable = STATUS_USED;
+		ftp->PW_Enable = STATUS_USED;
+
+		if(ftp->ID_Enable == STATUS_USED)
+			strcpy(ftp->username, ftp_ID);
+		if(ftp->PW_Enable == STATUS_USED)
+			strcpy(ftp->userpassword, ftp_PW);
+
+		strcpy(ftp->workingdir, "/");
+
+		socket(ftp->control, Sn_MR_TCP, IPPORT_FTP, 0x0);
+
+		ftp_session_cnt++;
+		pending = 0xff;
+	}
+
+	if(ftp_session_cnt)
+	{
+		printf(" FTP ID[%d]:%s \r\n", strlen(ftp_sessions[0].username), ftp_sessions[0].username);
+		printf(" FTP PW[%d]:%s \r\n", strlen(ftp_sessions[0].userpassword), ftp_sessions[0].userpassword);
+	}
 
 	local_ip.cVal[0] = src_ip[0];
 	local_ip.cVal[1] = src_ip[1];
 	local_ip.cVal[2] = src_ip[2];
 	local_ip.cVal[3] = src_ip[3];
 	local_port = 35000;
-	
-	strcpy(ftp.workingdir, "/");
-
-	socket(CTRL_SOCK, Sn_MR_TCP, IPPORT_FTP, 0x0);
-    socket(CTRL_SOCK1, Sn_MR_TCP, IPPORT_FTP, 0x0);
 }
 
-uint8_t ftpd_run(uint8_t * dbuf)
+static long ftpd_ctrl_run(struct ftpd *ftp, uint8_t * dbuf)
 {
-	uint16_t size = 0, i;
+	uint8_t sn = ftp->control;
+	uint16_t size = 0;
 	long ret = 0;
-	uint32_t blocklen, send_byte, recv_byte;
-	uint32_t remain_filesize;
-	int32_t remain_datasize;
-	//static uint32_t con_remain_cnt1 = 0;
-	//static uint32_t con_remain_cnt2 = 0;
-#if defined(F_FILESYSTEM)
-	//FILINFO fno;
-#endif
 
-	//memset(dbuf, 0, sizeof(_MAX_SS));
-	////////////////////////FTP Control 1
-	#if 1
-    switch(getSn_SR(CTRL_SOCK))
+    switch(getSn_SR(sn))
     {
     	case SOCK_ESTABLISHED :
-    		if(!connect_state_control)
+    		if(!ftp->connect_state_control)
     		{
 #if defined(_FTP_DEBUG_)
-    			printf("%d:FTP Connected\r\n", CTRL_SOCK);
+    			printf("%d:FTP Connected\r\n", sn);
 #endif
-    			//fsprintf(CTRL_SOCK, banner, HOSTNAME, VERSION);
-    			strcpy(ftp.workingdir, "/");
+    			/* A new client starts from scratch */
+    			ftp_xfer_close(ftp);
+    			ftp->state = FTPS_NOT_LOGIN;
+    			ftp->dsock_mode = ACTIVE_MODE;
+    			ftp->dsock_state = DATASOCK_IDLE;
+    			strcpy(ftp->workingdir, "/");
     			sprintf((char *)dbuf, "220 %s FTP version %s ready.\r\n", HOSTNAME, VERSION);
-    			ret = send(CTRL_SOCK, (uint8_t *)dbuf, strlen((const char *)dbuf));
-                
+    			ret = send(sn, (uint8_t *)dbuf, strlen((const char *)dbuf));
+
 #if defined(_FTP_DEBUG_)
-                printf("%d:send() [%s]\r\n",CTRL_SOCK,dbuf);
+                printf("%d:send() [%s]\r\n",sn,dbuf);
 #endif
     			if(ret < 0)
     			{
 #if defined(_FTP_DEBUG_)
-    				printf("%d:send() error:%ld\r\n",CTRL_SOCK,ret);
+    				printf("%d:send() error:%ld\r\n",sn,ret);
 #endif
-    				close(CTRL_SOCK);
+    				close(sn);
     				return ret;
     			}
-    			connect_state_control = 1;
+    			ftp->connect_state_control = 1;
     		}
 			#if connect_timeout_en
+			else if(ftp->current_cmd != NO_CMD)
+			{
+				/* Not idle while a transfer is going */
+				ftp->con_remain_cnt = 0;
+			}
 			else
 			{
-				if(con_remain_cnt1 > remain_time)
+				if(ftp->con_remain_cnt > remain_time)
 				{
-					if((ret=disconnect(CTRL_SOCK)) != SOCK_OK) return ret;
+					if((ret=disconnect(sn)) != SOCK_OK) return ret;
 			#if defined(_FTP_DEBUG_)
-						printf("%d:Timeout Closed\r\n",CTRL_SOCK);
+						printf("%d:Timeout Closed\r\n",sn);
 			#endif
 				}
 				#if defined(_FTP_DEBUG_)
-				else if(((con_remain_cnt1 % 10000) == 0) && (con_remain_cnt1 != 0))
+				else if(((ftp->con_remain_cnt % 10000) == 0) && (ftp->con_remain_cnt != 0))
 				{
-					printf("%d:Timeout Count:%ld\r\n", CTRL_SOCK, con_remain_cnt1);
+					printf("%d:Timeout Count:%ld\r\n", sn, ftp->con_remain_cnt);
 				}
 				#endif
-				con_remain_cnt1++;
+				ftp->con_remain_cnt++;
 			}
 			#endif
-	
-#if defined(_FTP_DEBUG_)
-    		//printf("ftp socket %d\r\n", CTRL_SOCK);
-#endif
-			 
-    		if((size = getSn_RX_RSR(CTRL_SOCK)) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
+
+    		if((size = getSn_RX_RSR(sn)) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
     		{
 #if defined(_FTP_DEBUG_)
-    			printf("%d:size: %d\r\n", CTRL_SOCK, size);
+    			printf("%d:size: %d\r\n", sn, size);
 #endif
 
     			memset(dbuf, 0, _MAX_SS);
 
     			if(size > _MAX_SS) size = _MAX_SS - 1;
 
-    			ret = recv(CTRL_SOCK,dbuf,size);
-    			dbuf[ret] = '\0';
+    			ret = recv(sn,dbuf,size);
     			if(ret != size)
     			{
     				if(ret==SOCK_BUSY) return 0;
     				if(ret < 0)
     				{
 #if defined(_FTP_DEBUG_)
-    					printf("%d:recv() error:%ld\r\n",CTRL_SOCK,ret);
+    					printf("%d:recv() error:%ld\r\n",sn,ret);
 #endif
-    					close(CTRL_SOCK);
+    					close(sn);
     					return ret;
     				}
     			}
+    			dbuf[ret] = '\0';
 #if defined(_FTP_DEBUG_)
-    			printf("%d:Rcvd Command: %s", CTRL_SOCK, dbuf);
+    			printf("%d:Rcvd Command: %s", sn, dbuf);
 #endif
-    			proc_ftpd(CTRL_SOCK, (char *)dbuf);
-				con_remain_cnt1 = 0;
+    			proc_ftpd(sn, (char *)dbuf);
+				ftp->con_remain_cnt = 0;
     		}
     		break;
 
     	case SOCK_CLOSE_WAIT :
 #if defined(_FTP_DEBUG_)
-    		printf("%d:CloseWait\r\n",CTRL_SOCK);
+    		printf("%d:CloseWait\r\n",sn);
 #endif
-    		if((ret=disconnect(CTRL_SOCK)) != SOCK_OK) return ret;
+    		/* The data connection goes with the control connection */
+    		if(ftp->current_cmd != NO_CMD)
+    		{
+    			ftp_xfer_close(ftp);
+    			close(ftp->data);
+    		}
+    		if((ret=disconnect(sn)) != SOCK_OK) return ret;
 #if defined(_FTP_DEBUG_)
-    		printf("%d:Closed\r\n",CTRL_SOCK);
+    		printf("%d:Closed\r\n",sn);
 #endif
     		break;
 
     	case SOCK_CLOSED :
 #if defined(_FTP_DEBUG_)
-    		printf("%d:FTPStart\r\n",CTRL_SOCK);
+    		printf("%d:FTPStart\r\n",sn);
 #endif
-    		if((ret=socket(CTRL_SOCK, Sn_MR_TCP, IPPORT_FTP, 0x0)) != CTRL_SOCK)
+    		if((ret=socket(sn, Sn_MR_TCP, IPPORT_FTP, 0x0)) != sn)
     		{
 #if defined(_FTP_DEBUG_)
-    			printf("%d:socket() error:%ld\r\n", CTRL_SOCK, ret);
+    			printf("%d:socket() error:%ld\r\n", sn, ret);
 #endif
-    			close(CTRL_SOCK);
+    			close(sn);
     			return ret;
     		}
     		break;
 
     	case SOCK_INIT :
 #if defined(_FTP_DEBUG_)
-    		printf("%d:Opened\r\n",CTRL_SOCK);
+    		printf("%d:Opened\r\n",sn);
 #endif
-    		//strcpy(ftp.workingdir, "/");
-    		if( (ret = listen(CTRL_SOCK)) != SOCK_OK)
+    		if( (ret = listen(sn)) != SOCK_OK)
     		{
 #if defined(_FTP_DEBUG_)
-    			printf("%d:Listen error\r\n",CTRL_SOCK);
+    			printf("%d:Listen error\r\n",sn);
 #endif
     			return ret;
     		}
-			connect_state_control = 0;
-			con_remain_cnt1 = 0;
+			ftp->connect_state_control = 0;
+			ftp->con_remain_cnt = 0;
 
 #if defined(_FTP_DEBUG_)
-			printf("%d:Listen ok\r\n",CTRL_SOCK);
+			printf("%d:Listen ok\r\n",sn);
 #endif
 			break;
 
     	default :
     		break;
     }
-	////////////////////////FTP Control 2
-	
-	switch(getSn_SR(CTRL_SOCK1))
-	{
-		case SOCK_ESTABLISHED :
-			if(!connect_state_control1)
-			{
-#if defined(_FTP_DEBUG_)
-				printf("%d:FTP Connected\r\n", CTRL_SOCK1);
-#endif
-				strcpy(ftp.workingdir, "/");
-				sprintf((char *)dbuf, "220 %s FTP version %s ready.\r\n", HOSTNAME, VERSION);
-				ret = send(CTRL_SOCK1, (uint8_t *)dbuf, strlen((const char *)dbuf));
-				
-#if defined(_FTP_DEBUG_)
-				printf("%d:send() [%s]\r\n",CTRL_SOCK1,dbuf);
-#endif
-				if(ret < 0)
-				{
-#if defined(_FTP_DEBUG_)
-					printf("%d:send() error:%ld\r\n",CTRL_SOCK1,ret);
-#endif
-					close(CTRL_SOCK1);
-					return ret;
-				}
-				connect_state_control1 = 1;
-			}
-			#if connect_timeout_en
-			else
-			{
-				if(con_remain_cnt2 > remain_time)
-				{
-					if((ret=disconnect(CTRL_SOCK1)) != SOCK_OK) return ret;
-			#if defined(_FTP_DEBUG_)
-						printf("%d:Timeout Closed\r\n",CTRL_SOCK1);
-			#endif
-				}
-				#if defined(_FTP_DEBUG_)
-				else if(((con_remain_cnt2 % 10000) == 0) && (con_remain_cnt2 != 0))
-				{
-					printf("%d:Timeout Count:%ld\r\n", CTRL_SOCK1, con_remain_cnt2);
-				}
-				#endif
-				con_remain_cnt2++;
-			}
-			#endif
-	
-#if defined(_FTP_DEBUG_)
-			//printf("ftp socket %d\r\n", CTRL_SOCK);
-#endif
-			
-			if((size = getSn_RX_RSR(CTRL_SOCK1)) > 0) // Don't need to check SOCKERR_BUSY because it doesn't not occur.
-			{
-#if defined(_FTP_DEBUG_)
-				printf("%d: size: %d\r\n", CTRL_SOCK1, size);
-#endif
-
-				memset(dbuf, 0, _MAX_SS);
-
-				if(size > _MAX_SS) size = _MAX_SS - 1;
-
-				ret = recv(CTRL_SOCK1,dbuf,size);
-				dbuf[ret] = '\0';
-				if(ret != size)
-				{
-					if(ret==SOCK_BUSY) return 0;
-					if(ret < 0)
-					{
-#if defined(_FTP_DEBUG_)
-						printf("%d:recv() error:%ld\r\n",CTRL_SOCK1,ret);
-#endif
-						close(CTRL_SOCK1);
-						return ret;
-					}
-				}
-#if defined(_FTP_DEBUG_)
-				printf("%d: Rcvd Command: %s", CTRL_SOCK1, dbuf);
-#endif
-				proc_ftpd(CTRL_SOCK1, (char *)dbuf);
-				con_remain_cnt2 = 0;
-			}
-			break;
 
-		case SOCK_CLOSE_WAIT :
-#if defined(_FTP_DEBUG_)
-			printf("%d:CloseWait\r\n",CTRL_SOCK1);
-#endif
-			if((ret=disconnect(CTRL_SOCK1)) != SOCK_OK) return ret;
-			connect_count--;
-#if defined(_FTP_DEBUG_)
-			printf("%d:Closed\r\n",CTRL_SOCK1);
-#endif
-			break;
-
-		case SOCK_CLOSED :
-#if defined(_FTP_DEBUG_)
-			printf("%d:FTPStart\r\n",CTRL_SOCK1);
-#endif
-			if((ret=socket(CTRL_SOCK1, Sn_MR_TCP, IPPORT_FTP, 0x0)) != CTRL_SOCK1)
-			{
-#if defined(_FTP_DEBUG_)
-				printf("%d:socket() error:%ld\r\n", CTRL_SOCK1, ret);
-#endif
-				close(CTRL_SOCK1);
-				return ret;
-			}
-			break;
+    return 0;
+}
 
-		case SOCK_INIT :
-#if defined(_FTP_DEBUG_)
-			printf("%d:Opened\r\n",CTRL_SOCK1);
-#endif
-			//strcpy(ftp.workingdir, "/");
-			if( (ret = listen(CTRL_SOCK1)) != SOCK_OK)
-			{
-#if defined(_FTP_DEBUG_)
-				printf("%d:Listen error\r\n",CTRL_SOCK1);
-#endif
-				return ret;
-			}
-			connect_state_control1 = 0;
-			con_remain_cnt2 = 0;
-#if defined(_FTP_DEBUG_)
-			printf("%d:Listen ok\r\n",CTRL_SOCK1);
-#endif
-			break;
+static long ftpd_data_run(struct ftpd *ftp)
+{
+	uint8_t sn = ftp->data;
+	char sendbuf[LINELEN + 50];
+	long ret = 0;
 
-		default :
-			break;
-	}
-    
-	#endif
-/////////////////////////////////// ftp data part
-#if 1
-    switch(getSn_SR(DATA_SOCK))
+    switch(getSn_SR(sn))
     {
     	case SOCK_ESTABLISHED :
-    		if(!connect_state_data)
+    	case SOCK_CLOSE_WAIT :
+    		if(!ftp->connect_state_data)
     		{
 #if defined(_FTP_DEBUG_)
-    			printf("%d:FTP Data socket Connected\r\n", DATA_SOCK);
+    			printf("%d:FTP Data socket Connected\r\n", sn);
 #endif
-    			connect_state_data = 1;
+    			ftp->connect_state_data = 1;
     		}
-	
-    		switch(ftp.current_cmd)
+
+    		switch(ftp->current_cmd)
     		{
     			case LIST_CMD:
     			case MLSD_CMD:
-#if defined(_FTP_DEBUG_)
-    				printf("previous size: %d\r\n", size);
-#endif
-#if defined(F_FILESYSTEM)
-    				scan_files(ftp.workingdir, dbuf, (int *)&size);
-#endif
-#if defined(_FTP_DEBUG_)
-    				printf("returned size: %d\r\n", size);
-    				printf("%s\r\n", dbuf);
-#endif
-#if !defined(F_FILESYSTEM)
-    				if (strncmp(ftp.workingdir, "/$Recycle.Bin", sizeof("/$Recycle.Bin")) != 0)
-    					size = sprintf(dbuf, "drwxr-xr-x 1 ftp ftp 0 Dec 31 2014 $Recycle.Bin\r\n-rwxr-xr-x 1 ftp ftp 512 Dec 31 2014 test.txt\r\n");
-#endif
-    				size = strlen(dbuf);
-    				send(DATA_SOCK, dbuf, size);
-    				ftp.current_cmd = NO_CMD;
-    				disconnect(DATA_SOCK);
-    				size = sprintf(dbuf, "226 Successfully transferred \"%s\"\r\n", ftp.workingdir);
-					send(cur_sn, dbuf, size);
-    				break;
-
     			case RETR_CMD:
-#if defined(_FTP_DEBUG_)
-    				printf("filename to retrieve : %s %d\r\n", ftp.filename, strlen(ftp.filename));
-#endif
-#if defined(F_FILESYSTEM)
-    				ftp.fr = f_open(&(ftp.fil), (const char *)ftp.filename, FA_READ);
-    				//print_filedsc(&(ftp.fil));
-    				if(ftp.fr == FR_OK){
-    					remain_filesize = ftp.fil.fsize;
-#if defined(_FTP_DEBUG_)
-    					printf("f_open return FR_OK\r\n");
-#endif
-    					do{
-#if defined(_FTP_DEBUG_)
-    						//printf("remained file size: %d\r\n", ftp.fil.fsize);
-#endif
-    						memset(dbuf, 0, _MAX_SS);
-
-    						if(remain_filesize > _MAX_SS)
-    							send_byte = _MAX_SS;
-    						else
-    							send_byte = remain_filesize;
-
-    						ftp.fr = f_read(&(ftp.fil), dbuf, send_byte , &blocklen);
-    						if(ftp.fr != FR_OK)
-    							break;
-#if defined(_FTP_DEBUG_)
-    						printf("#");
-    						//printf("----->fsize:%d recv:%d len:%d \r\n", remain_filesize, send_byte, blocklen);
-    						//printf("----->fn:%s data:%s \r\n", ftp.filename, dbuf);
-#endif
-    						send(DATA_SOCK, dbuf, blocklen);
-    						remain_filesize -= blocklen;
-    					}while(remain_filesize != 0);
-#if defined(_FTP_DEBUG_)
-    					printf("\r\nFile read finished\r\n");
-#endif
-    					ftp.fr = f_close(&(ftp.fil));
-    				}else{
-#if defined(_FTP_DEBUG_)
-    					printf("File Open Error: %d\r\n", ftp.fr);
-#endif
-    				}
-#else
-					remain_filesize = strlen(ftp.filename);
-					#if defined(_FTP_DEBUG_)
-                    printf("<<<<<1recv data[%d]\r\n", remain_datasize);
-					#endif
-					do{
-						memset(dbuf, 0, _MAX_SS);
-
-						blocklen = sprintf(dbuf, "%s", ftp.filename);
-
-						printf("####1[%d] dbuf:%s\r\n",remain_filesize ,dbuf);
-
-						send(DATA_SOCK, dbuf, blocklen);
-						remain_filesize -= blocklen;
-					}while(remain_filesize != 0);
-
-#endif
-    				ftp.current_cmd = NO_CMD;
-    				disconnect(DATA_SOCK);
-    				size = sprintf(dbuf, "226 Successfully transferred \"%s\"\r\n", ftp.filename);
-					send(cur_sn, dbuf, size);
+    				ftp_send_step(ftp);
     				break;
 
     			case STOR_CMD:
-#if defined(_FTP_DEBUG_)
-    				printf("filename to store : %s %d\r\n", ftp.filename, strlen(ftp.filename));
-#endif
-#if defined(F_FILESYSTEM)
-    				ftp.fr = f_open(&(ftp.fil), (const char *)ftp.filename, FA_CREATE_ALWAYS | FA_WRITE);
-    				//print_filedsc(&(ftp.fil));
-    				if(ftp.fr == FR_OK){
-#if defined(_FTP_DEBUG_)
-    					printf("f_open return FR_OK\r\n");
-#endif
-    					while(1){
-    						if((remain_datasize = getSn_RX_RSR(DATA_SOCK)) > 0){
-    							while(1){
-    								memset(dbuf, 0, _MAX_SS);
-
-    								if(remain_datasize > _MAX_SS)
-    									recv_byte = _MAX_SS;
-    								else
-    									recv_byte = remain_datasize;
-
-    								ret = recv(DATA_SOCK, dbuf, recv_byte);
-#if defined(_FTP_DEBUG_)
-    								//printf("----->fn:%s data:%s \r\n", ftp.filename, dbuf);
-#endif
-
-    								ftp.fr = f_write(&(ftp.fil), dbuf, (UINT)ret, &blocklen);
-#if defined(_FTP_DEBUG_)
-    								//printf("----->dsize:%d recv:%d len:%d \r\n", remain_datasize, ret, blocklen);
-#endif
-    								remain_datasize -= blocklen;
-
-    								if(ftp.fr != FR_OK){
-#if defined(_FTP_DEBUG_)
-    									printf("f_write failed\r\n");
-#endif
-    									break;
-    								}
-
-    								if(remain_datasize <= 0)
-    									break;
-    							}
-
-    							if(ftp.fr != FR_OK){
-#if defined(_FTP_DEBUG_)
-    								printf("f_write failed\r\n");
-#endif
-    								break;
-    							}
-
-#if defined(_FTP_DEBUG_)
-    							printf("#");
-#endif
-    						}else{
-    							if(getSn_SR(DATA_SOCK) != SOCK_ESTABLISHED)
-    								break;
-    						}
-    					}
-#if defined(_FTP_DEBUG_)
-    					printf("\r\nFile write finished\r\n");
-#endif
-    					ftp.fr = f_close(&(ftp.fil));
-    				}else{
-#if defined(_FTP_DEBUG_)
-    					printf("File Open Error: %d\r\n", ftp.fr);
-#endif
-    				}
-
-    				//fno.fdate = (WORD)(((current_year - 1980) << 9) | (current_month << 5) | current_day);
-    				//fno.ftime = (WORD)((current_hour << 11) | (current_min << 5) | (current_sec >> 1));
-    				//f_utime((const char *)ftp.filename, &fno);
-#else
-					while(1){
-						if((remain_datasize = getSn_RX_RSR(DATA_SOCK)) > 0){
-							#if defined(_FTP_DEBUG_)
-                            printf("<<<<<2recv data[%ld]\r\n", remain_datasize);
-							#endif
-							while(1){
-								memset(dbuf, 0, _MAX_SS);
-
-								if(remain_datasize > _MAX_SS)
-									recv_byte = _MAX_SS;
-								else
-									recv_byte = remain_datasize;
-
-								ret = recv(DATA_SOCK, dbuf, recv_byte);
-								if(ret < 0)
-                                {
-									#if defined(_FTP_DEBUG_)
-                                    printf("finish ret[%d\r\n", ret);
-									#endif
-                                    break;
-                                }
-
-								#if defined(_FTP_DEBUG_)
-								printf("#####2[%ld] dbuf:%s\r\n", remain_datasize, dbuf);
-								#endif
-
-								remain_datasize -= ret;
-								#if defined(_FTP_DEBUG_)
-                                printf("###ret:%ld,remain:%d\r\n",ret, remain_datasize);
-								#endif
-
-								if(remain_datasize <= 0)
-									break;
-							}
-						}else{
-							if(getSn_SR(DATA_SOCK) != SOCK_ESTABLISHED)
-								break;
-						}
-					}
-#endif
-    				ftp.current_cmd = NO_CMD;
-    				disconnect(DATA_SOCK);
-    				size = sprintf(dbuf, "226 Successfully transferred \"%s\"\r\n", ftp.filename);
-					send(cur_sn, dbuf, size);
+    			case APPE_CMD:
+    				ftp_recv_step(ftp);
     				break;
 
     			case NO_CMD:
     			default:
+    				if(getSn_SR(sn) == SOCK_CLOSE_WAIT)
+    					disconnect(sn);
     				break;
     		}
     		break;
 
-   		case SOCK_CLOSE_WAIT :
-#if defined(_FTP_DEBUG_)
-   			printf("%d:CloseWait\r\n",DATA_SOCK);
-#endif
-   			if((ret=disconnect(DATA_SOCK)) != SOCK_OK) return ret;
-#if defined(_FTP_DEBUG_)
-   			printf("%d:Closed\r\n",DATA_SOCK);
-#endif
-   			break;
-
    		case SOCK_CLOSED :
-   			if(ftp.dsock_state == DATASOCK_READY)
+   			/* Reset or timed out under a transfer */
+   			if(ftp->connect_state_data)
    			{
-   				if(ftp.dsock_mode == PASSIVE_MODE){
+   				ftp->connect_state_data = 0;
+   				if(ftp->current_cmd != NO_CMD)
+   				{
+   					ftp_xfer_close(ftp);
+   					sprintf(sendbuf, "426 Connection closed; transfer aborted.\r\n");
+   					send(ftp->control, (uint8_t *)sendbuf, strlen(sendbuf));
+   				}
+   			}
+
+   			if(ftp->dsock_state == DATASOCK_READY)
+   			{
+   				if(ftp->dsock_mode == PASSIVE_MODE){
 #if defined(_FTP_DEBUG_)
-   					printf("%d:FTPDataStart, port : %d\r\n",DATA_SOCK, local_port);
+   					printf("%d:FTPDataStart, port : %d\r\n",sn, ftp->data_port);
 #endif
-   					if((ret=socket(DATA_SOCK, Sn_MR_TCP, local_port, 0x0)) != DATA_SOCK)
+   					if((ret=socket(sn, Sn_MR_TCP, ftp->data_port, SF_IO_NONBLOCK)) != sn)
    					{
 #if defined(_FTP_DEBUG_)
-   						printf("%d:socket() error:%ld\r\n", DATA_SOCK, ret);
+   						printf("%d:socket() error:%ld\r\n", sn, ret);
 #endif
-   						close(DATA_SOCK);
+   						close(sn);
    						return ret;
    					}
-
-   					local_port++;
-   					if(local_port > 50000)
-   						local_port = 35000;
    				}else{
 #if defined(_FTP_DEBUG_)
-   					printf("%d:FTPDataStart, port : %d\r\n",DATA_SOCK, IPPORT_FTPD);
+   					printf("%d:FTPDataStart, port : %d\r\n",sn, IPPORT_FTPD);
 #endif
-   					if((ret=socket(DATA_SOCK, Sn_MR_TCP, IPPORT_FTPD, 0x0)) != DATA_SOCK)
+   					if((ret=socket(sn, Sn_MR_TCP, IPPORT_FTPD, SF_IO_NONBLOCK)) != sn)
    					{
 #if defined(_FTP_DEBUG_)
-   						printf("%d:socket() error:%ld\r\n", DATA_SOCK, ret);
+   						printf("%d:socket() error:%ld\r\n", sn, ret);
 #endif
-   						close(DATA_SOCK);
+   						close(sn);
    						return ret;
    					}
    				}
 
-   				ftp.dsock_state = DATASOCK_START;
+   				ftp->dsock_state = DATASOCK_START;
    			}
    			break;
 
    		case SOCK_INIT :
 #if defined(_FTP_DEBUG_)
-   			printf("%d:Opened\r\n",DATA_SOCK);
+   			printf("%d:Opened\r\n",sn);
 #endif
-   			if(ftp.dsock_mode == PASSIVE_MODE){
-   				if( (ret = listen(DATA_SOCK)) != SOCK_OK)
+   			if(ftp->dsock_mode == PASSIVE_MODE){
+   				if( (ret = listen(sn)) != SOCK_OK)
    				{
 #if defined(_FTP_DEBUG_)
-   					printf("%d:Listen error\r\n",DATA_SOCK);
+   					printf("%d:Listen error\r\n",sn);
 #endif
    					return ret;
    				}
 
 #if defined(_FTP_DEBUG_)
-   				printf("%d:Listen ok\r\n",DATA_SOCK);
+   				printf("%d:Listen ok\r\n",sn);
 #endif
    			}else{
-   				if((ret = connect(DATA_SOCK, remote_ip.cVal, remote_port)) != SOCK_OK){
+   				/* Non-blocking, so SOCK_BUSY while the SYN is out */
+   				if((ret = connect(sn, ftp->remote_ip.cVal, ftp->remote_port)) < 0){
 #if defined(_FTP_DEBUG_)
-   					printf("%d:Connect error\r\n", DATA_SOCK);
+   					printf("%d:Connect error\r\n", sn);
 #endif
    					return ret;
    				}
    			}
-   			connect_state_data = 0;
+   			ftp->connect_state_data = 0;
    			break;
 
    		default :
    			break;
     }
-#endif
 
     return 0;
 }
 
+uint8_t ftpd_run(uint8_t * dbuf)
+{
+	long ret;
+	uint8_t i;
+
+	/* Each session's control connection, then its data connection, one step each */
+	for(i = 0; i < ftp_session_cnt; i++)
+	{
+		if((ret = ftpd_ctrl_run(&ftp_sessions[i], dbuf)) < 0)
+			return ret;
+		if((ret = ftpd_data_run(&ftp_sessions[i])) < 0)
+			return ret;
+	}
+
+	return 0;
+}
+
+/* A new PORT or PASV replaces any data connection not yet used */
+static void ftp_data_reset(struct ftpd *ftp)
+{
+	ftp_xfer_close(ftp);
+	if(getSn_SR(ftp->data) != SOCK_CLOSED)
+	{
+#if defined(_FTP_DEBUG_)
+		printf("data disconnect: %d\r\n", ftp->data);
+#endif
+		close(ftp->data);
+	}
+	ftp->connect_state_data = 0;
+}
+
 char proc_ftpd(uint8_t sn, char * buf)
 {
-	char **cmdp, *cp, *arg, *tmpstr;
+	struct ftpd *ftp = ftp_session(sn);
+	char **cmdp, *cp, *arg;
 	char sendbuf[200];
+	char path[LINELEN];
 	int slen;
 	long ret;
-	
+	long size;
+
+	if(ftp == NULL)
+		return 0;
 
 	/* Translate first word to lower case */
 	for (cp = buf; *cp != ' ' && *cp != '\0'; cp++)
@@ -784,7 +834,7 @@ char proc_ftpd(uint8_t sn, char * buf)
 		return 0;
 	}
 	/* Allow only USER, PASS and QUIT before logging in */
-	if (ftp.state == FTPS_NOT_LOGIN)
+	if (ftp->state == FTPS_NOT_LOGIN)
 	{
 		switch(cmdp - commands)
 		{
@@ -799,7 +849,7 @@ char proc_ftpd(uint8_t sn, char * buf)
 				return 0;
 		}
 	}
-	
+
 	arg = &buf[strlen(*cmdp)];
 	while(*arg == ' ') arg++;
 
@@ -813,9 +863,9 @@ char proc_ftpd(uint8_t sn, char * buf)
 			slen = strlen(arg);
 			arg[slen - 1] = 0x00;
 			arg[slen - 2] = 0x00;
-			if(ftp.ID_Enable == STATUS_USED)
+			if(ftp->ID_Enable == STATUS_USED)
 			{
-				if(strcmp(ftp.username, arg) != 0)
+				if(strcmp(ftp->username, arg) != 0)
 				{
 					slen = sprintf(sendbuf, "430 Invalid username\r\n");
 					ret = send(sn, (uint8_t *)sendbuf, slen);
@@ -832,7 +882,7 @@ char proc_ftpd(uint8_t sn, char * buf)
 			}
 			else
 			{
-				strcpy(ftp.username, arg);
+				strcpy(ftp->username, arg);
 			}
 			//fsprintf(CTRL_SOCK, givepass);
 			slen = sprintf(sendbuf, "331 Enter PASS command\r\n");
@@ -854,9 +904,9 @@ char proc_ftpd(uint8_t sn, char * buf)
 			slen = strlen(arg);
 			arg[slen - 1] = 0x00;
 			arg[slen - 2] = 0x00;
-			if(ftp.PW_Enable == STATUS_USED)
+			if(ftp->PW_Enable == STATUS_USED)
 			{
-				if(strcmp(ftp.userpassword, arg) != 0)
+				if(strcmp(ftp->userpassword, arg) != 0)
 				{
 					slen = sprintf(sendbuf, "430 Invalid password\r\n");
 					ret = send(sn, (uint8_t *)sendbuf, slen);
@@ -882,7 +932,7 @@ char proc_ftpd(uint8_t sn, char * buf)
 			{
 				case 'A':
 				case 'a':	/* Ascii */
-					ftp.type = ASCII_TYPE;
+					ftp->type = ASCII_TYPE;
 					//fsprintf(CTRL_SOCK, typeok, arg);
 					slen = sprintf(sendbuf, "200 Type set to %s\r\n", arg);
 					send(sn, (uint8_t *)sendbuf, slen);
@@ -892,7 +942,7 @@ char proc_ftpd(uint8_t sn, char * buf)
 				case 'b':	/* Binary */
 				case 'I':
 				case 'i':	/* Image */
-					ftp.type = IMAGE_TYPE;
+					ftp->type = IMAGE_TYPE;
 					//fsprintf(CTRL_SOCK, typeok, arg);
 					slen = sprintf(sendbuf, "200 Type set to %s\r\n", arg);
 					send(sn, (uint8_t *)sendbuf, slen);
@@ -907,7 +957,7 @@ char proc_ftpd(uint8_t sn, char * buf)
 			break;
 
 		case FEAT_CMD :
-			slen = sprintf(sendbuf, "211-Features:\r\n MDTM\r\n REST STREAM\r\n SIZE\r\n MLST size*;type*;create*;modify*;\r\n MLSD\r\n UTF8\r\n CLNT\r\n MFMT\r\n211 END\r\n");
+			slen = sprintf(sendbuf, "211-Features:\r\n SIZE\r\n MLSD\r\n UTF8\r\n211 END\r\n");
 			send(sn, (uint8_t *)sendbuf, slen);
 			break;
 
@@ -928,13 +978,30 @@ char proc_ftpd(uint8_t sn, char * buf)
 #if defined(_FTP_DEBUG_)
 			printf("RETR_CMD\r\n");
 #endif
-			if(strlen(ftp.workingdir) == 1)
-				sprintf(ftp.filename, "/%s", arg);
-			else
-				sprintf(ftp.filename, "%s/%s", ftp.workingdir, arg);
-			slen = sprintf(sendbuf, "150 Opening data channel for file downloand from server of \"%s\"\r\n", ftp.filename);
+			ftp_make_path(ftp, arg, ftp->filename);
+			if(ftp->dsock_state == DATASOCK_IDLE)
+			{
+				slen = sprintf(sendbuf, "425 Use PORT or PASV first.\r\n");
+				send(sn, (uint8_t *)sendbuf, slen);
+				break;
+			}
+			ftp_xfer_close(ftp);
+#if defined(F_FILESYSTEM)
+			ftp->fr = f_open(&(ftp->fil), (const char *)ftp->filename, FA_READ);
+			if(ftp->fr != FR_OK)
+			{
+#if defined(_FTP_DEBUG_)
+				printf("File Open Error: %d\r\n", ftp->fr);
+#endif
+				slen = snprintf(sendbuf, sizeof(sendbuf), "550 Can't read file \"%s\"\r\n", ftp->filename);
+				send(sn, (uint8_t *)sendbuf, slen);
+				break;
+			}
+			ftp->xfer_open = 1;
+#endif
+			slen = snprintf(sendbuf, sizeof(sendbuf), "150 Opening data channel for file downloand from server of \"%s\"\r\n", ftp->filename);
 			send(sn, (uint8_t *)sendbuf, slen);
-			ftp.current_cmd = RETR_CMD;
+			ftp_xfer_start(ftp, RETR_CMD);
 			break;
 
 		case APPE_CMD :
@@ -945,58 +1012,76 @@ char proc_ftpd(uint8_t sn, char * buf)
 #if defined(_FTP_DEBUG_)
 			printf("STOR_CMD\r\n");
 #endif
-			if(strlen(ftp.workingdir) == 1)
-				sprintf(ftp.filename, "/%s", arg);
-			else
-				sprintf(ftp.filename, "%s/%s", ftp.workingdir, arg);
-			slen = sprintf(sendbuf, "150 Opening data channel for file upload to server of \"%s\"\r\n", ftp.filename);
-			send(sn, (uint8_t *)sendbuf, slen);
-			ftp.current_cmd = STOR_CMD;
-			if(ftp.dsock_mode == ACTIVE_MODE)
+			ftp_make_path(ftp, arg, ftp->filename);
+			if(ftp->dsock_state == DATASOCK_IDLE)
 			{
-				if((ret = connect(DATA_SOCK, remote_ip.cVal, remote_port)) != SOCK_OK){
-	#if defined(_FTP_DEBUG_)
-					printf("%d:Connect error\r\n", DATA_SOCK);
-	#endif
-					return ret;
-				}
+				slen = sprintf(sendbuf, "425 Use PORT or PASV first.\r\n");
+				send(sn, (uint8_t *)sendbuf, slen);
+				break;
+			}
+			ftp_xfer_close(ftp);
+#if defined(F_FILESYSTEM)
+			ftp->fr = f_open(&(ftp->fil), (const char *)ftp->filename,
+							 FA_WRITE | (((cmdp - commands) == APPE_CMD) ? FA_OPEN_APPEND : FA_CREATE_ALWAYS));
+			if(ftp->fr != FR_OK)
+			{
+#if defined(_FTP_DEBUG_)
+				printf("File Open Error: %d\r\n", ftp->fr);
+#endif
+				slen = snprintf(sendbuf, sizeof(sendbuf), "553 Can't create \"%s\"\r\n", ftp->filename);
+				send(sn, (uint8_t *)sendbuf, slen);
+				break;
 			}
-   			connect_state_data = 0;
+			ftp->xfer_open = 1;
+#endif
+			slen = snprintf(sendbuf, sizeof(sendbuf), "150 Opening data channel for file upload to server of \"%s\"\r\n", ftp->filename);
+			send(sn, (uint8_t *)sendbuf, slen);
+			ftp_xfer_start(ftp, STOR_CMD);
 			break;
 
 		case PORT_CMD:
 #if defined(_FTP_DEBUG_)
 			printf("PORT_CMD\r\n");
 #endif
-			if (pport(arg) == -1){
+			if (pport(ftp, arg) == -1){
 				//fsprintf(CTRL_SOCK, badport);
 				slen = sprintf(sendbuf, "501 Bad port syntax\r\n");
 				send(sn, (uint8_t *)sendbuf, slen);
 			} else{
 				//fsprintf(CTRL_SOCK, portok);
-				ftp.dsock_mode = ACTIVE_MODE;
-				ftp.dsock_state = DATASOCK_READY;
+				ftp_data_reset(ftp);
+				ftp->dsock_mode = ACTIVE_MODE;
+				ftp->dsock_state = DATASOCK_READY;
 				slen = sprintf(sendbuf, "200 PORT command successful.\r\n");
 				send(sn, (uint8_t *)sendbuf, slen);
 			}
 			break;
 
 		case MLSD_CMD:
-#if defined(_FTP_DEBUG_)
-			printf("MLSD_CMD\r\n");
-#endif
-			slen = sprintf(sendbuf, "150 Opening data channel for directory listing of \"%s\"\r\n", ftp.workingdir);
-			send(sn, (uint8_t *)sendbuf, slen);
-			ftp.current_cmd = MLSD_CMD;
-			break;
-
 		case LIST_CMD:
 #if defined(_FTP_DEBUG_)
 			printf("LIST_CMD\r\n");
 #endif
-			slen = sprintf(sendbuf, "150 Opening data channel for directory listing of \"%s\"\r\n", ftp.workingdir);
+			if(ftp->dsock_state == DATASOCK_IDLE)
+			{
+				slen = sprintf(sendbuf, "425 Use PORT or PASV first.\r\n");
+				send(sn, (uint8_t *)sendbuf, slen);
+				break;
+			}
+			ftp_xfer_close(ftp);
+#if defined(F_FILESYSTEM)
+			ftp->fr = f_opendir(&(ftp->dir), ftp->workingdir);
+			if(ftp->fr != FR_OK)
+			{
+				slen = snprintf(sendbuf, sizeof(sendbuf), "550 Can't read directory \"%s\"\r\n", ftp->workingdir);
+				send(sn, (uint8_t *)sendbuf, slen);
+				break;
+			}
+			ftp->xfer_open = 1;
+#endif
+			slen = snprintf(sendbuf, sizeof(sendbuf), "150 Opening data channel for directory listing of \"%s\"\r\n", ftp->workingdir);
 			send(sn, (uint8_t *)sendbuf, slen);
-			ftp.current_cmd = LIST_CMD;
+			ftp_xfer_start(ftp, (enum ftp_cmd)(cmdp - commands));
 			break;
 
 		case NLST_CMD:
@@ -1012,26 +1097,23 @@ char proc_ftpd(uint8_t sn, char * buf)
 
 		case PWD_CMD:
 		case XPWD_CMD:
-			slen = sprintf(sendbuf, "257 \"%s\" is current directory.\r\n", ftp.workingdir);
+			slen = sprintf(sendbuf, "257 \"%s\" is current directory.\r\n", ftp->workingdir);
 			send(sn, (uint8_t *)sendbuf, slen);
 			break;
 
 		case PASV_CMD:
-			slen = sprintf(sendbuf, "227 Entering Passive Mode (%d,%d,%d,%d,%d,%d)\r\n", local_ip.cVal[0], local_ip.cVal[1], local_ip.cVal[2], local_ip.cVal[3], local_port >> 8, local_port & 0x00ff);
+			ftp_data_reset(ftp);
+			ftp->data_port = local_port++;
+			if(local_port > 50000)
+				local_port = 35000;
+
+			slen = sprintf(sendbuf, "227 Entering Passive Mode (%d,%d,%d,%d,%d,%d)\r\n", local_ip.cVal[0], local_ip.cVal[1], local_ip.cVal[2], local_ip.cVal[3], ftp->data_port >> 8, ftp->data_port & 0x00ff);
 			send(sn, (uint8_t *)sendbuf, slen);
 
-			if(getSn_SR(DATA_SOCK) == SOCK_ESTABLISHED) 
-			{
+			ftp->dsock_mode = PASSIVE_MODE;
+			ftp->dsock_state = DATASOCK_READY;
 #if defined(_FTP_DEBUG_)
-				printf("data disconnect: %d\r\n", DATA_SOCK);
-#endif			
-				disconnect(DATA_SOCK);
-			}
-			ftp.dsock_mode = PASSIVE_MODE;
-			ftp.dsock_state = DATASOCK_READY;
-			cur_sn = sn;
-#if defined(_FTP_DEBUG_)
-			printf("PASV port: %d\r\n", local_port);
+			printf("PASV port: %d\r\n", ftp->data_port);
 #endif
 		break;
 
@@ -1039,57 +1121,55 @@ char proc_ftpd(uint8_t sn, char * buf)
 			slen = strlen(arg);
 			arg[slen - 1] = 0x00;
 			arg[slen - 2] = 0x00;
-			if(slen > 3)
-			{
-				tmpstr = strrchr(arg, '/');
-				*tmpstr = 0;
+			ftp_make_path(ftp, arg, path);
 #if defined(F_FILESYSTEM)
-				slen = get_filesize(arg, tmpstr + 1);
+			size = get_filesize(path);
 #else
-				slen = _MAX_SS;
+			size = _MAX_SS;
 #endif
-				if(slen > 0)
-					slen = sprintf(sendbuf, "213 %d\r\n", slen);
-				else
-					slen = sprintf(sendbuf, "550 File not Found\r\n");
-			}
+			if(size >= 0)
+				slen = sprintf(sendbuf, "213 %ld\r\n", size);
 			else
-			{
 				slen = sprintf(sendbuf, "550 File not Found\r\n");
-			}
 			send(sn, (uint8_t *)sendbuf, slen);
 			break;
 
 		case CWD_CMD:
+		case XCWD_CMD:
 			slen = strlen(arg);
 			arg[slen - 1] = 0x00;
 			arg[slen - 2] = 0x00;
-			if(slen > 3)
+			if(strcmp(arg, "..") == 0)
+			{
+				/* Up one */
+				strcpy(path, ftp->workingdir);
+				cp = strrchr(path, '/');
+				if(cp == path)
+					cp++;
+				if(cp)
+					*cp = 0;
+			}
+			else
 			{
-				arg[slen - 3] = 0x00;
-				tmpstr = strrchr(arg, '/');
-				*tmpstr = 0;
+				ftp_make_path(ftp, arg, path);
+			}
+			/* No trailing '/' except for the root */
+			slen = strlen(path);
+			while(slen > 1 && path[slen - 1] == '/')
+				path[--slen] = 0;
 #if defined(F_FILESYSTEM)
-				slen = get_filesize(arg, tmpstr + 1);
-#else
-				slen = 0;
+			if(get_filesize(path) == 0)
 #endif
-				*tmpstr = '/';
-				if(slen == 0){
-					slen = sprintf(sendbuf, "213 %d\r\n", slen);
-					strcpy(ftp.workingdir, arg);
-					slen = sprintf(sendbuf, "250 CWD successful. \"%s\" is current directory.\r\n", ftp.workingdir);
-				}
-				else
-				{
-					slen = sprintf(sendbuf, "550 CWD failed. \"%s\"\r\n", arg);
-				}
+			{
+				strcpy(ftp->workingdir, path);
+				slen = sprintf(sendbuf, "250 CWD successful. \"%s\" is current directory.\r\n", ftp->workingdir);
 			}
+#if defined(F_FILESYSTEM)
 			else
 			{
-				strcpy(ftp.workingdir, arg);
-				slen = sprintf(sendbuf, "250 CWD successful. \"%s\" is current directory.\r\n", ftp.workingdir);
+				slen = sprintf(sendbuf, "550 CWD failed. \"%s\"\r\n", path);
 			}
+#endif
 			send(sn, (uint8_t *)sendbuf, slen);
 			break;
 
@@ -1099,14 +1179,14 @@ char proc_ftpd(uint8_t sn, char * buf)
 			arg[slen - 1] = 0x00;
 			arg[slen - 2] = 0x00;
 #if defined(F_FILESYSTEM)
-			if (f_mkdir(arg) != 0)
+			ftp_make_path(ftp, arg, path);
+			if (f_mkdir(path) != FR_OK)
 			{
 				slen = sprintf(sendbuf, "550 Can't create directory. \"%s\"\r\n", arg);
 			}
 			else
 			{
 				slen = sprintf(sendbuf, "257 MKD command successful. \"%s\"\r\n", arg);
-				//strcpy(ftp.workingdir, arg);
 			}
 #else
 			slen = sprintf(sendbuf, "550 Can't create directory. Permission denied\r\n");
@@ -1115,11 +1195,14 @@ char proc_ftpd(uint8_t sn, char * buf)
 			break;
 
 		case DELE_CMD:
+		case XRMD_CMD:
+		case RMD_CMD:
 			slen = strlen(arg);
 			arg[slen - 1] = 0x00;
 			arg[slen - 2] = 0x00;
 #if defined(F_FILESYSTEM)
-			if (f_unlink(arg) != 0)
+			ftp_make_path(ftp, arg, path);
+			if (f_unlink(path) != FR_OK)
 			{
 				slen = sprintf(sendbuf, "550 Could not delete. \"%s\"\r\n", arg);
 			}
@@ -1133,10 +1216,7 @@ char proc_ftpd(uint8_t sn, char * buf)
 			send(sn, (uint8_t *)sendbuf, slen);
 			break;
 
-		case XCWD_CMD:
 		case ACCT_CMD:
-		case XRMD_CMD:
-		case RMD_CMD:
 		case STRU_CMD:
 		case MODE_CMD:
 		case XMD5_CMD:
@@ -1151,30 +1231,32 @@ char proc_ftpd(uint8_t sn, char * buf)
 			send(sn, (uint8_t *)sendbuf, slen);
 			break;
 	}
-	
+
 	return 1;
 }
 
 
 char ftplogin(uint8_t sn, char * pass)
 {
+	struct ftpd *ftp = ftp_session(sn);
 	char sendbuf[100];
 	int slen = 0;
-	
-	//memset(sendbuf, 0, DATA_BUF_SIZE);
-	
+
+	if(ftp == NULL)
+		return 0;
+
 #if defined(_FTP_DEBUG_)
-	printf("%s logged in\r\n", ftp.username);
+	printf("%s logged in\r\n", ftp->username);
 #endif
 	//fsprintf(CTRL_SOCK, logged);
 	slen = sprintf(sendbuf, "230 Logged on\r\n");
 	send(sn, (uint8_t *)sendbuf, slen);
-	ftp.state = FTPS_LOGIN;
-	
+	ftp->state = FTPS_LOGIN;
+
 	return 1;
 }
 
-int pport(char * arg)
+int pport(struct ftpd *ftp, char * arg)
 {
 	int i;
 	char* tok=0;
@@ -1183,7 +1265,6 @@ int pport(char * arg)
 	{
 		if(i==0) tok = strtok(arg,",\r\n");
 		else	 tok = strtok(NULL,",");
-		remote_ip.cVal[i] = (uint8_t)atoi(tok);
 		if (!tok)
 		{
 #if defined(_FTP_DEBUG_)
@@ -1191,13 +1272,12 @@ int pport(char * arg)
 #endif
 			return -1;
 		}
+		ftp->remote_ip.cVal[i] = (uint8_t)atoi(tok);
 	}
-	remote_port = 0;
+	ftp->remote_port = 0;
 	for (i = 0; i < 2; i++)
 	{
 		tok = strtok(NULL,",\r\n");
-		remote_port <<= 8;
-		remote_port += atoi(tok);
 		if (!tok)
 		{
 #if defined(_FTP_DEBUG_)
@@ -1205,9 +1285,11 @@ int pport(char * arg)
 #endif
 			return -1;
 		}
+		ftp->remote_port <<= 8;
+		ftp->remote_port += atoi(tok);
 	}
 #if defined(_FTP_DEBUG_)
-	printf("ip : %d.%d.%d.%d, port : %d\r\n", remote_ip.cVal[0], remote_ip.cVal[1], remote_ip.cVal[2], remote_ip.cVal[3], remote_port);
+	printf("ip : %d.%d.%d.%d, port : %d\r\n", ftp->remote_ip.cVal[0], ftp->remote_ip.cVal[1], ftp->remote_ip.cVal[2], ftp->remote_ip.cVal[3], ftp->remote_port);
 #endif
 
 	return 0;
@@ -1217,15 +1299,15 @@ int pport(char * arg)
 void print_filedsc(FIL *fil)
 {
 #if defined(_FTP_DEBUG_)
-	printf("File System pointer : %08X\r\n", fil->fs);
-	printf("File System mount ID : %d\r\n", fil->id);
+	printf("File System pointer : %08X\r\n", fil->obj.fs);
+	printf("File System mount ID : %d\r\n", fil->obj.id);
 	printf("File status flag : %08X\r\n", fil->flag);
 	printf("File System pads : %08X\r\n", fil->err);
 	printf("File read write pointer : %08X\r\n", fil->fptr);
-	printf("File size : %08X\r\n", fil->fsize);
-	printf("File start cluster : %08X\r\n", fil->sclust);
+	printf("File size : %08X\r\n", fil->obj.objsize);
+	printf("File start cluster : %08X\r\n", fil->obj.sclust);
 	printf("current cluster : %08X\r\n", fil->clust);
-	printf("current data sector : %08X\r\n", fil->dsect);
+	printf("current data sector : %08X\r\n", fil->sect);
 	printf("dir entry sector : %08X\r\n", fil->dir_sect);
 	printf("dir entry pointer : %08X\r\n", fil->dir_ptr);
 #endif
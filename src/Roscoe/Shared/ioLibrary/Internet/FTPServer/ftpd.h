@@ -18,14 +18,15 @@ extern "C" {
 
 #include <stdint.h>
 
-//#define F_FILESYSTEM // If your target support a file system, you have to activate this feature and implement.
+#define F_FILESYSTEM // If your target support a file system, you have to activate this feature and implement.
 
 #if defined(F_FILESYSTEM)
-#include "ff.h"
+#include "Shared/FatFS/source/ff.h"
+#define _MAX_SS		FF_MAX_SS
 #endif
 
 #define F_APP_FTP
-#define _FTP_DEBUG_
+//#define _FTP_DEBUG_
 
 
 #define LINELEN		100
@@ -37,6 +38,22 @@ extern "C" {
 #define CTRL_SOCK	2
 #define DATA_SOCK	3
 #define CTRL_SOCK1	4
+#define DATA_SOCK1	5
+
+/* Each session takes two sockets, control then data, in socket number order from the mask */
+#define FTP_SOCK_MASK		((1 << CTRL_SOCK) | (1 << DATA_SOCK) | (1 << CTRL_SOCK1) | (1 << DATA_SOCK1))
+
+/* Sessions (and data buffers) to allocate - one per socket pair in FTP_SOCK_MASK. Raise
+   it if ftpd_init_socks() is given a wider mask. */
+#define FTP_MASK_SOCKS(m)	(((m) & 1) + (((m) >> 1) & 1) + (((m) >> 2) & 1) + (((m) >> 3) & 1) + \
+							 (((m) >> 4) & 1) + (((m) >> 5) & 1) + (((m) >> 6) & 1) + (((m) >> 7) & 1))
+#ifndef FTP_MAX_SESSIONS
+#define FTP_MAX_SESSIONS	(FTP_MASK_SOCKS(FTP_SOCK_MASK) / 2)
+#endif
+
+/* Per session data channel staging buffer; a multiple of _MAX_SS. Transfers move
+   min(this, the data socket's buffer) at a time, in whole sectors. */
+#define FTP_DATA_BUF_SIZE	8192
 
 
 #define	IPPORT_FTPD	20	/* FTP Data port */
@@ -108,10 +125,25 @@ enum ftp_use_status{
 	STATUS_NOT_USED
 };
 
+#ifndef un_I2cval
+typedef union _un_l2cval {
+	uint32_t	lVal;
+	uint8_t		cVal[4];
+}un_l2cval;
+#endif
+
 struct ftpd {
 	uint8_t control;			/* Control stream */
 	uint8_t data;			/* Data stream */
 
+	uint8_t connect_state_control;
+	uint8_t connect_state_data;
+	uint32_t con_remain_cnt;
+
+	un_l2cval remote_ip;		/* Active mode peer, from PORT */
+	uint16_t remote_port;
+	uint16_t data_port;		/* Passive mode listening port, from PASV */
+
 	enum ftp_type type;		/* Transfer type */
 	enum ftp_state state;
 
@@ -130,25 +162,26 @@ struct ftpd {
 
 #if defined(F_FILESYSTEM)
 	FIL fil;	// FatFs File objects
+	DIR dir;	// Directory being listed
 	FRESULT fr;	// FatFs function common result code
+	uint8_t xfer_open;	// fil or dir is open for the current transfer
 #endif
 
+	uint8_t *xbuf;		// Data channel staging buffer, FTP_DATA_BUF_SIZE bytes
+	uint32_t xbuf_len;	// Bytes staged
+	uint32_t xbuf_ofs;	// Staged bytes already given to the socket
+	uint8_t xfer_eof;	// Nothing more to read for the current transfer
+	uint32_t xfer_bytes;
 };
 
-#ifndef un_I2cval
-typedef union _un_l2cval {
-	uint32_t	lVal;
-	uint8_t		cVal[4];
-}un_l2cval;
-#endif
-
 void ftpd_init(uint8_t * src_ip);
+void ftpd_init_socks(uint8_t * src_ip, uint8_t sock_mask);
 uint8_t ftpd_run(uint8_t * dbuf);
 char proc_ftpd(uint8_t sn, char * buf);
 
 char ftplogin(uint8_t sn,char * pass);
 
-int pport(char * arg);
+int pport(struct ftpd *ftp, char * arg);
 
 int sendit(char * command);
 int recvit(char * command);
@@ -8,7 +8,9 @@ extern "C" {
 
 #include <stdint.h>
 
+#if !defined(__BYTE_ORDER__) || (__BYTE_ORDER__ != __ORDER_BIG_ENDIAN__)
 #define SYSTEM_LITTLE_ENDIAN
+#endif
 
 int8_t* inet_ntoa(uint32_t addr);
 int8_t* inet_ntoa_pad(uint32_t addr);
@@ -6,7 +6,10 @@
  */
 
 /* Includes -----------------------------------------------------*/
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <strings.h>
 #include "tftp.h"
 #include "socket.h"
 #include "netutil.h"
@@ -40,22 +43,39 @@ static uint32_t tftp_time_cnt = 0;
 static uint32_t tftp_retry_cnt = 0;
 
 static uint8_t *g_tftp_rcv_buf = NULL;
-
-static TFTP_OPTION default_tftp_opt = {
-	.code = (uint8_t *)"timeout",
-	.value = (uint8_t *)"5"
-};
+static uint8_t g_tftp_snd_buf[MAX_MTU_SIZE];
+
+/* Options sent with the RRQ, and what the server agreed to */
+static TFTP_OPTION g_tftp_opt[4];
+static uint8_t g_tftp_opt_cnt = 0;
+static uint8_t g_opt_blksize[6];
+static uint8_t g_opt_windowsize[6];
+static uint16_t g_req_windowsize = 1;
+
+static uint16_t g_blksize = TFTP_BLK_SIZE;
+static uint16_t g_windowsize = 1;
+static uint16_t g_window_cnt = 0;		/* In-order blocks since the last ACK */
+static uint8_t g_ooo_acked = 0;			/* Last good block already re-ACKed for this gap */
+
+/* Load destination. In-order DATA payloads are read out of the chip straight into place. */
+static uint8_t *g_dest = NULL;
+static uint32_t g_dest_size = 0;
+static uint32_t g_rcv_len = 0;
+static uint8_t g_data_placed = 0;
 
 uint8_t g_progress_state = TFTP_PROGRESS;
 
 #ifdef __TFTP_DEBUG__
-int dbg_level = (INFO_DBG | ERROR_DBG | IPC_DBG);
+int dbg_level = (INFO_DBG | ERROR_DBG);	/* | IPC_DBG for a line per packet */
 #endif
 
 /* static function define ---------------------------------------*/
 static void set_filename(uint8_t *file, uint32_t file_size)
 {
-	memcpy(g_filename, file, file_size);
+	if(file_size > FILE_NAME_SIZE)
+		file_size = FILE_NAME_SIZE;
+	memmove(g_filename, file, file_size);	/* RRQ retransmits pass g_filename itself */
+	g_filename[FILE_NAME_SIZE - 1] = 0;
 }
 
 static inline void set_server_ip(uint32_t ipaddr)
@@ -161,6 +181,7 @@ static int recv_udp_packet(int socket, uint8_t *packet, uint32_t len, uint32_t *
 	int ret;
 	uint8_t sck_state;
 	uint16_t recv_len;
+	int32_t rd_len;
 
 	/* Receive Packet Process */
 	ret = getsockopt(socket, SO_STATUS, &sck_state);
@@ -177,16 +198,19 @@ static int recv_udp_packet(int socket, uint8_t *packet, uint32_t len, uint32_t *
 		}
 
 		if(recv_len) {
-			recv_len = recvfrom(socket, packet, len, (uint8_t *)ip, port);
-			if(recv_len < 0) {
+			rd_len = recvfrom(socket, packet, len, (uint8_t *)ip, port);
+			if(rd_len < 0) {
 				//DBG_PRINT(ERROR_DBG, "[%s] recvfrom error\r\n", __func__);
 				return -1;
 			}
 
 			*ip = ntohl(*ip);
 
-			return recv_len;
+			return rd_len;
 		}
+
+		/* Nothing waiting */
+		return 0;
 	}
 	return -1;
 }
@@ -231,14 +255,84 @@ static void tftp_reg_timeout()
 	}
 }
 
-static void process_tftp_option(uint8_t *msg, uint32_t msg_len)
+/* Build the RRQ options. windowsize is trimmed so a whole window of full blocks, each with the
+   W5500's 8 byte UDP packet header, fits in the socket's RX memory; anything past that is dropped by the chip. */
+static void set_tftp_options(void)
 {
-	/* TODO Option Process */
+	uint16_t window;
+
+	window = getSn_RxMAX(g_tftp_socket) / (TFTP_MAX_BLK_SIZE + TFTP_HDR_SIZE + 8);
+	if(window > TFTP_WINDOW_SIZE)
+		window = TFTP_WINDOW_SIZE;
+	if(window < 1)
+		window = 1;
+	g_req_windowsize = window;
+
+	g_tftp_opt_cnt = 0;
+
+	sprintf((char *)g_opt_blksize, "%u", TFTP_MAX_BLK_SIZE);
+	g_tftp_opt[g_tftp_opt_cnt].code = (uint8_t *)"blksize";
+	g_tftp_opt[g_tftp_opt_cnt++].value = g_opt_blksize;
+
+	if(window > 1) {
+		sprintf((char *)g_opt_windowsize, "%u", window);
+		g_tftp_opt[g_tftp_opt_cnt].code = (uint8_t *)"windowsize";
+		g_tftp_opt[g_tftp_opt_cnt++].value = g_opt_windowsize;
+	}
+
+	g_tftp_opt[g_tftp_opt_cnt].code = (uint8_t *)"timeout";
+	g_tftp_opt[g_tftp_opt_cnt++].value = (uint8_t *)"5";
+
+	g_tftp_opt[g_tftp_opt_cnt].code = (uint8_t *)"tsize";
+	g_tftp_opt[g_tftp_opt_cnt++].value = (uint8_t *)"0";
+}
+
+/* Take on what the server agreed to in its OACK. Returns TFTP_ERR_OPTION if it answered with something
+   that wasn't asked for, TFTP_ERR_DISK_FULL if tsize says the file won't fit the load destination, else 0. */
+static int process_tftp_option(uint8_t *msg, uint32_t msg_len)
+{
+	uint8_t *opt = msg + 2;
+	uint8_t *end = msg + msg_len;
+	uint8_t *value;
+	uint32_t num;
+
+	while(opt < end) {
+		value = opt + strnlen((char *)opt, end - opt) + 1;
+		if(value >= end)
+			break;
+		num = strtoul((char *)value, NULL, 10);
+#ifdef __TFTP_DEBUG__
+		DBG_PRINT(INFO_DBG, "[%s] %s = %s\r\n", __func__, opt, value);
+#endif
+
+		if(!strcasecmp((char *)opt, "blksize")) {
+			if((num < 8) || (num > TFTP_MAX_BLK_SIZE))
+				return TFTP_ERR_OPTION;
+			g_blksize = (uint16_t)num;
+		}
+		else if(!strcasecmp((char *)opt, "windowsize")) {
+			if((num < 1) || (num > g_req_windowsize))
+				return TFTP_ERR_OPTION;
+			g_windowsize = (uint16_t)num;
+		}
+		else if(!strcasecmp((char *)opt, "timeout")) {
+			if((num >= 1) && (num <= 255))
+				set_tftp_timeout(num);
+		}
+		else if(!strcasecmp((char *)opt, "tsize")) {
+			if(g_dest && (num > g_dest_size))
+				return TFTP_ERR_DISK_FULL;
+		}
+
+		opt = value + strnlen((char *)value, end - value) + 1;
+	}
+
+	return 0;
 }
 
 static void send_tftp_rrq(uint8_t *filename, uint8_t *mode, TFTP_OPTION *opt, uint8_t opt_len)
 {
-	uint8_t snd_buf[MAX_MTU_SIZE];
+	uint8_t *snd_buf = g_tftp_snd_buf;
 	uint8_t *pkt = snd_buf;
 	uint32_t i, len;
 
@@ -335,6 +429,10 @@ static void send_tftp_ack(uint16_t block_number)
 	pkt += 2;
 
 	send_udp_packet(g_tftp_socket , snd_buf, 4, get_server_ip(), get_server_port());
+
+	/* The server sends the next window from the block after this one */
+	g_window_cnt = 0;
+	tftp_cancel_timeout();
 	tftp_reg_timeout();
 #ifdef __TFTP_DEBUG__
 	DBG_PRINT(IPC_DBG, ">> TFTP ACK : Block Number(%d)\r\n", block_number);
@@ -368,10 +466,9 @@ static void send_tftp_oack(TFTP_OPTION *opt, uint8_t opt_len)
 }
 #endif
 
-#if 0	// 2014.07.01 sskim
 static void send_tftp_error(uint16_t error_number, uint8_t *error_message)
 {
-	uint8_t snd_buf[MAX_MTU_SIZE];
+	uint8_t *snd_buf = g_tftp_snd_buf;
 	uint8_t *pkt = snd_buf;
 	uint32_t len;
 
@@ -390,7 +487,6 @@ static void send_tftp_error(uint16_t error_number, uint8_t *error_message)
 	DBG_PRINT(IPC_DBG, ">> TFTP ERROR : Error Number(%d)\r\n", error_number);
 #endif
 }
-#endif
 
 static void recv_tftp_rrq(uint8_t *msg, uint32_t msg_len)
 {
@@ -405,6 +501,7 @@ static void recv_tftp_wrq(uint8_t *msg, uint32_t msg_len)
 static void recv_tftp_data(uint8_t *msg, uint32_t msg_len)
 {
 	TFTP_DATA_T *data = (TFTP_DATA_T *)msg;
+	uint32_t data_len = msg_len - TFTP_HDR_SIZE;
 
 	data->opcode = ntohs(data->opcode);
 	data->block_num = ntohs(data->block_num);
@@ -416,36 +513,44 @@ static void recv_tftp_data(uint8_t *msg, uint32_t msg_len)
 	{
 		case STATE_RRQ :
 		case STATE_OACK :
-			if(data->block_num == 1) {
-				set_tftp_state(STATE_DATA);
-				set_block_number(data->block_num);
-#ifdef F_STORAGE
-				save_data(data->data, msg_len - 4, data->block_num);
-#endif
-				tftp_cancel_timeout();
-			}
-			send_tftp_ack(data->block_num);
-
-			if((msg_len - 4) < TFTP_BLK_SIZE) {
-				init_tftp();
-				g_progress_state = TFTP_SUCCESS;
-			}
-
-			break;
-			
 		case STATE_DATA :
-			if(data->block_num == (get_block_number() + 1)) {
+			if(data->block_num == (uint16_t)(get_block_number() + 1)) {
+				if(g_dest && !g_data_placed) {
+					/* recv_tftp_payload() only leaves it in the receive buffer if it won't fit */
+					send_tftp_error(TFTP_ERR_DISK_FULL, (uint8_t *)"File too large");
+					init_tftp();
+					g_progress_state = TFTP_FAIL;
+					break;
+				}
+
+				set_tftp_state(STATE_DATA);
 				set_block_number(data->block_num);
+				g_rcv_len += data_len;
 #ifdef F_STORAGE
-				save_data(data->data, msg_len - 4, data->block_num);
+				if(!g_dest)
+					save_data(data->data, data_len, data->block_num);
 #endif
-				tftp_cancel_timeout();
+				g_ooo_acked = 0;
+
+				if(data_len < g_blksize) {
+					send_tftp_ack(data->block_num);
+					init_tftp();
+					g_progress_state = TFTP_SUCCESS;
+				}
+				else if(++g_window_cnt >= g_windowsize) {
+					send_tftp_ack(data->block_num);
+				}
+				else {
+					/* Mid-window; restart the timer in case the rest of the window is lost */
+					tftp_cancel_timeout();
+					tftp_reg_timeout();
+				}
 			}
-			send_tftp_ack(data->block_num);
-
-			if((msg_len - 4) < TFTP_BLK_SIZE) {
-				init_tftp();
-				g_progress_state = TFTP_SUCCESS;
+			else if(!g_ooo_acked) {
+				/* Duplicate, or a block went missing. ACK the last good one once so the server
+				   resends from there, rather than once for every block left in its window. */
+				g_ooo_acked = 1;
+				send_tftp_ack(get_block_number());
 			}
 
 			break;
@@ -478,6 +583,8 @@ static void recv_tftp_ack(uint8_t *msg, uint32_t msg_len)
 
 static void recv_tftp_oack(uint8_t *msg, uint32_t msg_len)
 {
+	int ret;
+
 #ifdef __TFTP_DEBUG__
 	DBG_PRINT(IPC_DBG, "<< TFTP_OACK : \r\n");
 #endif
@@ -485,7 +592,12 @@ static void recv_tftp_oack(uint8_t *msg, uint32_t msg_len)
 	switch(get_tftp_state())
 	{
 		case STATE_RRQ :
-			process_tftp_option(msg, msg_len);	
+			if((ret = process_tftp_option(msg, msg_len)) != 0) {
+				send_tftp_error(ret, (uint8_t *)((ret == TFTP_ERR_DISK_FULL) ? "File too large" : "Bad option"));
+				init_tftp();
+				g_progress_state = TFTP_FAIL;
+				break;
+			}
 			set_tftp_state(STATE_OACK);
 			tftp_cancel_timeout();
 			send_tftp_ack(0);
@@ -517,14 +629,74 @@ static void recv_tftp_error(uint8_t *msg, uint32_t msg_len)
 	DBG_PRINT(IPC_DBG, "<< TFTP_ERROR : %d (%s)\r\n", data->error_code, data->error_msg);
 	DBG_PRINT(ERROR_DBG, "[%s] Error Code : %d (%s)\r\n", __func__, data->error_code, data->error_msg);
 #endif
+
+	/* A server that refuses options gets a plain RFC 1350 request instead */
+	if((get_tftp_state() == STATE_RRQ) && (data->error_code == TFTP_ERR_OPTION) && g_tftp_opt_cnt) {
+		g_tftp_opt_cnt = 0;
+		tftp_cancel_timeout();
+		send_tftp_rrq(g_filename, (uint8_t *)TRANS_BINARY, g_tftp_opt, g_tftp_opt_cnt);
+		return;
+	}
+
 	init_tftp();
 	g_progress_state = TFTP_FAIL;
 }
 
+/* Read the rest of the packet whose header is in packet. The next in-order DATA block goes straight
+   from the chip into the load destination; anything else follows the header in packet. */
+static uint16_t recv_tftp_payload(uint8_t *packet, uint32_t from_ip)
+{
+	uint16_t remain = 0;
+	uint16_t len = 0;
+	uint16_t space;
+	uint16_t from_port;
+	uint8_t addr[4];
+	uint8_t scratch[16];
+	uint32_t state = get_tftp_state();
+	int32_t rd_len;
+
+	g_data_placed = 0;
+	getsockopt(g_tftp_socket, SO_REMAINSIZE, &remain);
+
+	if(g_dest && (remain <= g_blksize) && (remain <= (g_dest_size - g_rcv_len)) &&
+	   (from_ip == get_server_ip()) &&
+	   ((state == STATE_RRQ) || (state == STATE_OACK) || (state == STATE_DATA)) &&
+	   (ntohs(*((uint16_t *)packet)) == TFTP_DATA) &&
+	   ((uint16_t)ntohs(*((uint16_t *)(packet + 2))) == (uint16_t)(get_block_number() + 1))) {
+		rd_len = remain ? recvfrom(g_tftp_socket, g_dest + g_rcv_len, remain, addr, &from_port) : 0;
+		if(rd_len < 0)
+			return 0;
+		g_data_placed = 1;
+		return (uint16_t)rd_len;
+	}
+
+	/* Keep room for a terminating 0 after the packet */
+	while(remain) {
+		space = MAX_MTU_SIZE - 1 - TFTP_HDR_SIZE - len;
+		if(space) {
+			rd_len = recvfrom(g_tftp_socket, packet + TFTP_HDR_SIZE + len, (remain < space) ? remain : space, addr, &from_port);
+			if(rd_len > 0)
+				len += rd_len;
+		}
+		else {
+			rd_len = recvfrom(g_tftp_socket, scratch, (remain < sizeof(scratch)) ? remain : sizeof(scratch), addr, &from_port);
+		}
+
+		if(rd_len <= 0)
+			break;
+		remain -= rd_len;
+	}
+
+	return len;
+}
+
 static void recv_tftp_packet(uint8_t *packet, uint32_t packet_len, uint32_t from_ip, uint16_t from_port)
 {
 	uint16_t opcode;
 
+	if(packet_len < 2)
+		return;
+
 	/* Verify Server IP */
 	if(from_ip != get_server_ip()) {
 #ifdef __TFTP_DEBUG__
@@ -592,7 +764,8 @@ void TFTP_exit(void)
 
 int TFTP_run(void)
 {
-	uint16_t len, from_port;
+	int len;
+	uint16_t from_port;
 	uint32_t from_ip;
 
 	/* Timeout Process */
@@ -603,11 +776,12 @@ int TFTP_run(void)
 				break;
 
 			case STATE_RRQ:
-				send_tftp_rrq(g_filename, (uint8_t *)TRANS_BINARY, &default_tftp_opt, 1);
+				send_tftp_rrq(g_filename, (uint8_t *)TRANS_BINARY, g_tftp_opt, g_tftp_opt_cnt);
 				break;
 
 			case STATE_OACK:
 			case STATE_DATA:
+				g_ooo_acked = 0;
 				send_tftp_ack(get_block_number());
 				break;
 
@@ -628,29 +802,70 @@ int TFTP_run(void)
 		}
 	}
 
-	/* Receive Packet Process */
-	len = recv_udp_packet(g_tftp_socket, g_tftp_rcv_buf, MAX_MTU_SIZE, &from_ip, &from_port);
+	/* Receive Packet Process; the header first, so the payload can go wherever it belongs.
+	   Only recv_tftp_payload() sets g_data_placed, and short packets never get that far. */
+	g_data_placed = 0;
+	len = recv_udp_packet(g_tftp_socket, g_tftp_rcv_buf, TFTP_HDR_SIZE, &from_ip, &from_port);
 	if(len < 0) {
 #ifdef __TFTP_DEBUG__
 		DBG_PRINT(ERROR_DBG, "[%s] recv_udp_packet error\r\n", __func__);
 #endif
 		return g_progress_state;
 	}
+	if(len == 0)
+		return g_progress_state;
+
+	if(len == TFTP_HDR_SIZE)
+		len += recv_tftp_payload(g_tftp_rcv_buf, from_ip);
+	if(!g_data_placed)
+		g_tftp_rcv_buf[len] = 0;
 
 	recv_tftp_packet(g_tftp_rcv_buf, len, from_ip, from_port);
 
 	return g_progress_state;
 }
 
-void TFTP_read_request(uint32_t server_ip, uint8_t *filename)
+static void start_read_request(uint32_t server_ip, uint8_t *filename)
 {
+	init_tftp();
 	set_server_ip(server_ip);
 #ifdef __TFTP_DEBUG__
 	DBG_PRINT(INFO_DBG, "[%s] Set Tftp Server : %x\r\n", __func__, server_ip);
 #endif
 
+	/* RFC 1350 behaviour until an OACK says otherwise */
+	g_blksize = TFTP_BLK_SIZE;
+	g_windowsize = 1;
+	g_window_cnt = 0;
+	g_ooo_acked = 0;
+	g_rcv_len = 0;
+	set_tftp_timeout(5);
+	set_tftp_options();
+
 	g_progress_state = TFTP_PROGRESS;
-	send_tftp_rrq(filename, (uint8_t *)TRANS_BINARY, &default_tftp_opt, 1);
+	send_tftp_rrq(filename, (uint8_t *)TRANS_BINARY, g_tftp_opt, g_tftp_opt_cnt);
+}
+
+/* Blocks are handed to save_data() as they arrive */
+void TFTP_read_request(uint32_t server_ip, uint8_t *filename)
+{
+	g_dest = NULL;
+	g_dest_size = 0;
+	start_read_request(server_ip, filename);
+}
+
+/* Blocks land at dest in order, read straight out of the socket's RX memory. The transfer
+   fails if the file is larger than dest_size. TFTP_get_length() gives the size once done. */
+void TFTP_read_request_to(uint32_t server_ip, uint8_t *filename, uint8_t *dest, uint32_t dest_size)
+{
+	g_dest = dest;
+	g_dest_size = dest_size;
+	start_read_request(server_ip, filename);
+}
+
+uint32_t TFTP_get_length(void)
+{
+	return g_rcv_len;
 }
 
 void tftp_timeout_handler(void)
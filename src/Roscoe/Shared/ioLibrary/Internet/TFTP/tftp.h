@@ -51,6 +51,11 @@ extern int dbg_level;
 #define STATE_ACK		4
 #define STATE_OACK		5
 
+/* tftp error codes */
+#define TFTP_ERR_UNDEF			0
+#define TFTP_ERR_DISK_FULL		3
+#define TFTP_ERR_OPTION			8
+
 /* tftp transfer mode */
 #define TRANS_ASCII		"netascii"
 #define TRANS_BINARY	"octet"
@@ -63,9 +68,12 @@ extern int dbg_level;
 /* define */
 #define TFTP_SERVER_PORT		69
 #define TFTP_TEMP_PORT			51000
-#define TFTP_BLK_SIZE			512
+#define TFTP_BLK_SIZE			512		/* RFC 1350 block size; used when the server ignores options */
+#define TFTP_MAX_BLK_SIZE		1468	/* blksize (RFC 2348) asked for; one 1500 byte Ethernet MTU less IP, UDP and TFTP headers */
+#define TFTP_WINDOW_SIZE		16		/* windowsize (RFC 7440) asked for, if the socket's RX memory holds that many blocks */
+#define TFTP_HDR_SIZE			4
 #define MAX_MTU_SIZE			1514
-#define FILE_NAME_SIZE			20
+#define FILE_NAME_SIZE			128
 
 //#define __TFTP_DEBUG__
 
@@ -92,6 +100,8 @@ void TFTP_init(uint8_t socket, uint8_t *buf);
 void TFTP_exit(void);
 int TFTP_run(void);
 void TFTP_read_request(uint32_t server_ip, uint8_t *filename);
+void TFTP_read_request_to(uint32_t server_ip, uint8_t *filename, uint8_t *dest, uint32_t dest_size);
+uint32_t TFTP_get_length(void);
 void tftp_timeout_handler(void);
 
 #ifdef __cplusplus
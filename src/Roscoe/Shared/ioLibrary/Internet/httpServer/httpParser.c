@@ -288,7 +288,7 @@ uint8_t get_http_uri_name(uint8_t * uri, uint8_t * uri_buf)
 	uri_ptr = (uint8_t *)strtok((char *)uri_buf, " ?");
 
 	if(strcmp((char *)uri_ptr,"/")) uri_ptr++;
-	strcpy((char *)uri_buf, (char *)uri_ptr);
+	memmove(uri_buf, uri_ptr, strlen((char *)uri_ptr) + 1);	// uri_ptr points into uri_buf
 
 #ifdef _HTTPPARSER_DEBUG_
 	printf("  uri_name = %s\r\n", uri_buf);
@@ -13,6 +13,11 @@
 #include "ff.h" 	// header file for FatFs library (FAT file system)
 #endif
 
+#ifdef	_USE_FATFS_
+#include <ctype.h>
+#include <strings.h>
+#endif
+
 #ifndef DATA_BUF_SIZE
 	#define DATA_BUF_SIZE		2048
 #endif
@@ -45,6 +50,24 @@ FIL fs;		// FatFs: File object
 FRESULT fr;	// FatFs: File function return code
 #endif
 
+#ifdef	_USE_FATFS_
+// Request headers that matter to a FATFILE response, pulled out before parse_http_request() tokenizes the request
+typedef struct _st_http_headers
+{
+	uint8_t		keep_alive;		// Persistent connection; HTTP/1.1 default, or "Connection: keep-alive"
+	uint8_t		accept_gzip;	// A pre-compressed .gz variant may be sent
+	uint8_t		range;			// A single byte range was requested
+	uint8_t		range_suffix;	// "bytes=-n"; range_last is the suffix length
+	uint32_t	range_first;
+	uint32_t	range_last;		// 0xffffffff when open ended ("bytes=n-")
+}st_http_headers;
+
+static st_http_headers http_headers;
+
+// f_read() moves whole sectors from the disk straight into here when the file pointer is sector aligned
+static uint8_t http_file_buf[HTTP_FILE_BUF_SIZE] __attribute__((aligned(4)));
+#endif
+
 /*****************************************************************************
  * Private functions
  ****************************************************************************/
@@ -57,6 +80,19 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request);
 static void send_http_response_header(uint8_t s, uint8_t content_type, uint32_t body_len, uint16_t http_status);
 static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf, uint32_t start_addr, uint32_t file_len);
 static void send_http_response_cgi(uint8_t s, uint8_t * buf, uint8_t * http_body, uint16_t file_len);
+static int32_t http_send(uint8_t s, uint8_t * buf, uint16_t len);
+
+#ifdef	_USE_FATFS_
+static uint16_t http_peek_request(uint8_t s, uint8_t * buf, uint8_t * overflow);
+static char * find_http_header(char * buf, char * end, const char * name);
+static uint8_t http_header_has(char * value, const char * token);
+static void parse_http_headers(char * buf);
+static FRESULT http_open_file(int8_t seqnum, uint8_t * uri_name, uint32_t * file_len, uint8_t * gzip);
+static void http_close_file(int8_t seqnum);
+static const char * http_content_type(uint8_t type);
+static void send_http_response_file_head(uint8_t s, uint8_t method, uint8_t content_type, uint32_t file_size, uint8_t gzip);
+static void send_http_response_file(uint8_t s, uint8_t * head, uint16_t head_len);
+#endif
 
 /*****************************************************************************
  * Public functions
@@ -118,7 +154,11 @@ void httpServer_run(uint8_t seqnum)
 {
 	uint8_t s;	// socket number
 	uint16_t len;
+#ifdef _USE_FATFS_
+	uint8_t overflow;
+#else
 	uint32_t gettime = 0;
+#endif
 
 #ifdef _HTTPSERVER_DEBUG_
 	uint8_t destip[4] = {0, };
@@ -139,6 +179,17 @@ void httpServer_run(uint8_t seqnum)
 			if(getSn_IR(s) & Sn_IR_CON)
 			{
 				setSn_IR(s, Sn_IR_CON);
+#ifdef _USE_FATFS_
+				// New connection; drop anything left over from the last one on this socket
+				http_close_file(seqnum);
+				HTTPSock_Status[seqnum].file_len = 0;
+				HTTPSock_Status[seqnum].file_offset = 0;
+				HTTPSock_Status[seqnum].file_start = 0;
+				HTTPSock_Status[seqnum].keep_alive = 1;
+				HTTPSock_Status[seqnum].send_issued = 0;
+				HTTPSock_Status[seqnum].idle_time = get_httpServer_timecount();
+				HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
+#endif
 			}
 
 			// HTTP Process states
@@ -146,6 +197,38 @@ void httpServer_run(uint8_t seqnum)
 			{
 
 				case STATE_HTTP_IDLE :
+#ifdef _USE_FATFS_
+					// Requests are only taken out of the RX memory once complete, and only up to the end of
+					// the first one, so pipelined requests wait there for their turn.
+					if ((len = http_peek_request(s, (uint8_t *)http_request, &overflow)) > 0)
+					{
+						parse_http_headers((char *)http_request);
+						HTTPSock_Status[seqnum].keep_alive = http_headers.keep_alive;
+						parse_http_request(parsed_http_request, (uint8_t *)http_request);
+#ifdef _HTTPSERVER_DEBUG_
+						printf("> HTTPSocket[%d] : HTTP Request received [ %d ]byte\r\n", s, len);
+#endif
+						http_process_handler(s, parsed_http_request);
+
+						if(HTTPSock_Status[seqnum].file_len > 0) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_INPROC;
+						else HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
+					}
+					else if (overflow)
+					{
+						// Never going to fit in the request buffer
+						http_response = pHTTP_RX;
+						send_http_response_header(s, 0, 0, STATUS_BAD_REQ);
+						HTTPSock_Status[seqnum].keep_alive = 0;
+						HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
+					}
+					else if ((get_httpServer_timecount() - HTTPSock_Status[seqnum].idle_time) > HTTP_KEEPALIVE_TIMEOUT_SEC)
+					{
+#ifdef _HTTPSERVER_DEBUG_
+						printf("> HTTPSocket[%d] : Keep-alive timeout\r\n", s);
+#endif
+						http_disconnect(s);
+					}
+#else
 					if ((len = getSn_RX_RSR(s)) > 0)
 					{
 						if (len > DATA_BUF_SIZE) len = DATA_BUF_SIZE;
@@ -183,6 +266,7 @@ void httpServer_run(uint8_t seqnum)
 						if(HTTPSock_Status[seqnum].file_len > 0) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_INPROC;
 						else HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE; // Send the 'HTTP response' end
 					}
+#endif
 					break;
 
 				case STATE_HTTP_RES_INPROC :
@@ -191,12 +275,35 @@ void httpServer_run(uint8_t seqnum)
 					printf("> HTTPSocket[%d] : [State] STATE_HTTP_RES_INPROC\r\n", s);
 #endif
 					// Repeatedly send remaining data to client
+#ifdef _USE_FATFS_
+					if(HTTPSock_Status[seqnum].storage_type == FATFILE)
+					{
+						send_http_response_file(s, 0, 0);
+					}
+					else
+#endif
 					send_http_response_body(s, 0, http_response, 0, 0);
 
 					if(HTTPSock_Status[seqnum].file_len == 0) HTTPSock_Status[seqnum].sock_status = STATE_HTTP_RES_DONE;
 					break;
 
 				case STATE_HTTP_RES_DONE :
+#ifdef _USE_FATFS_
+					http_close_file(seqnum);
+					if(HTTPSock_Status[seqnum].keep_alive)
+					{
+						// Persistent connection; go back for the next (possibly already pipelined) request
+						HTTPSock_Status[seqnum].file_len = 0;
+						HTTPSock_Status[seqnum].file_offset = 0;
+						HTTPSock_Status[seqnum].file_start = 0;
+						HTTPSock_Status[seqnum].idle_time = get_httpServer_timecount();
+						HTTPSock_Status[seqnum].sock_status = STATE_HTTP_IDLE;
+						break;
+					}
+
+					// Let the response drain before the FIN goes out
+					if(getSn_TX_FSR(s) != getSn_TxMAX(s)) break;
+#endif
 #ifdef _HTTPSERVER_DEBUG_
 					printf("> HTTPSocket[%d] : [State] STATE_HTTP_RES_DONE\r\n", s);
 #endif
@@ -302,7 +409,7 @@ static void send_http_response_header(uint8_t s, uint8_t content_type, uint32_t
 #ifdef _HTTPSERVER_DEBUG_
 		printf("> HTTPSocket[%d] : [Send] HTTP Response Header [ %d ]byte\r\n", s, (uint16_t)strlen((char *)http_response));
 #endif
-		send(s, http_response, strlen((char *)http_response));
+		http_send(s, http_response, strlen((char *)http_response));
 	}
 }
 
@@ -433,7 +540,7 @@ static void send_http_response_body(uint8_t s, uint8_t * uri_name, uint8_t * buf
 	printf("> HTTPSocket[%d] : [Send] HTTP Response body [ %ld ]byte\r\n", s, send_len);
 #endif
 
-	if(send_len) send(s, buf, send_len);
+	if(send_len) http_send(s, buf, send_len);
 	else flag_datasend_end = 1;
 
 	if(flag_datasend_end)
@@ -470,7 +577,18 @@ static void send_http_response_cgi(uint8_t s, uint8_t * buf, uint8_t * http_body
 	printf("> HTTPSocket[%d] : HTTP Response Header + Body - send len [ %d ]byte\r\n", s, send_len);
 #endif
 
-	send(s, buf, send_len);
+	http_send(s, buf, send_len);
+}
+
+static int32_t http_send(uint8_t s, uint8_t * buf, uint16_t len)
+{
+	int32_t ret;
+
+	ret = send(s, buf, len);
+#ifdef _USE_FATFS_
+	if((ret > 0) && (getHTTPSequenceNum(s) != -1)) HTTPSock_Status[getHTTPSequenceNum(s)].send_issued = 1;
+#endif
+	return ret;
 }
 
 
@@ -496,6 +614,10 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 	uint16_t http_status;
 	int8_t get_seqnum;
 	uint8_t content_found;
+#ifdef _USE_FATFS_
+	uint8_t gzip = 0;
+	size_t uri_len;
+#endif
 
 	if((get_seqnum = getHTTPSequenceNum(s)) == -1) return; // exception handling; invalid number
 
@@ -515,10 +637,18 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 		case METHOD_GET :
 			get_http_uri_name(p_http_request->URI, uri_buf);
 			uri_name = uri_buf;
+#ifdef _USE_FATFS_
+			unescape_http_url((char *)uri_name);
+#endif
 
 			if (!strcmp((char *)uri_name, "/")) strcpy((char *)uri_name, INITIAL_WEBPAGE);	// If URI is "/", respond by index.html
 			if (!strcmp((char *)uri_name, "m")) strcpy((char *)uri_name, M_INITIAL_WEBPAGE);
 			if (!strcmp((char *)uri_name, "mobile")) strcpy((char *)uri_name, MOBILE_INITIAL_WEBPAGE);
+#ifdef _USE_FATFS_
+			// Any other directory gets its own index page
+			uri_len = strlen((char *)uri_name);
+			if (uri_len && (uri_name[uri_len - 1] == '/') && ((uri_len + sizeof(INITIAL_WEBPAGE)) <= MAX_URI_SIZE)) strcat((char *)uri_name, INITIAL_WEBPAGE);
+#endif
 			find_http_uri_type(&p_http_request->TYPE, uri_name);	// Checking requested file types (HTML, TEXT, GIF, JPEG and Etc. are included)
 
 #ifdef _HTTPSERVER_DEBUG_
@@ -561,6 +691,12 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 					content_addr = fs.sclust;
 					HTTPSock_Status[get_seqnum].storage_type = SDCARD;
 				}
+#elif defined(_USE_FATFS_)
+				else if(http_open_file(get_seqnum, uri_name, &file_len, &gzip) == FR_OK)
+				{
+					content_found = 1;
+					HTTPSock_Status[get_seqnum].storage_type = FATFILE;
+				}
 #elif _USE_FLASH_
 				else if(/* Read content from Dataflash */)
 				{
@@ -594,6 +730,14 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 				{
 #ifdef _HTTPSERVER_DEBUG_
 					printf("> HTTPSocket[%d] : Requested content len = [ %ld ]byte\r\n", s, file_len);
+#endif
+#ifdef _USE_FATFS_
+					if((http_status == STATUS_OK) && (HTTPSock_Status[get_seqnum].storage_type == FATFILE))
+					{
+						// Header and body go out together; HEAD and Range are handled there
+						send_http_response_file_head(s, p_http_request->METHOD, p_http_request->TYPE, file_len, gzip);
+						break;
+					}
 #endif
 					send_http_response_header(s, p_http_request->TYPE, file_len, http_status);
 				}
@@ -648,6 +792,410 @@ static void http_process_handler(uint8_t s, st_http_request * p_http_request)
 	}
 }
 
+#ifdef _USE_FATFS_
+// Copy whatever is in the socket's RX memory without consuming it. If it holds a complete request
+// (header, plus the body for a Content-Length), consume just that request and return its length,
+// null terminated in buf. Otherwise return 0, with overflow set if the request can never fit.
+static uint16_t http_peek_request(uint8_t s, uint8_t * buf, uint8_t * overflow)
+{
+	uint16_t len;
+	uint32_t req_len;
+	char * end;
+	char * value;
+
+	*overflow = 0;
+	if((len = getSn_RX_RSR(s)) == 0) return 0;
+	if(len > DATA_BUF_SIZE - 1) len = DATA_BUF_SIZE - 1;
+
+	wiz_peek_data(s, buf, len);
+	buf[len] = '\0';
+
+	if(!(end = strstr((char *)buf, "\r\n\r\n")))
+	{
+		if((len == DATA_BUF_SIZE - 1) || (len == getSn_RxMAX(s))) *overflow = 1;
+		return 0;
+	}
+	end += 4;
+	req_len = (uint32_t)(end - (char *)buf);
+
+	// POST data has to be in the buffer too for the CGI handlers
+	if((value = find_http_header((char *)buf, end, "Content-Length")))
+	{
+		req_len += strtoul(value, NULL, 10);
+	}
+
+	if(req_len > DATA_BUF_SIZE - 1)
+	{
+		*overflow = 1;
+		return 0;
+	}
+	if(req_len > len) return 0;
+
+	// Hide any pipelined requests behind this one from the parser
+	buf[req_len] = '\0';
+
+	wiz_recv_ignore(s, (uint16_t)req_len);
+	setSn_CR(s, Sn_CR_RECV);
+	while(getSn_CR(s));
+
+	return (uint16_t)req_len;
+}
+
+// Find the value of header field 'name' in the request header between buf and end
+static char * find_http_header(char * buf, char * end, const char * name)
+{
+	size_t name_len = strlen(name);
+	char * line;
+
+	// Skip the request line
+	if(!(line = strstr(buf, "\r\n"))) return NULL;
+	line += 2;
+
+	while(line < end)
+	{
+		if(!strncasecmp(line, name, name_len) && (line[name_len] == ':'))
+		{
+			line += name_len + 1;
+			while((*line == ' ') || (*line == '\t')) line++;
+			return line;
+		}
+
+		if(!(line = strstr(line, "\r\n"))) break;
+		line += 2;
+	}
+
+	return NULL;
+}
+
+// Is 'token' in the header value (up to the end of its line)? Case insensitive; "token;q=0" counts as absent.
+static uint8_t http_header_has(char * value, const char * token)
+{
+	size_t token_len = strlen(token);
+	char * q;
+
+	while(*value && (*value != '\r'))
+	{
+		if(!strncasecmp(value, token, token_len) && !isalnum((unsigned char) value[token_len]))
+		{
+			value += token_len;
+			while(*value == ' ') value++;
+			if(strncmp(value, ";q=0", 4)) return 1;
+
+			// Any non-zero digit in the q-value means it is acceptable
+			for(q = value + 4; (*q == '.') || ((*q >= '0') && (*q <= '9')); q++)
+			{
+				if((*q >= '1') && (*q <= '9')) return 1;
+			}
+			return 0;
+		}
+		value++;
+	}
+
+	return 0;
+}
+
+static void parse_http_headers(char * buf)
+{
+	char * end = buf + strlen(buf);
+	char * line_end;
+	char * value;
+	char * num_end;
+
+	memset(&http_headers, 0, sizeof(http_headers));
+
+	// HTTP/1.1 connections are persistent unless asked otherwise; HTTP/1.0 only if asked
+	line_end = strstr(buf, "\r\n");
+	value = strstr(buf, " HTTP/1.1");
+	http_headers.keep_alive = (value && line_end && (value < line_end));
+
+	if((value = find_http_header(buf, end, "Connection")))
+	{
+		if(http_header_has(value, "close")) http_headers.keep_alive = 0;
+		else if(http_header_has(value, "keep-alive")) http_headers.keep_alive = 1;
+	}
+
+	if((value = find_http_header(buf, end, "Accept-Encoding")))
+	{
+		http_headers.accept_gzip = http_header_has(value, "gzip");
+	}
+
+	// Only a single range is served as 206; a list of ranges gets the whole file
+	if((value = find_http_header(buf, end, "Range")) && !strncasecmp(value, "bytes=", 6))
+	{
+		value += 6;
+		line_end = strstr(value, "\r\n");
+		if(strchr(value, ',') && (!line_end || (strchr(value, ',') < line_end))) return;
+
+		if(*value == '-')
+		{
+			http_headers.range_last = strtoul(value + 1, &num_end, 10);
+			http_headers.range_suffix = 1;
+			http_headers.range = (num_end != value + 1);
+		}
+		else if((*value >= '0') && (*value <= '9'))
+		{
+			http_headers.range_first = strtoul(value, &num_end, 10);
+			if(*num_end++ != '-') return;
+
+			if((*num_end >= '0') && (*num_end <= '9')) http_headers.range_last = strtoul(num_end, NULL, 10);
+			else http_headers.range_last = 0xffffffff;
+
+			// An invalid range is ignored rather than refused
+			http_headers.range = (http_headers.range_last >= http_headers.range_first);
+		}
+	}
+}
+
+// Open the requested file (or its .gz variant when the client takes gzip) into the socket's FIL
+static FRESULT http_open_file(int8_t seqnum, uint8_t * uri_name, uint32_t * file_len, uint8_t * gzip)
+{
+	char path[sizeof(HTTP_FATFS_ROOT) + MAX_URI_SIZE + 3];
+	size_t path_len;
+	FIL * fp = &HTTPSock_Status[seqnum].file;
+	FRESULT fr;
+
+	*gzip = 0;
+	http_close_file(seqnum);
+
+	// Nothing outside the web root
+	if(strstr((char *)uri_name, "..")) return FR_NO_FILE;
+
+	strcpy(path, HTTP_FATFS_ROOT);
+	strcat(path, (char *)uri_name);
+	path_len = strlen(path);
+
+	if(http_headers.accept_gzip)
+	{
+		strcpy(path + path_len, ".gz");
+		if((fr = f_open(fp, path, FA_READ)) == FR_OK)
+		{
+			*gzip = 1;
+		}
+		path[path_len] = '\0';
+	}
+
+	if(!*gzip)
+	{
+		fr = f_open(fp, path, FA_READ);
+	}
+
+	if(fr == FR_OK)
+	{
+		HTTPSock_Status[seqnum].file_open = 1;
+		*file_len = (uint32_t)f_size(fp);
+
+		memset(HTTPSock_Status[seqnum].file_name, 0x00, MAX_CONTENT_NAME_LEN);
+		strncpy((char *)HTTPSock_Status[seqnum].file_name, (char *)uri_name, MAX_CONTENT_NAME_LEN - 1);
+	}
+
+	return fr;
+}
+
+static void http_close_file(int8_t seqnum)
+{
+	if(HTTPSock_Status[seqnum].file_open)
+	{
+		f_close(&HTTPSock_Status[seqnum].file);
+		HTTPSock_Status[seqnum].file_open = 0;
+	}
+}
+
+static const char * http_content_type(uint8_t type)
+{
+	switch(type)
+	{
+		case PTYPE_HTML:	return "text/html";
+		case PTYPE_GIF:		return "image/gif";
+		case PTYPE_TEXT:	return "text/plain";
+		case PTYPE_JPEG:	return "image/jpeg";
+		case PTYPE_FLASH:	return "application/x-shockwave-flash";
+		case PTYPE_XML:		return "text/xml";
+		case PTYPE_CSS:		return "text/css";
+		case PTYPE_JSON:	return "application/json";
+		case PTYPE_JS:		return "application/javascript";
+		case PTYPE_PNG:		return "image/png";
+		case PTYPE_ICO:		return "image/x-icon";
+		case PTYPE_TTF:		return "application/x-font-truetype";
+		case PTYPE_OTF:		return "application/x-font-opentype";
+		case PTYPE_WOFF:	return "application/font-woff";
+		case PTYPE_EOT:		return "application/vnd.ms-fontobject";
+		case PTYPE_SVG:		return "image/svg+xml";
+		default:			return "application/octet-stream";	// Firmware images and anything else
+	}
+}
+
+// Work out the status and body range for an open FATFILE, then send the header along with as much of the body as fits
+static void send_http_response_file_head(uint8_t s, uint8_t method, uint8_t content_type, uint32_t file_size, uint8_t gzip)
+{
+	int8_t get_seqnum;
+	uint16_t http_status = STATUS_OK;
+	uint32_t first = 0;
+	uint32_t last = file_size - 1;
+	uint32_t body_len;
+	uint16_t head_len;
+	char * head = (char *)http_response;
+
+	if((get_seqnum = getHTTPSequenceNum(s)) == -1) return; // exception handling; invalid number
+
+	if(http_headers.range)
+	{
+		http_status = STATUS_PARTIAL;
+		if(http_headers.range_suffix)
+		{
+			if((http_headers.range_last == 0) || (file_size == 0)) http_status = STATUS_RANGE_NOT_SAT;
+			else if(http_headers.range_last < file_size) first = file_size - http_headers.range_last;
+		}
+		else if(http_headers.range_first >= file_size)
+		{
+			http_status = STATUS_RANGE_NOT_SAT;
+		}
+		else
+		{
+			first = http_headers.range_first;
+			if(http_headers.range_last < last) last = http_headers.range_last;
+		}
+	}
+
+	if(http_status == STATUS_RANGE_NOT_SAT)
+	{
+		http_close_file(get_seqnum);
+		head_len = sprintf(head, "HTTP/1.1 416 Range Not Satisfiable\r\nContent-Range: bytes */%lu\r\nContent-Length: 0\r\nConnection: %s\r\n\r\n",
+						   (unsigned long)file_size, HTTPSock_Status[get_seqnum].keep_alive ? "keep-alive" : "close");
+		http_send(s, (uint8_t *)head, head_len);
+		return;
+	}
+
+	body_len = file_size ? (last - first + 1) : 0;
+
+	head_len = sprintf(head, "HTTP/1.1 %s\r\nContent-Type: %s\r\nContent-Length: %lu\r\nAccept-Ranges: bytes\r\n",
+					   (http_status == STATUS_PARTIAL) ? "206 Partial Content" : "200 OK", http_content_type(content_type), (unsigned long)body_len);
+	if(http_status == STATUS_PARTIAL)
+	{
+		head_len += sprintf(head + head_len, "Content-Range: bytes %lu-%lu/%lu\r\n", (unsigned long)first, (unsigned long)last, (unsigned long)file_size);
+	}
+	if(gzip)
+	{
+		head_len += sprintf(head + head_len, "Content-Encoding: gzip\r\nVary: Accept-Encoding\r\n");
+	}
+	head_len += sprintf(head + head_len, "Connection: %s\r\n\r\n", HTTPSock_Status[get_seqnum].keep_alive ? "keep-alive" : "close");
+
+#ifdef _HTTPSERVER_DEBUG_
+	printf("> HTTPSocket[%d] : HTTP Response Header - %d, body %lu-%lu/%lu%s\r\n", s, http_status, (unsigned long)first, (unsigned long)last, (unsigned long)file_size, gzip ? " gzip" : "");
+#endif
+
+	if((method == METHOD_HEAD) || (body_len == 0))
+	{
+		http_close_file(get_seqnum);
+		http_send(s, (uint8_t *)head, head_len);
+		return;
+	}
+
+	if(first && (f_lseek(&HTTPSock_Status[get_seqnum].file, first) != FR_OK))
+	{
+		// Nothing has gone out yet, so a plain error page still works
+		http_close_file(get_seqnum);
+		send_http_response_header(s, 0, 0, STATUS_NOT_FOUND);
+		return;
+	}
+
+	HTTPSock_Status[get_seqnum].file_start = first;
+	HTTPSock_Status[get_seqnum].file_len = body_len;
+	HTTPSock_Status[get_seqnum].file_offset = 0;
+
+	send_http_response_file(s, (uint8_t *)head, head_len);
+}
+
+// Send the next part of a FATFILE body, plus the response header on the first call. Each part is
+// sized to the free TX memory and ends on a sector boundary, so after the first part every f_read()
+// is a whole-sector transfer from the disk and each SEND carries up to the full TX memory.
+static void send_http_response_file(uint8_t s, uint8_t * head, uint16_t head_len)
+{
+	int8_t get_seqnum;
+	st_http_socket * sock;
+	uint32_t remain;
+	uint32_t send_len;
+	uint32_t pos;
+	uint16_t freesize;
+	UINT read_len = 0;
+	wiz_iovec iov[2];
+	uint8_t iovcnt = 0;
+	int32_t ret;
+
+	if((get_seqnum = getHTTPSequenceNum(s)) == -1) return; // exception handling; invalid number
+	sock = &HTTPSock_Status[get_seqnum];
+
+	// Leave the CPU to the other sockets until the last SEND completes
+	if(!head_len && sock->send_issued && !(getSn_IR(s) & Sn_IR_SENDOK)) return;
+
+	remain = sock->file_len - sock->file_offset;
+	freesize = getSn_TX_FSR(s);
+	send_len = (freesize > head_len) ? (freesize - head_len) : 0;
+	if(send_len > HTTP_FILE_BUF_SIZE) send_len = HTTP_FILE_BUF_SIZE;
+
+	if(send_len >= remain)
+	{
+		send_len = remain;
+	}
+	else
+	{
+		pos = sock->file_start + sock->file_offset;
+		if(((pos + send_len) & ~(uint32_t)(FF_MIN_SS - 1)) > pos)
+		{
+			send_len = ((pos + send_len) & ~(uint32_t)(FF_MIN_SS - 1)) - pos;
+		}
+		else if(!head_len)
+		{
+			// Not even a sector of room; wait for ACKs to free some
+			return;
+		}
+	}
+
+	if(head_len)
+	{
+		iov[iovcnt].buf = head;
+		iov[iovcnt].len = head_len;
+		iovcnt++;
+	}
+
+	if(send_len)
+	{
+		if((f_read(&sock->file, http_file_buf, send_len, &read_len) != FR_OK) || (read_len != send_len))
+		{
+#ifdef _HTTPSERVER_DEBUG_
+			printf("> HTTPSocket[%d] : [FatFs] Read failed - %s\r\n", s, sock->file_name);
+#endif
+			goto abort;
+		}
+		iov[iovcnt].buf = http_file_buf;
+		iov[iovcnt].len = (uint16_t)send_len;
+		iovcnt++;
+	}
+
+	ret = sendv(s, iov, iovcnt);
+	if(ret < 0) goto abort;
+
+	sock->send_issued = 1;
+	sock->file_offset += send_len;
+
+	if(sock->file_offset >= sock->file_len)
+	{
+		http_close_file(get_seqnum);
+		sock->file_start = 0;
+		sock->file_len = 0;
+		sock->file_offset = 0;
+	}
+	return;
+
+abort:
+	// The peer can't tell a short body from a complete one on a persistent connection; close it
+	http_close_file(get_seqnum);
+	sock->keep_alive = 0;
+	sock->file_start = 0;
+	sock->file_len = 0;
+	sock->file_offset = 0;
+}
+#endif
+
 void httpServer_time_handler(void)
 {
 	httpServer_tick_1s++;
@@ -13,7 +13,7 @@ extern "C" {
 #endif
 
 // HTTP Server debug message enable
-#define _HTTPSERVER_DEBUG_
+//#define _HTTPSERVER_DEBUG_
 
 #define INITIAL_WEBPAGE				"index.html"
 #define M_INITIAL_WEBPAGE			"m/index.html"
@@ -25,10 +25,23 @@ extern "C" {
 //#define _USE_FLASH_
 #endif
 
+/* Static files from a FatFs volume; keep-alive, pipelining, Range and pre-compressed .gz */
 #if !defined(_USE_SDCARD_) && !defined(_USE_FLASH_)
+#define _USE_FATFS_
+#endif
+
+#if !defined(_USE_SDCARD_) && !defined(_USE_FLASH_) && !defined(_USE_FATFS_)
 #define _NOTUSED_STORAGE_
 #endif
 
+#ifdef _USE_FATFS_
+#include "Shared/FatFS/source/ff.h"
+
+#define HTTP_FATFS_ROOT				"/"			// Directory URIs are resolved against
+#define HTTP_FILE_BUF_SIZE			4096		// Sector buffer; a multiple of FF_MAX_SS
+#define HTTP_KEEPALIVE_TIMEOUT_SEC	5			// Idle persistent connections are closed after this
+#endif
+
 
 /* Watchdog timer */
 //#define _USE_WATCHDOG_
@@ -59,12 +72,19 @@ extern "C" {
 *********************************************/
 #define HTTP_MAX_TIMEOUT_SEC		3			// Sec.
 
+/*********************************************
+* HTTP Response status not in httpParser.h
+*********************************************/
+#define STATUS_PARTIAL			206
+#define STATUS_RANGE_NOT_SAT	416
+
 typedef enum
 {
    NONE,		///< Web storage none
    CODEFLASH,	///< Code flash memory
    SDCARD,    	///< SD card
-   DATAFLASH	///< External data flash memory
+   DATAFLASH,	///< External data flash memory
+   FATFILE		///< File on a FatFs volume, streamed a sector run at a time
 }StorageType;
 
 typedef struct _st_http_socket
@@ -75,6 +95,13 @@ typedef struct _st_http_socket
 	uint32_t 		file_len;
 	uint32_t 		file_offset; // (start addr + sent size...)
 	uint8_t			storage_type; // Storage type; Code flash, SDcard, Data flash ...
+#ifdef _USE_FATFS_
+	FIL				file;			// Open file for a FATFS response; file_offset counts bytes sent
+	uint8_t			file_open;
+	uint8_t			keep_alive;		// Go back to IDLE instead of disconnecting after the response
+	uint8_t			send_issued;	// A SEND has been issued on this connection
+	uint32_t		idle_time;		// httpServer tick when the connection last went IDLE
+#endif
 }st_http_socket;
 
 // Web content structure for file in code flash memory
@@ -4,6 +4,11 @@
 #include <string.h>
 #include <time.h>
 #include <ctype.h>
+#ifndef _WIN32
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#endif
 #include "lex.h"
 #include "types.h"
 
@@ -112,6 +117,9 @@ static unsigned char PI_SUBST[256] =
   31, 26, 219, 153, 141, 51, 159, 17, 131, 20
 };
 
+// Erased flash, for spotting fill quickly in ParseCompsize()
+static const UINT8 u8FillBlock[] = {0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff};
+
 static UINT8 u8EFIImageName[200];
 static UINT8 u8SerialNumber[6];
 UINT8 u8OnBit = 0;
@@ -153,6 +161,57 @@ static UINT16 wCRCTable[256] =
 	0x8201, 0x42c0, 0x4380, 0x8341, 0x4100, 0x81c1, 0x8081, 0x4040
 };
 
+// wCRCSliceTable[n][x] is the CRC of byte x followed by n zero bytes, so 8
+// bytes can be folded in at a time (slicing-by-8).
+static UINT16 wCRCSliceTable[8][256];
+
+static void CRC16SliceInit(void)
+{
+	UINT32 u32Loop;
+	UINT32 u32Slice;
+
+	for (u32Loop = 0; u32Loop < 256; u32Loop++)
+	{
+		wCRCSliceTable[0][u32Loop] = wCRCTable[u32Loop];
+	}
+
+	for (u32Slice = 1; u32Slice < 8; u32Slice++)
+	{
+		for (u32Loop = 0; u32Loop < 256; u32Loop++)
+		{
+			UINT16 wCrc16 = wCRCSliceTable[u32Slice - 1][u32Loop];
+
+			wCRCSliceTable[u32Slice][u32Loop] = wCRCTable[wCrc16 & 0xff] ^ (wCrc16 >> 8);
+		}
+	}
+}
+
+static UINT16 CRC16Range(UINT8 *pbData,
+						 UINT32 dwLength,
+						 UINT16 wCrc16)
+{
+	while (dwLength >= 8)
+	{
+		wCrc16 = wCRCSliceTable[7][(wCrc16 ^ pbData[0]) & 0xff] ^
+				 wCRCSliceTable[6][((wCrc16 >> 8) ^ pbData[1]) & 0xff] ^
+				 wCRCSliceTable[5][pbData[2]] ^
+				 wCRCSliceTable[4][pbData[3]] ^
+				 wCRCSliceTable[3][pbData[4]] ^
+				 wCRCSliceTable[2][pbData[5]] ^
+				 wCRCSliceTable[1][pbData[6]] ^
+				 wCRCSliceTable[0][pbData[7]];
+		pbData += 8;
+		dwLength -= 8;
+	}
+
+	while (dwLength--)
+	{
+		wCrc16 = wCRCTable[(wCrc16 ^ *pbData++) & 0xff] ^ (wCrc16 >> 8);
+	}
+
+	return(wCrc16);
+}
+
 void ParseSize()
 {
 	UINT32 dwToken;
@@ -323,8 +382,7 @@ void ParseLoad(void)
 	UINT32 dwAddr = 0;
 	UINT32 dwLimit = 0xffffffff;
 	UINT32 dwOffset = 0;
-	UINT8 *pbAddr = NULL;
-	UINT8 bByte;
+	UINT32 dwChunk;
 	FILE *fp = NULL;
 
 	dwToken = yylex();
@@ -407,23 +465,22 @@ void ParseLoad(void)
 		exit(1);
 	}
 
-	// Load the file in place!
+	// Load the file in place! Read as much as will fit in one go, then make
+	// sure there isn't anything (within the limit) that didn't.
 
-	while ((feof(fp) == 0) && dwLimit)
+	dwChunk = dwSize - dwAddr;
+	if (dwChunk > dwLimit)
 	{
-		bByte = fgetc(fp);
-		if (feof(fp) == 0)
-		{
-			if (dwAddr >= dwSize)
-			{
-				yyerror("Attempted to load file past end of image");
-				exit(1);
-			}	
-			pbImage[dwAddr] = bByte;
-			dwAddr++;
-		}
+		dwChunk = dwLimit;
+	}
+
+	dwChunk = fread(pbImage + dwAddr, 1, dwChunk, fp);
+	dwLimit -= dwChunk;
 
-		--dwLimit;
+	if (dwLimit && (fgetc(fp) != EOF))
+	{
+		yyerror("Attempted to load file past end of image");
+		exit(1);
 	}
 
 	fclose(fp);
@@ -436,7 +493,6 @@ void ParseCRC16(void)
 	UINT16 wCrc16 = 0;
 	UINT32 dwFrom = 0;
 	UINT32 dwTo = 0;
-	UINT32 dwLoop = 0;
 
 	dwToken = yylex();
 	if (CONSTANT != dwToken)
@@ -508,12 +564,9 @@ void ParseCRC16(void)
 		exit(1);
 	}
 
-	wCrc16 = 0;
-
-	for (dwLoop = dwFrom; dwLoop <= dwTo; dwLoop++)
-	{
-		wCrc16 = wCRCTable[(wCrc16 ^ pbImage[dwLoop]) & 0xff] ^ (wCrc16 >> 8);
-	}
+	wCrc16 = CRC16Range(pbImage + dwFrom,
+						(dwTo - dwFrom) + 1,
+						0);
 
 	printf("CRC16=%.4xh\n", wCrc16);
 
@@ -562,6 +615,7 @@ void ParseCompsize()
 	UINT32 u32High = 0;
 	UINT32 u32Lockdown = 0;
 	UINT32 u32Minimum = 0;
+	UINT32 u32Bound;
 	UINT32 dwToken;
 
 	dwToken = yylex();
@@ -644,9 +698,30 @@ void ParseCompsize()
 		exit(1);
 	}
 
-	// Let's figure out where it is
+	// Let's figure out where it is. Stop at the minimum or just below the low
+	// address, whichever we hit first.
+
+	if (u32Minimum >= u32Low)
+	{
+		u32Bound = u32Minimum;
+	}
+	else
+	{
+		u32Bound = u32Low - 1;
+	}
+
+	// Skip 0xff fill a block at a time, then finish up a byte at a time
+	while ((u32High - u32Bound) >= sizeof(u8FillBlock))
+	{
+		if (memcmp(pbImage + u32High - (sizeof(u8FillBlock) - 1), u8FillBlock, sizeof(u8FillBlock)))
+		{
+			break;
+		}
+
+		u32High -= sizeof(u8FillBlock);
+	}
 
-	while ((pbImage[u32High] == 0xff) && (u32High >= u32Low) && (u32High > u32Minimum))
+	while ((u32High > u32Bound) && (pbImage[u32High] == 0xff))
 	{
 		--u32High;
 	}
@@ -943,34 +1018,114 @@ void ParseFile()
 	}
 }
 
+// Builds the image described by one script
+static int BuildImage(char *pu8Script)
+{
+	// Now let's open ourselves up
+
+	if (yyopen(pu8Script, LEX_FILE) == 0)
+	{
+		printf("Can't open file '%s'\n", pu8Script);
+		return(1);
+	}
+	
+	// Let's rock
+
+	ParseFile();
+
+	// And close things up
+
+	yykill();
+
+	free(pbImage);
+	pbImage = NULL;
+	dwSize = 0;
+	return(0);
+}
+
 int main(int argc, char **argv)
 {
 	UINT32 u32Loop;
+	int s32Result = 0;
 
 	if (argc < 2)
 	{
-		printf("Parse filename required\n");
+		printf("Parse filename(s) required\n");
 		exit(1);
 	}
 
 	// Set up the reserved word list
 
 	SetReservedWordlist(sRomtool);
+	CRC16SliceInit();
 
-	// Now let's open ourselves up
+	if (2 == argc)
+	{
+		return(BuildImage(argv[1]));
+	}
 
-	if (yyopen(argv[1], LEX_FILE) == 0)
+#ifdef _WIN32
+	// Batch mode - one image after another
+	for (u32Loop = 1; u32Loop < (UINT32) argc; u32Loop++)
 	{
-		printf("Can't open file '%s'\n", argv[1]);
-		exit(1);
+		s32Result = BuildImage(argv[u32Loop]);
+		if (s32Result)
+		{
+			break;
+		}
 	}
-	
-	// Let's rock
+#else
+	// Batch mode - every script builds its own image, so build them all at
+	// once, a process apiece. Any parse error just exits that process.
+	{
+		pid_t *peChildren;
+		int s32Status;
+		pid_t eChild;
 
-	ParseFile();
+		peChildren = calloc(argc, sizeof(*peChildren));
+		assert(peChildren);
 
-	// And close things up
+		// Don't let the children inherit anything buffered
+		fflush(stdout);
 
-	yykill();
-	return(0);
+		for (u32Loop = 1; u32Loop < (UINT32) argc; u32Loop++)
+		{
+			peChildren[u32Loop] = fork();
+			if (0 == peChildren[u32Loop])
+			{
+				s32Result = BuildImage(argv[u32Loop]);
+				fflush(stdout);
+				_exit(s32Result);
+			}
+
+			if (peChildren[u32Loop] < 0)
+			{
+				printf("Can't start a build for '%s'\n", argv[u32Loop]);
+				s32Result = 1;
+			}
+		}
+
+		while ((eChild = wait(&s32Status)) > 0)
+		{
+			if (WIFEXITED(s32Status) && (0 == WEXITSTATUS(s32Status)))
+			{
+				continue;
+			}
+
+			for (u32Loop = 1; u32Loop < (UINT32) argc; u32Loop++)
+			{
+				if (peChildren[u32Loop] == eChild)
+				{
+					printf("Failed to build from '%s'\n", argv[u32Loop]);
+				}
+			}
+
+			s32Result = 1;
+		}
+
+		free(peChildren);
+	}
+#endif
+
+	return(s32Result);
 }
@@ -0,0 +1,1169 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <signal.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+// Host side of the network benchmark. Drives the services the target's
+// netbench application (Shared/ioLibrary/Application/netbench) runs, for
+// each combination of buffer size and connection count, and prints one JSON
+// line per run. Given a baseline file of earlier results it exits nonzero
+// when a score has dropped by more than the allowed percentage, for CI.
+
+// Target ports; must match netbench.h
+#define	NB_PORT_SINK				5001
+#define	NB_PORT_SOURCE				5002
+#define	NB_PORT_ECHO				5003
+#define	NB_PORT_UDP					5004
+#define	NB_PORT_HTTP				80
+
+#define	NB_HTTP_REQUEST				"GET /bench.txt HTTP/1.1\r\nHost: roscoe\r\n\r\n"
+
+#define	NB_DEFAULT_SECONDS			5
+#define	NB_DEFAULT_SIZES			"64,512,1460,8192"
+#define	NB_DEFAULT_CONNS			"1,2"
+#define	NB_DEFAULT_TESTS			"tcp_tx,tcp_rx,echo,connect,udp,http"
+#define	NB_DEFAULT_REGRESSION		10			// Percent
+#define	NB_MAX_CONNS				64
+#define	NB_MAX_BUFFER				65536
+#define	NB_UDP_MAX_PAYLOAD			1472		// One Ethernet frame
+#define	NB_UDP_MIN_PAYLOAD			8
+#define	NB_UDP_RETRY_MS				200
+#define	NB_CONNECT_TIMEOUT_MS		2000
+#define	NB_DRAIN_TIMEOUT_MS			10000
+#define	NB_MAX_SAMPLES				(1024 * 1024)
+#define	NB_MAX_BASELINE				1024
+
+typedef enum
+{
+	ECONN_IDLE,
+	ECONN_CONNECTING,
+	ECONN_SENDING,
+	ECONN_RECEIVING
+} EConnState;
+
+typedef struct SNetConn
+{
+	int s32Socket;
+	EConnState eState;
+	uint32_t u32Done;				// Bytes of the current operation sent or received
+	uint32_t u32Expect;				// Bytes expected back; 0 until an HTTP header says
+	uint64_t u64OpStart;			// Microseconds
+	char eHeader[512];				// HTTP response header so far
+	uint32_t u32HeaderLength;
+} SNetConn;
+
+typedef struct SNetResult
+{
+	uint64_t u64Bytes;
+	uint64_t u64Ops;
+	uint64_t u64Errors;
+	uint64_t u64Elapsed;			// Microseconds
+} SNetResult;
+
+typedef struct SNetTest
+{
+	const char *peName;
+	const char *peUnit;
+	uint16_t u16Port;
+	void (*Run)(uint32_t u32Buffer, uint32_t u32Conns, SNetResult *psResult);
+} SNetTest;
+
+typedef struct SNetBaseline
+{
+	char eKey[96];
+	double dScore;
+} SNetBaseline;
+
+static struct sockaddr_in sg_sTarget;
+static uint16_t sg_u16PortOffset;
+static uint64_t sg_u64RunUs;
+static uint8_t *sg_pu8Buffer;
+static uint8_t *sg_pu8Receive;
+static uint32_t *sg_pu32Samples;
+static uint32_t sg_u32SampleCount;
+static SNetBaseline sg_sBaseline[NB_MAX_BASELINE];
+static uint32_t sg_u32BaselineCount;
+
+static uint64_t NetTimeUs(void)
+{
+	struct timespec sTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &sTime);
+	return(((uint64_t) sTime.tv_sec * 1000000) + (sTime.tv_nsec / 1000));
+}
+
+// Ports below 1024 are moved up when the target is the host simulator
+static uint16_t NetPort(uint16_t u16Port)
+{
+	if (u16Port < 1024)
+	{
+		u16Port += sg_u16PortOffset;
+	}
+	return(u16Port);
+}
+
+static void NetSample(uint64_t u64Start)
+{
+	if (sg_u32SampleCount < NB_MAX_SAMPLES)
+	{
+		sg_pu32Samples[sg_u32SampleCount++] = (uint32_t) (NetTimeUs() - u64Start);
+	}
+}
+
+static int NetSampleCompare(const void *pvA,
+							const void *pvB)
+{
+	uint32_t u32A = *((const uint32_t *) pvA);
+	uint32_t u32B = *((const uint32_t *) pvB);
+
+	return((u32A > u32B) - (u32A < u32B));
+}
+
+static void NetNonBlocking(int s32Socket)
+{
+	(void) fcntl(s32Socket, F_SETFL, fcntl(s32Socket, F_GETFL) | O_NONBLOCK);
+}
+
+// Starts a non-blocking connect to the target. Returns the socket, or -1.
+static int NetConnectStart(uint16_t u16Port,
+						   bool bReset)
+{
+	struct sockaddr_in sAddress = sg_sTarget;
+	int s32Socket;
+	int s32One = 1;
+
+	s32Socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (s32Socket < 0)
+	{
+		return(-1);
+	}
+
+	(void) setsockopt(s32Socket, IPPROTO_TCP, TCP_NODELAY, &s32One, sizeof(s32One));
+
+	// Reset rather than FIN so the connect test doesn't run the host out of ports in TIME_WAIT
+	if (bReset)
+	{
+		struct linger sLinger = {1, 0};
+
+		(void) setsockopt(s32Socket, SOL_SOCKET, SO_LINGER, &sLinger, sizeof(sLinger));
+	}
+
+	NetNonBlocking(s32Socket);
+	sAddress.sin_port = htons(NetPort(u16Port));
+	if ((connect(s32Socket, (struct sockaddr *) &sAddress, sizeof(sAddress)) < 0) &&
+		(errno != EINPROGRESS))
+	{
+		close(s32Socket);
+		return(-1);
+	}
+
+	return(s32Socket);
+}
+
+// Connects and waits for it to complete
+static int NetConnect(uint16_t u16Port)
+{
+	struct pollfd sPoll;
+	int s32Socket;
+	int s32Error = 0;
+	socklen_t u32Length = sizeof(s32Error);
+
+	s32Socket = NetConnectStart(u16Port, false);
+	if (s32Socket < 0)
+	{
+		return(-1);
+	}
+
+	sPoll.fd = s32Socket;
+	sPoll.events = POLLOUT;
+	if ((poll(&sPoll, 1, NB_CONNECT_TIMEOUT_MS) != 1) ||
+		(getsockopt(s32Socket, SOL_SOCKET, SO_ERROR, &s32Error, &u32Length) < 0) ||
+		s32Error)
+	{
+		close(s32Socket);
+		return(-1);
+	}
+
+	return(s32Socket);
+}
+
+static uint32_t NetConnectAll(SNetConn *psConns,
+							  uint32_t u32Conns,
+							  uint16_t u16Port)
+{
+	uint32_t u32Loop;
+	uint32_t u32Connected = 0;
+
+	for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+	{
+		memset((void *) &psConns[u32Loop], 0, sizeof(psConns[u32Loop]));
+		psConns[u32Loop].s32Socket = NetConnect(u16Port);
+		if (psConns[u32Loop].s32Socket >= 0)
+		{
+			u32Connected++;
+		}
+	}
+
+	return(u32Connected);
+}
+
+static void NetCloseAll(SNetConn *psConns,
+						uint32_t u32Conns)
+{
+	uint32_t u32Loop;
+
+	for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+	{
+		if (psConns[u32Loop].s32Socket >= 0)
+		{
+			close(psConns[u32Loop].s32Socket);
+			psConns[u32Loop].s32Socket = -1;
+		}
+	}
+}
+
+// Remaining run time in milliseconds for poll(), or -1 when it's over
+static int NetRemainingMs(uint64_t u64End)
+{
+	uint64_t u64Now = NetTimeUs();
+
+	if (u64Now >= u64End)
+	{
+		return(-1);
+	}
+
+	return((int) (((u64End - u64Now) + 999) / 1000));
+}
+
+// Half closes every connection and waits for the other end to follow
+static void NetDrain(SNetConn *psConns,
+					 uint32_t u32Conns,
+					 SNetResult *psResult)
+{
+	struct pollfd sPoll[NB_MAX_CONNS];
+	uint64_t u64End = NetTimeUs() + (NB_DRAIN_TIMEOUT_MS * 1000);
+	uint32_t u32Open = 0;
+	uint32_t u32Loop;
+	int s32Timeout;
+
+	for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+	{
+		if (psConns[u32Loop].s32Socket >= 0)
+		{
+			(void) shutdown(psConns[u32Loop].s32Socket, SHUT_WR);
+			u32Open++;
+		}
+	}
+
+	while (u32Open &&
+		   ((s32Timeout = NetRemainingMs(u64End)) >= 0))
+	{
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			sPoll[u32Loop].fd = psConns[u32Loop].s32Socket;
+			sPoll[u32Loop].events = POLLIN;
+			sPoll[u32Loop].revents = 0;
+		}
+
+		if (poll(sPoll, u32Conns, s32Timeout) <= 0)
+		{
+			continue;
+		}
+
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			ssize_t s64Length;
+
+			if (0 == sPoll[u32Loop].revents)
+			{
+				continue;
+			}
+
+			s64Length = recv(psConns[u32Loop].s32Socket, sg_pu8Receive, NB_MAX_BUFFER, 0);
+			if ((0 == s64Length) ||
+				((s64Length < 0) && (errno != EAGAIN) && (errno != EINTR)))
+			{
+				close(psConns[u32Loop].s32Socket);
+				psConns[u32Loop].s32Socket = -1;
+				u32Open--;
+			}
+		}
+	}
+
+	if (u32Open)
+	{
+		psResult->u64Errors++;
+	}
+}
+
+// Streams in one direction over every connection for the run time
+static void NetStream(uint32_t u32Buffer,
+					  uint32_t u32Conns,
+					  SNetResult *psResult,
+					  uint16_t u16Port,
+					  bool bTransmit)
+{
+	SNetConn sConns[NB_MAX_CONNS];
+	struct pollfd sPoll[NB_MAX_CONNS];
+	uint64_t u64Start;
+	uint64_t u64End;
+	uint32_t u32Loop;
+	int s32Timeout;
+
+	if (NetConnectAll(sConns, u32Conns, u16Port) != u32Conns)
+	{
+		psResult->u64Errors++;
+	}
+
+	u64Start = NetTimeUs();
+	u64End = u64Start + sg_u64RunUs;
+	while ((s32Timeout = NetRemainingMs(u64End)) >= 0)
+	{
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			sPoll[u32Loop].fd = sConns[u32Loop].s32Socket;
+			sPoll[u32Loop].events = bTransmit ? POLLOUT : POLLIN;
+			sPoll[u32Loop].revents = 0;
+		}
+
+		if (poll(sPoll, u32Conns, s32Timeout) <= 0)
+		{
+			continue;
+		}
+
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			ssize_t s64Length;
+
+			if (0 == sPoll[u32Loop].revents)
+			{
+				continue;
+			}
+
+			if (bTransmit)
+			{
+				s64Length = send(sConns[u32Loop].s32Socket, sg_pu8Buffer, u32Buffer, MSG_NOSIGNAL);
+			}
+			else
+			{
+				s64Length = recv(sConns[u32Loop].s32Socket, sg_pu8Receive, u32Buffer, 0);
+			}
+
+			if (s64Length > 0)
+			{
+				psResult->u64Bytes += (uint64_t) s64Length;
+				psResult->u64Ops++;
+			}
+			else if ((s64Length < 0) &&
+					 ((EAGAIN == errno) || (EINTR == errno)))
+			{
+				// Spurious wakeup
+			}
+			else
+			{
+				psResult->u64Errors++;
+				close(sConns[u32Loop].s32Socket);
+				sConns[u32Loop].s32Socket = -1;
+			}
+		}
+	}
+
+	// What's still queued on the host hasn't reached the target yet. Send a
+	// FIN and time up to the sink closing its end, which it does once it's read
+	// everything.
+	if (bTransmit)
+	{
+		NetDrain(sConns, u32Conns, psResult);
+	}
+
+	psResult->u64Elapsed = NetTimeUs() - u64Start;
+	NetCloseAll(sConns, u32Conns);
+}
+
+static void NetTCPTransmit(uint32_t u32Buffer,
+						   uint32_t u32Conns,
+						   SNetResult *psResult)
+{
+	NetStream(u32Buffer, u32Conns, psResult, NB_PORT_SINK, true);
+}
+
+static void NetTCPReceive(uint32_t u32Buffer,
+						  uint32_t u32Conns,
+						  SNetResult *psResult)
+{
+	NetStream(u32Buffer, u32Conns, psResult, NB_PORT_SOURCE, false);
+}
+
+// Collects an HTTP response header. Returns true once it's complete, with
+// u32Expect set to the length of the header plus body.
+static bool NetHTTPHeader(SNetConn *psConn,
+						  uint8_t *pu8Data,
+						  uint32_t u32Length)
+{
+	uint32_t u32Room = sizeof(psConn->eHeader) - 1 - psConn->u32HeaderLength;
+	char *peEnd;
+	char *peLength;
+
+	if (u32Length > u32Room)
+	{
+		u32Length = u32Room;
+	}
+	memcpy(psConn->eHeader + psConn->u32HeaderLength, pu8Data, u32Length);
+	psConn->u32HeaderLength += u32Length;
+	psConn->eHeader[psConn->u32HeaderLength] = '\0';
+
+	peEnd = strstr(psConn->eHeader, "\r\n\r\n");
+	if (NULL == peEnd)
+	{
+		return(false);
+	}
+
+	peEnd += 4;
+	peLength = strstr(psConn->eHeader, "Content-Length:");
+	psConn->u32Expect = (uint32_t) (peEnd - psConn->eHeader);
+	if (peLength)
+	{
+		psConn->u32Expect += (uint32_t) strtoul(peLength + 15, NULL, 10);
+	}
+	return(true);
+}
+
+// Request/response over every connection: echo round trips, or HTTP requests
+static void NetRequestResponse(uint32_t u32Buffer,
+							   uint32_t u32Conns,
+							   SNetResult *psResult,
+							   bool bHTTP)
+{
+	SNetConn sConns[NB_MAX_CONNS];
+	struct pollfd sPoll[NB_MAX_CONNS];
+	const uint8_t *pu8Request = bHTTP ? (const uint8_t *) NB_HTTP_REQUEST : sg_pu8Buffer;
+	uint32_t u32Request = bHTTP ? (uint32_t) strlen(NB_HTTP_REQUEST) : u32Buffer;
+	uint16_t u16Port = bHTTP ? NB_PORT_HTTP : NB_PORT_ECHO;
+	uint64_t u64Start;
+	uint64_t u64End;
+	uint32_t u32Loop;
+	int s32Timeout;
+
+	if (NetConnectAll(sConns, u32Conns, u16Port) != u32Conns)
+	{
+		psResult->u64Errors++;
+	}
+
+	for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+	{
+		sConns[u32Loop].eState = ECONN_SENDING;
+		sConns[u32Loop].u64OpStart = NetTimeUs();
+	}
+
+	u64Start = NetTimeUs();
+	u64End = u64Start + sg_u64RunUs;
+	while ((s32Timeout = NetRemainingMs(u64End)) >= 0)
+	{
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			SNetConn *psConn = &sConns[u32Loop];
+
+			// The server may close a keep-alive connection between requests
+			if ((psConn->s32Socket < 0) &&
+				bHTTP)
+			{
+				psConn->s32Socket = NetConnect(u16Port);
+				psConn->eState = ECONN_SENDING;
+				psConn->u32Done = 0;
+				psConn->u64OpStart = NetTimeUs();
+			}
+
+			sPoll[u32Loop].fd = psConn->s32Socket;
+			sPoll[u32Loop].events = (ECONN_SENDING == psConn->eState) ? POLLOUT : POLLIN;
+			sPoll[u32Loop].revents = 0;
+		}
+
+		if (poll(sPoll, u32Conns, s32Timeout) <= 0)
+		{
+			continue;
+		}
+
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			SNetConn *psConn = &sConns[u32Loop];
+			ssize_t s64Length;
+
+			if (0 == sPoll[u32Loop].revents)
+			{
+				continue;
+			}
+
+			if (ECONN_SENDING == psConn->eState)
+			{
+				s64Length = send(psConn->s32Socket, pu8Request + psConn->u32Done, u32Request - psConn->u32Done, MSG_NOSIGNAL);
+				if (s64Length > 0)
+				{
+					psConn->u32Done += (uint32_t) s64Length;
+					if (psConn->u32Done == u32Request)
+					{
+						psConn->eState = ECONN_RECEIVING;
+						psConn->u32Done = 0;
+						psConn->u32Expect = bHTTP ? 0 : u32Request;
+						psConn->u32HeaderLength = 0;
+					}
+					continue;
+				}
+			}
+			else
+			{
+				s64Length = recv(psConn->s32Socket, sg_pu8Receive, NB_MAX_BUFFER, 0);
+				if (s64Length > 0)
+				{
+					psResult->u64Bytes += (uint64_t) s64Length;
+					psConn->u32Done += (uint32_t) s64Length;
+					if (0 == psConn->u32Expect)
+					{
+						(void) NetHTTPHeader(psConn, sg_pu8Receive, (uint32_t) s64Length);
+					}
+
+					if (psConn->u32Expect &&
+						(psConn->u32Done >= psConn->u32Expect))
+					{
+						NetSample(psConn->u64OpStart);
+						psResult->u64Ops++;
+						psConn->eState = ECONN_SENDING;
+						psConn->u32Done = 0;
+						psConn->u64OpStart = NetTimeUs();
+					}
+					continue;
+				}
+			}
+
+			if ((s64Length < 0) &&
+				((EAGAIN == errno) || (EINTR == errno)))
+			{
+				continue;
+			}
+
+			// Closed; only an error if it was part way through an exchange
+			if ((false == bHTTP) ||
+				(ECONN_RECEIVING == psConn->eState))
+			{
+				psResult->u64Errors++;
+			}
+			close(psConn->s32Socket);
+			psConn->s32Socket = -1;
+		}
+	}
+
+	psResult->u64Elapsed = NetTimeUs() - u64Start;
+	NetCloseAll(sConns, u32Conns);
+}
+
+static void NetEcho(uint32_t u32Buffer,
+					uint32_t u32Conns,
+					SNetResult *psResult)
+{
+	NetRequestResponse(u32Buffer, u32Conns, psResult, false);
+}
+
+static void NetHTTP(uint32_t u32Buffer,
+					uint32_t u32Conns,
+					SNetResult *psResult)
+{
+	NetRequestResponse(u32Buffer, u32Conns, psResult, true);
+}
+
+// Connect, exchange one buffer with the echo service and reset, over and
+// over with u32Conns in flight. Each op is a full connection lifetime.
+static void NetConnectRate(uint32_t u32Buffer,
+						   uint32_t u32Conns,
+						   SNetResult *psResult)
+{
+	SNetConn sConns[NB_MAX_CONNS];
+	struct pollfd sPoll[NB_MAX_CONNS];
+	uint64_t u64Start;
+	uint64_t u64End;
+	uint32_t u32Loop;
+	int s32Timeout;
+
+	memset((void *) sConns, 0, sizeof(sConns));
+	for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+	{
+		sConns[u32Loop].s32Socket = -1;
+	}
+
+	u64Start = NetTimeUs();
+	u64End = u64Start + sg_u64RunUs;
+	while ((s32Timeout = NetRemainingMs(u64End)) >= 0)
+	{
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			SNetConn *psConn = &sConns[u32Loop];
+
+			if (psConn->s32Socket < 0)
+			{
+				psConn->u64OpStart = NetTimeUs();
+				psConn->s32Socket = NetConnectStart(NB_PORT_ECHO, true);
+				psConn->eState = ECONN_CONNECTING;
+				psConn->u32Done = 0;
+				if (psConn->s32Socket < 0)
+				{
+					psResult->u64Errors++;
+				}
+			}
+
+			sPoll[u32Loop].fd = psConn->s32Socket;
+			sPoll[u32Loop].events = (ECONN_RECEIVING == psConn->eState) ? POLLIN : POLLOUT;
+			sPoll[u32Loop].revents = 0;
+		}
+
+		// A connection the target never answers is given up on
+		if (poll(sPoll, u32Conns, s32Timeout < NB_CONNECT_TIMEOUT_MS ? s32Timeout : NB_CONNECT_TIMEOUT_MS) <= 0)
+		{
+			for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+			{
+				if ((sConns[u32Loop].s32Socket >= 0) &&
+					((NetTimeUs() - sConns[u32Loop].u64OpStart) >= (NB_CONNECT_TIMEOUT_MS * 1000)))
+				{
+					psResult->u64Errors++;
+					close(sConns[u32Loop].s32Socket);
+					sConns[u32Loop].s32Socket = -1;
+				}
+			}
+			continue;
+		}
+
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			SNetConn *psConn = &sConns[u32Loop];
+			ssize_t s64Length = -1;
+
+			if (0 == sPoll[u32Loop].revents)
+			{
+				continue;
+			}
+
+			if (ECONN_CONNECTING == psConn->eState)
+			{
+				int s32Error = 0;
+				socklen_t u32Length = sizeof(s32Error);
+
+				if ((getsockopt(psConn->s32Socket, SOL_SOCKET, SO_ERROR, &s32Error, &u32Length) == 0) &&
+					(0 == s32Error))
+				{
+					psConn->eState = ECONN_SENDING;
+					continue;
+				}
+			}
+			else if (ECONN_SENDING == psConn->eState)
+			{
+				s64Length = send(psConn->s32Socket, sg_pu8Buffer + psConn->u32Done, u32Buffer - psConn->u32Done, MSG_NOSIGNAL);
+				if (s64Length > 0)
+				{
+					psConn->u32Done += (uint32_t) s64Length;
+					if (psConn->u32Done == u32Buffer)
+					{
+						psConn->eState = ECONN_RECEIVING;
+						psConn->u32Done = 0;
+					}
+					continue;
+				}
+			}
+			else
+			{
+				s64Length = recv(psConn->s32Socket, sg_pu8Receive, NB_MAX_BUFFER, 0);
+				if (s64Length > 0)
+				{
+					psConn->u32Done += (uint32_t) s64Length;
+					if (psConn->u32Done >= u32Buffer)
+					{
+						NetSample(psConn->u64OpStart);
+						psResult->u64Ops++;
+						psResult->u64Bytes += u32Buffer;
+						close(psConn->s32Socket);
+						psConn->s32Socket = -1;
+					}
+					continue;
+				}
+			}
+
+			if ((s64Length < 0) &&
+				((EAGAIN == errno) || (EINTR == errno)))
+			{
+				continue;
+			}
+
+			psResult->u64Errors++;
+			close(psConn->s32Socket);
+			psConn->s32Socket = -1;
+		}
+	}
+
+	psResult->u64Elapsed = NetTimeUs() - u64Start;
+	NetCloseAll(sConns, u32Conns);
+}
+
+// One datagram in flight per socket, resent if the echo doesn't come back
+static void NetUDP(uint32_t u32Buffer,
+				   uint32_t u32Conns,
+				   SNetResult *psResult)
+{
+	SNetConn sConns[NB_MAX_CONNS];
+	struct pollfd sPoll[NB_MAX_CONNS];
+	struct sockaddr_in sAddress = sg_sTarget;
+	uint64_t u64Start;
+	uint64_t u64End;
+	uint32_t u32Loop;
+	int s32Timeout;
+
+	sAddress.sin_port = htons(NetPort(NB_PORT_UDP));
+	for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+	{
+		memset((void *) &sConns[u32Loop], 0, sizeof(sConns[u32Loop]));
+		sConns[u32Loop].s32Socket = socket(AF_INET, SOCK_DGRAM, 0);
+		if ((sConns[u32Loop].s32Socket < 0) ||
+			(connect(sConns[u32Loop].s32Socket, (struct sockaddr *) &sAddress, sizeof(sAddress)) < 0))
+		{
+			fprintf(stderr, "Can't set up UDP socket - %s\n", strerror(errno));
+			psResult->u64Errors++;
+			NetCloseAll(sConns, u32Loop + 1);
+			return;
+		}
+		NetNonBlocking(sConns[u32Loop].s32Socket);
+		sConns[u32Loop].eState = ECONN_SENDING;
+	}
+
+	u64Start = NetTimeUs();
+	u64End = u64Start + sg_u64RunUs;
+	while ((s32Timeout = NetRemainingMs(u64End)) >= 0)
+	{
+		uint64_t u64Now = NetTimeUs();
+
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			SNetConn *psConn = &sConns[u32Loop];
+
+			if ((ECONN_RECEIVING == psConn->eState) &&
+				((u64Now - psConn->u64OpStart) >= (NB_UDP_RETRY_MS * 1000)))
+			{
+				psResult->u64Errors++;
+				psConn->eState = ECONN_SENDING;
+			}
+
+			sPoll[u32Loop].fd = psConn->s32Socket;
+			sPoll[u32Loop].events = (ECONN_SENDING == psConn->eState) ? POLLOUT : POLLIN;
+			sPoll[u32Loop].revents = 0;
+		}
+
+		if (poll(sPoll, u32Conns, s32Timeout < NB_UDP_RETRY_MS ? s32Timeout : NB_UDP_RETRY_MS) <= 0)
+		{
+			continue;
+		}
+
+		for (u32Loop = 0; u32Loop < u32Conns; u32Loop++)
+		{
+			SNetConn *psConn = &sConns[u32Loop];
+
+			if (0 == sPoll[u32Loop].revents)
+			{
+				continue;
+			}
+
+			if (ECONN_SENDING == psConn->eState)
+			{
+				if (send(psConn->s32Socket, sg_pu8Buffer, u32Buffer, 0) == (ssize_t) u32Buffer)
+				{
+					psConn->eState = ECONN_RECEIVING;
+					psConn->u64OpStart = NetTimeUs();
+				}
+			}
+			else if (recv(psConn->s32Socket, sg_pu8Receive, NB_MAX_BUFFER, 0) == (ssize_t) u32Buffer)
+			{
+				NetSample(psConn->u64OpStart);
+				psResult->u64Ops++;
+				psResult->u64Bytes += u32Buffer;
+				psConn->eState = ECONN_SENDING;
+			}
+		}
+	}
+
+	psResult->u64Elapsed = NetTimeUs() - u64Start;
+	NetCloseAll(sConns, u32Conns);
+}
+
+static const SNetTest sg_sTests[] =
+{
+	{"tcp_tx",	"bytes/sec",	NB_PORT_SINK,	NetTCPTransmit},
+	{"tcp_rx",	"bytes/sec",	NB_PORT_SOURCE,	NetTCPReceive},
+	{"echo",	"ops/sec",		NB_PORT_ECHO,	NetEcho},
+	{"connect",	"ops/sec",		NB_PORT_ECHO,	NetConnectRate},
+	{"udp",		"ops/sec",		NB_PORT_UDP,	NetUDP},
+	{"http",	"ops/sec",		NB_PORT_HTTP,	NetHTTP},
+};
+
+#define	NB_TEST_COUNT				(sizeof(sg_sTests) / sizeof(sg_sTests[0]))
+
+static void NetBaselineKey(char *peKey,
+						   size_t u64KeySize,
+						   const char *peLabel,
+						   const char *peTest,
+						   uint32_t u32Buffer,
+						   uint32_t u32Conns)
+{
+	snprintf(peKey, u64KeySize, "%s/%s/%u/%u", peLabel, peTest, u32Buffer, u32Conns);
+}
+
+// Pulls a string or number field out of one of our own JSON lines
+static bool NetJSONField(const char *peLine,
+						 const char *peField,
+						 char *peValue,
+						 size_t u64ValueSize)
+{
+	char eName[64];
+	const char *peStart;
+	size_t u64Length;
+
+	snprintf(eName, sizeof(eName), "\"%s\":", peField);
+	peStart = strstr(peLine, eName);
+	if (NULL == peStart)
+	{
+		return(false);
+	}
+
+	peStart += strlen(eName);
+	if ('"' == *peStart)
+	{
+		peStart++;
+		u64Length = strcspn(peStart, "\"");
+	}
+	else
+	{
+		u64Length = strcspn(peStart, ",}");
+	}
+
+	if (u64Length >= u64ValueSize)
+	{
+		return(false);
+	}
+
+	memcpy(peValue, peStart, u64Length);
+	peValue[u64Length] = '\0';
+	return(true);
+}
+
+static bool NetBaselineLoad(const char *peFile)
+{
+	FILE *psFile;
+	char eLine[1024];
+
+	psFile = fopen(peFile, "r");
+	if (NULL == psFile)
+	{
+		fprintf(stderr, "Can't open baseline '%s' - %s\n", peFile, strerror(errno));
+		return(false);
+	}
+
+	while (fgets(eLine, sizeof(eLine), psFile) &&
+		   (sg_u32BaselineCount < NB_MAX_BASELINE))
+	{
+		char eSide[16];
+		char eLabel[32];
+		char eTest[16];
+		char eBuffer[16];
+		char eConns[16];
+		char eScore[32];
+
+		if ((false == NetJSONField(eLine, "netbench", eSide, sizeof(eSide))) ||
+			strcmp(eSide, "host") ||
+			(false == NetJSONField(eLine, "label", eLabel, sizeof(eLabel))) ||
+			(false == NetJSONField(eLine, "test", eTest, sizeof(eTest))) ||
+			(false == NetJSONField(eLine, "buf", eBuffer, sizeof(eBuffer))) ||
+			(false == NetJSONField(eLine, "conns", eConns, sizeof(eConns))) ||
+			(false == NetJSONField(eLine, "score", eScore, sizeof(eScore))))
+		{
+			continue;
+		}
+
+		NetBaselineKey(sg_sBaseline[sg_u32BaselineCount].eKey, sizeof(sg_sBaseline[0].eKey),
+					   eLabel, eTest, (uint32_t) atoi(eBuffer), (uint32_t) atoi(eConns));
+		sg_sBaseline[sg_u32BaselineCount].dScore = atof(eScore);
+		sg_u32BaselineCount++;
+	}
+
+	fclose(psFile);
+	return(true);
+}
+
+static SNetBaseline *NetBaselineFind(const char *peKey)
+{
+	uint32_t u32Loop;
+
+	for (u32Loop = 0; u32Loop < sg_u32BaselineCount; u32Loop++)
+	{
+		if (0 == strcmp(sg_sBaseline[u32Loop].eKey, peKey))
+		{
+			return(&sg_sBaseline[u32Loop]);
+		}
+	}
+
+	return(NULL);
+}
+
+// Runs one test and prints its line. Returns false if it regressed against the baseline.
+static bool NetRun(const SNetTest *psTest,
+				   const char *peLabel,
+				   uint32_t u32Buffer,
+				   uint32_t u32Conns,
+				   uint32_t u32RegressionPercent)
+{
+	SNetResult sResult;
+	SNetBaseline *psBaseline;
+	char eKey[96];
+	double dScore;
+	uint32_t u32P50 = 0;
+	uint32_t u32P99 = 0;
+	bool bRegressed = false;
+
+	// HTTP fetches a fixed object and UDP is one frame at most
+	if (psTest->Run == NetHTTP)
+	{
+		u32Buffer = (uint32_t) strlen(NB_HTTP_REQUEST);
+	}
+	else if (psTest->Run == NetUDP)
+	{
+		if (u32Buffer > NB_UDP_MAX_PAYLOAD)
+		{
+			u32Buffer = NB_UDP_MAX_PAYLOAD;
+		}
+		else if (u32Buffer < NB_UDP_MIN_PAYLOAD)
+		{
+			u32Buffer = NB_UDP_MIN_PAYLOAD;
+		}
+	}
+
+	memset((void *) &sResult, 0, sizeof(sResult));
+	sg_u32SampleCount = 0;
+	psTest->Run(u32Buffer, u32Conns, &sResult);
+
+	if (0 == sResult.u64Elapsed)
+	{
+		sResult.u64Elapsed = 1;
+	}
+
+	if (strcmp(psTest->peUnit, "bytes/sec"))
+	{
+		dScore = ((double) sResult.u64Ops * 1000000.0) / (double) sResult.u64Elapsed;
+	}
+	else
+	{
+		dScore = ((double) sResult.u64Bytes * 1000000.0) / (double) sResult.u64Elapsed;
+	}
+
+	if (sg_u32SampleCount)
+	{
+		qsort(sg_pu32Samples, sg_u32SampleCount, sizeof(sg_pu32Samples[0]), NetSampleCompare);
+		u32P50 = sg_pu32Samples[sg_u32SampleCount / 2];
+		u32P99 = sg_pu32Samples[((uint64_t) sg_u32SampleCount * 99) / 100];
+	}
+
+	printf("{\"netbench\":\"host\",\"label\":\"%s\",\"test\":\"%s\",\"port\":%u,\"buf\":%u,\"conns\":%u,"
+		   "\"ms\":%llu,\"bytes\":%llu,\"ops\":%llu,\"errors\":%llu,\"p50_us\":%u,\"p99_us\":%u,"
+		   "\"score\":%.1f,\"unit\":\"%s\"",
+		   peLabel, psTest->peName, NetPort(psTest->u16Port), u32Buffer, u32Conns,
+		   (unsigned long long) (sResult.u64Elapsed / 1000), (unsigned long long) sResult.u64Bytes,
+		   (unsigned long long) sResult.u64Ops, (unsigned long long) sResult.u64Errors,
+		   u32P50, u32P99, dScore, psTest->peUnit);
+
+	NetBaselineKey(eKey, sizeof(eKey), peLabel, psTest->peName, u32Buffer, u32Conns);
+	psBaseline = NetBaselineFind(eKey);
+	if (psBaseline)
+	{
+		bRegressed = (dScore < (psBaseline->dScore * (100 - u32RegressionPercent) / 100.0));
+		printf(",\"baseline\":%.1f,\"regressed\":%s", psBaseline->dScore, bRegressed ? "true" : "false");
+	}
+	printf("}\n");
+	fflush(stdout);
+
+	if (bRegressed)
+	{
+		fprintf(stderr, "%s: %.1f %s is more than %u%% below the baseline of %.1f\n",
+				eKey, dScore, psTest->peUnit, u32RegressionPercent, psBaseline->dScore);
+	}
+
+	return(false == bRegressed);
+}
+
+static uint32_t NetParseList(char *peList,
+							 uint32_t *pu32Values,
+							 uint32_t u32MaxValues,
+							 uint32_t u32Max)
+{
+	uint32_t u32Count = 0;
+	char *peValue;
+
+	for (peValue = strtok(peList, ","); peValue && (u32Count < u32MaxValues); peValue = strtok(NULL, ","))
+	{
+		uint32_t u32Value = (uint32_t) atoi(peValue);
+
+		if ((0 == u32Value) ||
+			(u32Value > u32Max))
+		{
+			return(0);
+		}
+		pu32Values[u32Count++] = u32Value;
+	}
+
+	return(u32Count);
+}
+
+static void NetUsage(char *peProgram)
+{
+	printf("Usage: %s [-t seconds] [-b size[,size...]] [-c conns[,conns...]] [-T test[,test...]]\n", peProgram);
+	printf("          [-o port offset] [-L label] [-g baseline file] [-r regression percent] target\n");
+	printf("Tests: %s (default all)\n", NB_DEFAULT_TESTS);
+}
+
+int main(int argc,
+		 char **argv)
+{
+	char eSizes[256] = NB_DEFAULT_SIZES;
+	char eConnList[256] = NB_DEFAULT_CONNS;
+	char eTests[256] = NB_DEFAULT_TESTS;
+	char *peLabel = "";
+	char *peBaseline = NULL;
+	uint32_t u32Sizes[32];
+	uint32_t u32Conns[32];
+	uint32_t u32SizeCount;
+	uint32_t u32ConnCount;
+	uint32_t u32Seconds = NB_DEFAULT_SECONDS;
+	uint32_t u32RegressionPercent = NB_DEFAULT_REGRESSION;
+	uint32_t u32Regressions = 0;
+	char *peTest;
+	int s32Option;
+
+	while ((s32Option = getopt(argc, argv, "t:b:c:T:o:L:g:r:")) != -1)
+	{
+		switch (s32Option)
+		{
+			case 't':
+				u32Seconds = (uint32_t) atoi(optarg);
+				break;
+			case 'b':
+				snprintf(eSizes, sizeof(eSizes), "%s", optarg);
+				break;
+			case 'c':
+				snprintf(eConnList, sizeof(eConnList), "%s", optarg);
+				break;
+			case 'T':
+				snprintf(eTests, sizeof(eTests), "%s", optarg);
+				break;
+			case 'o':
+				sg_u16PortOffset = (uint16_t) atoi(optarg);
+				break;
+			case 'L':
+				peLabel = optarg;
+				break;
+			case 'g':
+				peBaseline = optarg;
+				break;
+			case 'r':
+				u32RegressionPercent = (uint32_t) atoi(optarg);
+				break;
+			default:
+				NetUsage(argv[0]);
+				return(1);
+		}
+	}
+
+	u32SizeCount = NetParseList(eSizes, u32Sizes, sizeof(u32Sizes) / sizeof(u32Sizes[0]), NB_MAX_BUFFER);
+	u32ConnCount = NetParseList(eConnList, u32Conns, sizeof(u32Conns) / sizeof(u32Conns[0]), NB_MAX_CONNS);
+	if ((optind != (argc - 1)) ||
+		(0 == u32Seconds) ||
+		(0 == u32SizeCount) ||
+		(0 == u32ConnCount) ||
+		(u32RegressionPercent > 100))
+	{
+		NetUsage(argv[0]);
+		return(1);
+	}
+
+	memset((void *) &sg_sTarget, 0, sizeof(sg_sTarget));
+	sg_sTarget.sin_family = AF_INET;
+	if (inet_pton(AF_INET, argv[optind], &sg_sTarget.sin_addr) != 1)
+	{
+		printf("Bad target address '%s'\n", argv[optind]);
+		return(1);
+	}
+
+	if (peBaseline &&
+		(false == NetBaselineLoad(peBaseline)))
+	{
+		return(1);
+	}
+
+	sg_u64RunUs = (uint64_t) u32Seconds * 1000000;
+	sg_pu8Buffer = malloc(NB_MAX_BUFFER);
+	sg_pu8Receive = malloc(NB_MAX_BUFFER);
+	sg_pu32Samples = malloc(NB_MAX_SAMPLES * sizeof(sg_pu32Samples[0]));
+	if ((NULL == sg_pu8Buffer) ||
+		(NULL == sg_pu8Receive) ||
+		(NULL == sg_pu32Samples))
+	{
+		printf("Out of memory\n");
+		return(1);
+	}
+	memset(sg_pu8Buffer, 'x', NB_MAX_BUFFER);
+	signal(SIGPIPE, SIG_IGN);
+
+	for (peTest = strtok(eTests, ","); peTest; peTest = strtok(NULL, ","))
+	{
+		const SNetTest *psTest = NULL;
+		uint32_t u32Loop;
+		uint32_t u32Size;
+		uint32_t u32Conn;
+
+		for (u32Loop = 0; u32Loop < NB_TEST_COUNT; u32Loop++)
+		{
+			if (0 == strcmp(peTest, sg_sTests[u32Loop].peName))
+			{
+				psTest = &sg_sTests[u32Loop];
+			}
+		}
+
+		if (NULL == psTest)
+		{
+			printf("Unknown test '%s'\n", peTest);
+			NetUsage(argv[0]);
+			return(1);
+		}
+
+		for (u32Conn = 0; u32Conn < u32ConnCount; u32Conn++)
+		{
+			for (u32Size = 0; u32Size < u32SizeCount; u32Size++)
+			{
+				if (false == NetRun(psTest, peLabel, u32Sizes[u32Size], u32Conns[u32Conn], u32RegressionPercent))
+				{
+					u32Regressions++;
+				}
+
+				// HTTP ignores the buffer size
+				if (psTest->Run == NetHTTP)
+				{
+					break;
+				}
+			}
+		}
+	}
+
+	free(sg_pu8Buffer);
+	free(sg_pu8Receive);
+	free(sg_pu32Samples);
+	return(u32Regressions ? 2 : 0);
+}
@@ -0,0 +1,239 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <signal.h>
+#include <time.h>
+#include <getopt.h>
+#include "wizchip_conf.h"
+#include "socket.h"
+#include "netbench.h"
+#include "w5500sim.h"
+
+// The netbench target code running on a host against the W5500 model, with
+// the chip's sockets backed by host sockets on 127.0.0.1. Serves the layout's
+// roles for Utils/netbench/netbench to drive, or times TFTP reads from
+// Utils/tftpd/tftpd. Results go to stdout as JSON lines, same as the target.
+
+#define	SIM_DEFAULT_PORT_OFFSET		8000
+#define	SIM_DEFAULT_BUFFER_SIZE		2048
+#define	SIM_HTTP_BUFFER_SIZE		2048		// httpServer's DATA_BUF_SIZE
+#define	SIM_TFTP_SOCKET				0
+#define	SIM_TFTP_MAX_FILE			(16 * 1024 * 1024)
+
+static volatile sig_atomic_t sg_bStop;
+
+static uint32_t SimMs(void)
+{
+	struct timespec sTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &sTime);
+	return((uint32_t) ((sTime.tv_sec * 1000) + (sTime.tv_nsec / 1000000)));
+}
+
+static void SimPoll(void)
+{
+	W5500SimPump(0);
+}
+
+static void SimSignal(int s32Signal)
+{
+	(void) s32Signal;
+	sg_bStop = true;
+}
+
+static void SimUsage(char *peProgram)
+{
+	fprintf(stderr, "Usage: %s [-o port offset] [-l layout] [-b buffer size] [-t seconds] [-i report seconds]\n", peProgram);
+	fprintf(stderr, "       %s [-o port offset] -T file [-k rx KB[,rx KB...]] [-n repeats]\n", peProgram);
+	fprintf(stderr, "Layout letters: s=sink r=source e=echo u=udp h=http -=unused (default %s)\n", NB_DEFAULT_LAYOUT);
+}
+
+// Time TFTP reads of peFile at each RX buffer size
+static int SimTFTP(char *peFile,
+				   char *peSizes,
+				   uint32_t u32Repeats)
+{
+	uint8_t *pu8File;
+	char *peSize;
+	int s32Result = 0;
+
+	pu8File = malloc(SIM_TFTP_MAX_FILE);
+	if (NULL == pu8File)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return(1);
+	}
+
+	for (peSize = strtok(peSizes, ","); peSize; peSize = strtok(NULL, ","))
+	{
+		uint8_t u8RxKB = (uint8_t) atoi(peSize);
+		uint32_t u32Loop;
+
+		for (u32Loop = 0; u32Loop < u32Repeats; u32Loop++)
+		{
+			if (netbench_tftp(SIM_TFTP_SOCKET, u8RxKB, 0x7f000001, (uint8_t *) peFile,
+							  pu8File, SIM_TFTP_MAX_FILE, SimMs, SimPoll) < 0)
+			{
+				s32Result = 1;
+			}
+			fflush(stdout);
+		}
+	}
+
+	free(pu8File);
+	return(s32Result);
+}
+
+int main(int argc,
+		 char **argv)
+{
+	static uint8_t u8HTTPTx[SIM_HTTP_BUFFER_SIZE];
+	static uint8_t u8HTTPRx[SIM_HTTP_BUFFER_SIZE];
+	wiz_NetInfo sNetInfo =
+	{
+		.mac = {0x02, 0x00, 0x00, 0x00, 0x55, 0x00},
+		.ip = {127, 0, 0, 1},
+		.sn = {255, 0, 0, 0},
+		.gw = {127, 0, 0, 1},
+		.dhcp = NETINFO_STATIC
+	};
+	char *peLayout = NB_DEFAULT_LAYOUT;
+	char *peTFTPFile = NULL;
+	char eTFTPSizes[64] = "2,8,16";
+	uint16_t u16PortOffset = SIM_DEFAULT_PORT_OFFSET;
+	uint32_t u32BufferSize = SIM_DEFAULT_BUFFER_SIZE;
+	uint32_t u32RunSeconds = 0;
+	uint32_t u32ReportSeconds = 0;
+	uint32_t u32Repeats = 1;
+	uint32_t u32Start;
+	uint32_t u32Tick;
+	uint32_t u32Report;
+	uint8_t *pu8Buffer;
+	int8_t s8SocketKB;
+	int s32Option;
+
+	while ((s32Option = getopt(argc, argv, "o:l:b:t:i:T:k:n:")) != -1)
+	{
+		switch (s32Option)
+		{
+			case 'o':
+				u16PortOffset = (uint16_t) atoi(optarg);
+				break;
+			case 'l':
+				peLayout = optarg;
+				break;
+			case 'b':
+				u32BufferSize = (uint32_t) atoi(optarg);
+				break;
+			case 't':
+				u32RunSeconds = (uint32_t) atoi(optarg);
+				break;
+			case 'i':
+				u32ReportSeconds = (uint32_t) atoi(optarg);
+				break;
+			case 'T':
+				peTFTPFile = optarg;
+				break;
+			case 'k':
+				snprintf(eTFTPSizes, sizeof(eTFTPSizes), "%s", optarg);
+				break;
+			case 'n':
+				u32Repeats = (uint32_t) atoi(optarg);
+				break;
+			default:
+				SimUsage(argv[0]);
+				return(1);
+		}
+	}
+
+	if ((optind != argc) ||
+		(0 == u32BufferSize) ||
+		(u32BufferSize > 0xffff))
+	{
+		SimUsage(argv[0]);
+		return(1);
+	}
+
+	W5500SimInit(u16PortOffset);
+	reg_wizchip_cs_cbfunc(W5500SimSelect,
+						  W5500SimDeselect);
+	reg_wizchip_spi_cbfunc(W5500SimByteRead,
+						   W5500SimByteWrite);
+	reg_wizchip_spiburst_cbfunc(W5500SimBurstRead,
+								W5500SimBurstWrite);
+	wizchip_setnetinfo(&sNetInfo);
+
+	if (peTFTPFile)
+	{
+		return(SimTFTP(peTFTPFile,
+					   eTFTPSizes,
+					   u32Repeats));
+	}
+
+	pu8Buffer = malloc(u32BufferSize);
+	if (NULL == pu8Buffer)
+	{
+		fprintf(stderr, "Out of memory\n");
+		return(1);
+	}
+
+	s8SocketKB = netbench_init(peLayout, pu8Buffer, (uint16_t) u32BufferSize, u8HTTPTx, u8HTTPRx);
+	if (s8SocketKB < 0)
+	{
+		fprintf(stderr, "Bad layout '%s'\n", peLayout);
+		SimUsage(argv[0]);
+		return(1);
+	}
+
+	signal(SIGINT, SimSignal);
+	signal(SIGTERM, SimSignal);
+	signal(SIGPIPE, SIG_IGN);
+
+	fprintf(stderr, "netbenchsim: layout %s, %dK per socket, ports below 1024 +%u\n", peLayout, s8SocketKB, u16PortOffset);
+
+	u32Start = u32Tick = u32Report = SimMs();
+	while (false == sg_bStop)
+	{
+		uint32_t u32Now;
+		bool bBusy = false;
+		uint8_t u8Socket;
+
+		for (u8Socket = 0; u8Socket < _WIZCHIP_SOCK_NUM_; u8Socket++)
+		{
+			if (netbench_run(u8Socket) > 0)
+			{
+				bBusy = true;
+			}
+		}
+
+		// Sleep in poll() when every service is waiting on the network
+		W5500SimPump(bBusy ? 0 : 1);
+
+		u32Now = SimMs();
+		if (u32Now - u32Tick >= 1000)
+		{
+			u32Tick += 1000;
+			netbench_time_handler();
+		}
+
+		if (u32ReportSeconds &&
+			(u32Now - u32Report >= (u32ReportSeconds * 1000)))
+		{
+			netbench_report(u32Now - u32Report, 1);
+			fflush(stdout);
+			u32Report = u32Now;
+		}
+
+		if (u32RunSeconds &&
+			(u32Now - u32Start >= (u32RunSeconds * 1000)))
+		{
+			break;
+		}
+	}
+
+	netbench_report(SimMs() - u32Report, 0);
+	free(pu8Buffer);
+	return(0);
+}
@@ -0,0 +1,56 @@
+#include "ff.h"
+#include "diskio.h"
+
+// httpServer is built with FatFs support, but the simulator only serves the
+// content netbench registers with it, so there's no disk behind it.
+
+DSTATUS disk_initialize(BYTE u8Drive)
+{
+	(void) u8Drive;
+	return(STA_NOINIT | STA_NODISK);
+}
+
+DSTATUS disk_status(BYTE u8Drive)
+{
+	(void) u8Drive;
+	return(STA_NOINIT | STA_NODISK);
+}
+
+DRESULT disk_read(BYTE u8Drive,
+				  BYTE *pu8Buffer,
+				  LBA_t u32Sector,
+				  UINT u32Count)
+{
+	(void) u8Drive;
+	(void) pu8Buffer;
+	(void) u32Sector;
+	(void) u32Count;
+	return(RES_NOTRDY);
+}
+
+DRESULT disk_write(BYTE u8Drive,
+				   const BYTE *pu8Buffer,
+				   LBA_t u32Sector,
+				   UINT u32Count)
+{
+	(void) u8Drive;
+	(void) pu8Buffer;
+	(void) u32Sector;
+	(void) u32Count;
+	return(RES_NOTRDY);
+}
+
+DRESULT disk_ioctl(BYTE u8Drive,
+				   BYTE u8Command,
+				   void *pvBuffer)
+{
+	(void) u8Drive;
+	(void) u8Command;
+	(void) pvBuffer;
+	return(RES_NOTRDY);
+}
+
+DWORD get_fattime(void)
+{
+	return(0);
+}
@@ -0,0 +1,976 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#include "w5500sim.h"
+
+// W5500 model for running the ioLibrary stack on a host. It takes the place of
+// Shared/NIC.c's SPI callbacks, decodes the frames into register and socket
+// buffer accesses, and backs each chip socket with a host socket on 127.0.0.1.
+// The netbench target code runs unmodified against it, so the benchmark works
+// in CI without hardware. The ioLibrary headers clash with the host's socket
+// headers, so the chip's constants are repeated here.
+
+#define	SIM_SOCKETS					8
+#define	SIM_BLOCKS					(1 + (SIM_SOCKETS * 4))
+#define	SIM_BLOCK_SIZE				0x4000		// Largest socket buffer is 16K
+#define	SIM_VERSION					0x04
+
+// Frames between the pumps done from inside chip selects, so the blocking
+// loops in socket.c still see progress. Those don't accept connections:
+// listen() checks for SOCK_LISTEN right after the command, and one that
+// had already gone to ESTABLISHED would be closed.
+#define	SIM_PUMP_SELECTS			64
+
+// Common registers
+#define	SIM_MR						0x00
+#define	SIM_SIR						0x17
+#define	SIM_PHYCFGR					0x2e
+#define	SIM_VERSIONR				0x39
+
+// Socket registers
+#define	SIM_SN_MR					0x00
+#define	SIM_SN_CR					0x01
+#define	SIM_SN_IR					0x02
+#define	SIM_SN_SR					0x03
+#define	SIM_SN_PORT					0x04
+#define	SIM_SN_DIPR					0x0c
+#define	SIM_SN_DPORT				0x10
+#define	SIM_SN_RXBUF_SIZE			0x1e
+#define	SIM_SN_TXBUF_SIZE			0x1f
+#define	SIM_SN_TX_FSR				0x20
+#define	SIM_SN_TX_RD				0x22
+#define	SIM_SN_TX_WR				0x24
+#define	SIM_SN_RX_RSR				0x26
+#define	SIM_SN_RX_RD				0x28
+#define	SIM_SN_RX_WR				0x2a
+#define	SIM_SN_IMR					0x2c
+
+// Sn_MR protocols
+#define	SIM_MR_TCP					0x01
+#define	SIM_MR_UDP					0x02
+#define	SIM_MR_RST					0x80		// Common MR
+
+// Sn_CR commands
+#define	SIM_CR_OPEN					0x01
+#define	SIM_CR_LISTEN				0x02
+#define	SIM_CR_CONNECT				0x04
+#define	SIM_CR_DISCON				0x08
+#define	SIM_CR_CLOSE				0x10
+#define	SIM_CR_SEND					0x20
+#define	SIM_CR_SEND_MAC				0x21
+#define	SIM_CR_RECV					0x40
+
+// Sn_IR bits
+#define	SIM_IR_CON					0x01
+#define	SIM_IR_DISCON				0x02
+#define	SIM_IR_RECV					0x04
+#define	SIM_IR_TIMEOUT				0x08
+#define	SIM_IR_SENDOK				0x10
+
+// Sn_SR states
+#define	SIM_SOCK_CLOSED				0x00
+#define	SIM_SOCK_INIT				0x13
+#define	SIM_SOCK_LISTEN				0x14
+#define	SIM_SOCK_SYNSENT			0x15
+#define	SIM_SOCK_ESTABLISHED		0x17
+#define	SIM_SOCK_FIN_WAIT			0x18
+#define	SIM_SOCK_CLOSE_WAIT			0x1c
+#define	SIM_SOCK_UDP				0x22
+
+#define	SIM_PHYCFGR_LINK			0x01
+#define	SIM_UDP_HEADER				8
+
+typedef struct SSimSocket
+{
+	int s32Socket;					// Host socket, -1 if none
+	uint16_t u16TxRd;				// What's been written to the host socket
+	uint16_t u16TxEnd;				// TX_WR as of the last SEND
+	uint16_t u16RxRd;				// RX_RD as of the last RECV
+	uint16_t u16RxWr;
+} SSimSocket;
+
+// One host listener per port, shared by every chip socket listening on it
+typedef struct SSimListener
+{
+	uint16_t u16Port;
+	int s32Socket;
+} SSimListener;
+
+static uint8_t sg_u8Memory[SIM_BLOCKS][SIM_BLOCK_SIZE];
+static SSimSocket sg_sSockets[SIM_SOCKETS];
+static SSimListener sg_sListeners[SIM_SOCKETS];
+static uint16_t sg_u16PortOffset;
+
+// SPI frame decode
+static uint8_t sg_u8Phase;
+static uint16_t sg_u16Address;
+static uint8_t sg_u8Control;
+static uint32_t sg_u32Selects;
+
+// Set when a socket interrupt is raised. The pumps done from inside chip
+// selects can pull data in after the caller last looked, so the next
+// W5500SimPump() mustn't sleep on the host sockets.
+static bool sg_bActivity;
+
+static uint8_t *SimReg(uint8_t u8Socket,
+					   uint8_t u8Register)
+{
+	return(&sg_u8Memory[1 + (u8Socket * 4)][u8Register]);
+}
+
+static uint16_t SimReg16Get(uint8_t u8Socket,
+							uint8_t u8Register)
+{
+	uint8_t *pu8Reg = SimReg(u8Socket, u8Register);
+
+	return((uint16_t) ((pu8Reg[0] << 8) | pu8Reg[1]));
+}
+
+static void SimReg16Set(uint8_t u8Socket,
+						uint8_t u8Register,
+						uint16_t u16Value)
+{
+	uint8_t *pu8Reg = SimReg(u8Socket, u8Register);
+
+	pu8Reg[0] = (uint8_t) (u16Value >> 8);
+	pu8Reg[1] = (uint8_t) u16Value;
+}
+
+static uint16_t SimBufferSize(uint8_t u8Socket,
+							  bool bRx)
+{
+	return((uint16_t) (*SimReg(u8Socket, bRx ? SIM_SN_RXBUF_SIZE : SIM_SN_TXBUF_SIZE) << 10));
+}
+
+static uint8_t *SimBuffer(uint8_t u8Socket,
+						  bool bRx)
+{
+	return(sg_u8Memory[(u8Socket * 4) + (bRx ? 3 : 2)]);
+}
+
+static uint16_t SimHostPort(uint16_t u16Port)
+{
+	return((u16Port < 1024) ? (uint16_t) (u16Port + sg_u16PortOffset) : u16Port);
+}
+
+// SIR follows each socket's unmasked Sn_IR bits
+static void SimInterruptUpdate(void)
+{
+	uint8_t u8Socket;
+	uint8_t u8SIR = 0;
+
+	for (u8Socket = 0; u8Socket < SIM_SOCKETS; u8Socket++)
+	{
+		if (*SimReg(u8Socket, SIM_SN_IR) & *SimReg(u8Socket, SIM_SN_IMR))
+		{
+			u8SIR |= (uint8_t) (1 << u8Socket);
+		}
+	}
+
+	sg_u8Memory[0][SIM_SIR] = u8SIR;
+}
+
+static void SimInterrupt(uint8_t u8Socket,
+						 uint8_t u8Bits)
+{
+	*SimReg(u8Socket, SIM_SN_IR) |= u8Bits;
+	SimInterruptUpdate();
+	sg_bActivity = true;
+}
+
+// Refresh the registers derived from the ring pointers
+static void SimPointersUpdate(uint8_t u8Socket)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+
+	SimReg16Set(u8Socket, SIM_SN_TX_FSR, (uint16_t) (SimBufferSize(u8Socket, false) - (uint16_t) (psSocket->u16TxEnd - psSocket->u16TxRd)));
+	SimReg16Set(u8Socket, SIM_SN_TX_RD, psSocket->u16TxRd);
+	SimReg16Set(u8Socket, SIM_SN_RX_RSR, (uint16_t) (psSocket->u16RxWr - psSocket->u16RxRd));
+	SimReg16Set(u8Socket, SIM_SN_RX_WR, psSocket->u16RxWr);
+}
+
+static void SimHostClose(uint8_t u8Socket)
+{
+	if (sg_sSockets[u8Socket].s32Socket >= 0)
+	{
+		close(sg_sSockets[u8Socket].s32Socket);
+		sg_sSockets[u8Socket].s32Socket = -1;
+	}
+}
+
+static void SimSocketClosed(uint8_t u8Socket)
+{
+	SimHostClose(u8Socket);
+	*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_CLOSED;
+}
+
+static int SimListenerGet(uint16_t u16Port)
+{
+	struct sockaddr_in sAddress;
+	uint8_t u8Loop;
+	int s32Socket;
+	int s32One = 1;
+
+	for (u8Loop = 0; u8Loop < SIM_SOCKETS; u8Loop++)
+	{
+		if ((sg_sListeners[u8Loop].s32Socket >= 0) &&
+			(sg_sListeners[u8Loop].u16Port == u16Port))
+		{
+			return(sg_sListeners[u8Loop].s32Socket);
+		}
+	}
+
+	for (u8Loop = 0; u8Loop < SIM_SOCKETS; u8Loop++)
+	{
+		if (sg_sListeners[u8Loop].s32Socket < 0)
+		{
+			break;
+		}
+	}
+
+	if (SIM_SOCKETS == u8Loop)
+	{
+		return(-1);
+	}
+
+	s32Socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (s32Socket < 0)
+	{
+		return(-1);
+	}
+
+	setsockopt(s32Socket, SOL_SOCKET, SO_REUSEADDR, &s32One, sizeof(s32One));
+	fcntl(s32Socket, F_SETFL, O_NONBLOCK);
+
+	memset((void *) &sAddress, 0, sizeof(sAddress));
+	sAddress.sin_family = AF_INET;
+	sAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sAddress.sin_port = htons(SimHostPort(u16Port));
+	if ((bind(s32Socket, (struct sockaddr *) &sAddress, sizeof(sAddress)) < 0) ||
+		(listen(s32Socket, SIM_SOCKETS) < 0))
+	{
+		fprintf(stderr, "w5500sim: can't listen on port %u - %s\n", SimHostPort(u16Port), strerror(errno));
+		close(s32Socket);
+		return(-1);
+	}
+
+	sg_sListeners[u8Loop].u16Port = u16Port;
+	sg_sListeners[u8Loop].s32Socket = s32Socket;
+	return(s32Socket);
+}
+
+static void SimPeerSet(uint8_t u8Socket,
+					   struct sockaddr_in *psAddress)
+{
+	uint32_t u32IP = ntohl(psAddress->sin_addr.s_addr);
+	uint8_t *pu8DIPR = SimReg(u8Socket, SIM_SN_DIPR);
+
+	pu8DIPR[0] = (uint8_t) (u32IP >> 24);
+	pu8DIPR[1] = (uint8_t) (u32IP >> 16);
+	pu8DIPR[2] = (uint8_t) (u32IP >> 8);
+	pu8DIPR[3] = (uint8_t) u32IP;
+	SimReg16Set(u8Socket, SIM_SN_DPORT, ntohs(psAddress->sin_port));
+}
+
+// Write out as much of the last SEND as the host socket takes. SENDOK once it's all gone.
+static void SimTCPTransmit(uint8_t u8Socket)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+	uint16_t u16Size = SimBufferSize(u8Socket, false);
+	uint8_t *pu8Buffer = SimBuffer(u8Socket, false);
+
+	while (psSocket->u16TxRd != psSocket->u16TxEnd)
+	{
+		uint16_t u16Offset = psSocket->u16TxRd & (u16Size - 1);
+		uint16_t u16Length = (uint16_t) (psSocket->u16TxEnd - psSocket->u16TxRd);
+		ssize_t s64Sent;
+
+		if (u16Length > (u16Size - u16Offset))
+		{
+			u16Length = (uint16_t) (u16Size - u16Offset);
+		}
+
+		s64Sent = send(psSocket->s32Socket, pu8Buffer + u16Offset, u16Length, MSG_DONTWAIT | MSG_NOSIGNAL);
+		if (s64Sent <= 0)
+		{
+			if ((s64Sent < 0) &&
+				(errno != EAGAIN) &&
+				(errno != EWOULDBLOCK))
+			{
+				// Peer's gone; drop the data the way a reset would
+				psSocket->u16TxRd = psSocket->u16TxEnd;
+				break;
+			}
+
+			SimPointersUpdate(u8Socket);
+			return;
+		}
+
+		psSocket->u16TxRd += (uint16_t) s64Sent;
+	}
+
+	SimPointersUpdate(u8Socket);
+	SimInterrupt(u8Socket, SIM_IR_SENDOK);
+}
+
+static void SimUDPTransmit(uint8_t u8Socket)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+	uint16_t u16Size = SimBufferSize(u8Socket, false);
+	uint8_t *pu8Buffer = SimBuffer(u8Socket, false);
+	uint8_t u8Datagram[SIM_BLOCK_SIZE];
+	uint16_t u16Length = 0;
+	struct sockaddr_in sTo;
+
+	while (psSocket->u16TxRd != psSocket->u16TxEnd)
+	{
+		u8Datagram[u16Length++] = pu8Buffer[psSocket->u16TxRd & (u16Size - 1)];
+		psSocket->u16TxRd++;
+	}
+
+	// Everything on the "network" lives on this host
+	memset((void *) &sTo, 0, sizeof(sTo));
+	sTo.sin_family = AF_INET;
+	sTo.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sTo.sin_port = htons(SimHostPort(SimReg16Get(u8Socket, SIM_SN_DPORT)));
+	(void) sendto(psSocket->s32Socket, u8Datagram, u16Length, 0, (struct sockaddr *) &sTo, sizeof(sTo));
+
+	SimPointersUpdate(u8Socket);
+	SimInterrupt(u8Socket, SIM_IR_SENDOK);
+}
+
+static void SimRxCopy(uint8_t u8Socket,
+					  const uint8_t *pu8Data,
+					  uint16_t u16Length)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+	uint16_t u16Size = SimBufferSize(u8Socket, true);
+	uint8_t *pu8Buffer = SimBuffer(u8Socket, true);
+
+	while (u16Length--)
+	{
+		pu8Buffer[psSocket->u16RxWr & (u16Size - 1)] = *pu8Data++;
+		psSocket->u16RxWr++;
+	}
+}
+
+// Pull what fits from a connected host socket. A zero read is the peer's FIN.
+static void SimTCPReceive(uint8_t u8Socket)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+	uint16_t u16Size = SimBufferSize(u8Socket, true);
+	uint8_t u8Data[SIM_BLOCK_SIZE];
+	uint16_t u16Free = (uint16_t) (u16Size - (uint16_t) (psSocket->u16RxWr - psSocket->u16RxRd));
+	ssize_t s64Read;
+
+	// Already seen the FIN
+	if ((0 == u16Free) ||
+		(SIM_SOCK_CLOSE_WAIT == *SimReg(u8Socket, SIM_SN_SR)))
+	{
+		return;
+	}
+
+	s64Read = recv(psSocket->s32Socket, u8Data, u16Free, MSG_DONTWAIT);
+	if (s64Read > 0)
+	{
+		if (*SimReg(u8Socket, SIM_SN_SR) != SIM_SOCK_FIN_WAIT)
+		{
+			SimRxCopy(u8Socket, u8Data, (uint16_t) s64Read);
+			SimPointersUpdate(u8Socket);
+			SimInterrupt(u8Socket, SIM_IR_RECV);
+		}
+		return;
+	}
+
+	if ((s64Read < 0) &&
+		((EAGAIN == errno) || (EWOULDBLOCK == errno)))
+	{
+		return;
+	}
+
+	if (SIM_SOCK_ESTABLISHED == *SimReg(u8Socket, SIM_SN_SR))
+	{
+		*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_CLOSE_WAIT;
+	}
+	else
+	{
+		SimSocketClosed(u8Socket);
+	}
+
+	SimInterrupt(u8Socket, SIM_IR_DISCON);
+}
+
+// Datagrams that don't fit are dropped, like the chip does
+static void SimUDPReceive(uint8_t u8Socket)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+	uint16_t u16Size = SimBufferSize(u8Socket, true);
+	uint8_t u8Data[SIM_BLOCK_SIZE];
+	struct sockaddr_in sFrom;
+	socklen_t u32FromLength;
+	ssize_t s64Read;
+	bool bReceived = false;
+
+	for (;;)
+	{
+		uint8_t u8Header[SIM_UDP_HEADER];
+		uint32_t u32IP;
+		uint16_t u16Port;
+
+		u32FromLength = sizeof(sFrom);
+		s64Read = recvfrom(psSocket->s32Socket, u8Data, sizeof(u8Data), MSG_DONTWAIT, (struct sockaddr *) &sFrom, &u32FromLength);
+		if (s64Read < 0)
+		{
+			break;
+		}
+
+		if ((uint16_t) (psSocket->u16RxWr - psSocket->u16RxRd) + SIM_UDP_HEADER + s64Read > u16Size)
+		{
+			continue;
+		}
+
+		u32IP = ntohl(sFrom.sin_addr.s_addr);
+		u16Port = ntohs(sFrom.sin_port);
+		u8Header[0] = (uint8_t) (u32IP >> 24);
+		u8Header[1] = (uint8_t) (u32IP >> 16);
+		u8Header[2] = (uint8_t) (u32IP >> 8);
+		u8Header[3] = (uint8_t) u32IP;
+		u8Header[4] = (uint8_t) (u16Port >> 8);
+		u8Header[5] = (uint8_t) u16Port;
+		u8Header[6] = (uint8_t) (s64Read >> 8);
+		u8Header[7] = (uint8_t) s64Read;
+		SimRxCopy(u8Socket, u8Header, sizeof(u8Header));
+		SimRxCopy(u8Socket, u8Data, (uint16_t) s64Read);
+		bReceived = true;
+	}
+
+	if (bReceived)
+	{
+		SimPointersUpdate(u8Socket);
+		SimInterrupt(u8Socket, SIM_IR_RECV);
+	}
+}
+
+static void SimAccept(uint8_t u8Socket)
+{
+	struct sockaddr_in sPeer;
+	socklen_t u32PeerLength = sizeof(sPeer);
+	int s32Listener = SimListenerGet(SimReg16Get(u8Socket, SIM_SN_PORT));
+	int s32Socket;
+	int s32One = 1;
+
+	if (s32Listener < 0)
+	{
+		return;
+	}
+
+	s32Socket = accept(s32Listener, (struct sockaddr *) &sPeer, &u32PeerLength);
+	if (s32Socket < 0)
+	{
+		return;
+	}
+
+	fcntl(s32Socket, F_SETFL, O_NONBLOCK);
+	setsockopt(s32Socket, IPPROTO_TCP, TCP_NODELAY, &s32One, sizeof(s32One));
+
+	sg_sSockets[u8Socket].s32Socket = s32Socket;
+	SimPeerSet(u8Socket, &sPeer);
+	*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_ESTABLISHED;
+	SimInterrupt(u8Socket, SIM_IR_CON);
+}
+
+static void SimConnectCheck(uint8_t u8Socket)
+{
+	struct pollfd sPoll;
+	int s32Error = 0;
+	socklen_t u32Length = sizeof(s32Error);
+
+	sPoll.fd = sg_sSockets[u8Socket].s32Socket;
+	sPoll.events = POLLOUT;
+	if (poll(&sPoll, 1, 0) <= 0)
+	{
+		return;
+	}
+
+	getsockopt(sPoll.fd, SOL_SOCKET, SO_ERROR, &s32Error, &u32Length);
+	if (s32Error)
+	{
+		SimSocketClosed(u8Socket);
+		SimInterrupt(u8Socket, SIM_IR_TIMEOUT);
+		return;
+	}
+
+	*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_ESTABLISHED;
+	SimInterrupt(u8Socket, SIM_IR_CON);
+}
+
+static void SimCommandOpen(uint8_t u8Socket)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+	uint8_t u8Protocol = *SimReg(u8Socket, SIM_SN_MR) & 0x0f;
+
+	SimHostClose(u8Socket);
+	psSocket->u16TxRd = psSocket->u16TxEnd = 0;
+	psSocket->u16RxRd = psSocket->u16RxWr = 0;
+	SimReg16Set(u8Socket, SIM_SN_TX_WR, 0);
+	SimReg16Set(u8Socket, SIM_SN_RX_RD, 0);
+	SimPointersUpdate(u8Socket);
+
+	if (SIM_MR_TCP == u8Protocol)
+	{
+		*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_INIT;
+	}
+	else
+	if (SIM_MR_UDP == u8Protocol)
+	{
+		struct sockaddr_in sAddress;
+		int s32Size = 1 << 20;
+
+		psSocket->s32Socket = socket(AF_INET, SOCK_DGRAM, 0);
+		if (psSocket->s32Socket < 0)
+		{
+			return;
+		}
+
+		setsockopt(psSocket->s32Socket, SOL_SOCKET, SO_RCVBUF, &s32Size, sizeof(s32Size));
+		fcntl(psSocket->s32Socket, F_SETFL, O_NONBLOCK);
+
+		memset((void *) &sAddress, 0, sizeof(sAddress));
+		sAddress.sin_family = AF_INET;
+		sAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+		sAddress.sin_port = htons(SimHostPort(SimReg16Get(u8Socket, SIM_SN_PORT)));
+		if (bind(psSocket->s32Socket, (struct sockaddr *) &sAddress, sizeof(sAddress)) < 0)
+		{
+			fprintf(stderr, "w5500sim: can't bind UDP port %u - %s\n", ntohs(sAddress.sin_port), strerror(errno));
+			SimHostClose(u8Socket);
+			return;
+		}
+
+		*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_UDP;
+	}
+}
+
+static void SimCommandConnect(uint8_t u8Socket)
+{
+	struct sockaddr_in sAddress;
+	int s32Socket;
+	int s32One = 1;
+
+	s32Socket = socket(AF_INET, SOCK_STREAM, 0);
+	if (s32Socket < 0)
+	{
+		SimInterrupt(u8Socket, SIM_IR_TIMEOUT);
+		return;
+	}
+
+	fcntl(s32Socket, F_SETFL, O_NONBLOCK);
+	setsockopt(s32Socket, IPPROTO_TCP, TCP_NODELAY, &s32One, sizeof(s32One));
+
+	memset((void *) &sAddress, 0, sizeof(sAddress));
+	sAddress.sin_family = AF_INET;
+	sAddress.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+	sAddress.sin_port = htons(SimHostPort(SimReg16Get(u8Socket, SIM_SN_DPORT)));
+	if ((connect(s32Socket, (struct sockaddr *) &sAddress, sizeof(sAddress)) < 0) &&
+		(errno != EINPROGRESS))
+	{
+		close(s32Socket);
+		SimInterrupt(u8Socket, SIM_IR_TIMEOUT);
+		return;
+	}
+
+	sg_sSockets[u8Socket].s32Socket = s32Socket;
+	*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_SYNSENT;
+}
+
+// Queued data goes out ahead of the FIN
+static void SimCommandDisconnect(uint8_t u8Socket)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+
+	if (psSocket->s32Socket < 0)
+	{
+		SimSocketClosed(u8Socket);
+		return;
+	}
+
+	fcntl(psSocket->s32Socket, F_SETFL, 0);
+	SimTCPTransmit(u8Socket);
+	fcntl(psSocket->s32Socket, F_SETFL, O_NONBLOCK);
+	shutdown(psSocket->s32Socket, SHUT_WR);
+
+	if (SIM_SOCK_CLOSE_WAIT == *SimReg(u8Socket, SIM_SN_SR))
+	{
+		SimSocketClosed(u8Socket);
+		SimInterrupt(u8Socket, SIM_IR_DISCON);
+	}
+	else
+	{
+		*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_FIN_WAIT;
+	}
+}
+
+static void SimCommand(uint8_t u8Socket,
+					   uint8_t u8Command)
+{
+	SSimSocket *psSocket = &sg_sSockets[u8Socket];
+	uint8_t u8Status = *SimReg(u8Socket, SIM_SN_SR);
+
+	switch (u8Command)
+	{
+		case SIM_CR_OPEN:
+			SimCommandOpen(u8Socket);
+			break;
+		case SIM_CR_LISTEN:
+			if ((SIM_SOCK_INIT == u8Status) &&
+				(SimListenerGet(SimReg16Get(u8Socket, SIM_SN_PORT)) >= 0))
+			{
+				*SimReg(u8Socket, SIM_SN_SR) = SIM_SOCK_LISTEN;
+			}
+			else
+			{
+				SimSocketClosed(u8Socket);
+			}
+			break;
+		case SIM_CR_CONNECT:
+			if (SIM_SOCK_INIT == u8Status)
+			{
+				SimCommandConnect(u8Socket);
+			}
+			break;
+		case SIM_CR_DISCON:
+			SimCommandDisconnect(u8Socket);
+			break;
+		case SIM_CR_CLOSE:
+			SimSocketClosed(u8Socket);
+			break;
+		case SIM_CR_SEND:
+		case SIM_CR_SEND_MAC:
+			psSocket->u16TxEnd = SimReg16Get(u8Socket, SIM_SN_TX_WR);
+			if (SIM_SOCK_UDP == u8Status)
+			{
+				SimUDPTransmit(u8Socket);
+			}
+			else
+			if (psSocket->s32Socket >= 0)
+			{
+				SimTCPTransmit(u8Socket);
+			}
+			break;
+		case SIM_CR_RECV:
+			psSocket->u16RxRd = SimReg16Get(u8Socket, SIM_SN_RX_RD);
+			SimPointersUpdate(u8Socket);
+			break;
+		default:
+			break;
+	}
+
+	*SimReg(u8Socket, SIM_SN_CR) = 0;
+}
+
+// Back to power on state; socket.c's wizchip_sw_reset() puts the addresses back
+static void SimReset(void)
+{
+	uint8_t u8Socket;
+
+	for (u8Socket = 0; u8Socket < SIM_SOCKETS; u8Socket++)
+	{
+		SimHostClose(u8Socket);
+	}
+
+	memset((void *) sg_u8Memory, 0, sizeof(sg_u8Memory));
+	memset((void *) sg_sSockets, 0, sizeof(sg_sSockets));
+
+	sg_u8Memory[0][SIM_PHYCFGR] = 0xb8 | SIM_PHYCFGR_LINK;
+	sg_u8Memory[0][SIM_VERSIONR] = SIM_VERSION;
+
+	for (u8Socket = 0; u8Socket < SIM_SOCKETS; u8Socket++)
+	{
+		sg_sSockets[u8Socket].s32Socket = -1;
+		*SimReg(u8Socket, SIM_SN_RXBUF_SIZE) = 2;
+		*SimReg(u8Socket, SIM_SN_TXBUF_SIZE) = 2;
+		SimPointersUpdate(u8Socket);
+	}
+}
+
+static uint8_t *SimCell(void)
+{
+	uint8_t u8Block = sg_u8Control >> 3;
+	uint16_t u16Address = sg_u16Address;
+
+	if (u8Block && ((u8Block % 4) != 1))
+	{
+		uint8_t u8Socket = (u8Block - 2) / 4;
+		uint16_t u16Size = SimBufferSize(u8Socket, (u8Block % 4) == 3);
+
+		u16Address &= (uint16_t) (u16Size ? (u16Size - 1) : 0);
+	}
+	else
+	{
+		u16Address &= 0xff;
+	}
+
+	return(&sg_u8Memory[u8Block][u16Address]);
+}
+
+static void SimWrite(uint8_t u8Data)
+{
+	uint8_t u8Block = sg_u8Control >> 3;
+	uint8_t u8Register = (uint8_t) sg_u16Address;
+
+	if (0 == u8Block)
+	{
+		if ((SIM_MR == u8Register) &&
+			(u8Data & SIM_MR_RST))
+		{
+			SimReset();
+		}
+		else
+		if ((u8Register != SIM_SIR) &&
+			(u8Register != SIM_VERSIONR))
+		{
+			*SimCell() = u8Data;
+		}
+	}
+	else
+	if ((u8Block % 4) == 1)
+	{
+		uint8_t u8Socket = (u8Block - 1) / 4;
+
+		switch (u8Register)
+		{
+			case SIM_SN_CR:
+				SimCommand(u8Socket, u8Data);
+				break;
+			case SIM_SN_IR:
+				*SimReg(u8Socket, SIM_SN_IR) &= (uint8_t) ~u8Data;
+				SimInterruptUpdate();
+				break;
+			case SIM_SN_SR:
+			case SIM_SN_TX_FSR:
+			case SIM_SN_TX_FSR + 1:
+			case SIM_SN_TX_RD:
+			case SIM_SN_TX_RD + 1:
+			case SIM_SN_RX_RSR:
+			case SIM_SN_RX_RSR + 1:
+			case SIM_SN_RX_WR:
+			case SIM_SN_RX_WR + 1:
+				break;
+			case SIM_SN_IMR:
+				*SimCell() = u8Data;
+				SimInterruptUpdate();
+				break;
+			default:
+				*SimCell() = u8Data;
+				if ((SIM_SN_RXBUF_SIZE == u8Register) ||
+					(SIM_SN_TXBUF_SIZE == u8Register))
+				{
+					SimPointersUpdate(u8Socket);
+				}
+				break;
+		}
+	}
+	else
+	{
+		*SimCell() = u8Data;
+	}
+
+	sg_u16Address++;
+}
+
+void W5500SimByteWrite(uint8_t u8Data)
+{
+	switch (sg_u8Phase)
+	{
+		case 0:
+			sg_u16Address = (uint16_t) (u8Data << 8);
+			sg_u8Phase++;
+			break;
+		case 1:
+			sg_u16Address |= u8Data;
+			sg_u8Phase++;
+			break;
+		case 2:
+			sg_u8Control = u8Data;
+			sg_u8Phase++;
+			break;
+		default:
+			SimWrite(u8Data);
+			break;
+	}
+}
+
+uint8_t W5500SimByteRead(void)
+{
+	uint8_t u8Data = *SimCell();
+
+	sg_u16Address++;
+	return(u8Data);
+}
+
+void W5500SimBurstRead(uint8_t *pu8Buffer,
+						 uint16_t u16Length)
+{
+	while (u16Length--)
+	{
+		*pu8Buffer++ = W5500SimByteRead();
+	}
+}
+
+void W5500SimBurstWrite(uint8_t *pu8Buffer,
+						  uint16_t u16Length)
+{
+	while (u16Length--)
+	{
+		W5500SimByteWrite(*pu8Buffer++);
+	}
+}
+
+static void SimPump(int s32TimeoutMs,
+					bool bAccept)
+{
+	struct pollfd sPoll[SIM_SOCKETS * 2];
+	uint8_t u8Sockets[SIM_SOCKETS * 2];
+	uint8_t u8Count = 0;
+	uint8_t u8Socket;
+	uint8_t u8Loop;
+
+	if (sg_bActivity)
+	{
+		s32TimeoutMs = 0;
+		sg_bActivity = false;
+	}
+
+	for (u8Socket = 0; u8Socket < SIM_SOCKETS; u8Socket++)
+	{
+		SSimSocket *psSocket = &sg_sSockets[u8Socket];
+		uint8_t u8Status = *SimReg(u8Socket, SIM_SN_SR);
+		int s32Socket = psSocket->s32Socket;
+		short s16Events = POLLIN;
+
+		if (SIM_SOCK_LISTEN == u8Status)
+		{
+			s32Socket = bAccept ? SimListenerGet(SimReg16Get(u8Socket, SIM_SN_PORT)) : -1;
+		}
+		else
+		if (SIM_SOCK_SYNSENT == u8Status)
+		{
+			s16Events = POLLOUT;
+		}
+		else
+		{
+			// Nothing more to read after the FIN, and no room means no reading either
+			if ((SIM_SOCK_CLOSE_WAIT == u8Status) ||
+				((SIM_SOCK_UDP != u8Status) &&
+				 (SimReg16Get(u8Socket, SIM_SN_RX_RSR) == SimBufferSize(u8Socket, true))))
+			{
+				s16Events = 0;
+			}
+
+			if (psSocket->u16TxRd != psSocket->u16TxEnd)
+			{
+				s16Events |= POLLOUT;
+			}
+		}
+
+		if ((s32Socket < 0) ||
+			(SIM_SOCK_CLOSED == u8Status) ||
+			(SIM_SOCK_INIT == u8Status))
+		{
+			continue;
+		}
+
+		sPoll[u8Count].fd = s32Socket;
+		sPoll[u8Count].events = s16Events;
+		sPoll[u8Count].revents = 0;
+		u8Sockets[u8Count++] = u8Socket;
+	}
+
+	if (poll(sPoll, u8Count, s32TimeoutMs) <= 0)
+	{
+		return;
+	}
+
+	for (u8Loop = 0; u8Loop < u8Count; u8Loop++)
+	{
+		uint8_t u8Status;
+
+		if (0 == sPoll[u8Loop].revents)
+		{
+			continue;
+		}
+
+		u8Socket = u8Sockets[u8Loop];
+		u8Status = *SimReg(u8Socket, SIM_SN_SR);
+
+		switch (u8Status)
+		{
+			case SIM_SOCK_LISTEN:
+				SimAccept(u8Socket);
+				break;
+			case SIM_SOCK_SYNSENT:
+				SimConnectCheck(u8Socket);
+				break;
+			case SIM_SOCK_UDP:
+				SimUDPReceive(u8Socket);
+				break;
+			case SIM_SOCK_ESTABLISHED:
+			case SIM_SOCK_CLOSE_WAIT:
+			case SIM_SOCK_FIN_WAIT:
+				if (sg_sSockets[u8Socket].u16TxRd != sg_sSockets[u8Socket].u16TxEnd)
+				{
+					SimTCPTransmit(u8Socket);
+				}
+				if (sPoll[u8Loop].revents & (POLLIN | POLLHUP | POLLERR))
+				{
+					SimTCPReceive(u8Socket);
+				}
+				break;
+			default:
+				break;
+		}
+	}
+}
+
+void W5500SimSelect(void)
+{
+	sg_u8Phase = 0;
+
+	if (0 == (++sg_u32Selects % SIM_PUMP_SELECTS))
+	{
+		SimPump(0, false);
+	}
+}
+
+void W5500SimDeselect(void)
+{
+}
+
+void W5500SimPump(int s32TimeoutMs)
+{
+	SimPump(s32TimeoutMs, true);
+}
+
+void W5500SimInit(uint16_t u16PortOffset)
+{
+	uint8_t u8Loop;
+
+	sg_u16PortOffset = u16PortOffset;
+
+	for (u8Loop = 0; u8Loop < SIM_SOCKETS; u8Loop++)
+	{
+		sg_sSockets[u8Loop].s32Socket = -1;
+		sg_sListeners[u8Loop].s32Socket = -1;
+	}
+
+	SimReset();
+}
@@ -0,0 +1,22 @@
+#ifndef _W5500SIM_H_
+#define _W5500SIM_H_
+
+// Ports below 1024 are moved up by u16PortOffset on the host side
+extern void W5500SimInit(uint16_t u16PortOffset);
+
+// Move data between the host sockets and the socket buffers. Waits up to
+// s32TimeoutMs for something to happen; 0 just looks.
+extern void W5500SimPump(int s32TimeoutMs);
+
+// SPI callbacks for reg_wizchip_cs_cbfunc(), reg_wizchip_spi_cbfunc() and
+// reg_wizchip_spiburst_cbfunc(), in place of Shared/NIC.c's
+extern void W5500SimSelect(void);
+extern void W5500SimDeselect(void);
+extern uint8_t W5500SimByteRead(void);
+extern void W5500SimByteWrite(uint8_t u8Data);
+extern void W5500SimBurstRead(uint8_t *pu8Buffer,
+							  uint16_t u16Length);
+extern void W5500SimBurstWrite(uint8_t *pu8Buffer,
+							   uint16_t u16Length);
+
+#endif
@@ -0,0 +1,517 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "Shared/zlib/zlib.h"
+
+// Flash image post-processing - does the jobs of pad, split and bin2c in one
+// pass over a mapped copy of the input:
+//
+// -p quantum	Pad the image with 0xff out to a multiple of quantum bytes. The
+//				padding applies to everything else this run produces.
+// -o file		Write the (padded) image to file
+// -w lanes		Split the image into 1, 2 or 4 byte lanes, one per flash chip.
+//				Lane n gets every byte whose offset % lanes == n. Two lanes are
+//				named <base>Even.bin/<base>Odd.bin like split's, otherwise
+//				<base>Lane<n>.bin.
+// -c variable	Emit the (padded) image as a C array on stdout, as bin2c does.
+//				Everything else printed goes to stderr in that case.
+//
+// A CRC32 and 16 bit sum of the image and of each lane are always printed so
+// they can be checked against the device programmer.
+
+// x86 hosts de-interleave with SSE2 if the CPU has it (this is built -m32, so
+// it can't be assumed)
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define	ROMIMG_SSE2				1
+#endif
+
+// Most lanes we'll split into
+#define	ROMIMG_LANES_MAX		4
+
+// How much of the image gets processed at a time. Must be a multiple of
+// ROMIMG_LANES_MAX and 64 (the SSE2 block size).
+#define	ROMIMG_CHUNK			(64 * 1024)
+
+// Per lane output
+typedef struct SLane
+{
+	char eFilename[512];
+	FILE *psFile;
+	uint32_t u32CRC32;
+	uint16_t u16Sum;
+	uint8_t u8Data[ROMIMG_CHUNK / 2];
+} SLane;
+
+// Fill for padding
+static uint8_t sg_u8Fill[ROMIMG_CHUNK];
+
+// The chunk that runs into the padding
+static uint8_t sg_u8Stage[ROMIMG_CHUNK];
+
+// Where messages go (stderr if stdout is carrying a C array)
+static FILE *sg_psInfo;
+
+// Splits u32Length bytes (a multiple of u8Lanes) into lanes a byte at a time
+static void LaneSplitScalar(uint8_t *pu8Data,
+							uint32_t u32Length,
+							uint8_t u8Lanes,
+							uint8_t **ppu8Lanes)
+{
+	uint32_t u32Loop;
+	uint8_t u8Lane;
+
+	for (u32Loop = 0; u32Loop < u32Length; u32Loop += u8Lanes)
+	{
+		for (u8Lane = 0; u8Lane < u8Lanes; u8Lane++)
+		{
+			*ppu8Lanes[u8Lane]++ = pu8Data[u32Loop + u8Lane];
+		}
+	}
+}
+
+#ifdef ROMIMG_SSE2
+// Splits 32 bytes into 16 even and 16 odd bytes
+__attribute__((target("sse2"))) static inline void LaneSplit2SSE2(__m128i sLow,
+																  __m128i sHigh,
+																  __m128i *psEven,
+																  __m128i *psOdd)
+{
+	__m128i sMask = _mm_set1_epi16(0x00ff);
+
+	*psEven = _mm_packus_epi16(_mm_and_si128(sLow, sMask), _mm_and_si128(sHigh, sMask));
+	*psOdd = _mm_packus_epi16(_mm_srli_epi16(sLow, 8), _mm_srli_epi16(sHigh, 8));
+}
+
+// Same as LaneSplitScalar(), but 64 bytes at a time for 2 and 4 lanes
+__attribute__((target("sse2"))) static void LaneSplitSSE2(uint8_t *pu8Data,
+														  uint32_t u32Length,
+														  uint8_t u8Lanes,
+														  uint8_t **ppu8Lanes)
+{
+	uint32_t u32Offset = 0;
+
+	while (u32Offset + 64 <= u32Length)
+	{
+		__m128i sEven[2];
+		__m128i sOdd[2];
+
+		LaneSplit2SSE2(_mm_loadu_si128((__m128i *) (pu8Data + u32Offset)),
+					   _mm_loadu_si128((__m128i *) (pu8Data + u32Offset + 16)),
+					   &sEven[0],
+					   &sOdd[0]);
+		LaneSplit2SSE2(_mm_loadu_si128((__m128i *) (pu8Data + u32Offset + 32)),
+					   _mm_loadu_si128((__m128i *) (pu8Data + u32Offset + 48)),
+					   &sEven[1],
+					   &sOdd[1]);
+
+		if (2 == u8Lanes)
+		{
+			_mm_storeu_si128((__m128i *) ppu8Lanes[0], sEven[0]);
+			_mm_storeu_si128((__m128i *) (ppu8Lanes[0] + 16), sEven[1]);
+			_mm_storeu_si128((__m128i *) ppu8Lanes[1], sOdd[0]);
+			_mm_storeu_si128((__m128i *) (ppu8Lanes[1] + 16), sOdd[1]);
+			ppu8Lanes[0] += 32;
+			ppu8Lanes[1] += 32;
+		}
+		else
+		{
+			__m128i sLane[4];
+
+			// Lanes 0/2 are the even bytes split again, 1/3 the odd ones
+			LaneSplit2SSE2(sEven[0], sEven[1], &sLane[0], &sLane[2]);
+			LaneSplit2SSE2(sOdd[0], sOdd[1], &sLane[1], &sLane[3]);
+
+			_mm_storeu_si128((__m128i *) ppu8Lanes[0], sLane[0]);
+			_mm_storeu_si128((__m128i *) ppu8Lanes[1], sLane[1]);
+			_mm_storeu_si128((__m128i *) ppu8Lanes[2], sLane[2]);
+			_mm_storeu_si128((__m128i *) ppu8Lanes[3], sLane[3]);
+			ppu8Lanes[0] += 16;
+			ppu8Lanes[1] += 16;
+			ppu8Lanes[2] += 16;
+			ppu8Lanes[3] += 16;
+		}
+
+		u32Offset += 64;
+	}
+
+	LaneSplitScalar(pu8Data + u32Offset,
+					u32Length - u32Offset,
+					u8Lanes,
+					ppu8Lanes);
+}
+#endif
+
+static void LaneSplit(uint8_t *pu8Data,
+					  uint32_t u32Length,
+					  uint8_t u8Lanes,
+					  SLane *psLanes)
+{
+	uint8_t *pu8Lanes[ROMIMG_LANES_MAX];
+	uint8_t u8Lane;
+
+	for (u8Lane = 0; u8Lane < u8Lanes; u8Lane++)
+	{
+		pu8Lanes[u8Lane] = psLanes[u8Lane].u8Data;
+	}
+
+#ifdef ROMIMG_SSE2
+	__builtin_cpu_init();
+	if ((u8Lanes > 1) &&
+		(__builtin_cpu_supports("sse2")))
+	{
+		LaneSplitSSE2(pu8Data,
+					  u32Length,
+					  u8Lanes,
+					  pu8Lanes);
+		return;
+	}
+#endif
+
+	LaneSplitScalar(pu8Data,
+					u32Length,
+					u8Lanes,
+					pu8Lanes);
+}
+
+// Adds up bytes
+static uint16_t Sum16(uint16_t u16Sum,
+					  uint8_t *pu8Data,
+					  uint32_t u32Length)
+{
+	uint32_t u32Sum = u16Sum;
+
+	while (u32Length--)
+	{
+		u32Sum += *pu8Data++;
+	}
+
+	return((uint16_t) u32Sum);
+}
+
+// Writes a chunk of the image as C array text, bin2c style (16 bytes per line)
+static void CArrayEmit(uint8_t *pu8Data,
+					   uint32_t u32Length,
+					   uint32_t u32Offset)
+{
+	static const char sg_eHex[] = "0123456789abcdef";
+	char eLine[16 * 6 + 3];
+	char *pePtr = eLine;
+
+	while (u32Length--)
+	{
+		if (0 == (u32Offset & 0x0f))
+		{
+			*pePtr++ = '\t';
+		}
+
+		*pePtr++ = '0';
+		*pePtr++ = 'x';
+		*pePtr++ = sg_eHex[*pu8Data >> 4];
+		*pePtr++ = sg_eHex[*pu8Data & 0x0f];
+		*pePtr++ = ',';
+		*pePtr++ = ' ';
+		++pu8Data;
+		++u32Offset;
+
+		if (0 == (u32Offset & 0x0f))
+		{
+			*pePtr++ = '\n';
+			fwrite(eLine, 1, pePtr - eLine, stdout);
+			pePtr = eLine;
+		}
+	}
+
+	fwrite(eLine, 1, pePtr - eLine, stdout);
+}
+
+static bool Write(FILE *psFile,
+				  char *peFilename,
+				  uint8_t *pu8Data,
+				  uint32_t u32Length)
+{
+	if (fwrite(pu8Data, 1, u32Length, psFile) != u32Length)
+	{
+		fprintf(sg_psInfo, "Failed to write %u bytes to '%s'\n", u32Length, peFilename);
+		return(false);
+	}
+
+	return(true);
+}
+
+int main(int argc, char **argv)
+{
+	static SLane sLanes[ROMIMG_LANES_MAX];
+	char *peImageFilename = NULL;
+	char *peVariable = NULL;
+	FILE *psImageFile = NULL;
+	uint32_t u32Quantum = 0;
+	uint8_t u8Lanes = 0;
+	uint8_t *pu8Data;
+	uint32_t u32Size;
+	uint32_t u32SizePadded;
+	uint32_t u32Offset;
+	uint32_t u32ImageCRC32 = 0;
+	uint16_t u16ImageSum = 0;
+	struct stat sStat;
+	int s32File;
+	int s32Arg = 1;
+	uint8_t u8Lane;
+	char eBase[480];
+	char *pePtr;
+
+	sg_psInfo = stdout;
+
+	while ((s32Arg < argc - 1) &&
+		   ('-' == argv[s32Arg][0]))
+	{
+		if (strcmp(argv[s32Arg], "-p") == 0)
+		{
+			u32Quantum = (uint32_t) strtoul(argv[++s32Arg], NULL, 0);
+		}
+		else
+		if (strcmp(argv[s32Arg], "-o") == 0)
+		{
+			peImageFilename = argv[++s32Arg];
+		}
+		else
+		if (strcmp(argv[s32Arg], "-w") == 0)
+		{
+			u8Lanes = (uint8_t) atoi(argv[++s32Arg]);
+			if ((u8Lanes != 1) &&
+				(u8Lanes != 2) &&
+				(u8Lanes != 4))
+			{
+				printf("Lanes must be 1, 2 or 4\n");
+				exit(1);
+			}
+		}
+		else
+		if (strcmp(argv[s32Arg], "-c") == 0)
+		{
+			peVariable = argv[++s32Arg];
+			sg_psInfo = stderr;
+		}
+		else
+		{
+			break;
+		}
+
+		s32Arg++;
+	}
+
+	if ((argc - s32Arg) != 1)
+	{
+		printf("Usage: romimg [-p quantum] [-o paddedfile] [-w lanes] [-c variable_name] filename\n");
+		exit(1);
+	}
+
+	s32File = open(argv[s32Arg], O_RDONLY);
+	if ((s32File < 0) ||
+		(fstat(s32File, &sStat) != 0) ||
+		(0 == sStat.st_size) ||
+		((uint64_t) sStat.st_size > 0x7fffffff))
+	{
+		fprintf(sg_psInfo, "Can't open '%s' for reading\n", argv[s32Arg]);
+		exit(1);
+	}
+
+	u32Size = (uint32_t) sStat.st_size;
+	pu8Data = mmap(NULL, u32Size, PROT_READ, MAP_PRIVATE, s32File, 0);
+	close(s32File);
+	if (MAP_FAILED == pu8Data)
+	{
+		fprintf(sg_psInfo, "%s: Failed to mmap() %u bytes\n", argv[s32Arg], u32Size);
+		exit(1);
+	}
+
+	(void) madvise(pu8Data, u32Size, MADV_SEQUENTIAL);
+
+	// Figure out the padded size. The lanes have to come out the same size too.
+	u32SizePadded = u32Size;
+	if (u32Quantum)
+	{
+		u32SizePadded = ((u32SizePadded + u32Quantum - 1) / u32Quantum) * u32Quantum;
+	}
+
+	if (u8Lanes)
+	{
+		u32SizePadded = ((u32SizePadded + u8Lanes - 1) / u8Lanes) * u8Lanes;
+	}
+
+	memset((void *) sg_u8Fill, 0xff, sizeof(sg_u8Fill));
+
+	fprintf(sg_psInfo, "Read %u bytes, padded to %u bytes\n", u32Size, u32SizePadded);
+
+	if (peImageFilename)
+	{
+		psImageFile = fopen(peImageFilename, "wb");
+		if (NULL == psImageFile)
+		{
+			fprintf(sg_psInfo, "Can't open file '%s' for writing\n", peImageFilename);
+			exit(1);
+		}
+	}
+
+	if (u8Lanes)
+	{
+		// Base name is the input filename less its extension
+		snprintf(eBase, sizeof(eBase), "%s", argv[s32Arg]);
+		pePtr = strrchr(eBase, '.');
+		if ((pePtr) &&
+			(NULL == strchr(pePtr, '/')))
+		{
+			*pePtr = '\0';
+		}
+
+		for (u8Lane = 0; u8Lane < u8Lanes; u8Lane++)
+		{
+			if (2 == u8Lanes)
+			{
+				snprintf(sLanes[u8Lane].eFilename, sizeof(sLanes[u8Lane].eFilename), "%s%s.bin", eBase, u8Lane ? "Odd" : "Even");
+			}
+			else
+			{
+				snprintf(sLanes[u8Lane].eFilename, sizeof(sLanes[u8Lane].eFilename), "%sLane%u.bin", eBase, u8Lane);
+			}
+
+			sLanes[u8Lane].psFile = fopen(sLanes[u8Lane].eFilename, "wb");
+			if (NULL == sLanes[u8Lane].psFile)
+			{
+				fprintf(sg_psInfo, "Can't open file '%s' for writing\n", sLanes[u8Lane].eFilename);
+				exit(1);
+			}
+		}
+	}
+
+	if (peVariable)
+	{
+		printf("#include <stdint.h>\n\n");
+		printf("const uint8_t %s[] __attribute__ ((aligned (8)))=\n{\n", peVariable);
+	}
+
+	// One pass through the image, a chunk at a time
+	for (u32Offset = 0; u32Offset < u32SizePadded; )
+	{
+		uint8_t *pu8Chunk;
+		uint32_t u32Chunk;
+
+		u32Chunk = u32SizePadded - u32Offset;
+		if (u32Chunk > ROMIMG_CHUNK)
+		{
+			u32Chunk = ROMIMG_CHUNK;
+		}
+
+		if (u32Offset >= u32Size)
+		{
+			// All padding
+			pu8Chunk = sg_u8Fill;
+		}
+		else
+		if ((u32Offset + u32Chunk) > u32Size)
+		{
+			// Runs into the padding - stage it with the fill behind it
+			pu8Chunk = sg_u8Stage;
+			memcpy((void *) pu8Chunk, (void *) (pu8Data + u32Offset), u32Size - u32Offset);
+			memset((void *) (pu8Chunk + (u32Size - u32Offset)), 0xff, u32Chunk - (u32Size - u32Offset));
+		}
+		else
+		{
+			pu8Chunk = pu8Data + u32Offset;
+		}
+
+		u32ImageCRC32 = (uint32_t) crc32(u32ImageCRC32, pu8Chunk, u32Chunk);
+		u16ImageSum = Sum16(u16ImageSum, pu8Chunk, u32Chunk);
+
+		if (psImageFile)
+		{
+			if (false == Write(psImageFile, peImageFilename, pu8Chunk, u32Chunk))
+			{
+				exit(1);
+			}
+		}
+
+		if (peVariable)
+		{
+			CArrayEmit(pu8Chunk,
+					   u32Chunk,
+					   u32Offset);
+		}
+
+		if (u8Lanes > 1)
+		{
+			LaneSplit(pu8Chunk,
+					  u32Chunk,
+					  u8Lanes,
+					  sLanes);
+		}
+
+		for (u8Lane = 0; u8Lane < u8Lanes; u8Lane++)
+		{
+			SLane *psLane = &sLanes[u8Lane];
+			uint32_t u32LaneChunk = u32Chunk / u8Lanes;
+			uint8_t *pu8Lane = psLane->u8Data;
+
+			// A single lane is just the image
+			if (1 == u8Lanes)
+			{
+				pu8Lane = pu8Chunk;
+			}
+
+			psLane->u32CRC32 = (uint32_t) crc32(psLane->u32CRC32, pu8Lane, u32LaneChunk);
+			psLane->u16Sum = Sum16(psLane->u16Sum, pu8Lane, u32LaneChunk);
+
+			if (false == Write(psLane->psFile, psLane->eFilename, pu8Lane, u32LaneChunk))
+			{
+				exit(1);
+			}
+		}
+
+		u32Offset += u32Chunk;
+	}
+
+	if (peVariable)
+	{
+		printf("};\n");
+		printf("\n");
+		printf("const uint32_t %sSize = sizeof(%s);\n", peVariable, peVariable);
+	}
+
+	if (psImageFile)
+	{
+		if (fclose(psImageFile))
+		{
+			fprintf(sg_psInfo, "Failed to write '%s'\n", peImageFilename);
+			exit(1);
+		}
+
+		fprintf(sg_psInfo, "Image %s\n", peImageFilename);
+	}
+
+	fprintf(sg_psInfo, "Image: CRC32=0x%.8x sum16=0x%.4x\n", u32ImageCRC32, u16ImageSum);
+
+	for (u8Lane = 0; u8Lane < u8Lanes; u8Lane++)
+	{
+		if (fclose(sLanes[u8Lane].psFile))
+		{
+			fprintf(sg_psInfo, "Failed to write '%s'\n", sLanes[u8Lane].eFilename);
+			exit(1);
+		}
+
+		fprintf(sg_psInfo, "Lane %u: %s - %u bytes CRC32=0x%.8x sum16=0x%.4x\n",
+				u8Lane,
+				sLanes[u8Lane].eFilename,
+				u32SizePadded / u8Lanes,
+				sLanes[u8Lane].u32CRC32,
+				sLanes[u8Lane].u16Sum);
+	}
+
+	munmap(pu8Data, u32Size);
+	return(0);
+}
@@ -2,6 +2,13 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <assert.h>
+#include <string.h>
+#include <stddef.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #ifndef _WIN32
 #include <endian.h>
 #else
@@ -23,14 +30,111 @@
 #endif
 #include <time.h>
 #include "Shared/Version.h"
+#include "Shared/ZImage.h"
 #include "Shared/zlib/zlib.h"
+#include "Shared/SHA256/sha256.h"
+
+// x86 hosts search with SSE2 if the CPU has it (this is built -m32, so it
+// can't be assumed)
+#if defined(__x86_64__) || defined(__i386__)
+#include <emmintrin.h>
+#define	STAMP_SSE2				1
+#endif
+
+// How much of the image gets CRC'd at a time
+#define	STAMP_CRC_CHUNK			(64 * 1024)
+
+// Set true (-z) to also write a compressed copy of each stamped image
+static bool sg_bCompress;
+
+// Set true (-s) to also write "<image>.sha256" for each stamped image
+static bool sg_bHash;
+
+// Per image stamping job
+typedef struct SStampJob
+{
+	char *peFilename;
+	int s32Result;
+	pthread_t sThread;
+} SStampJob;
+
+// Returns the offset of the first 4 byte aligned copy of u32Word (in memory
+// order) in pu8Data, or u32Size if there isn't one
+static uint32_t StampFindWordScalar(uint8_t *pu8Data,
+									uint32_t u32Size,
+									uint32_t u32Word)
+{
+	uint32_t u32Offset = 0;
+
+	while (u32Offset + sizeof(uint32_t) <= u32Size)
+	{
+		if (memcmp((void *) (pu8Data + u32Offset), (void *) &u32Word, sizeof(u32Word)) == 0)
+		{
+			return(u32Offset);
+		}
+
+		u32Offset += sizeof(uint32_t);
+	}
+
+	return(u32Size);
+}
+
+#ifdef STAMP_SSE2
+// Same as StampFindWordScalar(), but compares 4 aligned words at a time
+__attribute__((target("sse2"))) static uint32_t StampFindWordSSE2(uint8_t *pu8Data,
+																  uint32_t u32Size,
+																  uint32_t u32Word)
+{
+	__m128i sWord = _mm_set1_epi32((int) u32Word);
+	uint32_t u32Offset = 0;
+
+	while (u32Offset + sizeof(__m128i) <= u32Size)
+	{
+		int s32Mask = _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_loadu_si128((__m128i *) (pu8Data + u32Offset)), sWord));
+
+		if (s32Mask)
+		{
+			// Each matching word lights up 4 mask bits
+			return(u32Offset + (__builtin_ctz((unsigned int) s32Mask) & ~3));
+		}
+
+		u32Offset += sizeof(__m128i);
+	}
+
+	u32Offset += StampFindWordScalar(pu8Data + u32Offset,
+									 u32Size - u32Offset,
+									 u32Word);
+	return(u32Offset);
+}
+#endif
+
+static uint32_t StampFindWord(uint8_t *pu8Data,
+							  uint32_t u32Size,
+							  uint32_t u32Word)
+{
+#ifdef STAMP_SSE2
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("sse2"))
+	{
+		return(StampFindWordSSE2(pu8Data,
+								 u32Size,
+								 u32Word));
+	}
+#endif
+
+	return(StampFindWordScalar(pu8Data,
+							   u32Size,
+							   u32Word));
+}
 
 // This will find a basic version structure (unstamped)
-SImageVersion *VersionFindBasicStructure(uint8_t *pu8BaseAddress,
+SImageVersion *VersionFindBasicStructure(char *peFilename,
+										 uint8_t *pu8BaseAddress,
 										 uint32_t u32Size,
 										 uint32_t *pu32Offset)
 {
 	SImageVersion *psImageVersion;
+	uint32_t u32Prefix = htobe32(VERSION_PREFIX);
 	uint32_t u32Offset = 0;
 
 	// If our size is smaller than the image version structure, then we've not
@@ -42,16 +146,19 @@ SImageVersion *VersionFindBasicStructure(uint8_t *pu8BaseAddress,
 	}
 
 	u32Size -= sizeof(*psImageVersion);
-	while (u32Size >= 4)
+	while (u32Offset <= u32Size)
 	{
-		psImageVersion = (SImageVersion *) pu8BaseAddress;
-
-		// Do we have a proper prefix?
-		if (be32toh(psImageVersion->u32VersionPrefix) != VERSION_PREFIX)
+		// Skip straight to the next prefix
+		u32Offset += StampFindWord(pu8BaseAddress + u32Offset,
+								   (u32Size - u32Offset) + sizeof(uint32_t),
+								   u32Prefix);
+		if (u32Offset > u32Size)
 		{
-			// Skip it
+			break;
 		}
-		else
+
+		psImageVersion = (SImageVersion *) (pu8BaseAddress + u32Offset);
+
 		// And a proper suffix?
 		if (be32toh(psImageVersion->u32VersionSuffix) != VERSION_SUFFIX)
 		{
@@ -61,21 +168,21 @@ SImageVersion *VersionFindBasicStructure(uint8_t *pu8BaseAddress,
 		// Is the image type known?
 		if ((be32toh(psImageVersion->eImageType) <= EIMGTYPE_UNKNOWN) || (be32toh(psImageVersion->eImageType) >= EIMGTYPE_COUNT))
 		{
-			printf("Unreasonable image type\n");
+			printf("%s: Unreasonable image type\n", peFilename);
 			// Image type is unreasonable
 		}
 		else
 		// Stamp fill for image?
 		if (be32toh(psImageVersion->u32ImageCRC32) != STAMP_IMAGE_CRC32_FILL)
 		{
-			printf("CRC32 Fill not seen\n");
+			printf("%s: CRC32 Fill not seen\n", peFilename);
 			// Image CRC32 fill not correct
 		}
 		else
 		// Stamp fill for version structure?
 		if (be32toh(psImageVersion->u32VersionStructCRC32) != STAMP_VERSION_CRC32_FILL)
 		{
-			printf("Stamp fill not seen\n");
+			printf("%s: Stamp fill not seen\n", peFilename);
 			// Image CRC32 fill not correct
 		}
 		else
@@ -86,69 +193,229 @@ SImageVersion *VersionFindBasicStructure(uint8_t *pu8BaseAddress,
 				*pu32Offset = u32Offset;
 			}
 
-			printf("Unstamped image found at offset %u\n", u32Offset);
+			printf("%s: Unstamped image found at offset %u\n", peFilename, u32Offset);
 
 			return(psImageVersion);
 		}
 
 		u32Offset += sizeof(uint32_t);
-		pu8BaseAddress += sizeof(uint32_t);
-		u32Size -= sizeof(uint32_t);
 	}
 
 errorExit:
 	return(NULL);
 }
 
-int main(int argc, char **argv)
+// Computes the image CRC and the version structure CRC in one pass over the
+// image. Everything in the version structure other than the two CRCs must
+// already be filled in. The structure CRC covers the image CRC field, so
+// the structure is CRC'd around it and the pieces are joined up with
+// crc32_combine() once the image CRC is known.
+static void StampCRC(uint8_t *pu8Data,
+					 uint32_t u32Size,
+					 uint32_t u32VersionOffset,
+					 uint32_t *pu32ImageCRC,
+					 uint32_t *pu32StructCRC)
+{
+	uint8_t *pu8Version = pu8Data + u32VersionOffset;
+	uint32_t u32ImageCRCOffset = offsetof(SImageVersion, u32ImageCRC32);
+	uint32_t u32StructCRCOffset = offsetof(SImageVersion, u32VersionStructCRC32);
+	uint32_t u32ImageCRC = VERSION_CRC32_IMAGE_INITIAL;
+	uint32_t u32StructHead = 0;
+	uint32_t u32StructTail = 0;
+	uint32_t u32StructTailSize;
+	uint32_t u32ImageCRCBE;
+	uint32_t u32Offset = 0;
+
+	while (u32Offset < u32Size)
+	{
+		uint32_t u32Chunk = u32Size - u32Offset;
+
+		if (u32Chunk > STAMP_CRC_CHUNK)
+		{
+			u32Chunk = STAMP_CRC_CHUNK;
+		}
+
+		if (u32Offset == u32VersionOffset)
+		{
+			// The version structure isn't part of the image CRC. CRC its
+			// pieces on the way past instead.
+			u32StructHead = crc32(VERSION_CRC32_STRUCT_INITIAL,
+								  pu8Version,
+								  u32ImageCRCOffset);
+			u32StructTail = crc32(0,
+								  pu8Version + u32ImageCRCOffset + sizeof(uint32_t),
+								  u32StructCRCOffset - (u32ImageCRCOffset + sizeof(uint32_t)));
+			u32StructTail = crc32(u32StructTail,
+								  pu8Version + u32StructCRCOffset + sizeof(uint32_t),
+								  sizeof(SImageVersion) - (u32StructCRCOffset + sizeof(uint32_t)));
+			u32Offset += sizeof(SImageVersion);
+			continue;
+		}
+
+		// Don't run into the version structure
+		if ((u32Offset < u32VersionOffset) &&
+			(u32Offset + u32Chunk > u32VersionOffset))
+		{
+			u32Chunk = u32VersionOffset - u32Offset;
+		}
+
+		u32ImageCRC = crc32(u32ImageCRC,
+							pu8Data + u32Offset,
+							u32Chunk);
+		u32Offset += u32Chunk;
+	}
+
+	// Now drop the (big endian) image CRC into the structure CRC
+	u32StructTailSize = (u32StructCRCOffset - (u32ImageCRCOffset + sizeof(uint32_t))) +
+						(sizeof(SImageVersion) - (u32StructCRCOffset + sizeof(uint32_t)));
+	u32ImageCRCBE = htobe32(u32ImageCRC);
+	u32StructHead = crc32(u32StructHead,
+						  (const unsigned char *) &u32ImageCRCBE,
+						  sizeof(u32ImageCRCBE));
+
+	*pu32ImageCRC = u32ImageCRC;
+	*pu32StructCRC = crc32_combine(u32StructHead,
+								   u32StructTail,
+								   u32StructTailSize);
+}
+
+// Writes a compressed (ZImage) copy of a stamped image to "<image>.z"
+static int StampCompress(char *peFilename,
+						 uint8_t *pu8Data,
+						 uint32_t u32Size)
 {
+	SZImageHeader sHeader;
+	z_stream sStream;
+	uint8_t *pu8Compressed = NULL;
+	uint32_t u32CompressedSize;
+	char eOutputFilename[4096];
 	FILE *psFile = NULL;
+	int s32Result = 1;
+
+	memset((void *) &sStream, 0, sizeof(sStream));
+	if (deflateInit2(&sStream, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		printf("%s: deflateInit2() failed\n", peFilename);
+		return(1);
+	}
+
+	u32CompressedSize = (uint32_t) deflateBound(&sStream, u32Size);
+	pu8Compressed = malloc(u32CompressedSize);
+	if (NULL == pu8Compressed)
+	{
+		printf("%s: Failed to malloc() %u bytes\n", peFilename, u32CompressedSize);
+		goto errorExit;
+	}
+
+	sStream.next_in = pu8Data;
+	sStream.avail_in = u32Size;
+	sStream.next_out = pu8Compressed;
+	sStream.avail_out = u32CompressedSize;
+	if (deflate(&sStream, Z_FINISH) != Z_STREAM_END)
+	{
+		printf("%s: deflate() failed\n", peFilename);
+		goto errorExit;
+	}
+
+	u32CompressedSize = (uint32_t) sStream.total_out;
+
+	// Everything is big endian targeted
+	memset((void *) &sHeader, 0, sizeof(sHeader));
+	sHeader.u32Signature = htobe32(ZIMAGE_SIGNATURE);
+	sHeader.u16Version = htobe16(ZIMAGE_VERSION);
+	sHeader.u16HeaderSize = htobe16(sizeof(sHeader));
+	sHeader.u32CompressedSize = htobe32(u32CompressedSize);
+	sHeader.u32CompressedCRC32 = htobe32(crc32(0, pu8Compressed, u32CompressedSize));
+	sHeader.u32UncompressedSize = htobe32(u32Size);
+	sHeader.u32UncompressedCRC32 = htobe32(crc32(0, pu8Data, u32Size));
+	sHeader.u32HeaderCRC32 = htobe32(crc32(0, (const unsigned char *) &sHeader, offsetof(SZImageHeader, u32HeaderCRC32)));
+
+	snprintf(eOutputFilename, sizeof(eOutputFilename), "%s.z", peFilename);
+	psFile = fopen(eOutputFilename, "wb");
+	if (NULL == psFile)
+	{
+		printf("Can't open '%s' for writing\n", eOutputFilename);
+		goto errorExit;
+	}
+
+	if ((fwrite((void *) &sHeader, 1, sizeof(sHeader), psFile) != sizeof(sHeader)) ||
+		(fwrite((void *) pu8Compressed, 1, u32CompressedSize, psFile) != u32CompressedSize))
+	{
+		printf("Failed to write '%s'\n", eOutputFilename);
+		goto errorExit;
+	}
+
+	printf("%s: Compressed %u bytes to %u bytes in '%s'\n", peFilename, u32Size, u32CompressedSize, eOutputFilename);
+	s32Result = 0;
+
+errorExit:
+	if (psFile)
+	{
+		if (fclose(psFile) != 0)
+		{
+			s32Result = 1;
+		}
+	}
+
+	free(pu8Compressed);
+	(void) deflateEnd(&sStream);
+	return(s32Result);
+}
+
+// Stamps one image in place
+static int StampImage(char *peFilename)
+{
+	int s32File;
+	struct stat sStat;
 	uint32_t u32Size = 0;
 	uint8_t *pu8Data = NULL;
 	uint32_t u32VersionOffset = 0;
-	uint32_t u32CRC;
+	uint32_t u32ImageCRC;
+	uint32_t u32StructCRC;
 	uint64_t u64Timestamp;
 	SImageVersion *psImageVersion = NULL;
+	int s32Result = 1;
 
-	if (argc < 2)
+	s32File = open(peFilename, O_RDWR);
+	if (s32File < 0)
 	{
-		printf("Usage: stamp filename\n");
+		printf("File '%s' not found\n", peFilename);
 		return(1);
 	}
-  
-	psFile = fopen(argv[1], "rb");
-	if (NULL == psFile)
+	
+	// Figure out how big it is
+	if ((fstat(s32File, &sStat) != 0) ||
+		(0 == sStat.st_size) ||
+		((uint64_t) sStat.st_size > 0xffffffff))
 	{
-		printf("File '%s' not found\n", argv[1]);
+		printf("%s: Can't size file\n", peFilename);
+		close(s32File);
 		return(1);
 	}
-	
-	// Figure out how big it is
-	fseek(psFile, 0, SEEK_END);
-	u32Size = ftell(psFile);
-	fseek(psFile, 0, SEEK_SET);
-	
-	pu8Data = calloc(u32Size, 1);
-	if (NULL == pu8Data)
+
+	u32Size = (uint32_t) sStat.st_size;
+
+	// Map it so the stamp gets written straight back to the file
+	pu8Data = mmap(NULL, u32Size, PROT_READ | PROT_WRITE, MAP_SHARED, s32File, 0);
+	close(s32File);
+	if (MAP_FAILED == pu8Data)
 	{
-		printf("Failed to malloc() %u bytes\n", u32Size);
-		fclose(psFile);
+		printf("%s: Failed to mmap() %u bytes\n", peFilename, u32Size);
 		return(1);
 	}
 
-	printf("Reading in %u bytes\n", u32Size);
-	fread(pu8Data, 1, u32Size, psFile);
-	fclose(psFile);
+	printf("%s: Mapped %u bytes\n", peFilename, u32Size);
 
 	// Go find the unstamped version structure
-	psImageVersion = VersionFindBasicStructure(pu8Data,
+	psImageVersion = VersionFindBasicStructure(peFilename,
+											   pu8Data,
 											   u32Size,
 											   &u32VersionOffset);
 
 	if (NULL == psImageVersion)
 	{
-		printf("Failed to find unstamped version structure\n");
-		return(1);
+		printf("%s: Failed to find unstamped version structure\n", peFilename);
+		goto errorExit;
 	}
 
 	// Found our version image! Let's do some work... Remember, everything is
@@ -156,47 +423,245 @@ int main(int argc, char **argv)
 
 	u64Timestamp = (uint64_t) time(0);
 	psImageVersion->u64BuildTimestamp = htobe64(u64Timestamp);
+	psImageVersion->u32ImageSize = htobe32(u32Size);
 
-	// Get the CRC of the image
+	// Get the CRC of the image and the structure
+	StampCRC(pu8Data,
+			 u32Size,
+			 u32VersionOffset,
+			 &u32ImageCRC,
+			 &u32StructCRC);
 
-	// Before the version structure
-	u32CRC = crc32(VERSION_CRC32_IMAGE_INITIAL,
-				   pu8Data,
-				   u32VersionOffset);
+	psImageVersion->u32ImageCRC32 = htobe32(u32ImageCRC);
+	psImageVersion->u32VersionStructCRC32 = htobe32(u32StructCRC);
 
-	printf("After image CRC32 = %u\n", u32VersionOffset);
-	// And after the version structure
-	u32CRC = crc32(u32CRC,
-				   pu8Data + sizeof(*psImageVersion) + u32VersionOffset,
-				   u32Size - sizeof(*psImageVersion) - u32VersionOffset);
+	// Push it out to the file
+	if (msync(pu8Data, u32Size, MS_SYNC) != 0)
+	{
+		printf("%s: Can't write stamp back\n", peFilename);
+		goto errorExit;
+	}
+	
+	printf("%s: Successfully stamped\n", peFilename);
+	s32Result = 0;
 
-	psImageVersion->u32ImageCRC32 = htobe32(u32CRC);
-	psImageVersion->u32ImageSize = htobe32(u32Size);
+	if (sg_bCompress)
+	{
+		s32Result = StampCompress(peFilename,
+								  pu8Data,
+								  u32Size);
+	}
 
-	// CRC the structure. Remember... don't CRC the CRC32 field
-	u32CRC = crc32(VERSION_CRC32_STRUCT_INITIAL,
-				   (const unsigned char *) psImageVersion,
-				   ((uint32_t) &psImageVersion->u32VersionStructCRC32) - ((uint32_t) psImageVersion));
+errorExit:
+	munmap(pu8Data, u32Size);
+	return(s32Result);
+}
 
-	// And CRC everything past the u32VersionStructCRC32 member
-	u32CRC = crc32(u32CRC,
-				   ((const unsigned char *) &psImageVersion->u32VersionStructCRC32) + sizeof(psImageVersion->u32VersionStructCRC32),
-				   ((uint32_t) (psImageVersion + 1)) - (((uint32_t) &psImageVersion->u32VersionStructCRC32) + sizeof(psImageVersion->u32VersionStructCRC32)));
+// Writes "<image>.sha256" (sha256sum format, which is what the emulator
+// checks a loaded ROM against) for each stamped image. The images are hashed
+// as one batch so MySHA256_Multi() can run them side by side.
+static int StampHash(char **ppeFilenames,
+					 uint32_t u32Count)
+{
+	const void **ppvData;
+	size_t *pLengths;
+	uint8_t (*pu8Digests)[SHA256_DIGEST_LENGTH];
+	uint32_t u32Loop;
+	int s32Result = 1;
 
-	psImageVersion->u32VersionStructCRC32 = htobe32(u32CRC);
+	ppvData = calloc(u32Count, sizeof(*ppvData));
+	pLengths = calloc(u32Count, sizeof(*pLengths));
+	pu8Digests = calloc(u32Count, sizeof(*pu8Digests));
+	if ((NULL == ppvData) ||
+		(NULL == pLengths) ||
+		(NULL == pu8Digests))
+	{
+		printf("Failed to allocate %u hashes\n", u32Count);
+		goto errorExit;
+	}
 
-	// Time to write everything back
-	psFile = fopen(argv[1], "wb");
-	if (NULL == psFile)
+	for (u32Loop = 0; u32Loop < u32Count; u32Loop++)
 	{
-		printf("Can't open '%s' for writing\n", argv[1]);
-		return(1);
+		struct stat sStat;
+		void *pvData;
+		int s32File;
+
+		s32File = open(ppeFilenames[u32Loop], O_RDONLY);
+		if (s32File < 0)
+		{
+			printf("File '%s' not found\n", ppeFilenames[u32Loop]);
+			goto errorExit;
+		}
+
+		// Stamping already made sure the size is sane
+		if (fstat(s32File, &sStat) != 0)
+		{
+			printf("%s: Can't size file\n", ppeFilenames[u32Loop]);
+			close(s32File);
+			goto errorExit;
+		}
+
+		pvData = mmap(NULL, (size_t) sStat.st_size, PROT_READ, MAP_PRIVATE, s32File, 0);
+		close(s32File);
+		if (MAP_FAILED == pvData)
+		{
+			printf("%s: Failed to mmap() %u bytes\n", ppeFilenames[u32Loop], (uint32_t) sStat.st_size);
+			goto errorExit;
+		}
+
+		ppvData[u32Loop] = pvData;
+		pLengths[u32Loop] = (size_t) sStat.st_size;
 	}
-	
-	fwrite((void *) pu8Data, 1, u32Size, psFile);
-	fclose(psFile);
-	
-	printf("Successfully stamped\n");
-	return(0);
+
+	MySHA256_Multi(pu8Digests,
+				   ppvData,
+				   pLengths,
+				   u32Count);
+
+	for (u32Loop = 0; u32Loop < u32Count; u32Loop++)
+	{
+		char eOutputFilename[4096];
+		char *peBasename;
+		FILE *psFile;
+		uint32_t u32Byte;
+
+		snprintf(eOutputFilename, sizeof(eOutputFilename), "%s.sha256", ppeFilenames[u32Loop]);
+		psFile = fopen(eOutputFilename, "wb");
+		if (NULL == psFile)
+		{
+			printf("Can't open '%s' for writing\n", eOutputFilename);
+			goto errorExit;
+		}
+
+		for (u32Byte = 0; u32Byte < SHA256_DIGEST_LENGTH; u32Byte++)
+		{
+			fprintf(psFile, "%.2x", pu8Digests[u32Loop][u32Byte]);
+		}
+
+		peBasename = strrchr(ppeFilenames[u32Loop], '/');
+		fprintf(psFile, "  %s\n", peBasename ? (peBasename + 1) : ppeFilenames[u32Loop]);
+		if (fclose(psFile) != 0)
+		{
+			printf("Failed to write '%s'\n", eOutputFilename);
+			goto errorExit;
+		}
+
+		printf("%s: SHA-256 written to '%s' (%s)\n", ppeFilenames[u32Loop], eOutputFilename, MySHA256_GetKernelName());
+	}
+
+	s32Result = 0;
+
+errorExit:
+	if (ppvData && pLengths)
+	{
+		for (u32Loop = 0; u32Loop < u32Count; u32Loop++)
+		{
+			if (ppvData[u32Loop])
+			{
+				munmap((void *) ppvData[u32Loop], pLengths[u32Loop]);
+			}
+		}
+	}
+
+	free(ppvData);
+	free(pLengths);
+	free(pu8Digests);
+	return(s32Result);
+}
+
+static void *StampThread(void *pvJob)
+{
+	SStampJob *psJob = (SStampJob *) pvJob;
+
+	psJob->s32Result = StampImage(psJob->peFilename);
+	return(NULL);
 }
 
+int main(int argc, char **argv)
+{
+	SStampJob *psJobs;
+	int s32Count;
+	int s32Loop;
+	int s32Result = 0;
+
+	// -z Also writes compressed copies for the boot loader to inflate
+	// -s Also writes SHA-256 files for the emulator to check against
+	while (argc > 1)
+	{
+		if (strcmp(argv[1], "-z") == 0)
+		{
+			sg_bCompress = true;
+		}
+		else
+		if (strcmp(argv[1], "-s") == 0)
+		{
+			sg_bHash = true;
+		}
+		else
+		{
+			break;
+		}
+
+		argv++;
+		argc--;
+	}
+
+	s32Count = argc - 1;
+	if (argc < 2)
+	{
+		printf("Usage: stamp [-z] [-s] filename [filename...]\n");
+		return(1);
+	}
+
+	// Just the one? No need for threads.
+	if (1 == s32Count)
+	{
+		s32Result = StampImage(argv[1]);
+		goto hashImages;
+	}
+
+	psJobs = calloc(s32Count, sizeof(*psJobs));
+	if (NULL == psJobs)
+	{
+		printf("Failed to allocate %d jobs\n", s32Count);
+		return(1);
+	}
+
+	// A thread per image
+	for (s32Loop = 0; s32Loop < s32Count; s32Loop++)
+	{
+		psJobs[s32Loop].peFilename = argv[s32Loop + 1];
+		if (pthread_create(&psJobs[s32Loop].sThread, NULL, StampThread, (void *) &psJobs[s32Loop]) != 0)
+		{
+			// Couldn't start a thread - do it here
+			StampThread((void *) &psJobs[s32Loop]);
+			psJobs[s32Loop].peFilename = NULL;
+		}
+	}
+
+	for (s32Loop = 0; s32Loop < s32Count; s32Loop++)
+	{
+		if (psJobs[s32Loop].peFilename)
+		{
+			pthread_join(psJobs[s32Loop].sThread, NULL);
+		}
+
+		if (psJobs[s32Loop].s32Result)
+		{
+			s32Result = 1;
+		}
+	}
+
+	free(psJobs);
+
+hashImages:
+	// Every image is stamped (the hash covers the stamp), so hash them as a batch
+	if ((0 == s32Result) &&
+		sg_bHash)
+	{
+		s32Result = StampHash(&argv[1],
+							  (uint32_t) s32Count);
+	}
+
+	return(s32Result);
+}
@@ -0,0 +1,522 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <strings.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <time.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+
+// Read-only TFTP server for network booting and testing the firmware's TFTP
+// client. Speaks RFC 1350 plus blksize (RFC 2348), timeout/tsize (RFC 2349)
+// and windowsize (RFC 7440). One transfer at a time, each from its own port.
+
+// Opcodes
+#define	TFTP_RRQ					1
+#define	TFTP_WRQ					2
+#define	TFTP_DATA					3
+#define	TFTP_ACK					4
+#define	TFTP_ERROR					5
+#define	TFTP_OACK					6
+
+// Error codes
+#define	TFTP_ERR_UNDEF				0
+#define	TFTP_ERR_NOT_FOUND			1
+#define	TFTP_ERR_ACCESS				2
+#define	TFTP_ERR_ILLEGAL_OP			4
+#define	TFTP_ERR_OPTION				8
+
+#define	TFTP_DEFAULT_PORT			69
+#define	TFTP_HDR_SIZE				4
+#define	TFTP_BLK_SIZE				512			// RFC 1350
+#define	TFTP_MIN_BLK_SIZE			8
+#define	TFTP_MAX_BLK_SIZE			65464
+#define	TFTP_DEFAULT_TIMEOUT		1			// Seconds, when the client doesn't ask for one
+#define	TFTP_DEFAULT_MAX_WINDOW		64
+#define	TFTP_RETRIES				8
+
+typedef struct STFTPTransfer
+{
+	int s32Socket;					// Connected to the client's TID
+	uint8_t *pu8File;
+	uint32_t u32FileSize;
+
+	uint16_t u16BlockSize;
+	uint16_t u16WindowSize;
+	uint32_t u32TimeoutMs;
+	uint32_t u32LastBlock;			// 32 bit block numbers; the wire carries the low 16 bits
+
+	uint32_t u32Packets;
+	uint32_t u32Retransmits;
+	uint32_t u32Dropped;
+} STFTPTransfer;
+
+static uint32_t sg_u32LossPercent;
+static uint16_t sg_u16MaxWindow = TFTP_DEFAULT_MAX_WINDOW;
+
+static uint64_t TFTPTimeUs(void)
+{
+	struct timespec sTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &sTime);
+	return(((uint64_t) sTime.tv_sec * 1000000) + (sTime.tv_nsec / 1000));
+}
+
+static void TFTPSendError(int s32Socket,
+						  struct sockaddr_in *psTo,
+						  uint16_t u16Code,
+						  const char *peMessage)
+{
+	uint8_t u8Packet[TFTP_HDR_SIZE + 128];
+	size_t u64Length;
+
+	u8Packet[0] = 0;
+	u8Packet[1] = TFTP_ERROR;
+	u8Packet[2] = (uint8_t) (u16Code >> 8);
+	u8Packet[3] = (uint8_t) u16Code;
+	snprintf((char *) &u8Packet[TFTP_HDR_SIZE], sizeof(u8Packet) - TFTP_HDR_SIZE, "%s", peMessage);
+	u64Length = TFTP_HDR_SIZE + strlen((char *) &u8Packet[TFTP_HDR_SIZE]) + 1;
+
+	(void) sendto(s32Socket, u8Packet, u64Length, 0, (struct sockaddr *) psTo, sizeof(*psTo));
+}
+
+// Wait for an ACK from the client. Returns true with the 16 bit block number,
+// or false on timeout or if the client gave up.
+static bool TFTPWaitAck(STFTPTransfer *psTransfer,
+						uint16_t *pu16Block)
+{
+	uint64_t u64Deadline = TFTPTimeUs() + ((uint64_t) psTransfer->u32TimeoutMs * 1000);
+	uint8_t u8Packet[TFTP_HDR_SIZE + 512];
+	struct pollfd sPoll;
+	uint64_t u64Now;
+	ssize_t s64Length;
+
+	while ((u64Now = TFTPTimeUs()) < u64Deadline)
+	{
+		sPoll.fd = psTransfer->s32Socket;
+		sPoll.events = POLLIN;
+		if (poll(&sPoll, 1, (int) ((u64Deadline - u64Now + 999) / 1000)) <= 0)
+		{
+			continue;
+		}
+
+		s64Length = recv(psTransfer->s32Socket, u8Packet, sizeof(u8Packet) - 1, 0);
+		if (s64Length < TFTP_HDR_SIZE)
+		{
+			continue;
+		}
+
+		if (TFTP_ACK == ((u8Packet[0] << 8) | u8Packet[1]))
+		{
+			*pu16Block = (uint16_t) ((u8Packet[2] << 8) | u8Packet[3]);
+			return(true);
+		}
+
+		if (TFTP_ERROR == ((u8Packet[0] << 8) | u8Packet[1]))
+		{
+			u8Packet[s64Length] = '\0';
+			printf("Client error %u - %s\n", (u8Packet[2] << 8) | u8Packet[3], (char *) &u8Packet[TFTP_HDR_SIZE]);
+			*pu16Block = 0;
+			return(false);
+		}
+	}
+
+	*pu16Block = 0;
+	return(false);
+}
+
+static void TFTPSendBlock(STFTPTransfer *psTransfer,
+						  uint32_t u32Block,
+						  uint8_t *pu8Packet)
+{
+	uint32_t u32Offset = (u32Block - 1) * psTransfer->u16BlockSize;
+	uint32_t u32Length = psTransfer->u32FileSize - u32Offset;
+
+	if (u32Length > psTransfer->u16BlockSize)
+	{
+		u32Length = psTransfer->u16BlockSize;
+	}
+
+	pu8Packet[0] = 0;
+	pu8Packet[1] = TFTP_DATA;
+	pu8Packet[2] = (uint8_t) (u32Block >> 8);
+	pu8Packet[3] = (uint8_t) u32Block;
+	memcpy(&pu8Packet[TFTP_HDR_SIZE], psTransfer->pu8File + u32Offset, u32Length);
+
+	psTransfer->u32Packets++;
+
+	// Simulated loss, for exercising the client's recovery
+	if (sg_u32LossPercent && ((uint32_t) (rand() % 100) < sg_u32LossPercent))
+	{
+		psTransfer->u32Dropped++;
+		return;
+	}
+
+	(void) send(psTransfer->s32Socket, pu8Packet, TFTP_HDR_SIZE + u32Length, 0);
+}
+
+// Windowed send of the whole file. Each round sends up to a window of blocks
+// from the one after the last ACKed, then waits for an ACK. An ACK short of
+// the window end (the client missed something) just moves the start along.
+static bool TFTPSendFile(STFTPTransfer *psTransfer)
+{
+	uint8_t *pu8Packet = malloc(TFTP_HDR_SIZE + psTransfer->u16BlockSize);
+	uint32_t u32Base = 1;
+	uint32_t u32Retries = 0;
+	uint32_t u32Block;
+	uint32_t u32End;
+	uint32_t u32Acked;
+	uint16_t u16Ack;
+	bool bResend = false;
+	bool bResult = false;
+
+	if (NULL == pu8Packet)
+	{
+		return(false);
+	}
+
+	while (u32Base <= psTransfer->u32LastBlock)
+	{
+		u32End = u32Base + psTransfer->u16WindowSize - 1;
+		if (u32End > psTransfer->u32LastBlock)
+		{
+			u32End = psTransfer->u32LastBlock;
+		}
+
+		for (u32Block = u32Base; u32Block <= u32End; u32Block++)
+		{
+			TFTPSendBlock(psTransfer,
+						  u32Block,
+						  pu8Packet);
+			if (bResend)
+			{
+				psTransfer->u32Retransmits++;
+			}
+		}
+
+		// Wait for an ACK that lands in this window
+		while (1)
+		{
+			if (false == TFTPWaitAck(psTransfer, &u16Ack))
+			{
+				if (++u32Retries > TFTP_RETRIES)
+				{
+					printf("Client stopped responding at block %u\n", u32Base);
+					goto errorExit;
+				}
+
+				bResend = true;
+				break;
+			}
+
+			// Map the 16 bit ACK onto [u32Base - 1, u32End]
+			u32Acked = (u32Base - 1) + (uint16_t) (u16Ack - (uint16_t) (u32Base - 1));
+			if (u32Acked <= u32End)
+			{
+				u32Retries = 0;
+				bResend = (u32Acked != u32End);
+				u32Base = u32Acked + 1;
+				break;
+			}
+		}
+	}
+
+	bResult = true;
+
+errorExit:
+	free(pu8Packet);
+	return(bResult);
+}
+
+// Apply the client's options; builds the OACK payload. Returns false if the
+// request should be refused.
+static bool TFTPOptions(STFTPTransfer *psTransfer,
+						uint8_t *pu8Options,
+						uint8_t *pu8End,
+						uint8_t *pu8OACK,
+						size_t *pu64OACKLength)
+{
+	uint8_t *pu8Value;
+	unsigned long u64Value;
+	size_t u64Length = 2;
+
+	pu8OACK[0] = 0;
+	pu8OACK[1] = TFTP_OACK;
+
+	while (pu8Options < pu8End)
+	{
+		pu8Value = pu8Options + strnlen((char *) pu8Options, pu8End - pu8Options) + 1;
+		if (pu8Value >= pu8End)
+		{
+			break;
+		}
+
+		u64Value = strtoul((char *) pu8Value, NULL, 10);
+
+		if (0 == strcasecmp((char *) pu8Options, "blksize"))
+		{
+			if (u64Value < TFTP_MIN_BLK_SIZE)
+			{
+				return(false);
+			}
+			if (u64Value > TFTP_MAX_BLK_SIZE)
+			{
+				u64Value = TFTP_MAX_BLK_SIZE;
+			}
+			psTransfer->u16BlockSize = (uint16_t) u64Value;
+			u64Length += sprintf((char *) &pu8OACK[u64Length], "blksize%c%lu", 0, u64Value) + 1;
+		}
+		else if (0 == strcasecmp((char *) pu8Options, "windowsize"))
+		{
+			if (u64Value < 1)
+			{
+				return(false);
+			}
+			if (u64Value > sg_u16MaxWindow)
+			{
+				u64Value = sg_u16MaxWindow;
+			}
+			psTransfer->u16WindowSize = (uint16_t) u64Value;
+			u64Length += sprintf((char *) &pu8OACK[u64Length], "windowsize%c%lu", 0, u64Value) + 1;
+		}
+		else if (0 == strcasecmp((char *) pu8Options, "timeout"))
+		{
+			if ((u64Value >= 1) && (u64Value <= 255))
+			{
+				psTransfer->u32TimeoutMs = (uint32_t) u64Value * 1000;
+				u64Length += sprintf((char *) &pu8OACK[u64Length], "timeout%c%lu", 0, u64Value) + 1;
+			}
+		}
+		else if (0 == strcasecmp((char *) pu8Options, "tsize"))
+		{
+			u64Length += sprintf((char *) &pu8OACK[u64Length], "tsize%c%u", 0, psTransfer->u32FileSize) + 1;
+		}
+
+		pu8Options = pu8Value + strnlen((char *) pu8Value, pu8End - pu8Value) + 1;
+	}
+
+	*pu64OACKLength = u64Length;
+	return(true);
+}
+
+static void TFTPServeRequest(const char *peRoot,
+							 uint8_t *pu8Request,
+							 size_t u64Length,
+							 struct sockaddr_in *psClient)
+{
+	STFTPTransfer sTransfer;
+	uint8_t *pu8End = pu8Request + u64Length;
+	uint8_t *peName = pu8Request + 2;
+	uint8_t *peMode;
+	uint8_t u8OACK[256];
+	size_t u64OACKLength = 0;
+	char ePath[4096];
+	struct stat sStat;
+	FILE *psFile = NULL;
+	uint64_t u64Start;
+	uint64_t u64Elapsed;
+	uint16_t u16Ack;
+	uint32_t u32Retries;
+	bool bOK;
+
+	memset((void *) &sTransfer, 0, sizeof(sTransfer));
+	sTransfer.u16BlockSize = TFTP_BLK_SIZE;
+	sTransfer.u16WindowSize = 1;
+	sTransfer.u32TimeoutMs = TFTP_DEFAULT_TIMEOUT * 1000;
+
+	// Each transfer gets its own port (TID), connected to the client's
+	sTransfer.s32Socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if ((sTransfer.s32Socket < 0) ||
+		(connect(sTransfer.s32Socket, (struct sockaddr *) psClient, sizeof(*psClient)) < 0))
+	{
+		printf("Can't create transfer socket - %s\n", strerror(errno));
+		goto errorExit;
+	}
+
+	if (TFTP_RRQ != ((pu8Request[0] << 8) | pu8Request[1]))
+	{
+		TFTPSendError(sTransfer.s32Socket, psClient, TFTP_ERR_ILLEGAL_OP, "Only reads are supported");
+		goto errorExit;
+	}
+
+	peMode = peName + strnlen((char *) peName, pu8End - peName) + 1;
+	if (peMode >= pu8End)
+	{
+		TFTPSendError(sTransfer.s32Socket, psClient, TFTP_ERR_ILLEGAL_OP, "Malformed request");
+		goto errorExit;
+	}
+
+	// Nothing outside the served directory
+	if (('/' == peName[0]) || strstr((char *) peName, ".."))
+	{
+		TFTPSendError(sTransfer.s32Socket, psClient, TFTP_ERR_ACCESS, "Access violation");
+		goto errorExit;
+	}
+
+	snprintf(ePath, sizeof(ePath), "%s/%s", peRoot, (char *) peName);
+	psFile = fopen(ePath, "rb");
+	if ((NULL == psFile) || fstat(fileno(psFile), &sStat) || !S_ISREG(sStat.st_mode))
+	{
+		TFTPSendError(sTransfer.s32Socket, psClient, TFTP_ERR_NOT_FOUND, "File not found");
+		goto errorExit;
+	}
+
+	sTransfer.u32FileSize = (uint32_t) sStat.st_size;
+	sTransfer.pu8File = malloc(sTransfer.u32FileSize ? sTransfer.u32FileSize : 1);
+	if ((NULL == sTransfer.pu8File) ||
+		(fread(sTransfer.pu8File, 1, sTransfer.u32FileSize, psFile) != sTransfer.u32FileSize))
+	{
+		TFTPSendError(sTransfer.s32Socket, psClient, TFTP_ERR_UNDEF, "Read failed");
+		goto errorExit;
+	}
+
+	// Options follow the mode
+	peMode += strnlen((char *) peMode, pu8End - peMode) + 1;
+	if (false == TFTPOptions(&sTransfer,
+							 peMode,
+							 pu8End,
+							 u8OACK,
+							 &u64OACKLength))
+	{
+		TFTPSendError(sTransfer.s32Socket, psClient, TFTP_ERR_OPTION, "Bad option");
+		goto errorExit;
+	}
+
+	// The last block is the short one, which is empty if the size is a multiple of the block size
+	sTransfer.u32LastBlock = (sTransfer.u32FileSize / sTransfer.u16BlockSize) + 1;
+
+	printf("%s:%u '%s' %u bytes, blksize %u, windowsize %u\n",
+		   inet_ntoa(psClient->sin_addr), ntohs(psClient->sin_port), (char *) peName,
+		   sTransfer.u32FileSize, sTransfer.u16BlockSize, sTransfer.u16WindowSize);
+
+	u64Start = TFTPTimeUs();
+
+	// An OACK is answered with ACK 0
+	if (u64OACKLength > 2)
+	{
+		for (u32Retries = 0; u32Retries <= TFTP_RETRIES; u32Retries++)
+		{
+			(void) send(sTransfer.s32Socket, u8OACK, u64OACKLength, 0);
+			if (TFTPWaitAck(&sTransfer, &u16Ack) && (0 == u16Ack))
+			{
+				break;
+			}
+		}
+
+		if (u32Retries > TFTP_RETRIES)
+		{
+			printf("No ACK for the OACK\n");
+			goto errorExit;
+		}
+	}
+
+	bOK = TFTPSendFile(&sTransfer);
+	u64Elapsed = TFTPTimeUs() - u64Start;
+
+	printf("%s: %u packets, %u retransmitted, %u dropped, %.3fs, %.1fKB/s\n",
+		   bOK ? "Done" : "Failed",
+		   sTransfer.u32Packets, sTransfer.u32Retransmits, sTransfer.u32Dropped,
+		   (double) u64Elapsed / 1000000.0,
+		   u64Elapsed ? ((double) sTransfer.u32FileSize * 1000000.0 / 1024.0) / (double) u64Elapsed : 0.0);
+
+errorExit:
+	if (psFile)
+	{
+		fclose(psFile);
+	}
+	free(sTransfer.pu8File);
+	if (sTransfer.s32Socket >= 0)
+	{
+		close(sTransfer.s32Socket);
+	}
+}
+
+static void TFTPUsage(char *peProgram)
+{
+	printf("Usage: %s [-p port] [-w max windowsize] [-l loss percent] directory\n", peProgram);
+}
+
+int main(int argc,
+		 char **argv)
+{
+	uint16_t u16Port = TFTP_DEFAULT_PORT;
+	struct sockaddr_in sAddress;
+	struct sockaddr_in sClient;
+	socklen_t u32ClientLength;
+	uint8_t u8Request[TFTP_HDR_SIZE + 1024];
+	ssize_t s64Length;
+	int s32Socket;
+	int s32Option;
+
+	while ((s32Option = getopt(argc, argv, "p:w:l:")) != -1)
+	{
+		switch (s32Option)
+		{
+			case 'p':
+				u16Port = (uint16_t) atoi(optarg);
+				break;
+			case 'w':
+				sg_u16MaxWindow = (uint16_t) atoi(optarg);
+				if (0 == sg_u16MaxWindow)
+				{
+					sg_u16MaxWindow = 1;
+				}
+				break;
+			case 'l':
+				sg_u32LossPercent = (uint32_t) atoi(optarg);
+				break;
+			default:
+				TFTPUsage(argv[0]);
+				return(1);
+		}
+	}
+
+	if (optind != (argc - 1))
+	{
+		TFTPUsage(argv[0]);
+		return(1);
+	}
+
+	s32Socket = socket(AF_INET, SOCK_DGRAM, 0);
+	if (s32Socket < 0)
+	{
+		printf("Can't create socket - %s\n", strerror(errno));
+		return(1);
+	}
+
+	memset((void *) &sAddress, 0, sizeof(sAddress));
+	sAddress.sin_family = AF_INET;
+	sAddress.sin_addr.s_addr = htonl(INADDR_ANY);
+	sAddress.sin_port = htons(u16Port);
+	if (bind(s32Socket, (struct sockaddr *) &sAddress, sizeof(sAddress)) < 0)
+	{
+		printf("Can't bind to port %u - %s\n", u16Port, strerror(errno));
+		return(1);
+	}
+
+	printf("Serving '%s' on port %u\n", argv[optind], u16Port);
+
+	while (1)
+	{
+		u32ClientLength = sizeof(sClient);
+		s64Length = recvfrom(s32Socket, u8Request, sizeof(u8Request) - 1, 0, (struct sockaddr *) &sClient, &u32ClientLength);
+		if (s64Length < TFTP_HDR_SIZE)
+		{
+			continue;
+		}
+
+		u8Request[s64Length] = '\0';
+		TFTPServeRequest(argv[optind],
+						 u8Request,
+						 (size_t) s64Length,
+						 &sClient);
+	}
+
+	return(0);
+}
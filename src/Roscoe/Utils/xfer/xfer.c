@@ -0,0 +1,679 @@
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+#include <time.h>
+#include <endian.h>
+#include <sys/stat.h>
+#include "Hardware/Roscoe.h"
+#include "Shared/TransferProtocol.h"
+#include "Shared/zlib/zlib.h"
+
+// Host side of the monitor's sliding window transfer protocol. Streams a file
+// (optionally deflated) to the monitor's second UART.
+
+// How long to wait for input each time around (milliseconds)
+#define	XFER_POLL_MS				10
+
+// Extra time to allow past when a frame should have arrived before deciding
+// it's lost (microseconds)
+#define	XFER_ARRIVAL_MARGIN_US		200000
+
+// Give up after this long without the receiver making progress (microseconds)
+#define	XFER_STALL_US				10000000
+
+// Per frame send state
+typedef struct SXferFrame
+{
+	bool bAcked;
+	uint64_t u64ArrivalUs;			// When it should have reached the receiver
+	uint32_t u32SendCount;
+} SXferFrame;
+
+typedef struct SXfer
+{
+	int s32Port;					// Serial port file descriptor
+	uint32_t u32BaudRate;
+
+	uint8_t *pu8Stream;				// What goes in the DATA frames
+	uint32_t u32StreamSize;
+	STransferStart sStart;			// Host byte order
+	STransferEnd sEnd;				// Host byte order
+
+	uint32_t u32LastSequence;		// Sequence # of the END frame
+	SXferFrame *psFrames;
+	uint32_t u32Base;				// Oldest unacknowledged frame
+	uint32_t u32NextNew;			// Next never sent frame
+	uint64_t u64WireFreeUs;			// When what we've written so far will be out the UART
+	uint32_t u32Retransmits;
+
+	// Incoming frame
+	uint8_t u8Frame[TRANSFER_FRAME_MAX];
+	uint16_t u16FrameOffset;
+} SXfer;
+
+static const struct
+{
+	uint32_t u32BaudRate;
+	speed_t eSpeed;
+} sg_sBaudRates[] =
+{
+	{9600, B9600},
+	{19200, B19200},
+	{38400, B38400},
+	{57600, B57600},
+	{115200, B115200},
+	{230400, B230400},
+	{460800, B460800},
+	{921600, B921600},
+};
+
+static uint64_t XferTimeUs(void)
+{
+	struct timespec sTime;
+
+	clock_gettime(CLOCK_MONOTONIC, &sTime);
+	return(((uint64_t) sTime.tv_sec * 1000000) + (sTime.tv_nsec / 1000));
+}
+
+// Open the serial port raw, 8N1, no flow control. Anything that isn't a
+// tty (a pty or socket when testing) is used as-is.
+static int XferPortOpen(char *pePort,
+						uint32_t u32BaudRate)
+{
+	struct termios sSerialParams;
+	speed_t eSpeed = B0;
+	uint32_t u32Loop;
+	int s32Port;
+
+	for (u32Loop = 0; u32Loop < (sizeof(sg_sBaudRates) / sizeof(sg_sBaudRates[0])); u32Loop++)
+	{
+		if (sg_sBaudRates[u32Loop].u32BaudRate == u32BaudRate)
+		{
+			eSpeed = sg_sBaudRates[u32Loop].eSpeed;
+		}
+	}
+
+	if (B0 == eSpeed)
+	{
+		printf("Unsupported baud rate %u\n", u32BaudRate);
+		return(-1);
+	}
+
+	s32Port = open(pePort, O_RDWR | O_NOCTTY);
+	if (s32Port < 0)
+	{
+		printf("Can't open '%s' - %s\n", pePort, strerror(errno));
+		return(-1);
+	}
+
+	if (isatty(s32Port))
+	{
+		if (tcgetattr(s32Port, &sSerialParams))
+		{
+			printf("Can't get serial config on '%s' - %s\n", pePort, strerror(errno));
+			close(s32Port);
+			return(-1);
+		}
+
+		cfmakeraw(&sSerialParams);
+		sSerialParams.c_cflag |= (CLOCAL | CREAD);
+		sSerialParams.c_cflag &= ~(CSTOPB | CRTSCTS);
+		sSerialParams.c_iflag &= ~(IXON | IXOFF | IXANY);
+		sSerialParams.c_cc[VMIN] = 0;
+		sSerialParams.c_cc[VTIME] = 0;
+		cfsetispeed(&sSerialParams, eSpeed);
+		cfsetospeed(&sSerialParams, eSpeed);
+
+		if (tcsetattr(s32Port, TCSANOW, &sSerialParams))
+		{
+			printf("Can't set serial config on '%s' - %s\n", pePort, strerror(errno));
+			close(s32Port);
+			return(-1);
+		}
+
+		(void) tcflush(s32Port, TCIOFLUSH);
+	}
+
+	return(s32Port);
+}
+
+static bool XferWrite(SXfer *psXfer,
+					  uint8_t *pu8Data,
+					  uint32_t u32Size)
+{
+	while (u32Size)
+	{
+		ssize_t s64Written = write(psXfer->s32Port, pu8Data, u32Size);
+
+		if (s64Written < 0)
+		{
+			if (EINTR == errno)
+			{
+				continue;
+			}
+
+			printf("Write failed - %s\n", strerror(errno));
+			return(false);
+		}
+
+		pu8Data += s64Written;
+		u32Size -= (uint32_t) s64Written;
+	}
+
+	return(true);
+}
+
+// Build and send a frame. Payload is already in wire order.
+static bool XferSendFrame(SXfer *psXfer,
+						  ETransferFrameType eType,
+						  uint32_t u32Sequence,
+						  uint8_t *pu8Payload,
+						  uint16_t u16Length)
+{
+	uint8_t u8Frame[TRANSFER_FRAME_MAX];
+	STransferFrameHeader *psHeader = (STransferFrameHeader *) u8Frame;
+	uint32_t u32CRC;
+	uint32_t u32FrameSize = sizeof(*psHeader) + u16Length + sizeof(u32CRC);
+	uint64_t u64Now = XferTimeUs();
+
+	psHeader->u16Sync = htobe16(TRANSFER_SYNC);
+	psHeader->u8Type = (uint8_t) eType;
+	psHeader->u8Reserved = 0;
+	psHeader->u32Sequence = htobe32(u32Sequence);
+	psHeader->u16Length = htobe16(u16Length);
+	psHeader->u16LengthCheck = htobe16((uint16_t) ~u16Length);
+	if (u16Length)
+	{
+		memcpy((void *) (psHeader + 1), (void *) pu8Payload, u16Length);
+	}
+
+	u32CRC = htobe32((uint32_t) crc32(0, u8Frame, sizeof(*psHeader) + u16Length));
+	memcpy((void *) &u8Frame[sizeof(*psHeader) + u16Length], (void *) &u32CRC, sizeof(u32CRC));
+
+	// Track when this will have made it out of the UART (10 bits per byte)
+	if (psXfer->u64WireFreeUs < u64Now)
+	{
+		psXfer->u64WireFreeUs = u64Now;
+	}
+
+	psXfer->u64WireFreeUs += ((uint64_t) u32FrameSize * 10 * 1000000) / psXfer->u32BaudRate;
+
+	return(XferWrite(psXfer,
+					 u8Frame,
+					 u32FrameSize));
+}
+
+// Send a sequenced frame
+static bool XferSendSequence(SXfer *psXfer,
+							 uint32_t u32Sequence)
+{
+	uint8_t u8Payload[TRANSFER_PAYLOAD_MAX];
+	ETransferFrameType eType;
+	uint16_t u16Length;
+	bool bResult;
+
+	if (0 == u32Sequence)
+	{
+		STransferStart *psStart = (STransferStart *) u8Payload;
+
+		eType = ETRANSFER_FRAME_START;
+		*psStart = psXfer->sStart;
+		psStart->u32TransferID = htobe32(psStart->u32TransferID);
+		psStart->u32DataSize = htobe32(psStart->u32DataSize);
+		u16Length = sizeof(*psStart);
+	}
+	else
+	if (u32Sequence == psXfer->u32LastSequence)
+	{
+		STransferEnd *psEnd = (STransferEnd *) u8Payload;
+
+		eType = ETRANSFER_FRAME_END;
+		psEnd->u32DataCRC32 = htobe32(psXfer->sEnd.u32DataCRC32);
+		u16Length = sizeof(*psEnd);
+	}
+	else
+	{
+		uint32_t u32Offset = (u32Sequence - 1) * TRANSFER_PAYLOAD_MAX;
+
+		eType = ETRANSFER_FRAME_DATA;
+		u16Length = TRANSFER_PAYLOAD_MAX;
+		if ((psXfer->u32StreamSize - u32Offset) < u16Length)
+		{
+			u16Length = (uint16_t) (psXfer->u32StreamSize - u32Offset);
+		}
+
+		memcpy((void *) u8Payload, (void *) (psXfer->pu8Stream + u32Offset), u16Length);
+	}
+
+	bResult = XferSendFrame(psXfer,
+							eType,
+							u32Sequence,
+							u8Payload,
+							u16Length);
+
+	psXfer->psFrames[u32Sequence].u64ArrivalUs = psXfer->u64WireFreeUs;
+	psXfer->psFrames[u32Sequence].u32SendCount++;
+	if (psXfer->psFrames[u32Sequence].u32SendCount > 1)
+	{
+		psXfer->u32Retransmits++;
+	}
+
+	return(bResult);
+}
+
+// Resend anything in the window that should have arrived by now and hasn't
+// been acknowledged. If bHolesOnly is set, only frames older than the newest
+// acknowledged frame are considered.
+static bool XferRetransmit(SXfer *psXfer,
+						   bool bHolesOnly,
+						   uint32_t u32Highest)
+{
+	uint64_t u64Now = XferTimeUs();
+	uint32_t u32Sequence;
+
+	for (u32Sequence = psXfer->u32Base; u32Sequence < psXfer->u32NextNew; u32Sequence++)
+	{
+		SXferFrame *psFrame = &psXfer->psFrames[u32Sequence];
+
+		if ((bHolesOnly) &&
+			(u32Sequence >= u32Highest))
+		{
+			break;
+		}
+
+		if ((false == psFrame->bAcked) &&
+			(u64Now > (psFrame->u64ArrivalUs + XFER_ARRIVAL_MARGIN_US)))
+		{
+			if (false == XferSendSequence(psXfer,
+										  u32Sequence))
+			{
+				return(false);
+			}
+		}
+	}
+
+	return(true);
+}
+
+// Act on an ACK
+static void XferAck(SXfer *psXfer,
+					STransferAck *psAck,
+					uint32_t *pu32Highest)
+{
+	uint32_t u32Next = be32toh(psAck->u32NextSequence);
+	uint32_t u32Map = be32toh(psAck->u32ReceivedMap);
+	uint32_t u32Sequence;
+
+	if (u32Next > (psXfer->u32LastSequence + 1))
+	{
+		return;
+	}
+
+	for (u32Sequence = psXfer->u32Base; u32Sequence < u32Next; u32Sequence++)
+	{
+		psXfer->psFrames[u32Sequence].bAcked = true;
+	}
+
+	*pu32Highest = u32Next;
+	for (u32Sequence = 0; (u32Sequence < 32) && ((u32Next + u32Sequence) <= psXfer->u32LastSequence); u32Sequence++)
+	{
+		if (u32Map & ((uint32_t) 1 << u32Sequence))
+		{
+			psXfer->psFrames[u32Next + u32Sequence].bAcked = true;
+			*pu32Highest = u32Next + u32Sequence;
+		}
+	}
+
+	while ((psXfer->u32Base <= psXfer->u32LastSequence) &&
+		   (psXfer->psFrames[psXfer->u32Base].bAcked))
+	{
+		psXfer->u32Base++;
+	}
+}
+
+// Pull in what the receiver has sent and handle any complete frames. Returns
+// the type of the last frame handled, or 0 if none.
+static uint8_t XferReceive(SXfer *psXfer,
+						   int s32TimeoutMs,
+						   uint32_t *pu32Highest)
+{
+	STransferFrameHeader *psHeader = (STransferFrameHeader *) psXfer->u8Frame;
+	struct pollfd sPoll;
+	uint8_t u8Type = 0;
+	uint8_t u8Buffer[256];
+	ssize_t s64Read;
+	ssize_t s64Loop;
+
+	sPoll.fd = psXfer->s32Port;
+	sPoll.events = POLLIN;
+	sPoll.revents = 0;
+
+	if (poll(&sPoll, 1, s32TimeoutMs) <= 0)
+	{
+		return(0);
+	}
+
+	s64Read = read(psXfer->s32Port, u8Buffer, sizeof(u8Buffer));
+	for (s64Loop = 0; s64Loop < s64Read; s64Loop++)
+	{
+		uint16_t u16Length;
+
+		psXfer->u8Frame[psXfer->u16FrameOffset++] = u8Buffer[s64Loop];
+		if (psXfer->u16FrameOffset < sizeof(*psHeader))
+		{
+			continue;
+		}
+
+		u16Length = be16toh(psHeader->u16Length);
+		if (psXfer->u16FrameOffset == sizeof(*psHeader))
+		{
+			// Slide along a byte if this doesn't look like a header
+			if ((be16toh(psHeader->u16Sync) != TRANSFER_SYNC) ||
+				((be16toh(psHeader->u16LengthCheck) ^ u16Length) != 0xffff) ||
+				(u16Length > TRANSFER_PAYLOAD_MAX))
+			{
+				psXfer->u16FrameOffset--;
+				memmove((void *) psXfer->u8Frame, (void *) &psXfer->u8Frame[1], psXfer->u16FrameOffset);
+			}
+		}
+		else
+		if (psXfer->u16FrameOffset == (sizeof(*psHeader) + u16Length + sizeof(uint32_t)))
+		{
+			uint32_t u32CRC;
+
+			psXfer->u16FrameOffset = 0;
+			memcpy((void *) &u32CRC, (void *) &psXfer->u8Frame[sizeof(*psHeader) + u16Length], sizeof(u32CRC));
+			if (crc32(0, psXfer->u8Frame, sizeof(*psHeader) + u16Length) != be32toh(u32CRC))
+			{
+				continue;
+			}
+
+			if (ETRANSFER_FRAME_ACK == psHeader->u8Type)
+			{
+				if (u16Length >= sizeof(STransferAck))
+				{
+					XferAck(psXfer,
+							(STransferAck *) (psHeader + 1),
+							pu32Highest);
+					u8Type = psHeader->u8Type;
+				}
+			}
+			else
+			if ((ETRANSFER_FRAME_FINISHED == psHeader->u8Type) ||
+				(ETRANSFER_FRAME_CANCEL == psHeader->u8Type))
+			{
+				return(psHeader->u8Type);
+			}
+		}
+	}
+
+	return(u8Type);
+}
+
+// Push the whole stream through
+static int XferSend(SXfer *psXfer)
+{
+	uint64_t u64StartUs = XferTimeUs();
+	uint64_t u64ProgressUs = XferTimeUs();
+	uint64_t u64ElapsedUs;
+	uint32_t u32LastBase = 0;
+	uint32_t u32Highest = 0;
+
+	while (psXfer->u32Base <= psXfer->u32LastSequence)
+	{
+		uint8_t u8Type;
+
+		// Fill the window. Don't get too far ahead of the wire, otherwise
+		// retransmits queue up behind data the receiver can't take yet.
+		while ((psXfer->u32NextNew <= psXfer->u32LastSequence) &&
+			   (psXfer->u32NextNew < (psXfer->u32Base + TRANSFER_WINDOW)) &&
+			   (psXfer->u64WireFreeUs < (XferTimeUs() + XFER_ARRIVAL_MARGIN_US)))
+		{
+			if (false == XferSendSequence(psXfer,
+										  psXfer->u32NextNew))
+			{
+				return(1);
+			}
+
+			psXfer->u32NextNew++;
+		}
+
+		u8Type = XferReceive(psXfer,
+							 XFER_POLL_MS,
+							 &u32Highest);
+		if (ETRANSFER_FRAME_FINISHED == u8Type)
+		{
+			printf("\nReceiver has everything it needs\n");
+			break;
+		}
+
+		if (ETRANSFER_FRAME_CANCEL == u8Type)
+		{
+			printf("\nReceiver canceled the transfer\n");
+			return(1);
+		}
+
+		if (ETRANSFER_FRAME_ACK == u8Type)
+		{
+			// Anything older than the newest frame the receiver has is lost
+			if (false == XferRetransmit(psXfer,
+										true,
+										u32Highest))
+			{
+				return(1);
+			}
+		}
+		else
+		{
+			// Quiet. Resend anything that's overdue.
+			if (false == XferRetransmit(psXfer,
+										false,
+										0))
+			{
+				return(1);
+			}
+		}
+
+		if (psXfer->u32Base != u32LastBase)
+		{
+			u32LastBase = psXfer->u32Base;
+			u64ProgressUs = XferTimeUs();
+
+			if (psXfer->u32Base > 1)
+			{
+				uint32_t u32Sent = (psXfer->u32Base - 1) * TRANSFER_PAYLOAD_MAX;
+
+				if (u32Sent > psXfer->u32StreamSize)
+				{
+					u32Sent = psXfer->u32StreamSize;
+				}
+
+				printf("\r%u/%u bytes", u32Sent, psXfer->u32StreamSize);
+				fflush(stdout);
+			}
+		}
+		else
+		if ((XferTimeUs() - u64ProgressUs) > XFER_STALL_US)
+		{
+			printf("\nReceiver isn't responding\n");
+			(void) XferSendFrame(psXfer,
+								 ETRANSFER_FRAME_CANCEL,
+								 0,
+								 NULL,
+								 0);
+			return(1);
+		}
+	}
+
+	u64ElapsedUs = XferTimeUs() - u64StartUs;
+	if (0 == u64ElapsedUs)
+	{
+		u64ElapsedUs = 1;
+	}
+
+	printf("\nSent %u bytes (%u on the wire) in %.2f seconds - %.0f bytes/sec, %.0f%% of line rate, %u retransmits\n",
+		   psXfer->sStart.u32DataSize,
+		   psXfer->u32StreamSize,
+		   (double) u64ElapsedUs / 1000000.0,
+		   ((double) psXfer->sStart.u32DataSize * 1000000.0) / (double) u64ElapsedUs,
+		   ((double) psXfer->u32StreamSize * 1000000.0 * 1000.0) / ((double) u64ElapsedUs * (double) psXfer->u32BaudRate),
+		   psXfer->u32Retransmits);
+
+	return(0);
+}
+
+// Compress the file with raw deflate (no zlib/gzip wrapper)
+static bool XferDeflate(SXfer *psXfer,
+						uint8_t *pu8Data,
+						uint32_t u32Size)
+{
+	z_stream sDeflate;
+	uLong u32Bound;
+
+	memset((void *) &sDeflate, 0, sizeof(sDeflate));
+	if (deflateInit2(&sDeflate, Z_BEST_COMPRESSION, Z_DEFLATED, -MAX_WBITS, 9, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		printf("Can't init deflate\n");
+		return(false);
+	}
+
+	u32Bound = deflateBound(&sDeflate, u32Size);
+	psXfer->pu8Stream = malloc(u32Bound);
+	if (NULL == psXfer->pu8Stream)
+	{
+		printf("Failed to malloc %lu bytes\n", (unsigned long) u32Bound);
+		(void) deflateEnd(&sDeflate);
+		return(false);
+	}
+
+	sDeflate.next_in = pu8Data;
+	sDeflate.avail_in = u32Size;
+	sDeflate.next_out = psXfer->pu8Stream;
+	sDeflate.avail_out = (uInt) u32Bound;
+
+	if (deflate(&sDeflate, Z_FINISH) != Z_STREAM_END)
+	{
+		printf("Deflate failed\n");
+		(void) deflateEnd(&sDeflate);
+		return(false);
+	}
+
+	psXfer->u32StreamSize = (uint32_t) sDeflate.total_out;
+	(void) deflateEnd(&sDeflate);
+	return(true);
+}
+
+int main(int argc, char **argv)
+{
+	SXfer sXfer;
+	bool bDeflate = false;
+	uint8_t *pu8Data = NULL;
+	uint32_t u32Size;
+	struct stat sStat;
+	FILE *psFile;
+	int s32Arg = 1;
+	int s32Result;
+
+	memset((void *) &sXfer, 0, sizeof(sXfer));
+	sXfer.u32BaudRate = FLASH_UPDATE_BAUD_RATE;
+
+	while ((s32Arg < argc) && ('-' == argv[s32Arg][0]))
+	{
+		if (0 == strcmp(argv[s32Arg], "-z"))
+		{
+			bDeflate = true;
+		}
+		else
+		if ((0 == strcmp(argv[s32Arg], "-b")) && ((s32Arg + 1) < argc))
+		{
+			sXfer.u32BaudRate = (uint32_t) atol(argv[++s32Arg]);
+		}
+		else
+		{
+			break;
+		}
+
+		s32Arg++;
+	}
+
+	if ((argc - s32Arg) != 2)
+	{
+		printf("Usage: xfer [-z] [-b baudrate] serialport filename\n");
+		exit(1);
+	}
+
+	psFile = fopen(argv[s32Arg + 1], "rb");
+	if ((NULL == psFile) ||
+		(fstat(fileno(psFile), &sStat)))
+	{
+		printf("Can't open '%s' for reading\n", argv[s32Arg + 1]);
+		exit(1);
+	}
+
+	u32Size = (uint32_t) sStat.st_size;
+	pu8Data = malloc(u32Size + 1);
+	if (NULL == pu8Data)
+	{
+		printf("Failed to malloc\n");
+		exit(1);
+	}
+
+	if (fread(pu8Data, 1, u32Size, psFile) != u32Size)
+	{
+		printf("Can't read '%s'\n", argv[s32Arg + 1]);
+		exit(1);
+	}
+
+	fclose(psFile);
+
+	sXfer.sStart.u32TransferID = (uint32_t) time(NULL) ^ ((uint32_t) getpid() << 16);
+	sXfer.sStart.u8Version = TRANSFER_VERSION;
+	sXfer.sStart.u32DataSize = u32Size;
+	sXfer.sEnd.u32DataCRC32 = (uint32_t) crc32(0, pu8Data, u32Size);
+
+	if (bDeflate)
+	{
+		sXfer.sStart.u8Flags |= TRANSFER_FLAG_DEFLATE;
+		if (false == XferDeflate(&sXfer,
+								 pu8Data,
+								 u32Size))
+		{
+			exit(1);
+		}
+
+		printf("Compressed %u bytes to %u bytes\n", u32Size, sXfer.u32StreamSize);
+	}
+	else
+	{
+		sXfer.pu8Stream = pu8Data;
+		sXfer.u32StreamSize = u32Size;
+	}
+
+	// START is 0, then the DATA frames, then END
+	sXfer.u32LastSequence = ((sXfer.u32StreamSize + TRANSFER_PAYLOAD_MAX - 1) / TRANSFER_PAYLOAD_MAX) + 1;
+	sXfer.psFrames = calloc(sXfer.u32LastSequence + 1, sizeof(*sXfer.psFrames));
+	if (NULL == sXfer.psFrames)
+	{
+		printf("Failed to malloc\n");
+		exit(1);
+	}
+
+	sXfer.s32Port = XferPortOpen(argv[s32Arg],
+								 sXfer.u32BaudRate);
+	if (sXfer.s32Port < 0)
+	{
+		exit(1);
+	}
+
+	s32Result = XferSend(&sXfer);
+
+	close(sXfer.s32Port);
+	return(s32Result);
+}